@@ -0,0 +1,454 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "can_gateway.h"
+#include "j2534_jni.h"
+#include "uds_client.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define GATEWAY_RULE_INTS 5
+
+static unsigned long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000000ULL +
+           static_cast<unsigned long long>(ts.tv_nsec) / 1000ULL;
+}
+
+// Counters are written by the route thread only and read concurrently by gateway_stats
+static void add_counter(unsigned long long* counter, unsigned long long value) {
+    __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+static void put_can_id(PASSTHRU_MSG* msg, unsigned long can_id) {
+    msg->Data[0] = static_cast<unsigned char>(can_id >> 24);
+    msg->Data[1] = static_cast<unsigned char>(can_id >> 16);
+    msg->Data[2] = static_cast<unsigned char>(can_id >> 8);
+    msg->Data[3] = static_cast<unsigned char>(can_id);
+}
+
+/*
+ * Applies the rules and the transform to a received frame and turns it into
+ * a transmit message. Returns zero when the frame must not be forwarded.
+ */
+static int route_frame(GATEWAY_ROUTE* route, PASSTHRU_MSG* msg) {
+    unsigned long can_id = uds_message_can_id(msg);
+
+    for (unsigned int i = 0; i < route->rule_count; i++) {
+        const GATEWAY_RULE* rule = &route->rules[i];
+        if ((can_id & rule->mask) != rule->match) {
+            continue;
+        }
+        if (rule->action == GATEWAY_BLOCK) {
+            add_counter(&route->stats.blocked, 1);
+            return 0;
+        }
+        if (rule->action == GATEWAY_REWRITE) {
+            put_can_id(msg, (can_id & ~rule->rewrite_mask) | (rule->rewrite_value & rule->rewrite_mask));
+            add_counter(&route->stats.rewritten, 1);
+        }
+        break;
+    }
+
+    msg->TxFlags = msg->RxStatus & (CAN_29BIT_ID | CAN_FD_BRS | CAN_FD_FORMAT);
+    msg->RxStatus = 0;
+    msg->Timestamp = 0;
+    msg->ExtraDataIndex = 0;
+
+    if (route->transform != nullptr && !route->transform(route->transform_context, msg)) {
+        add_counter(&route->stats.blocked, 1);
+        return 0;
+    }
+    return 1;
+}
+
+static void record_latency(GATEWAY_ROUTE* route, unsigned long long latency_us, unsigned long frames) {
+    GATEWAY_STATS* stats = &route->stats;
+    if (latency_us < stats->latency_min_us) {
+        __atomic_store_n(&stats->latency_min_us, latency_us, __ATOMIC_RELAXED);
+    }
+    if (latency_us > stats->latency_max_us) {
+        __atomic_store_n(&stats->latency_max_us, latency_us, __ATOMIC_RELAXED);
+    }
+    add_counter(&stats->latency_total_us, latency_us * frames);
+
+    unsigned int bucket = 0;
+    while (bucket < GATEWAY_LATENCY_BUCKETS - 1 && (latency_us >> bucket) > 1) {
+        bucket++;
+    }
+    add_counter(&stats->latency_histogram[bucket], frames);
+}
+
+static void capture(GATEWAY_BRIDGE* bridge, const GATEWAY_ROUTE* route, const PASSTHRU_MSG* msgs,
+                    const unsigned long* source_ids, unsigned long count,
+                    unsigned long long read_us, unsigned long long latency_us) {
+    unsigned short latency = latency_us > 0xFFFF ? 0xFFFF : static_cast<unsigned short>(latency_us);
+
+    // Both directions share the ring; the lock keeps write_seq in slot order
+    pthread_mutex_lock(&bridge->capture_mutex);
+    for (unsigned long i = 0; i < count; i++) {
+        const PASSTHRU_MSG* msg = &msgs[i];
+        unsigned char* slot = bridge->ring + GATEWAY_RING_HEADER_SIZE +
+                              (bridge->seq % bridge->slot_count) * GATEWAY_SLOT_SIZE;
+        unsigned int source_id = static_cast<unsigned int>(source_ids[i]);
+        unsigned int forwarded_id = static_cast<unsigned int>(uds_message_can_id(msg));
+        unsigned long length = msg->DataSize - UDS_CAN_ID_SIZE;
+        if (length > 64) {
+            length = 64;
+        }
+
+        memcpy(slot, &read_us, 8);
+        memcpy(slot + 8, &source_id, 4);
+        memcpy(slot + 12, &forwarded_id, 4);
+        slot[16] = static_cast<unsigned char>(route->direction);
+        slot[17] = static_cast<unsigned char>(length);
+        memcpy(slot + 18, &latency, 2);
+        memcpy(slot + 20, msg->Data + UDS_CAN_ID_SIZE, length);
+
+        bridge->seq++;
+        __atomic_store_n(reinterpret_cast<unsigned long long*>(bridge->ring), bridge->seq,
+                         __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&bridge->capture_mutex);
+}
+
+static void* gateway_thread(void* arg) {
+    GATEWAY_ROUTE* route = static_cast<GATEWAY_ROUTE*>(arg);
+    GATEWAY_BRIDGE* bridge = static_cast<GATEWAY_BRIDGE*>(route->bridge);
+    J2534_LIBRARY* lib = bridge->lib;
+    PASSTHRU_MSG msgs[GATEWAY_BATCH];
+    unsigned long source_ids[GATEWAY_BATCH];
+
+    while (bridge->running) {
+        // A PassThruReadMsgs timeout waits for the full count, so block for one
+        // frame only and then take whatever else is already queued
+        unsigned long num_msgs = 1;
+        long result = lib->PassThruReadMsgs(route->source_channel, msgs, &num_msgs,
+                                            GATEWAY_IDLE_TIMEOUT_MS);
+        if (result == STATUS_NOERROR && num_msgs == 1) {
+            unsigned long more = GATEWAY_BATCH - 1;
+            result = lib->PassThruReadMsgs(route->source_channel, msgs + 1, &more, 0);
+            num_msgs += more;
+        }
+        if (result != STATUS_NOERROR && result != ERR_BUFFER_EMPTY && result != ERR_TIMEOUT) {
+            LOGE("Gateway read on channel %lu failed: %ld", route->source_channel, result);
+            break;
+        }
+        if (num_msgs == 0) {
+            continue;
+        }
+        unsigned long long read_us = now_us();
+
+        unsigned long count = 0;
+        for (unsigned long i = 0; i < num_msgs; i++) {
+            PASSTHRU_MSG* msg = &msgs[i];
+            // Loopback echoes and indications would bounce straight back
+            if (msg->RxStatus & (TX_MSG_TYPE | START_OF_MESSAGE | TX_INDICATION) ||
+                msg->DataSize < UDS_CAN_ID_SIZE) {
+                continue;
+            }
+            source_ids[count] = uds_message_can_id(msg);
+            if (!route_frame(route, msg)) {
+                continue;
+            }
+            if (count != i) {
+                msgs[count] = *msg;
+            }
+            count++;
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        unsigned long written = count;
+        result = lib->PassThruWriteMsgs(route->target_channel, msgs, &written, 0);
+        unsigned long long latency_us = now_us() - read_us;
+        if (result != STATUS_NOERROR) {
+            written = result == ERR_BUFFER_FULL || result == ERR_TIMEOUT ? written : 0;
+            add_counter(&route->stats.write_errors, count - written);
+            if (bridge->ring != nullptr) {
+                unsigned int* errors = reinterpret_cast<unsigned int*>(bridge->ring + 16);
+                __atomic_store_n(errors, *errors + static_cast<unsigned int>(count - written),
+                                 __ATOMIC_RELAXED);
+            }
+        }
+        if (written == 0) {
+            continue;
+        }
+
+        add_counter(&route->stats.forwarded, written);
+        add_counter(&route->stats.batches, 1);
+        record_latency(route, latency_us, written);
+        if (bridge->ring != nullptr) {
+            capture(bridge, route, msgs, source_ids, written, read_us, latency_us);
+        }
+    }
+    return nullptr;
+}
+
+static long open_pass_all(GATEWAY_BRIDGE* bridge, unsigned long channel_id, unsigned long* filter_id) {
+    PASSTHRU_MSG mask;
+    PASSTHRU_MSG pattern;
+    memset(&mask, 0, sizeof(mask));
+    memset(&pattern, 0, sizeof(pattern));
+    mask.ProtocolID = pattern.ProtocolID = bridge->protocol_id;
+    mask.DataSize = pattern.DataSize = UDS_CAN_ID_SIZE;
+    return bridge->lib->PassThruStartMsgFilter(channel_id, PASS_FILTER, &mask, &pattern, nullptr,
+                                               filter_id);
+}
+
+long gateway_start(GATEWAY_BRIDGE* bridge, unsigned long channel_a, unsigned long channel_b,
+                   unsigned char* ring, unsigned long ring_capacity) {
+    if (bridge == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (bridge->lib == nullptr || bridge->lib->PassThruReadMsgs == nullptr) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+    if (channel_a == channel_b ||
+        (bridge->protocol_id != CAN && bridge->protocol_id != FD_CAN_PS)) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+    if (bridge->routes[0].rule_count > GATEWAY_MAX_RULES ||
+        bridge->routes[1].rule_count > GATEWAY_MAX_RULES) {
+        return ERR_INVALID_MSG;
+    }
+
+    bridge->ring = ring;
+    if (ring != nullptr) {
+        if ((reinterpret_cast<unsigned long>(ring) & 7) != 0) {
+            return ERR_INVALID_MSG;
+        }
+        if (ring_capacity < GATEWAY_RING_HEADER_SIZE + GATEWAY_SLOT_SIZE) {
+            return ERR_BUFFER_OVERFLOW;
+        }
+        bridge->slot_count = static_cast<unsigned int>(
+            (ring_capacity - GATEWAY_RING_HEADER_SIZE) / GATEWAY_SLOT_SIZE);
+        unsigned int slot_size = GATEWAY_SLOT_SIZE;
+        memset(ring, 0, GATEWAY_RING_HEADER_SIZE);
+        memcpy(ring + 8, &bridge->slot_count, 4);
+        memcpy(ring + 12, &slot_size, 4);
+    }
+    bridge->seq = 0;
+
+    long result = open_pass_all(bridge, channel_a, &bridge->filter_a);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+    result = open_pass_all(bridge, channel_b, &bridge->filter_b);
+    if (result != STATUS_NOERROR) {
+        bridge->lib->PassThruStopMsgFilter(channel_a, bridge->filter_a);
+        return result;
+    }
+
+    pthread_mutex_init(&bridge->capture_mutex, nullptr);
+    bridge->running = 1;
+
+    unsigned int started = 0;
+    for (unsigned int d = 0; d < 2; d++) {
+        GATEWAY_ROUTE* route = &bridge->routes[d];
+        route->bridge = bridge;
+        route->direction = d;
+        route->source_channel = d == 0 ? channel_a : channel_b;
+        route->target_channel = d == 0 ? channel_b : channel_a;
+        memset(&route->stats, 0, sizeof(route->stats));
+        route->stats.latency_min_us = ~0ULL;
+        if (pthread_create(&route->thread, nullptr, gateway_thread, route) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    if (started != 2) {
+        bridge->running = 0;
+        for (unsigned int d = 0; d < started; d++) {
+            pthread_join(bridge->routes[d].thread, nullptr);
+        }
+        pthread_mutex_destroy(&bridge->capture_mutex);
+        bridge->lib->PassThruStopMsgFilter(channel_b, bridge->filter_b);
+        bridge->lib->PassThruStopMsgFilter(channel_a, bridge->filter_a);
+        return ERR_FAILED;
+    }
+
+    LOGI("Gateway bridging channels %lu and %lu (%u/%u rules)", channel_a, channel_b,
+         bridge->routes[0].rule_count, bridge->routes[1].rule_count);
+    return STATUS_NOERROR;
+}
+
+long gateway_stop(GATEWAY_BRIDGE* bridge) {
+    if (bridge == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    bridge->running = 0;
+    pthread_join(bridge->routes[0].thread, nullptr);
+    pthread_join(bridge->routes[1].thread, nullptr);
+    pthread_mutex_destroy(&bridge->capture_mutex);
+
+    bridge->lib->PassThruStopMsgFilter(bridge->routes[1].source_channel, bridge->filter_b);
+    bridge->lib->PassThruStopMsgFilter(bridge->routes[0].source_channel, bridge->filter_a);
+
+    for (unsigned int d = 0; d < 2; d++) {
+        const GATEWAY_STATS* stats = &bridge->routes[d].stats;
+        LOGI("Gateway %s: %llu forwarded, %llu blocked, %llu write errors, max latency %llu us",
+             d == 0 ? "A->B" : "B->A", stats->forwarded, stats->blocked, stats->write_errors,
+             stats->forwarded != 0 ? stats->latency_max_us : 0ULL);
+    }
+    return STATUS_NOERROR;
+}
+
+void gateway_stats(const GATEWAY_BRIDGE* bridge, unsigned int direction, GATEWAY_STATS* stats) {
+    const unsigned long long* src = reinterpret_cast<const unsigned long long*>(
+        &bridge->routes[direction].stats);
+    unsigned long long* dst = reinterpret_cast<unsigned long long*>(stats);
+    for (unsigned int i = 0; i < sizeof(GATEWAY_STATS) / sizeof(unsigned long long); i++) {
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+    if (stats->forwarded == 0) {
+        stats->latency_min_us = 0;
+    }
+}
+
+static int read_rules(JNIEnv* env, jintArray array, GATEWAY_ROUTE* route) {
+    route->rule_count = 0;
+    if (array == nullptr) {
+        return 1;
+    }
+    jsize length = env->GetArrayLength(array);
+    if (length % GATEWAY_RULE_INTS != 0 || length / GATEWAY_RULE_INTS > GATEWAY_MAX_RULES) {
+        return 0;
+    }
+
+    jint* values = env->GetIntArrayElements(array, nullptr);
+    for (jsize i = 0; i < length / GATEWAY_RULE_INTS; i++) {
+        GATEWAY_RULE* rule = &route->rules[i];
+        const jint* v = values + i * GATEWAY_RULE_INTS;
+        rule->mask = static_cast<unsigned int>(v[0]);
+        rule->match = static_cast<unsigned int>(v[1]);
+        rule->action = static_cast<unsigned int>(v[2]);
+        rule->rewrite_mask = static_cast<unsigned int>(v[3]);
+        rule->rewrite_value = static_cast<unsigned int>(v[4]);
+    }
+    env->ReleaseIntArrayElements(array, values, JNI_ABORT);
+    route->rule_count = static_cast<unsigned int>(length / GATEWAY_RULE_INTS);
+    return 1;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeGatewayStart
+ * Signature: (III[I[ILjava/nio/ByteBuffer;)J
+ *
+ * Each rules array holds (mask, match, action, rewriteMask, rewriteValue)
+ * per rule and may be null; capture may be null.
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeGatewayStart
+  (JNIEnv *env, jobject obj, jint protocol_id, jint channel_a, jint channel_b,
+   jintArray rules_a_to_b, jintArray rules_b_to_a, jobject capture_buffer) {
+
+    unsigned char* ring = nullptr;
+    unsigned long ring_capacity = 0;
+    if (capture_buffer != nullptr) {
+        ring = static_cast<unsigned char*>(env->GetDirectBufferAddress(capture_buffer));
+        if (ring == nullptr) {
+            g_last_error = ERR_NULL_PARAMETER;
+            return 0;
+        }
+        ring_capacity = static_cast<unsigned long>(env->GetDirectBufferCapacity(capture_buffer));
+    }
+    if (g_j2534_lib == nullptr) {
+        g_last_error = ERR_DEVICE_NOT_CONNECTED;
+        return 0;
+    }
+
+    GATEWAY_BRIDGE* bridge = static_cast<GATEWAY_BRIDGE*>(calloc(1, sizeof(GATEWAY_BRIDGE)));
+    if (bridge == nullptr) {
+        g_last_error = ERR_INSUFFICIENT_MEMORY;
+        return 0;
+    }
+    bridge->lib = g_j2534_lib;
+    bridge->protocol_id = static_cast<unsigned long>(protocol_id);
+
+    if (!read_rules(env, rules_a_to_b, &bridge->routes[0]) ||
+        !read_rules(env, rules_b_to_a, &bridge->routes[1])) {
+        free(bridge);
+        g_last_error = ERR_INVALID_MSG;
+        return 0;
+    }
+
+    long result = gateway_start(bridge, static_cast<unsigned long>(channel_a),
+                                static_cast<unsigned long>(channel_b), ring, ring_capacity);
+    g_last_error = result;
+    if (result != STATUS_NOERROR) {
+        free(bridge);
+        return 0;
+    }
+
+    // The route threads write into the buffer until stop, so keep it reachable
+    if (capture_buffer != nullptr) {
+        bridge->ring_ref = env->NewGlobalRef(capture_buffer);
+    }
+    return reinterpret_cast<jlong>(bridge);
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeGatewayStats
+ * Signature: (JI[J)I
+ *
+ * Fills stats with the GATEWAY_STATS fields in declaration order.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeGatewayStats
+  (JNIEnv *env, jobject obj, jlong handle, jint direction, jlongArray stats) {
+
+    GATEWAY_BRIDGE* bridge = reinterpret_cast<GATEWAY_BRIDGE*>(handle);
+    if (bridge == nullptr || stats == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+    const jsize field_count = static_cast<jsize>(sizeof(GATEWAY_STATS) / sizeof(unsigned long long));
+    if ((direction != 0 && direction != 1) || env->GetArrayLength(stats) < field_count) {
+        g_last_error = ERR_INVALID_MSG;
+        return -1;
+    }
+
+    GATEWAY_STATS snapshot;
+    gateway_stats(bridge, static_cast<unsigned int>(direction), &snapshot);
+    env->SetLongArrayRegion(stats, 0, field_count, reinterpret_cast<const jlong*>(&snapshot));
+    g_last_error = STATUS_NOERROR;
+    return 0;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeGatewayStop
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeGatewayStop
+  (JNIEnv *env, jobject obj, jlong handle) {
+
+    GATEWAY_BRIDGE* bridge = reinterpret_cast<GATEWAY_BRIDGE*>(handle);
+    if (bridge == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    long result = gateway_stop(bridge);
+    if (bridge->ring_ref != nullptr) {
+        env->DeleteGlobalRef(bridge->ring_ref);
+    }
+    free(bridge);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return 0;
+    } else {
+        return -1;
+    }
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef CAN_GATEWAY_H
+#define CAN_GATEWAY_H
+
+#include <jni.h>
+#include <pthread.h>
+#include "j2534_native.h"
+
+#define GATEWAY_MAX_RULES 16
+#define GATEWAY_BATCH 64
+#define GATEWAY_IDLE_TIMEOUT_MS 20          // wait for the first frame of a batch
+#define GATEWAY_LATENCY_BUCKETS 16          // log2 microseconds, last bucket open-ended
+
+// Rule actions, first matching rule wins; frames matching no rule are forwarded
+#define GATEWAY_PASS 0
+#define GATEWAY_BLOCK 1
+#define GATEWAY_REWRITE 2
+
+/*
+ * Shared capture ring (native byte order), one slot per forwarded frame:
+ *    0  u64 write_seq     frames captured so far, stored with release semantics
+ *    8  u32 slot_count
+ *   12  u32 slot_size
+ *   16  u32 write_errors  frames the destination channel refused
+ *   20  u32 reserved
+ *   24  slots[slot_count]:
+ *         u64 timestamp_us  host monotonic clock when the frame was read
+ *         u32 source_id     CAN ID as received
+ *         u32 forwarded_id  CAN ID as sent
+ *         u8  direction     0 A to B, 1 B to A
+ *         u8  length
+ *         u16 latency_us    read to write completion, saturated
+ *         u8  data[64]
+ */
+#define GATEWAY_RING_HEADER_SIZE 24
+#define GATEWAY_SLOT_SIZE 88
+
+// Matches (id & mask) == match; GATEWAY_REWRITE replaces the rewrite_mask bits with rewrite_value
+typedef struct {
+    unsigned long mask;
+    unsigned long match;
+    unsigned long action;
+    unsigned long rewrite_mask;
+    unsigned long rewrite_value;
+} GATEWAY_RULE;
+
+/*
+ * Optional native transform run after the rules on every forwarded frame; it
+ * may edit the frame in place (ID prefix, data, TxFlags) and returns zero to
+ * drop it.
+ */
+typedef int (*GATEWAY_TRANSFORM)(void* context, PASSTHRU_MSG* msg);
+
+typedef struct {
+    unsigned long long forwarded;
+    unsigned long long blocked;
+    unsigned long long rewritten;
+    unsigned long long write_errors;
+    unsigned long long batches;
+    unsigned long long latency_min_us;
+    unsigned long long latency_max_us;
+    unsigned long long latency_total_us;
+    unsigned long long latency_histogram[GATEWAY_LATENCY_BUCKETS];
+} GATEWAY_STATS;
+
+typedef struct {
+    void* bridge;                       // owning GATEWAY_BRIDGE
+    unsigned int direction;
+    unsigned long source_channel;
+    unsigned long target_channel;
+    GATEWAY_RULE rules[GATEWAY_MAX_RULES];
+    unsigned int rule_count;
+    GATEWAY_TRANSFORM transform;
+    void* transform_context;
+    GATEWAY_STATS stats;
+    pthread_t thread;
+} GATEWAY_ROUTE;
+
+typedef struct {
+    J2534_LIBRARY* lib;
+    unsigned long protocol_id;
+    unsigned long filter_a;
+    unsigned long filter_b;
+    GATEWAY_ROUTE routes[2];            // A to B, B to A
+    unsigned char* ring;                // optional capture
+    unsigned int slot_count;
+    pthread_mutex_t capture_mutex;
+    unsigned long long seq;
+    volatile int running;
+    jobject ring_ref;
+} GATEWAY_BRIDGE;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Forwards frames between two connected channels of the same protocol (CAN or
+ * FD_CAN_PS) with one native thread per direction. Each thread blocks for the
+ * first frame, drains whatever else is queued without waiting and writes the
+ * batch to the other channel in one PassThruWriteMsgs call; capture happens
+ * after the write so it stays off the forwarding path. Pass-all filters are
+ * opened on both channels. Routes, rules and transforms are set by the caller
+ * before start; ring may be null.
+ */
+long gateway_start(GATEWAY_BRIDGE* bridge, unsigned long channel_a, unsigned long channel_b,
+                   unsigned char* ring, unsigned long ring_capacity);
+
+long gateway_stop(GATEWAY_BRIDGE* bridge);
+
+// Copies one direction's counters; safe while the bridge runs
+void gateway_stats(const GATEWAY_BRIDGE* bridge, unsigned int direction, GATEWAY_STATS* stats);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeGatewayStart
+ * Signature: (III[I[ILjava/nio/ByteBuffer;)J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeGatewayStart
+  (JNIEnv *, jobject, jint, jint, jint, jintArray, jintArray, jobject);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeGatewayStats
+ * Signature: (JI[J)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeGatewayStats
+  (JNIEnv *, jobject, jlong, jint, jlongArray);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeGatewayStop
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeGatewayStop
+  (JNIEnv *, jobject, jlong);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAN_GATEWAY_H
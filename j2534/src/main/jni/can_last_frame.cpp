@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "can_last_frame.h"
+#include "j2534_jni.h"
+#include "uds_client.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LASTFRAME_EXTENDED_KEY 0x80000000u
+
+static unsigned long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000000ULL +
+           static_cast<unsigned long long>(ts.tv_nsec) / 1000ULL;
+}
+
+static unsigned long can_id_of(const unsigned char* data) {
+    return (static_cast<unsigned long>(data[0]) << 24) | (static_cast<unsigned long>(data[1]) << 16) |
+           (static_cast<unsigned long>(data[2]) << 8) | static_cast<unsigned long>(data[3]);
+}
+
+static unsigned int frame_key(unsigned long can_id, int extended) {
+    return static_cast<unsigned int>(can_id & 0x1FFFFFFF) | (extended ? LASTFRAME_EXTENDED_KEY : 0);
+}
+
+static unsigned int hash_slot(unsigned int key) {
+    return (key * 2654435761u) & (LASTFRAME_HASH_SIZE - 1);
+}
+
+static unsigned char* entry_at(const LAST_FRAME_TABLE* frames, unsigned int index) {
+    return frames->table + LASTFRAME_HEADER_SIZE + index * LASTFRAME_ENTRY_SIZE;
+}
+
+// Probes the ID index; safe from any thread because slots are published with release stores
+static long find_entry(const LAST_FRAME_TABLE* frames, unsigned int key, unsigned int* slot) {
+    unsigned int s = hash_slot(key);
+    for (;;) {
+        unsigned short stored = __atomic_load_n(&frames->slots[s], __ATOMIC_ACQUIRE);
+        if (stored == 0) {
+            *slot = s;
+            return -1;
+        }
+        if (frames->keys[stored - 1] == key) {
+            return stored - 1;
+        }
+        s = (s + 1) & (LASTFRAME_HASH_SIZE - 1);
+    }
+}
+
+static void write_entry(LAST_FRAME_TABLE* frames, unsigned char* entry, const unsigned char* data,
+                        unsigned long size, unsigned long rx_status, unsigned long timestamp) {
+    unsigned int* seq = reinterpret_cast<unsigned int*>(entry);
+    unsigned int start = *seq;
+    __atomic_store_n(seq, start + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    unsigned int can_id = static_cast<unsigned int>(can_id_of(data));
+    unsigned int status = static_cast<unsigned int>(rx_status);
+    unsigned int length = static_cast<unsigned int>(size - UDS_CAN_ID_SIZE);
+    if (length > LASTFRAME_MAX_DATA) {
+        length = LASTFRAME_MAX_DATA;
+    }
+    unsigned long long count;
+    memcpy(&count, entry + 16, 8);
+    count++;
+    unsigned long long last_seen = now_us() - frames->epoch_us;
+    unsigned int adapter_timestamp = static_cast<unsigned int>(timestamp);
+
+    memcpy(entry + 4, &can_id, 4);
+    memcpy(entry + 8, &status, 4);
+    memcpy(entry + 12, &length, 4);
+    memcpy(entry + 16, &count, 8);
+    memcpy(entry + 24, &last_seen, 8);
+    memcpy(entry + 32, &adapter_timestamp, 4);
+    memcpy(entry + 40, data + UDS_CAN_ID_SIZE, length);
+
+    __atomic_store_n(seq, start + 2, __ATOMIC_RELEASE);
+}
+
+static void update(LAST_FRAME_TABLE* frames, const unsigned char* data, unsigned long size,
+                   unsigned long rx_status, unsigned long timestamp) {
+    if (rx_status & (TX_MSG_TYPE | START_OF_MESSAGE | TX_INDICATION) || size < UDS_CAN_ID_SIZE) {
+        return;
+    }
+
+    unsigned int key = frame_key(can_id_of(data), (rx_status & CAN_29BIT_ID) != 0);
+    unsigned int slot;
+    long index = find_entry(frames, key, &slot);
+
+    if (index < 0) {
+        if (frames->used == frames->entry_count) {
+            unsigned int* overflow = reinterpret_cast<unsigned int*>(frames->table + 12);
+            __atomic_store_n(overflow, *overflow + 1, __ATOMIC_RELAXED);
+            return;
+        }
+        // Fill the entry before it becomes reachable through used or the index
+        index = frames->used;
+        write_entry(frames, entry_at(frames, static_cast<unsigned int>(index)), data, size,
+                    rx_status, timestamp);
+        frames->keys[index] = key;
+        __atomic_store_n(&frames->slots[slot], static_cast<unsigned short>(index + 1),
+                         __ATOMIC_RELEASE);
+        frames->used++;
+        __atomic_store_n(reinterpret_cast<unsigned int*>(frames->table + 8), frames->used,
+                         __ATOMIC_RELEASE);
+    } else {
+        write_entry(frames, entry_at(frames, static_cast<unsigned int>(index)), data, size,
+                    rx_status, timestamp);
+    }
+
+    unsigned long long* total = reinterpret_cast<unsigned long long*>(frames->table + 16);
+    __atomic_store_n(total, *total + 1, __ATOMIC_RELAXED);
+}
+
+static void* last_frame_thread(void* arg) {
+    LAST_FRAME_TABLE* frames = static_cast<LAST_FRAME_TABLE*>(arg);
+
+    if (frames->hub != nullptr) {
+        while (frames->running) {
+            FANOUT_FRAME* frame = nullptr;
+            long result = fanout_next(frames->hub, frames->subscriber_id, LASTFRAME_IDLE_TIMEOUT_MS,
+                                      &frame);
+            if (result == ERR_BUFFER_EMPTY) {
+                continue;
+            }
+            if (result != STATUS_NOERROR) {
+                LOGE("Last frame table lost its fan-out subscription: %ld", result);
+                break;
+            }
+            update(frames, frame->data, frame->data_size, frame->rx_status, frame->timestamp);
+            fanout_release(frames->hub, frame);
+        }
+        return nullptr;
+    }
+
+    PASSTHRU_MSG* msgs = static_cast<PASSTHRU_MSG*>(malloc(LASTFRAME_BATCH * sizeof(PASSTHRU_MSG)));
+    if (msgs == nullptr) {
+        LOGE("Last frame table for channel %lu out of memory", frames->channel_id);
+        return nullptr;
+    }
+    while (frames->running) {
+        // Block for one message, then take whatever else is queued without waiting
+        unsigned long num_msgs = 1;
+        long result = frames->lib->PassThruReadMsgs(frames->channel_id, msgs, &num_msgs,
+                                                    LASTFRAME_IDLE_TIMEOUT_MS);
+        if (result == STATUS_NOERROR && num_msgs == 1) {
+            unsigned long more = LASTFRAME_BATCH - 1;
+            result = frames->lib->PassThruReadMsgs(frames->channel_id, msgs + 1, &more, 0);
+            num_msgs += more;
+        }
+        if (result != STATUS_NOERROR && result != ERR_BUFFER_EMPTY && result != ERR_TIMEOUT) {
+            LOGE("Last frame read on channel %lu failed: %ld", frames->channel_id, result);
+            break;
+        }
+        for (unsigned long i = 0; i < num_msgs; i++) {
+            update(frames, msgs[i].Data, msgs[i].DataSize, msgs[i].RxStatus, msgs[i].Timestamp);
+        }
+    }
+    free(msgs);
+    return nullptr;
+}
+
+long last_frame_start(LAST_FRAME_TABLE* frames, unsigned char* table, unsigned long capacity) {
+    if (frames == nullptr || table == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (frames->hub == nullptr && (frames->lib == nullptr || frames->lib->PassThruReadMsgs == nullptr)) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+    if ((reinterpret_cast<unsigned long>(table) & 7) != 0) {
+        return ERR_INVALID_MSG;
+    }
+    if (capacity < LASTFRAME_HEADER_SIZE + LASTFRAME_ENTRY_SIZE) {
+        return ERR_BUFFER_OVERFLOW;
+    }
+
+    unsigned long entries = (capacity - LASTFRAME_HEADER_SIZE) / LASTFRAME_ENTRY_SIZE;
+    frames->entry_count = static_cast<unsigned int>(
+        entries < LASTFRAME_MAX_IDS ? entries : LASTFRAME_MAX_IDS);
+    frames->table = table;
+    frames->used = 0;
+    memset(frames->slots, 0, sizeof(frames->slots));
+
+    unsigned int entry_size = LASTFRAME_ENTRY_SIZE;
+    memset(table, 0, LASTFRAME_HEADER_SIZE + frames->entry_count * LASTFRAME_ENTRY_SIZE);
+    memcpy(table, &frames->entry_count, 4);
+    memcpy(table + 4, &entry_size, 4);
+
+    long result;
+    frames->has_filter = 0;
+    if (frames->hub != nullptr) {
+        // Dropping keeps a stalled dashboard from holding up the other subscribers
+        result = fanout_subscribe(frames->hub, nullptr, nullptr, 0, FANOUT_DROP,
+                                  &frames->subscriber_id);
+    } else if (frames->protocol_id == CAN || frames->protocol_id == FD_CAN_PS) {
+        PASSTHRU_MSG mask;
+        PASSTHRU_MSG pattern;
+        memset(&mask, 0, sizeof(mask));
+        memset(&pattern, 0, sizeof(pattern));
+        mask.ProtocolID = pattern.ProtocolID = frames->protocol_id;
+        mask.DataSize = pattern.DataSize = UDS_CAN_ID_SIZE;
+        result = frames->lib->PassThruStartMsgFilter(frames->channel_id, PASS_FILTER, &mask, &pattern,
+                                                     nullptr, &frames->filter_id);
+        frames->has_filter = result == STATUS_NOERROR;
+    } else {
+        result = ERR_INVALID_PROTOCOL_ID;
+    }
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+
+    frames->epoch_us = now_us();
+    frames->running = 1;
+    if (pthread_create(&frames->thread, nullptr, last_frame_thread, frames) != 0) {
+        frames->running = 0;
+        if (frames->hub != nullptr) {
+            fanout_unsubscribe(frames->hub, frames->subscriber_id);
+        } else {
+            frames->lib->PassThruStopMsgFilter(frames->channel_id, frames->filter_id);
+        }
+        return ERR_FAILED;
+    }
+
+    LOGI("Last frame table with %u entries started", frames->entry_count);
+    return STATUS_NOERROR;
+}
+
+long last_frame_stop(LAST_FRAME_TABLE* frames) {
+    if (frames == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    frames->running = 0;
+    pthread_join(frames->thread, nullptr);
+
+    if (frames->hub != nullptr) {
+        fanout_unsubscribe(frames->hub, frames->subscriber_id);
+    } else if (frames->has_filter) {
+        frames->lib->PassThruStopMsgFilter(frames->channel_id, frames->filter_id);
+    }
+    return STATUS_NOERROR;
+}
+
+long last_frame_lookup(LAST_FRAME_TABLE* frames, unsigned long can_id, int extended) {
+    unsigned int slot;
+    return find_entry(frames, frame_key(can_id, extended), &slot);
+}
+
+unsigned int last_frame_snapshot(LAST_FRAME_TABLE* frames, unsigned char* out, unsigned long capacity) {
+    unsigned int used = __atomic_load_n(reinterpret_cast<unsigned int*>(frames->table + 8),
+                                        __ATOMIC_ACQUIRE);
+    unsigned int count = 0;
+
+    for (unsigned int i = 0; i < used && (count + 1) * LASTFRAME_ENTRY_SIZE <= capacity; i++) {
+        const unsigned char* entry = entry_at(frames, i);
+        const unsigned int* seq = reinterpret_cast<const unsigned int*>(entry);
+        unsigned char* copy = out + count * LASTFRAME_ENTRY_SIZE;
+        for (;;) {
+            unsigned int before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+            if (before & 1) {
+                continue;
+            }
+            memcpy(copy, entry, LASTFRAME_ENTRY_SIZE);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(seq, __ATOMIC_RELAXED) == before) {
+                break;
+            }
+        }
+        count++;
+    }
+    return count;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeLastFrameStart
+ * Signature: (JIILjava/nio/ByteBuffer;)J
+ *
+ * A non-zero fanout handle feeds the table from a new subscriber of that hub;
+ * otherwise the table reads channel_id itself.
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeLastFrameStart
+  (JNIEnv *env, jobject obj, jlong fanout, jint channel_id, jint protocol_id, jobject table_buffer) {
+
+    unsigned char* table = table_buffer != nullptr
+        ? static_cast<unsigned char*>(env->GetDirectBufferAddress(table_buffer)) : nullptr;
+    if (table == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return 0;
+    }
+    if (fanout == 0 && g_j2534_lib == nullptr) {
+        g_last_error = ERR_DEVICE_NOT_CONNECTED;
+        return 0;
+    }
+
+    LAST_FRAME_TABLE* frames = static_cast<LAST_FRAME_TABLE*>(calloc(1, sizeof(LAST_FRAME_TABLE)));
+    if (frames == nullptr) {
+        g_last_error = ERR_INSUFFICIENT_MEMORY;
+        return 0;
+    }
+    frames->hub = reinterpret_cast<FANOUT_HUB*>(fanout);
+    frames->lib = g_j2534_lib;
+    frames->channel_id = static_cast<unsigned long>(channel_id);
+    frames->protocol_id = static_cast<unsigned long>(protocol_id);
+
+    long result = last_frame_start(frames, table,
+        static_cast<unsigned long>(env->GetDirectBufferCapacity(table_buffer)));
+    g_last_error = result;
+    if (result != STATUS_NOERROR) {
+        free(frames);
+        return 0;
+    }
+
+    // The RX thread writes into the buffer until stop, so keep it reachable
+    frames->table_ref = env->NewGlobalRef(table_buffer);
+    return reinterpret_cast<jlong>(frames);
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeLastFrameLookup
+ * Signature: (JIZ)I
+ *
+ * Returns the entry index for the ID in the shared table, or -1 if it has not
+ * been received yet.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeLastFrameLookup
+  (JNIEnv *env, jobject obj, jlong handle, jint can_id, jboolean extended) {
+
+    LAST_FRAME_TABLE* frames = reinterpret_cast<LAST_FRAME_TABLE*>(handle);
+    if (frames == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+    g_last_error = STATUS_NOERROR;
+    return static_cast<jint>(last_frame_lookup(frames, static_cast<unsigned int>(can_id),
+                                               extended == JNI_TRUE));
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeLastFrameSnapshot
+ * Signature: (JLjava/nio/ByteBuffer;)I
+ *
+ * Copies consistent entries into the direct buffer and returns how many.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeLastFrameSnapshot
+  (JNIEnv *env, jobject obj, jlong handle, jobject buffer) {
+
+    LAST_FRAME_TABLE* frames = reinterpret_cast<LAST_FRAME_TABLE*>(handle);
+    unsigned char* out = buffer != nullptr
+        ? static_cast<unsigned char*>(env->GetDirectBufferAddress(buffer)) : nullptr;
+    if (frames == nullptr || out == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    g_last_error = STATUS_NOERROR;
+    return static_cast<jint>(last_frame_snapshot(frames, out,
+        static_cast<unsigned long>(env->GetDirectBufferCapacity(buffer))));
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeLastFrameStop
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeLastFrameStop
+  (JNIEnv *env, jobject obj, jlong handle) {
+
+    LAST_FRAME_TABLE* frames = reinterpret_cast<LAST_FRAME_TABLE*>(handle);
+    if (frames == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    long result = last_frame_stop(frames);
+    env->DeleteGlobalRef(frames->table_ref);
+    free(frames);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return 0;
+    } else {
+        return -1;
+    }
+}
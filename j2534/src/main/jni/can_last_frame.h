@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef CAN_LAST_FRAME_H
+#define CAN_LAST_FRAME_H
+
+#include <jni.h>
+#include <pthread.h>
+#include "j2534_native.h"
+#include "rx_fanout.h"
+
+#define LASTFRAME_MAX_IDS 1024
+#define LASTFRAME_HASH_SIZE 2048            // power of two, twice LASTFRAME_MAX_IDS
+#define LASTFRAME_BATCH 32
+#define LASTFRAME_IDLE_TIMEOUT_MS 20
+#define LASTFRAME_MAX_DATA 64
+
+/*
+ * Shared table (native byte order). Entries are assigned in order of first
+ * appearance and never move, so entries 0..used-1 are valid:
+ *    0  u32 entry_count   capacity
+ *    4  u32 entry_size
+ *    8  u32 used          stored with release semantics after the entry is initialised
+ *   12  u32 overflow      frames whose ID found the table full
+ *   16  u64 total_frames
+ *   24  u64 reserved
+ *   32  entries[entry_count]:
+ *         u32 seq           seqlock, odd while the entry is being written
+ *         u32 can_id
+ *         u32 rx_status     CAN_29BIT_ID tells 11-bit and 29-bit IDs apart
+ *         u32 length        data bytes after the ID prefix
+ *         u64 count         frames received with this ID
+ *         u64 last_seen_us  host monotonic clock since start
+ *         u32 timestamp     adapter timestamp of the last frame
+ *         u32 reserved
+ *         u8  data[64]
+ * A reader loads seq (acquire), retries while it is odd, copies the entry,
+ * issues an acquire fence and accepts the copy if seq is unchanged.
+ */
+#define LASTFRAME_HEADER_SIZE 32
+#define LASTFRAME_ENTRY_SIZE 104
+
+typedef struct {
+    J2534_LIBRARY* lib;
+    unsigned long channel_id;
+    unsigned long protocol_id;
+    unsigned long filter_id;
+    int has_filter;
+    FANOUT_HUB* hub;                    // when set, frames come from a fan-out subscriber instead
+    unsigned int subscriber_id;
+    unsigned char* table;
+    unsigned int entry_count;
+    unsigned int used;
+    unsigned int keys[LASTFRAME_MAX_IDS];
+    unsigned short slots[LASTFRAME_HASH_SIZE];  // entry index + 1, 0 when empty
+    unsigned long long epoch_us;
+    pthread_t thread;
+    volatile int running;
+    jobject table_ref;
+} LAST_FRAME_TABLE;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Starts the RX thread that keeps the latest frame per CAN ID in table. Set
+ * lib, channel_id and protocol_id to read the channel directly (CAN and
+ * FD_CAN_PS get a pass-all filter), or hub to subscribe to a running fan-out
+ * hub so the table can share the channel with other consumers.
+ */
+long last_frame_start(LAST_FRAME_TABLE* frames, unsigned char* table, unsigned long capacity);
+
+long last_frame_stop(LAST_FRAME_TABLE* frames);
+
+// Index of the entry for an ID, or -1 if it has not been received yet; O(1)
+long last_frame_lookup(LAST_FRAME_TABLE* frames, unsigned long can_id, int extended);
+
+// Copies every entry consistently into out using the entry layout; returns the count
+unsigned int last_frame_snapshot(LAST_FRAME_TABLE* frames, unsigned char* out, unsigned long capacity);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeLastFrameStart
+ * Signature: (JIILjava/nio/ByteBuffer;)J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeLastFrameStart
+  (JNIEnv *, jobject, jlong, jint, jint, jobject);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeLastFrameLookup
+ * Signature: (JIZ)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeLastFrameLookup
+  (JNIEnv *, jobject, jlong, jint, jboolean);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeLastFrameSnapshot
+ * Signature: (JLjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeLastFrameSnapshot
+  (JNIEnv *, jobject, jlong, jobject);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeLastFrameStop
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeLastFrameStop
+  (JNIEnv *, jobject, jlong);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAN_LAST_FRAME_H
@@ -0,0 +1,527 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "checksum.h"
+#include "j2534_jni.h"
+#include "j2534_native.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// Carry-less multiply kernels need -mpclmul / +crypto for this file (see CMakeLists.txt)
+// and are only entered after a runtime CPU check.
+#if defined(__PCLMUL__) && defined(__SSE4_1__)
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#define CHECKSUM_PCLMUL 1
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES))
+#include <arm_neon.h>
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#define CHECKSUM_PMULL 1
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define CHECKSUM_ADD_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CHECKSUM_ADD_NEON 1
+#endif
+
+// The folding kernels consume 64-byte chunks after a 64-byte prologue
+#define CRC32_SIMD_MIN_LENGTH 64
+
+typedef struct {
+    uint32_t table[8][256];
+} CRC32_TABLES;
+
+typedef struct {
+    uint16_t table[8][256];
+} CRC16_TABLES;
+
+// table[k][b] is the CRC of byte b followed by k zero bytes
+static constexpr CRC32_TABLES build_crc32_tables() {
+    CRC32_TABLES t = {};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int bit = 0; bit < 8; bit++) {
+            c = (c & 1) ? (c >> 1) ^ 0xEDB88320U : c >> 1;
+        }
+        t.table[0][i] = c;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t prev = t.table[k - 1][i];
+            t.table[k][i] = (prev >> 8) ^ t.table[0][prev & 0xFF];
+        }
+    }
+    return t;
+}
+
+static constexpr CRC16_TABLES build_crc16_tables() {
+    CRC16_TABLES t = {};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            c = (c & 0x8000) ? (c << 1) ^ 0x1021 : c << 1;
+        }
+        t.table[0][i] = static_cast<uint16_t>(c);
+    }
+    for (int k = 1; k < 8; k++) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t prev = t.table[k - 1][i];
+            t.table[k][i] = static_cast<uint16_t>((prev << 8) ^ t.table[0][prev >> 8]);
+        }
+    }
+    return t;
+}
+
+static constexpr CRC32_TABLES g_crc32 = build_crc32_tables();
+static constexpr CRC16_TABLES g_crc16 = build_crc16_tables();
+
+static_assert(g_crc32.table[0][1] == 0x77073096U, "CRC32 table generation");
+static_assert(g_crc16.table[0][1] == 0x1021, "CRC16 table generation");
+
+static pthread_once_t g_cpu_once = PTHREAD_ONCE_INIT;
+static int g_has_clmul = 0;
+
+static void detect_cpu(void) {
+#if defined(CHECKSUM_PCLMUL)
+    __builtin_cpu_init();
+    g_has_clmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#elif defined(CHECKSUM_PMULL)
+    g_has_clmul = (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0;
+#endif
+}
+
+static int has_clmul(void) {
+    pthread_once(&g_cpu_once, detect_cpu);
+    return g_has_clmul;
+}
+
+// State-based kernels below work on the inverted CRC register
+
+static uint32_t crc32_bytewise(uint32_t crc, const unsigned char* p, unsigned long length) {
+    while (length--) {
+        crc = g_crc32.table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+// Little-endian loads; every Android ABI is little endian
+static uint32_t crc32_slice8(uint32_t crc, const unsigned char* p, unsigned long length) {
+    while (length >= 8) {
+        uint32_t one;
+        uint32_t two;
+        memcpy(&one, p, 4);
+        memcpy(&two, p + 4, 4);
+        one ^= crc;
+        crc = g_crc32.table[7][one & 0xFF] ^ g_crc32.table[6][(one >> 8) & 0xFF] ^
+              g_crc32.table[5][(one >> 16) & 0xFF] ^ g_crc32.table[4][one >> 24] ^
+              g_crc32.table[3][two & 0xFF] ^ g_crc32.table[2][(two >> 8) & 0xFF] ^
+              g_crc32.table[1][(two >> 16) & 0xFF] ^ g_crc32.table[0][two >> 24];
+        p += 8;
+        length -= 8;
+    }
+    return crc32_bytewise(crc, p, length);
+}
+
+/*
+ * Folding constants for the reflected IEEE polynomial (Gopal et al., "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ"): x^(4*128+32), x^(4*128-32),
+ * x^(128+32), x^(128-32), x^64, then P(x)' and mu for the Barrett reduction.
+ */
+#if defined(CHECKSUM_PCLMUL) || defined(CHECKSUM_PMULL)
+alignas(16) static const uint64_t g_k1k2[2] = { 0x0154442BD4ULL, 0x01C6E41596ULL };
+alignas(16) static const uint64_t g_k3k4[2] = { 0x01751997D0ULL, 0x00CCAA009EULL };
+alignas(16) static const uint64_t g_k5[2] = { 0x0163CD6124ULL, 0 };
+alignas(16) static const uint64_t g_poly[2] = { 0x01DB710641ULL, 0x01F7011641ULL };
+alignas(16) static const uint32_t g_mask32[4] = { 0xFFFFFFFFU, 0, 0xFFFFFFFFU, 0 };
+#endif
+
+#if defined(CHECKSUM_PCLMUL)
+// length >= 64 and a multiple of 16
+static uint32_t crc32_clmul(uint32_t crc, const unsigned char* p, unsigned long length) {
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x00));
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x10));
+    x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x20));
+    x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(g_k1k2));
+    p += 64;
+    length -= 64;
+
+    // Four independent 128-bit lanes hide the multiplier latency
+    while (length >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x00));
+        y6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x10));
+        y7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x20));
+        y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        p += 64;
+        length -= 64;
+    }
+
+    // Fold the four lanes into one
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(g_k3k4));
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    while (length >= 16) {
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        p += 16;
+        length -= 16;
+    }
+
+    // 128 -> 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_load_si128(reinterpret_cast<const __m128i*>(g_mask32));
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(g_k5));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(g_poly));
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+#elif defined(CHECKSUM_PMULL)
+// PMULL equivalents of _mm_clmulepi64_si128 immediates 0x00, 0x11 and 0x10
+static inline uint64x2_t clmul_00(uint64x2_t a, uint64x2_t b) {
+    return vreinterpretq_u64_p128(vmull_p64(vgetq_lane_u64(a, 0), vgetq_lane_u64(b, 0)));
+}
+
+static inline uint64x2_t clmul_11(uint64x2_t a, uint64x2_t b) {
+    return vreinterpretq_u64_p128(vmull_p64(vgetq_lane_u64(a, 1), vgetq_lane_u64(b, 1)));
+}
+
+static inline uint64x2_t clmul_10(uint64x2_t a, uint64x2_t b) {
+    return vreinterpretq_u64_p128(vmull_p64(vgetq_lane_u64(a, 0), vgetq_lane_u64(b, 1)));
+}
+
+static inline uint64x2_t load_u64x2(const unsigned char* p) {
+    return vreinterpretq_u64_u8(vld1q_u8(p));
+}
+
+static inline uint64x2_t shift_right_bytes(uint64x2_t x, int bytes) {
+    uint8x16_t zero = vdupq_n_u8(0);
+    return bytes == 8 ? vreinterpretq_u64_u8(vextq_u8(vreinterpretq_u8_u64(x), zero, 8))
+                      : vreinterpretq_u64_u8(vextq_u8(vreinterpretq_u8_u64(x), zero, 4));
+}
+
+// Same fold as the PCLMUL kernel; length >= 64 and a multiple of 16
+static uint32_t crc32_clmul(uint32_t crc, const unsigned char* p, unsigned long length) {
+    uint64x2_t x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = load_u64x2(p + 0x00);
+    x2 = load_u64x2(p + 0x10);
+    x3 = load_u64x2(p + 0x20);
+    x4 = load_u64x2(p + 0x30);
+    x1 = veorq_u64(x1, vreinterpretq_u64_u32(vsetq_lane_u32(crc, vdupq_n_u32(0), 0)));
+    x0 = vld1q_u64(g_k1k2);
+    p += 64;
+    length -= 64;
+
+    while (length >= 64) {
+        x5 = clmul_00(x1, x0);
+        x6 = clmul_00(x2, x0);
+        x7 = clmul_00(x3, x0);
+        x8 = clmul_00(x4, x0);
+        x1 = clmul_11(x1, x0);
+        x2 = clmul_11(x2, x0);
+        x3 = clmul_11(x3, x0);
+        x4 = clmul_11(x4, x0);
+        x1 = veorq_u64(veorq_u64(x1, x5), load_u64x2(p + 0x00));
+        x2 = veorq_u64(veorq_u64(x2, x6), load_u64x2(p + 0x10));
+        x3 = veorq_u64(veorq_u64(x3, x7), load_u64x2(p + 0x20));
+        x4 = veorq_u64(veorq_u64(x4, x8), load_u64x2(p + 0x30));
+        p += 64;
+        length -= 64;
+    }
+
+    x0 = vld1q_u64(g_k3k4);
+    x5 = clmul_00(x1, x0);
+    x1 = veorq_u64(veorq_u64(clmul_11(x1, x0), x2), x5);
+    x5 = clmul_00(x1, x0);
+    x1 = veorq_u64(veorq_u64(clmul_11(x1, x0), x3), x5);
+    x5 = clmul_00(x1, x0);
+    x1 = veorq_u64(veorq_u64(clmul_11(x1, x0), x4), x5);
+
+    while (length >= 16) {
+        x5 = clmul_00(x1, x0);
+        x1 = veorq_u64(veorq_u64(clmul_11(x1, x0), load_u64x2(p)), x5);
+        p += 16;
+        length -= 16;
+    }
+
+    x2 = clmul_10(x1, x0);
+    x3 = vreinterpretq_u64_u32(vld1q_u32(g_mask32));
+    x1 = veorq_u64(shift_right_bytes(x1, 8), x2);
+    x0 = vld1q_u64(g_k5);
+    x2 = shift_right_bytes(x1, 4);
+    x1 = vandq_u64(x1, x3);
+    x1 = veorq_u64(clmul_00(x1, x0), x2);
+
+    x0 = vld1q_u64(g_poly);
+    x2 = vandq_u64(clmul_10(vandq_u64(x1, x3), x0), x3);
+    x2 = clmul_00(x2, x0);
+    x1 = veorq_u64(x1, x2);
+    return vgetq_lane_u32(vreinterpretq_u32_u64(x1), 1);
+}
+#endif
+
+static uint32_t crc32_state(int impl, uint32_t crc, const unsigned char* p, unsigned long length) {
+#if defined(CHECKSUM_PCLMUL) || defined(CHECKSUM_PMULL)
+    if (impl == CHECKSUM_IMPL_SIMD && length >= CRC32_SIMD_MIN_LENGTH) {
+        unsigned long bulk = length & ~15UL;
+        crc = crc32_clmul(crc, p, bulk);
+        p += bulk;
+        length -= bulk;
+    }
+#endif
+    return impl == CHECKSUM_IMPL_BYTEWISE ? crc32_bytewise(crc, p, length)
+                                          : crc32_slice8(crc, p, length);
+}
+
+unsigned int crc32_update(unsigned int crc, const unsigned char* data, unsigned long length) {
+    int impl = has_clmul() ? CHECKSUM_IMPL_SIMD : CHECKSUM_IMPL_SLICE8;
+    return ~crc32_state(impl, ~crc, data, length);
+}
+
+static uint16_t crc16_bytewise(uint16_t crc, const unsigned char* p, unsigned long length) {
+    while (length--) {
+        crc = static_cast<uint16_t>((crc << 8) ^ g_crc16.table[0][(crc >> 8) ^ *p++]);
+    }
+    return crc;
+}
+
+static uint16_t crc16_slice8(uint16_t crc, const unsigned char* p, unsigned long length) {
+    while (length >= 8) {
+        crc = g_crc16.table[7][p[0] ^ (crc >> 8)] ^ g_crc16.table[6][p[1] ^ (crc & 0xFF)] ^
+              g_crc16.table[5][p[2]] ^ g_crc16.table[4][p[3]] ^ g_crc16.table[3][p[4]] ^
+              g_crc16.table[2][p[5]] ^ g_crc16.table[1][p[6]] ^ g_crc16.table[0][p[7]];
+        p += 8;
+        length -= 8;
+    }
+    return crc16_bytewise(crc, p, length);
+}
+
+unsigned short crc16_ccitt_update(unsigned short crc, const unsigned char* data, unsigned long length) {
+    return crc16_slice8(crc, data, length);
+}
+
+static uint32_t add8_bytewise(uint32_t sum, const unsigned char* p, unsigned long length) {
+    while (length--) {
+        sum += *p++;
+    }
+    return sum;
+}
+
+static uint32_t add8_simd(uint32_t sum, const unsigned char* p, unsigned long length) {
+#if defined(CHECKSUM_ADD_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    while (length >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+        p += 16;
+        length -= 16;
+    }
+    sum += static_cast<uint32_t>(_mm_cvtsi128_si32(acc)) +
+           static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+#elif defined(CHECKSUM_ADD_NEON)
+    uint32x4_t acc = vdupq_n_u32(0);
+    while (length >= 16) {
+        acc = vpadalq_u16(acc, vpaddlq_u8(vld1q_u8(p)));
+        p += 16;
+        length -= 16;
+    }
+    sum += vaddvq_u32(acc);
+#endif
+    return add8_bytewise(sum, p, length);
+}
+
+unsigned int checksum_add8(unsigned int sum, const unsigned char* data, unsigned long length) {
+    return add8_simd(sum, data, length);
+}
+
+int checksum_impl_available(int algorithm, int impl) {
+    switch (algorithm) {
+        case CHECKSUM_CRC32:
+            return impl == CHECKSUM_IMPL_BYTEWISE || impl == CHECKSUM_IMPL_SLICE8 ||
+                   (impl == CHECKSUM_IMPL_SIMD && has_clmul());
+        case CHECKSUM_CRC16_CCITT:
+            return impl == CHECKSUM_IMPL_BYTEWISE || impl == CHECKSUM_IMPL_SLICE8;
+        case CHECKSUM_ADD8:
+#if defined(CHECKSUM_ADD_SSE2) || defined(CHECKSUM_ADD_NEON)
+            return impl == CHECKSUM_IMPL_BYTEWISE || impl == CHECKSUM_IMPL_SIMD;
+#else
+            return impl == CHECKSUM_IMPL_BYTEWISE;
+#endif
+        default:
+            return 0;
+    }
+}
+
+long checksum_compute(int algorithm, int impl, unsigned int seed, const unsigned char* data,
+                      unsigned long length, unsigned int* value) {
+    if (data == nullptr && length > 0) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (impl == CHECKSUM_IMPL_AUTO) {
+        impl = checksum_impl_available(algorithm, CHECKSUM_IMPL_SIMD) ? CHECKSUM_IMPL_SIMD
+                                                                      : CHECKSUM_IMPL_SLICE8;
+    }
+    if (!checksum_impl_available(algorithm, impl)) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    switch (algorithm) {
+        case CHECKSUM_CRC32:
+            *value = ~crc32_state(impl, ~seed, data, length);
+            break;
+        case CHECKSUM_CRC16_CCITT:
+            *value = impl == CHECKSUM_IMPL_BYTEWISE
+                ? crc16_bytewise(static_cast<uint16_t>(seed), data, length)
+                : crc16_slice8(static_cast<uint16_t>(seed), data, length);
+            break;
+        default:
+            *value = impl == CHECKSUM_IMPL_BYTEWISE ? add8_bytewise(seed, data, length)
+                                                    : add8_simd(seed, data, length);
+            break;
+    }
+    return STATUS_NOERROR;
+}
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000000000ULL +
+           static_cast<unsigned long long>(ts.tv_nsec);
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeChecksum
+ * Signature: (ILjava/nio/ByteBuffer;III)J
+ *
+ * Returns the checksum as an unsigned 32-bit value, or -1 on error. seed is the
+ * running value from a previous chunk (0 for CRC32, 0xFFFF for CRC16).
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeChecksum
+  (JNIEnv *env, jobject obj, jint algorithm, jobject buffer, jint offset, jint length, jint seed) {
+
+    const unsigned char* data = buffer != nullptr
+        ? static_cast<const unsigned char*>(env->GetDirectBufferAddress(buffer)) : nullptr;
+    if (data == nullptr || offset < 0 || length < 0 ||
+        static_cast<jlong>(offset) + length > env->GetDirectBufferCapacity(buffer)) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    unsigned int value = 0;
+    long result = checksum_compute(algorithm, CHECKSUM_IMPL_AUTO, static_cast<unsigned int>(seed),
+                                   data + offset, static_cast<unsigned long>(length), &value);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return static_cast<jlong>(value);
+    } else {
+        return -1;
+    }
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeChecksumBenchmark
+ * Signature: (Ljava/nio/ByteBuffer;ILjava/nio/ByteBuffer;)I
+ *
+ * Runs every kernel available on this CPU over the whole buffer and writes one
+ * CHECKSUM_BENCH_RECORD_SIZE record per kernel. Returns the record count.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeChecksumBenchmark
+  (JNIEnv *env, jobject obj, jobject data_buffer, jint iterations, jobject result_buffer) {
+
+    const unsigned char* data = data_buffer != nullptr
+        ? static_cast<const unsigned char*>(env->GetDirectBufferAddress(data_buffer)) : nullptr;
+    unsigned char* out = result_buffer != nullptr
+        ? static_cast<unsigned char*>(env->GetDirectBufferAddress(result_buffer)) : nullptr;
+    if (data == nullptr || out == nullptr || iterations <= 0) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    unsigned long length = static_cast<unsigned long>(env->GetDirectBufferCapacity(data_buffer));
+    unsigned long capacity = static_cast<unsigned long>(env->GetDirectBufferCapacity(result_buffer));
+    unsigned int count = 0;
+
+    for (int algorithm = CHECKSUM_CRC32; algorithm <= CHECKSUM_ADD8; algorithm++) {
+        for (int impl = CHECKSUM_IMPL_BYTEWISE; impl <= CHECKSUM_IMPL_SIMD; impl++) {
+            if (!checksum_impl_available(algorithm, impl)) {
+                continue;
+            }
+            if ((count + 1) * CHECKSUM_BENCH_RECORD_SIZE > capacity) {
+                g_last_error = ERR_BUFFER_OVERFLOW;
+                return static_cast<jint>(count);
+            }
+
+            unsigned int seed = algorithm == CHECKSUM_CRC16_CCITT ? CHECKSUM_CRC16_INIT : 0;
+            unsigned int value = 0;
+            unsigned long long start = now_ns();
+            for (int i = 0; i < iterations; i++) {
+                checksum_compute(algorithm, impl, seed, data, length, &value);
+            }
+            unsigned long long elapsed = now_ns() - start;
+
+            float mb_per_s = elapsed > 0
+                ? static_cast<float>(static_cast<double>(length) * iterations * 1000.0 / elapsed)
+                : 0.0f;
+            unsigned int record[4];
+            record[0] = static_cast<unsigned int>(algorithm);
+            record[1] = static_cast<unsigned int>(impl);
+            memcpy(&record[2], &mb_per_s, 4);
+            record[3] = value;
+            memcpy(out + count * CHECKSUM_BENCH_RECORD_SIZE, record, sizeof(record));
+            count++;
+        }
+    }
+
+    g_last_error = STATUS_NOERROR;
+    return static_cast<jint>(count);
+}
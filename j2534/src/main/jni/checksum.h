@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <jni.h>
+
+// Algorithms
+#define CHECKSUM_CRC32 0         // IEEE 802.3, reflected, init/xorout 0xFFFFFFFF (zlib)
+#define CHECKSUM_CRC16_CCITT 1   // poly 0x1021, init 0xFFFF, not reflected (CCITT-FALSE)
+#define CHECKSUM_ADD8 2          // 32-bit sum of all bytes
+
+// Kernel variants, fastest available is used unless one is requested explicitly
+#define CHECKSUM_IMPL_AUTO -1
+#define CHECKSUM_IMPL_BYTEWISE 0
+#define CHECKSUM_IMPL_SLICE8 1
+#define CHECKSUM_IMPL_SIMD 2     // PCLMUL / PMULL for CRC32, SSE2 / NEON for ADD8
+
+#define CHECKSUM_CRC16_INIT 0xFFFF
+
+// Benchmark result record: u32 algorithm, u32 impl, f32 MB/s, u32 value
+#define CHECKSUM_BENCH_RECORD_SIZE 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Running CRC32: start from 0 and feed consecutive chunks
+unsigned int crc32_update(unsigned int crc, const unsigned char* data, unsigned long length);
+
+// Running CRC16-CCITT: start from CHECKSUM_CRC16_INIT
+unsigned short crc16_ccitt_update(unsigned short crc, const unsigned char* data, unsigned long length);
+
+unsigned int checksum_add8(unsigned int sum, const unsigned char* data, unsigned long length);
+
+int checksum_impl_available(int algorithm, int impl);
+
+// Runs one algorithm with a specific kernel; ERR_NOT_SUPPORTED if the CPU lacks it
+long checksum_compute(int algorithm, int impl, unsigned int seed, const unsigned char* data,
+                      unsigned long length, unsigned int* value);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeChecksum
+ * Signature: (ILjava/nio/ByteBuffer;III)J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeChecksum
+  (JNIEnv *, jobject, jint, jobject, jint, jint, jint);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeChecksumBenchmark
+ * Signature: (Ljava/nio/ByteBuffer;ILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeChecksumBenchmark
+  (JNIEnv *, jobject, jobject, jint, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CHECKSUM_H
@@ -0,0 +1,844 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "doip_transport.h"
+#include "uds_client.h"
+#include "j2534_jni.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static_assert(sizeof(DOIP_VEHICLE) == 40, "DOIP_VEHICLE records are 40 bytes");
+
+// Vehicle identification response: VIN, logical address, EID, GID, further action
+#define DOIP_ANNOUNCEMENT_MIN_LENGTH 32
+// Routing activation response: tester, entity, response code, reserved
+#define DOIP_ACTIVATION_RESPONSE_MIN_LENGTH 9
+
+typedef struct {
+    int in_use;
+    struct sockaddr_in address;
+    unsigned short tester_address;
+} DOIP_DEVICE;
+
+// A FLOW_CONTROL_FILTER maps the ID written by the engines onto a DoIP target
+typedef struct {
+    int in_use;
+    int flow_control;
+    unsigned long tx_id;
+    unsigned short target;
+} DOIP_FILTER;
+
+typedef struct {
+    int in_use;
+    int fd;
+    unsigned long device_id;
+    unsigned short tester_address;
+    unsigned short entity_address;
+    pthread_mutex_t tx_mutex;     // socket writes and filters
+    pthread_mutex_t rx_mutex;     // socket reads and the receive buffer
+    unsigned char* rx_buffer;
+    unsigned long rx_start;
+    unsigned long rx_end;
+    DOIP_FILTER filters[DOIP_MAX_FILTERS];
+} DOIP_CHANNEL;
+
+static pthread_mutex_t g_doip_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DOIP_DEVICE g_doip_devices[DOIP_MAX_DEVICES];
+static DOIP_CHANNEL g_doip_channels[DOIP_MAX_CHANNELS];
+static char g_doip_error[128];
+
+static void set_error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&g_doip_mutex);
+    vsnprintf(g_doip_error, sizeof(g_doip_error), format, args);
+    pthread_mutex_unlock(&g_doip_mutex);
+    va_end(args);
+}
+
+static void put_be16(unsigned char* dst, unsigned int value) {
+    dst[0] = static_cast<unsigned char>(value >> 8);
+    dst[1] = static_cast<unsigned char>(value);
+}
+
+static unsigned int get_be16(const unsigned char* src) {
+    return (static_cast<unsigned int>(src[0]) << 8) | src[1];
+}
+
+static void put_header(unsigned char* dst, unsigned short type, unsigned long length) {
+    dst[0] = DOIP_PROTOCOL_VERSION;
+    dst[1] = static_cast<unsigned char>(~DOIP_PROTOCOL_VERSION);
+    put_be16(dst + 2, type);
+    dst[4] = static_cast<unsigned char>(length >> 24);
+    dst[5] = static_cast<unsigned char>(length >> 16);
+    dst[6] = static_cast<unsigned char>(length >> 8);
+    dst[7] = static_cast<unsigned char>(length);
+}
+
+// Returns 1 for a valid header, 0 if the version pattern is wrong
+static int parse_header(const unsigned char* src, unsigned short* type, unsigned long* length) {
+    if ((src[0] ^ src[1]) != 0xFF) {
+        return 0;
+    }
+    *type = static_cast<unsigned short>(get_be16(src + 2));
+    *length = (static_cast<unsigned long>(src[4]) << 24) | (static_cast<unsigned long>(src[5]) << 16) |
+              (static_cast<unsigned long>(src[6]) << 8) | src[7];
+    return 1;
+}
+
+static DOIP_CHANNEL* channel_for(unsigned long channel_id) {
+    if (channel_id == 0 || channel_id > DOIP_MAX_CHANNELS || !g_doip_channels[channel_id - 1].in_use) {
+        return nullptr;
+    }
+    return &g_doip_channels[channel_id - 1];
+}
+
+// Gathers iov onto the socket, finishing partial sends
+static long send_all(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            set_error("DoIP send failed: %s", strerror(errno));
+            return errno == EPIPE || errno == ECONNRESET ? ERR_DEVICE_NOT_CONNECTED : ERR_FAILED;
+        }
+        while (count > 0 && static_cast<size_t>(sent) >= iov->iov_len) {
+            sent -= static_cast<ssize_t>(iov->iov_len);
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<unsigned char*>(iov->iov_base) + sent;
+            iov->iov_len -= static_cast<size_t>(sent);
+        }
+    }
+    return STATUS_NOERROR;
+}
+
+static long send_message(DOIP_CHANNEL* channel, unsigned short type, const unsigned char* body,
+                         unsigned long length) {
+    unsigned char header[DOIP_HEADER_SIZE];
+    put_header(header, type, length);
+
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = const_cast<unsigned char*>(body);
+    iov[1].iov_len = length;
+
+    pthread_mutex_lock(&channel->tx_mutex);
+    long result = send_all(channel->fd, iov, length > 0 ? 2 : 1);
+    pthread_mutex_unlock(&channel->tx_mutex);
+    return result;
+}
+
+/*
+ * Appends whatever the socket holds to the receive buffer, waiting up to
+ * timeout_ms for it to become readable. One read usually carries several
+ * DoIP messages; they are split by next_message.
+ */
+static long fill_rx(DOIP_CHANNEL* channel, unsigned long timeout_ms) {
+    if (channel->rx_start == channel->rx_end) {
+        channel->rx_start = channel->rx_end = 0;
+    } else if (channel->rx_start > 0 && DOIP_RX_BUFFER_SIZE - channel->rx_end < DOIP_RX_BUFFER_SIZE / 4) {
+        memmove(channel->rx_buffer, channel->rx_buffer + channel->rx_start,
+                channel->rx_end - channel->rx_start);
+        channel->rx_end -= channel->rx_start;
+        channel->rx_start = 0;
+    }
+    if (channel->rx_end == DOIP_RX_BUFFER_SIZE) {
+        return ERR_BUFFER_OVERFLOW;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = channel->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int ready = poll(&pfd, 1, static_cast<int>(timeout_ms));
+    if (ready <= 0) {
+        return ready < 0 && errno != EINTR ? ERR_FAILED : ERR_BUFFER_EMPTY;
+    }
+
+    ssize_t received = recv(channel->fd, channel->rx_buffer + channel->rx_end,
+                            DOIP_RX_BUFFER_SIZE - channel->rx_end, 0);
+    if (received == 0) {
+        set_error("DoIP entity closed the connection");
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+    if (received < 0) {
+        if (errno == EINTR || errno == EAGAIN) {
+            return ERR_BUFFER_EMPTY;
+        }
+        set_error("DoIP receive failed: %s", strerror(errno));
+        return ERR_FAILED;
+    }
+    channel->rx_end += static_cast<unsigned long>(received);
+    return STATUS_NOERROR;
+}
+
+// 1 and the message if one is complete in the buffer, 0 if not yet, -1 on a corrupt stream
+static int next_message(DOIP_CHANNEL* channel, unsigned short* type, const unsigned char** payload,
+                        unsigned long* length) {
+    unsigned long available = channel->rx_end - channel->rx_start;
+    if (available < DOIP_HEADER_SIZE) {
+        return 0;
+    }
+    const unsigned char* header = channel->rx_buffer + channel->rx_start;
+    if (!parse_header(header, type, length) || *length > DOIP_RX_BUFFER_SIZE - DOIP_HEADER_SIZE) {
+        set_error("Corrupt DoIP header");
+        return -1;
+    }
+    if (available < DOIP_HEADER_SIZE + *length) {
+        return 0;
+    }
+    *payload = header + DOIP_HEADER_SIZE;
+    channel->rx_start += DOIP_HEADER_SIZE + *length;
+    return 1;
+}
+
+static long doip_open(void* name, unsigned long* device_id) {
+    if (device_id == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(DOIP_PORT);
+    unsigned short tester_address = DOIP_DEFAULT_TESTER_ADDRESS;
+
+    const char* spec = static_cast<const char*>(name);
+    if (spec == nullptr || spec[0] == '\0') {
+        DOIP_VEHICLE vehicle;
+        unsigned int count = 0;
+        long result = doip_discover(nullptr, DOIP_DISCOVERY_TIMEOUT_MS, &vehicle, 1, &count);
+        if (result != STATUS_NOERROR || count == 0) {
+            set_error("No DoIP entity answered discovery");
+            return ERR_DEVICE_NOT_CONNECTED;
+        }
+        address.sin_addr.s_addr = vehicle.ip_address;
+    } else {
+        char host[64];
+        strncpy(host, spec, sizeof(host) - 1);
+        host[sizeof(host) - 1] = '\0';
+
+        char* tester = strchr(host, '/');
+        if (tester != nullptr) {
+            *tester++ = '\0';
+            tester_address = static_cast<unsigned short>(strtoul(tester, nullptr, 16));
+        }
+        char* port = strchr(host, ':');
+        if (port != nullptr) {
+            *port++ = '\0';
+            address.sin_port = htons(static_cast<unsigned short>(strtoul(port, nullptr, 10)));
+        }
+        if (inet_pton(AF_INET, host, &address.sin_addr) != 1) {
+            set_error("Invalid DoIP address '%s'", spec);
+            return ERR_INVALID_DEVICE_ID;
+        }
+    }
+
+    pthread_mutex_lock(&g_doip_mutex);
+    long result = ERR_DEVICE_IN_USE;
+    for (unsigned int i = 0; i < DOIP_MAX_DEVICES; i++) {
+        if (!g_doip_devices[i].in_use) {
+            g_doip_devices[i].in_use = 1;
+            g_doip_devices[i].address = address;
+            g_doip_devices[i].tester_address = tester_address;
+            *device_id = i + 1;
+            result = STATUS_NOERROR;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_doip_mutex);
+    return result;
+}
+
+static void release_channel(DOIP_CHANNEL* channel) {
+    shutdown(channel->fd, SHUT_RDWR);
+    close(channel->fd);
+    free(channel->rx_buffer);
+    pthread_mutex_destroy(&channel->tx_mutex);
+    pthread_mutex_destroy(&channel->rx_mutex);
+    memset(channel, 0, sizeof(DOIP_CHANNEL));
+}
+
+static long doip_disconnect(unsigned long channel_id) {
+    pthread_mutex_lock(&g_doip_mutex);
+    DOIP_CHANNEL* channel = channel_for(channel_id);
+    if (channel != nullptr) {
+        release_channel(channel);
+    }
+    pthread_mutex_unlock(&g_doip_mutex);
+    return channel != nullptr ? STATUS_NOERROR : ERR_INVALID_CHANNEL_ID;
+}
+
+static long doip_close(unsigned long device_id) {
+    if (device_id == 0 || device_id > DOIP_MAX_DEVICES) {
+        return ERR_INVALID_DEVICE_ID;
+    }
+    pthread_mutex_lock(&g_doip_mutex);
+    long result = ERR_INVALID_DEVICE_ID;
+    if (g_doip_devices[device_id - 1].in_use) {
+        for (unsigned int i = 0; i < DOIP_MAX_CHANNELS; i++) {
+            if (g_doip_channels[i].in_use && g_doip_channels[i].device_id == device_id) {
+                release_channel(&g_doip_channels[i]);
+            }
+        }
+        g_doip_devices[device_id - 1].in_use = 0;
+        result = STATUS_NOERROR;
+    }
+    pthread_mutex_unlock(&g_doip_mutex);
+    return result;
+}
+
+static int connect_socket(const struct sockaddr_in* address) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int result = connect(fd, reinterpret_cast<const struct sockaddr*>(address), sizeof(*address));
+    if (result != 0 && errno == EINPROGRESS) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        int error = ETIMEDOUT;
+        socklen_t error_length = sizeof(error);
+        if (poll(&pfd, 1, DOIP_CONNECT_TIMEOUT_MS) == 1) {
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_length);
+        }
+        errno = error;
+        result = error == 0 ? 0 : -1;
+    }
+    if (result != 0) {
+        set_error("DoIP connect failed: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, flags);
+
+    // Diagnostic messages are small request/response pairs; never hold them back
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static long activate_routing(DOIP_CHANNEL* channel) {
+    unsigned char request[7];
+    memset(request, 0, sizeof(request));
+    put_be16(request, channel->tester_address);
+    request[2] = DOIP_ACTIVATION_DEFAULT;
+
+    long result = send_message(channel, DOIP_ROUTING_ACTIVATION_REQUEST, request, sizeof(request));
+    unsigned long long deadline = uds_now_ms() + DOIP_CONNECT_TIMEOUT_MS;
+    while (result == STATUS_NOERROR) {
+        unsigned short type = 0;
+        const unsigned char* payload = nullptr;
+        unsigned long length = 0;
+        int ready = next_message(channel, &type, &payload, &length);
+        if (ready < 0) {
+            return ERR_FAILED;
+        }
+        if (ready == 0) {
+            unsigned long long now = uds_now_ms();
+            if (now >= deadline) {
+                set_error("No routing activation response");
+                return ERR_TIMEOUT;
+            }
+            result = fill_rx(channel, static_cast<unsigned long>(deadline - now));
+            if (result == ERR_BUFFER_EMPTY) {
+                result = STATUS_NOERROR;
+            }
+            continue;
+        }
+        if (type != DOIP_ROUTING_ACTIVATION_RESPONSE) {
+            continue;
+        }
+        if (length < DOIP_ACTIVATION_RESPONSE_MIN_LENGTH || payload[4] != DOIP_ROUTING_SUCCESS) {
+            set_error("Routing activation denied, code 0x%02X",
+                      length >= DOIP_ACTIVATION_RESPONSE_MIN_LENGTH ? payload[4] : 0);
+            return ERR_FAILED;
+        }
+        channel->entity_address = static_cast<unsigned short>(get_be16(payload + 2));
+        LOGI("DoIP routing active: tester 0x%04X, entity 0x%04X", channel->tester_address,
+             channel->entity_address);
+        return STATUS_NOERROR;
+    }
+    return result;
+}
+
+static long doip_connect(unsigned long device_id, unsigned long protocol_id, unsigned long flags,
+                         unsigned long baudrate, unsigned long* channel_id) {
+    if (channel_id == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (protocol_id != ISO15765) {
+        return ERR_INVALID_PROTOCOL_ID;
+    }
+    if (device_id == 0 || device_id > DOIP_MAX_DEVICES) {
+        return ERR_INVALID_DEVICE_ID;
+    }
+
+    pthread_mutex_lock(&g_doip_mutex);
+    DOIP_DEVICE device = g_doip_devices[device_id - 1];
+    DOIP_CHANNEL* channel = nullptr;
+    for (unsigned int i = 0; device.in_use && i < DOIP_MAX_CHANNELS; i++) {
+        if (!g_doip_channels[i].in_use) {
+            channel = &g_doip_channels[i];
+            channel->in_use = 1;
+            channel->fd = -1;
+            *channel_id = i + 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_doip_mutex);
+    if (!device.in_use) {
+        return ERR_INVALID_DEVICE_ID;
+    }
+    if (channel == nullptr) {
+        return ERR_CHANNEL_IN_USE;
+    }
+
+    channel->device_id = device_id;
+    channel->tester_address = device.tester_address;
+    channel->rx_buffer = static_cast<unsigned char*>(malloc(DOIP_RX_BUFFER_SIZE));
+    pthread_mutex_init(&channel->tx_mutex, nullptr);
+    pthread_mutex_init(&channel->rx_mutex, nullptr);
+    channel->fd = channel->rx_buffer != nullptr ? connect_socket(&device.address) : -1;
+
+    long result = channel->rx_buffer == nullptr ? ERR_INSUFFICIENT_MEMORY
+                : channel->fd < 0 ? ERR_DEVICE_NOT_CONNECTED
+                : activate_routing(channel);
+    if (result != STATUS_NOERROR) {
+        pthread_mutex_lock(&g_doip_mutex);
+        release_channel(channel);
+        pthread_mutex_unlock(&g_doip_mutex);
+    }
+    return result;
+}
+
+static long doip_read_msgs(unsigned long channel_id, void* msgs, unsigned long* num_msgs,
+                           unsigned long timeout) {
+    if (msgs == nullptr || num_msgs == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    DOIP_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+
+    PASSTHRU_MSG* out = static_cast<PASSTHRU_MSG*>(msgs);
+    unsigned long max_msgs = *num_msgs;
+    unsigned long count = 0;
+    unsigned long long deadline = uds_now_ms() + timeout;
+    long result = STATUS_NOERROR;
+
+    pthread_mutex_lock(&channel->rx_mutex);
+    while (count < max_msgs) {
+        unsigned short type = 0;
+        const unsigned char* payload = nullptr;
+        unsigned long length = 0;
+        unsigned long rx_start = channel->rx_start;
+        int ready = next_message(channel, &type, &payload, &length);
+        if (ready < 0) {
+            result = ERR_FAILED;
+            break;
+        }
+        if (ready == 0) {
+            // Once something is ready, only drain what already arrived
+            unsigned long long now = uds_now_ms();
+            unsigned long wait = count == 0 && deadline > now ? static_cast<unsigned long>(deadline - now) : 0;
+            long fill_result = fill_rx(channel, wait);
+            if (fill_result == ERR_BUFFER_EMPTY && wait == 0) {
+                break;
+            }
+            if (fill_result != STATUS_NOERROR && fill_result != ERR_BUFFER_EMPTY) {
+                result = fill_result;
+                break;
+            }
+            continue;
+        }
+
+        if (type == DOIP_DIAGNOSTIC_MESSAGE && length >= DOIP_ADDRESS_SIZE) {
+            unsigned long data_length = length - DOIP_ADDRESS_SIZE;
+            if (UDS_CAN_ID_SIZE + data_length > sizeof(out[count].Data)) {
+                LOGE("DoIP diagnostic message of %lu bytes dropped", data_length);
+                continue;
+            }
+            PASSTHRU_MSG* msg = &out[count++];
+            msg->ProtocolID = ISO15765;
+            msg->RxStatus = 0;
+            msg->TxFlags = 0;
+            msg->Timestamp = static_cast<unsigned long>(uds_now_ms() * 1000ULL);
+            msg->DataSize = UDS_CAN_ID_SIZE + data_length;
+            msg->ExtraDataIndex = msg->DataSize;
+            msg->Data[0] = 0;
+            msg->Data[1] = 0;
+            msg->Data[2] = payload[0];
+            msg->Data[3] = payload[1];
+            memcpy(msg->Data + UDS_CAN_ID_SIZE, payload + DOIP_ADDRESS_SIZE, data_length);
+        } else if (type == DOIP_ALIVE_CHECK_REQUEST) {
+            unsigned char response[2];
+            put_be16(response, channel->tester_address);
+            send_message(channel, DOIP_ALIVE_CHECK_RESPONSE, response, sizeof(response));
+        } else if (type == DOIP_DIAGNOSTIC_NACK || type == DOIP_GENERIC_NACK) {
+            // Hand over what was already decoded; the NACK is reported on the next call
+            if (count > 0) {
+                channel->rx_start = rx_start;
+                break;
+            }
+            unsigned int code = type == DOIP_GENERIC_NACK ? (length >= 1 ? payload[0] : 0)
+                                                          : (length >= 5 ? payload[4] : 0);
+            set_error("DoIP %s NACK, code 0x%02X",
+                      type == DOIP_GENERIC_NACK ? "generic" : "diagnostic", code);
+            LOGE("DoIP %s NACK, code 0x%02X", type == DOIP_GENERIC_NACK ? "generic" : "diagnostic", code);
+            result = ERR_FAILED;
+            break;
+        }
+        // Diagnostic ACKs are not waited for, so requests can be pipelined
+    }
+    pthread_mutex_unlock(&channel->rx_mutex);
+
+    *num_msgs = count;
+    if (count > 0) {
+        return STATUS_NOERROR;
+    }
+    return result != STATUS_NOERROR ? result : ERR_BUFFER_EMPTY;
+}
+
+static unsigned short target_for(const DOIP_CHANNEL* channel, unsigned long tx_id) {
+    for (unsigned int i = 0; i < DOIP_MAX_FILTERS; i++) {
+        const DOIP_FILTER* filter = &channel->filters[i];
+        if (filter->in_use && filter->flow_control && filter->tx_id == tx_id) {
+            return filter->target;
+        }
+    }
+    return static_cast<unsigned short>(tx_id);
+}
+
+static long doip_write_msgs(unsigned long channel_id, void* msgs, unsigned long* num_msgs,
+                            unsigned long timeout) {
+    if (msgs == nullptr || num_msgs == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    DOIP_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+
+    PASSTHRU_MSG* in = static_cast<PASSTHRU_MSG*>(msgs);
+    unsigned long total = *num_msgs;
+    unsigned long sent = 0;
+    long result = STATUS_NOERROR;
+
+    // Headers are built on the stack; payloads go out straight from the caller's messages
+    unsigned char headers[DOIP_WRITE_BATCH][DOIP_HEADER_SIZE + DOIP_ADDRESS_SIZE];
+    struct iovec iov[DOIP_WRITE_BATCH * 2];
+
+    pthread_mutex_lock(&channel->tx_mutex);
+    while (result == STATUS_NOERROR && sent < total) {
+        unsigned long batch = 0;
+        while (batch < DOIP_WRITE_BATCH && sent + batch < total) {
+            const PASSTHRU_MSG* msg = &in[sent + batch];
+            if (msg->DataSize <= UDS_CAN_ID_SIZE || msg->DataSize > sizeof(msg->Data)) {
+                result = ERR_INVALID_MSG;
+                break;
+            }
+            unsigned long data_length = msg->DataSize - UDS_CAN_ID_SIZE;
+            unsigned char* header = headers[batch];
+            put_header(header, DOIP_DIAGNOSTIC_MESSAGE, DOIP_ADDRESS_SIZE + data_length);
+            put_be16(header + DOIP_HEADER_SIZE, channel->tester_address);
+            put_be16(header + DOIP_HEADER_SIZE + 2, target_for(channel, uds_message_can_id(msg)));
+
+            iov[batch * 2].iov_base = header;
+            iov[batch * 2].iov_len = DOIP_HEADER_SIZE + DOIP_ADDRESS_SIZE;
+            iov[batch * 2 + 1].iov_base = const_cast<unsigned char*>(msg->Data + UDS_CAN_ID_SIZE);
+            iov[batch * 2 + 1].iov_len = data_length;
+            batch++;
+        }
+        if (batch == 0) {
+            break;
+        }
+        long send_result = send_all(channel->fd, iov, static_cast<int>(batch * 2));
+        if (send_result != STATUS_NOERROR) {
+            result = send_result;
+            break;
+        }
+        sent += batch;
+    }
+    pthread_mutex_unlock(&channel->tx_mutex);
+
+    *num_msgs = sent;
+    return result;
+}
+
+static long doip_start_msg_filter(unsigned long channel_id, unsigned long filter_type, void* mask,
+                                  void* pattern, void* flow_control, unsigned long* filter_id) {
+    if (filter_id == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    DOIP_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+    if (filter_type == FLOW_CONTROL_FILTER && (pattern == nullptr || flow_control == nullptr)) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    // The entity only routes messages addressed to the tester, so pass and block filters are no-ops
+    pthread_mutex_lock(&channel->tx_mutex);
+    long result = ERR_FAILED;
+    for (unsigned int i = 0; i < DOIP_MAX_FILTERS; i++) {
+        DOIP_FILTER* filter = &channel->filters[i];
+        if (filter->in_use) {
+            continue;
+        }
+        filter->in_use = 1;
+        filter->flow_control = filter_type == FLOW_CONTROL_FILTER;
+        if (filter->flow_control) {
+            filter->tx_id = uds_message_can_id(static_cast<const PASSTHRU_MSG*>(flow_control));
+            filter->target = static_cast<unsigned short>(
+                uds_message_can_id(static_cast<const PASSTHRU_MSG*>(pattern)));
+        }
+        *filter_id = i + 1;
+        result = STATUS_NOERROR;
+        break;
+    }
+    pthread_mutex_unlock(&channel->tx_mutex);
+    return result;
+}
+
+static long doip_stop_msg_filter(unsigned long channel_id, unsigned long filter_id) {
+    DOIP_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+    if (filter_id == 0 || filter_id > DOIP_MAX_FILTERS) {
+        return ERR_INVALID_FILTER_ID;
+    }
+    pthread_mutex_lock(&channel->tx_mutex);
+    long result = channel->filters[filter_id - 1].in_use ? STATUS_NOERROR : ERR_INVALID_FILTER_ID;
+    channel->filters[filter_id - 1].in_use = 0;
+    pthread_mutex_unlock(&channel->tx_mutex);
+    return result;
+}
+
+static long doip_set_programming_voltage(unsigned long device_id, unsigned long pin,
+                                         unsigned long voltage) {
+    return ERR_NOT_SUPPORTED;
+}
+
+static long doip_read_version(unsigned long device_id, char* firmware_version, char* dll_version,
+                              char* api_version) {
+    if (firmware_version == nullptr || dll_version == nullptr || api_version == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    strcpy(firmware_version, "DoIP ISO 13400-2");
+    strcpy(dll_version, "SpaceTec DoIP 1.0");
+    strcpy(api_version, "04.04");
+    return STATUS_NOERROR;
+}
+
+static long doip_get_last_error(char* description) {
+    if (description == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    pthread_mutex_lock(&g_doip_mutex);
+    strcpy(description, g_doip_error);
+    pthread_mutex_unlock(&g_doip_mutex);
+    return STATUS_NOERROR;
+}
+
+static long doip_ioctl(unsigned long channel_id, unsigned long ioctl_id, void* input, void* output) {
+    return ERR_NOT_SUPPORTED;
+}
+
+J2534_LIBRARY* doip_library(void) {
+    static J2534_LIBRARY library = {
+        nullptr,
+        doip_open,
+        doip_close,
+        doip_connect,
+        doip_disconnect,
+        doip_read_msgs,
+        doip_write_msgs,
+        doip_start_msg_filter,
+        doip_stop_msg_filter,
+        doip_set_programming_voltage,
+        doip_read_version,
+        doip_get_last_error,
+        doip_ioctl,
+    };
+    return &library;
+}
+
+long doip_discover(const char* broadcast_address, unsigned int timeout_ms,
+                   DOIP_VEHICLE* vehicles, unsigned int max_vehicles, unsigned int* count) {
+    if (count == nullptr || (vehicles == nullptr && max_vehicles > 0)) {
+        return ERR_NULL_PARAMETER;
+    }
+    *count = 0;
+
+    struct sockaddr_in target;
+    memset(&target, 0, sizeof(target));
+    target.sin_family = AF_INET;
+    target.sin_port = htons(DOIP_PORT);
+    if (inet_pton(AF_INET, broadcast_address != nullptr ? broadcast_address : "255.255.255.255",
+                  &target.sin_addr) != 1) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return ERR_FAILED;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+
+    unsigned char request[DOIP_HEADER_SIZE];
+    put_header(request, DOIP_VEHICLE_ID_REQUEST, 0);
+    if (sendto(fd, request, sizeof(request), 0, reinterpret_cast<struct sockaddr*>(&target),
+               sizeof(target)) != static_cast<ssize_t>(sizeof(request))) {
+        set_error("DoIP discovery send failed: %s", strerror(errno));
+        close(fd);
+        return ERR_FAILED;
+    }
+
+    unsigned long long deadline = uds_now_ms() + timeout_ms;
+    while (*count < max_vehicles) {
+        unsigned long long now = uds_now_ms();
+        if (now >= deadline) {
+            break;
+        }
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, static_cast<int>(deadline - now)) <= 0) {
+            continue;
+        }
+
+        unsigned char datagram[512];
+        struct sockaddr_in source;
+        socklen_t source_length = sizeof(source);
+        ssize_t received = recvfrom(fd, datagram, sizeof(datagram), 0,
+                                    reinterpret_cast<struct sockaddr*>(&source), &source_length);
+        unsigned short type = 0;
+        unsigned long length = 0;
+        if (received < DOIP_HEADER_SIZE || !parse_header(datagram, &type, &length) ||
+            type != DOIP_VEHICLE_ANNOUNCEMENT || length < DOIP_ANNOUNCEMENT_MIN_LENGTH ||
+            DOIP_HEADER_SIZE + length > static_cast<unsigned long>(received)) {
+            continue;
+        }
+
+        const unsigned char* payload = datagram + DOIP_HEADER_SIZE;
+        DOIP_VEHICLE* vehicle = &vehicles[*count];
+        memset(vehicle, 0, sizeof(DOIP_VEHICLE));
+        memcpy(vehicle->vin, payload, 17);
+        vehicle->logical_address = static_cast<unsigned short>(get_be16(payload + 17));
+        memcpy(vehicle->eid, payload + 19, sizeof(vehicle->eid));
+        memcpy(vehicle->gid, payload + 25, sizeof(vehicle->gid));
+        vehicle->further_action = payload[31];
+        vehicle->ip_address = source.sin_addr.s_addr;
+
+        // Entities may answer more than once
+        int duplicate = 0;
+        for (unsigned int i = 0; i < *count; i++) {
+            if (vehicles[i].ip_address == vehicle->ip_address &&
+                vehicles[i].logical_address == vehicle->logical_address) {
+                duplicate = 1;
+            }
+        }
+        if (!duplicate) {
+            (*count)++;
+        }
+    }
+    close(fd);
+    return STATUS_NOERROR;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeDoipLoad
+ * Signature: ()J
+ *
+ * Selects the DoIP backend in place of a J2534 DLL; nativePassThruOpen then
+ * takes the entity address as its device name.
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeDoipLoad
+  (JNIEnv *env, jobject obj) {
+
+    J2534_LIBRARY* lib = doip_library();
+    g_j2534_lib = lib;
+    g_last_error = STATUS_NOERROR;
+    return reinterpret_cast<jlong>(lib);
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeDoipDiscover
+ * Signature: (Ljava/lang/String;ILjava/nio/ByteBuffer;)I
+ *
+ * Fills the buffer with DOIP_VEHICLE records and returns their count.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeDoipDiscover
+  (JNIEnv *env, jobject obj, jstring broadcast_address, jint timeout_ms, jobject out_buffer) {
+
+    DOIP_VEHICLE* vehicles = out_buffer != nullptr
+        ? static_cast<DOIP_VEHICLE*>(env->GetDirectBufferAddress(out_buffer)) : nullptr;
+    if (vehicles == nullptr || timeout_ms < 0) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+    unsigned int max_vehicles = static_cast<unsigned int>(
+        env->GetDirectBufferCapacity(out_buffer) / static_cast<jlong>(sizeof(DOIP_VEHICLE)));
+
+    const char* address = nullptr;
+    if (broadcast_address != nullptr) {
+        address = env->GetStringUTFChars(broadcast_address, nullptr);
+        if (address == nullptr) {
+            g_last_error = ERR_NULL_PARAMETER;
+            return -1;
+        }
+    }
+
+    unsigned int count = 0;
+    long result = doip_discover(address, static_cast<unsigned int>(timeout_ms), vehicles,
+                                max_vehicles, &count);
+    if (address != nullptr) {
+        env->ReleaseStringUTFChars(broadcast_address, address);
+    }
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return static_cast<jint>(count);
+    } else {
+        return -1;
+    }
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef DOIP_TRANSPORT_H
+#define DOIP_TRANSPORT_H
+
+#include <jni.h>
+#include "j2534_native.h"
+
+// ISO 13400-2
+#define DOIP_PORT 13400
+#define DOIP_PROTOCOL_VERSION 0x02
+#define DOIP_HEADER_SIZE 8
+#define DOIP_ADDRESS_SIZE 4       // source and target logical address of a diagnostic message
+
+// Payload types
+#define DOIP_GENERIC_NACK 0x0000
+#define DOIP_VEHICLE_ID_REQUEST 0x0001
+#define DOIP_VEHICLE_ANNOUNCEMENT 0x0004
+#define DOIP_ROUTING_ACTIVATION_REQUEST 0x0005
+#define DOIP_ROUTING_ACTIVATION_RESPONSE 0x0006
+#define DOIP_ALIVE_CHECK_REQUEST 0x0007
+#define DOIP_ALIVE_CHECK_RESPONSE 0x0008
+#define DOIP_DIAGNOSTIC_MESSAGE 0x8001
+#define DOIP_DIAGNOSTIC_ACK 0x8002
+#define DOIP_DIAGNOSTIC_NACK 0x8003
+
+#define DOIP_ROUTING_SUCCESS 0x10
+#define DOIP_ACTIVATION_DEFAULT 0x00
+#define DOIP_DEFAULT_TESTER_ADDRESS 0x0E80
+
+#define DOIP_RX_BUFFER_SIZE (64 * 1024)
+#define DOIP_MAX_DEVICES 4
+#define DOIP_MAX_CHANNELS 8
+#define DOIP_MAX_FILTERS 16
+#define DOIP_WRITE_BATCH 16        // diagnostic messages gathered into one writev
+#define DOIP_CONNECT_TIMEOUT_MS 2000
+#define DOIP_DISCOVERY_TIMEOUT_MS 2000
+
+// One vehicle identification response (native byte order, 40 bytes)
+typedef struct {
+    char vin[18];
+    unsigned short logical_address;
+    unsigned char eid[6];
+    unsigned char gid[6];
+    unsigned char further_action;
+    unsigned char reserved[3];
+    unsigned int ip_address;       // IPv4, network byte order
+} DOIP_VEHICLE;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Broadcasts a vehicle identification request on UDP 13400 and collects the
+ * responses that arrive within timeout_ms.
+ */
+long doip_discover(const char* broadcast_address, unsigned int timeout_ms,
+                   DOIP_VEHICLE* vehicles, unsigned int max_vehicles, unsigned int* count);
+
+/*
+ * PassThru function table backed by DoIP, so every engine written against
+ * J2534_LIBRARY runs over Ethernet unchanged. PassThruOpen takes
+ * "host[:port][/tester]" (hex tester address) or null to use the first vehicle
+ * that answers discovery; PassThruConnect accepts ISO15765 and performs routing
+ * activation. The CAN ID field of a message carries the DoIP logical address:
+ * the target on transmit (or the pattern ID of a FLOW_CONTROL_FILTER whose flow
+ * control ID matches) and the source on receive. The table is static and must
+ * not be passed to unload_j2534_library.
+ */
+J2534_LIBRARY* doip_library(void);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeDoipLoad
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeDoipLoad
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeDoipDiscover
+ * Signature: (Ljava/lang/String;ILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeDoipDiscover
+  (JNIEnv *, jobject, jstring, jint, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DOIP_TRANSPORT_H
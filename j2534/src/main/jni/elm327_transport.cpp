@@ -0,0 +1,1216 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "elm327_transport.h"
+#include "kline_transport.h"
+#include "uds_client.h"
+#include "j2534_jni.h"
+#include <asm/termbits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ELM_PATH_SIZE 64
+#define ELM_CACHE_SIZE 24
+#define ELM_POLL_MS 50
+
+#define ELM_CMD_AT 0          // configuration, answers with text
+#define ELM_CMD_DATA 1        // bus request, answers with frames
+#define ELM_CMD_MONITOR 2     // STMA/ATMA, runs until interrupted
+
+typedef struct {
+    char line[ELM_COMMAND_SIZE];
+    int kind;
+    long result;
+    char reply[ELM_REPLY_SIZE];
+} ELM_COMMAND;
+
+typedef struct {
+    int in_use;
+    unsigned long type;
+    unsigned char mask[UDS_CAN_ID_SIZE];
+    unsigned char pattern[UDS_CAN_ID_SIZE];
+    unsigned char flow_control[UDS_CAN_ID_SIZE];
+} ELM_FILTER;
+
+typedef struct {
+    int active;
+    unsigned int id;
+    unsigned int length;
+    unsigned int received;
+    unsigned char next_sn;
+    unsigned long long timestamp;
+    unsigned char data[ISOTP_MAX_MESSAGE];
+} ELM_RX_SESSION;
+
+typedef struct {
+    int in_use;
+    int fd;
+    char path[ELM_PATH_SIZE];
+    int stn;
+    unsigned int version;             // ELM327 version x10 (v1.5 -> 15)
+    char firmware[ELM_REPLY_SIZE];
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    pthread_t thread;
+    volatile int running;
+    int link_lost;
+    // Command queue: issued > sent > done are running ticket counters
+    ELM_COMMAND commands[ELM_COMMAND_QUEUE];
+    unsigned long long issued;
+    unsigned long long sent;
+    unsigned long long done;
+    int busy;                         // a written command is waiting for its prompt
+    int monitoring;
+    int stopping;                     // a byte was sent to end the monitor
+    // Adapter state already programmed, so repeated commands can be skipped
+    char header[ELM_CACHE_SIZE];
+    char receive_address[ELM_CACHE_SIZE];
+    char flow_header[ELM_CACHE_SIZE];
+    char can_filter[ELM_CACHE_SIZE];
+    // Line assembly straight in the read buffer
+    char rx[ELM_READ_BUFFER];
+    unsigned int rx_length;
+    unsigned long buffer_full_count;
+    // The single channel
+    int connected;
+    unsigned long protocol_id;
+    unsigned long flags;
+    ELM_FILTER filters[ELM_MAX_FILTERS];
+    ELM_RX_SESSION sessions[ELM_RX_SESSIONS];
+    PASSTHRU_MSG* queue;
+    unsigned int queue_head;
+    unsigned int queue_count;
+} ELM_DEVICE;
+
+static pthread_mutex_t g_elm_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_elm_error_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ELM_DEVICE g_elm_devices[ELM_MAX_DEVICES];
+static char g_elm_error[128];
+
+static void set_error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&g_elm_error_mutex);
+    vsnprintf(g_elm_error, sizeof(g_elm_error), format, args);
+    pthread_mutex_unlock(&g_elm_error_mutex);
+    va_end(args);
+}
+
+static ELM_DEVICE* device_for(unsigned long device_id) {
+    if (device_id == 0 || device_id > ELM_MAX_DEVICES || !g_elm_devices[device_id - 1].in_use) {
+        return nullptr;
+    }
+    return &g_elm_devices[device_id - 1];
+}
+
+// One channel per adapter, so channel IDs are device IDs
+static ELM_DEVICE* channel_for(unsigned long channel_id) {
+    ELM_DEVICE* device = device_for(channel_id);
+    return device != nullptr && device->connected ? device : nullptr;
+}
+
+static unsigned long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void wait_until_ms(ELM_DEVICE* device, unsigned long long deadline_ms) {
+    unsigned long long now = uds_now_ms();
+    if (deadline_ms <= now) {
+        return;
+    }
+    unsigned long long wait_ms = deadline_ms - now;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += static_cast<time_t>(wait_ms / 1000);
+    deadline.tv_nsec += static_cast<long>(wait_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&device->changed, &device->mutex, &deadline);
+}
+
+static long write_all(int fd, const char* data, unsigned long length) {
+    unsigned long offset = 0;
+    while (offset < length) {
+        ssize_t written = write(fd, data + offset, length - offset);
+        if (written > 0) {
+            offset += static_cast<unsigned long>(written);
+        } else if (written < 0 && errno == EAGAIN) {
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            poll(&pfd, 1, ELM_COMMAND_TIMEOUT_MS);
+        } else if (written < 0 && errno != EINTR) {
+            set_error("Adapter write failed: %s", strerror(errno));
+            return ERR_FAILED;
+        }
+    }
+    return STATUS_NOERROR;
+}
+
+static long apply_line_settings(int fd, unsigned long baudrate) {
+    struct termios2 tio;
+    if (ioctl(fd, TCGETS2, &tio) != 0) {
+        set_error("TCGETS2 failed: %s", strerror(errno));
+        return ERR_FAILED;
+    }
+    tio.c_iflag = IGNBRK | IGNPAR;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+    tio.c_cflag = CS8 | CREAD | CLOCAL | BOTHER | (BOTHER << IBSHIFT);
+    tio.c_ispeed = static_cast<speed_t>(baudrate);
+    tio.c_ospeed = static_cast<speed_t>(baudrate);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (ioctl(fd, TCSETS2, &tio) != 0) {
+        set_error("Cannot set %lu baud: %s", baudrate, strerror(errno));
+        return ERR_INVALID_BAUDRATE;
+    }
+    return STATUS_NOERROR;
+}
+
+// Writes queued commands while the adapter is idle; called with mutex held
+static void pump(ELM_DEVICE* device) {
+    while (!device->busy && device->sent < device->issued) {
+        if (device->monitoring) {
+            // Any byte ends a monitor; the prompt that follows releases the queue
+            if (!device->stopping && write_all(device->fd, "\r", 1) == STATUS_NOERROR) {
+                device->stopping = 1;
+            }
+            return;
+        }
+        ELM_COMMAND* command = &device->commands[device->sent % ELM_COMMAND_QUEUE];
+        char buffer[ELM_COMMAND_SIZE + 1];
+        unsigned long length = strlen(command->line);
+        memcpy(buffer, command->line, length);
+        buffer[length++] = '\r';
+        device->sent++;
+        command->reply[0] = '\0';
+        command->result = write_all(device->fd, buffer, length);
+        if (command->result != STATUS_NOERROR) {
+            device->done++;
+            continue;
+        }
+        if (command->kind == ELM_CMD_MONITOR) {
+            device->monitoring = 1;
+            device->done++;
+            pthread_cond_broadcast(&device->changed);
+            continue;
+        }
+        device->busy = 1;
+    }
+}
+
+// Queues a command and returns its ticket; called with mutex held
+static long long issue(ELM_DEVICE* device, int kind, const char* format, ...) {
+    if (device->issued - device->done >= ELM_COMMAND_QUEUE) {
+        set_error("Adapter command queue full");
+        return -1;
+    }
+    ELM_COMMAND* command = &device->commands[device->issued % ELM_COMMAND_QUEUE];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(command->line, sizeof(command->line), format, args);
+    va_end(args);
+    command->kind = kind;
+    command->result = STATUS_NOERROR;
+    command->reply[0] = '\0';
+    long long ticket = static_cast<long long>(device->issued++);
+    pump(device);
+    return ticket;
+}
+
+// Waits for a ticket and returns its result; called with mutex held
+static long wait_ticket(ELM_DEVICE* device, long long ticket, unsigned long timeout_ms) {
+    if (ticket < 0) {
+        return ERR_BUFFER_FULL;
+    }
+    unsigned long long deadline = uds_now_ms() + timeout_ms;
+    unsigned long long target = static_cast<unsigned long long>(ticket);
+    while (device->done <= target && !device->link_lost && uds_now_ms() < deadline) {
+        wait_until_ms(device, deadline);
+    }
+    if (device->link_lost) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+    if (device->done <= target) {
+        // Give up on everything outstanding; a late prompt finds the adapter idle
+        set_error("Adapter did not answer '%s'", device->commands[ticket % ELM_COMMAND_QUEUE].line);
+        device->busy = 0;
+        device->sent = device->issued;
+        device->done = device->issued;
+        return ERR_TIMEOUT;
+    }
+    return device->commands[ticket % ELM_COMMAND_QUEUE].result;
+}
+
+// Runs a group of commands back to back and reports the first failure
+static long wait_batch(ELM_DEVICE* device, long long first, long long last, unsigned long timeout_ms) {
+    if (first < 0 || last < 0) {
+        return ERR_BUFFER_FULL;
+    }
+    long result = wait_ticket(device, last, timeout_ms);
+    for (long long ticket = first; ticket < last && result == STATUS_NOERROR; ticket++) {
+        result = device->commands[ticket % ELM_COMMAND_QUEUE].result;
+    }
+    return result;
+}
+
+// Replies live in the same device slot as firmware, so this avoids snprintf's restrict rules
+static void set_firmware(ELM_DEVICE* device, const char* reply) {
+    strncpy(device->firmware, reply, sizeof(device->firmware) - 1);
+    device->firmware[sizeof(device->firmware) - 1] = '\0';
+}
+
+// Issues a configuration command unless the adapter already has that setting
+static void issue_cached(ELM_DEVICE* device, char* cache, const char* line) {
+    if (strcmp(cache, line) != 0) {
+        snprintf(cache, ELM_CACHE_SIZE, "%s", line);
+        issue(device, ELM_CMD_AT, "%s", line);
+    }
+}
+
+static void clear_caches(ELM_DEVICE* device) {
+    device->header[0] = '\0';
+    device->receive_address[0] = '\0';
+    device->flow_header[0] = '\0';
+    device->can_filter[0] = '\0';
+}
+
+static int is_29bit(const ELM_DEVICE* device) {
+    return (device->flags & CAN_29BIT_ID) != 0;
+}
+
+static void format_id(const ELM_DEVICE* device, unsigned int id, char* out, unsigned long size) {
+    if (is_29bit(device)) {
+        snprintf(out, size, "%08X", id & 0x1FFFFFFF);
+    } else {
+        snprintf(out, size, "%03X", id & 0x7FF);
+    }
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// Parses "7E8 06 41 00 ..." (spaces optional) where it sits in the read buffer
+static int parse_frame(const char* text, unsigned int length, unsigned int header_digits,
+                       unsigned int* id, unsigned char* data, unsigned int max) {
+    unsigned int digits = 0;
+    unsigned int count = 0;
+    unsigned int value = 0;
+    *id = 0;
+    for (unsigned int i = 0; i < length; i++) {
+        if (text[i] == ' ') {
+            continue;
+        }
+        int nibble = hex_value(text[i]);
+        if (nibble < 0) {
+            return -1;
+        }
+        if (digits < header_digits) {
+            *id = (*id << 4) | static_cast<unsigned int>(nibble);
+        } else if (((digits - header_digits) & 1) == 0) {
+            value = static_cast<unsigned int>(nibble);
+        } else {
+            if (count == max) {
+                return -1;
+            }
+            data[count++] = static_cast<unsigned char>((value << 4) | static_cast<unsigned int>(nibble));
+        }
+        digits++;
+    }
+    if (digits <= header_digits || ((digits - header_digits) & 1) != 0) {
+        return -1;
+    }
+    return static_cast<int>(count);
+}
+
+static int id_matches(const unsigned char* id, const unsigned char* mask, const unsigned char* pattern) {
+    for (int i = 0; i < UDS_CAN_ID_SIZE; i++) {
+        if ((id[i] & mask[i]) != (pattern[i] & mask[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int passes_filters(const ELM_DEVICE* device, const unsigned char* id) {
+    int passed = 0;
+    for (unsigned int i = 0; i < ELM_MAX_FILTERS; i++) {
+        const ELM_FILTER* filter = &device->filters[i];
+        if (!filter->in_use || !id_matches(id, filter->mask, filter->pattern)) {
+            continue;
+        }
+        if (filter->type == BLOCK_FILTER) {
+            return 0;
+        }
+        passed = 1;
+    }
+    return passed;
+}
+
+static void put_id(unsigned char* out, unsigned int id) {
+    out[0] = static_cast<unsigned char>(id >> 24);
+    out[1] = static_cast<unsigned char>(id >> 16);
+    out[2] = static_cast<unsigned char>(id >> 8);
+    out[3] = static_cast<unsigned char>(id);
+}
+
+// Called with mutex held
+static void enqueue(ELM_DEVICE* device, unsigned int id, const unsigned char* data, unsigned long length,
+                    unsigned long long timestamp) {
+    if (device->queue_count == ELM_RX_QUEUE) {
+        LOGE("ELM327 receive queue full, message dropped");
+        return;
+    }
+    PASSTHRU_MSG* msg = &device->queue[(device->queue_head + device->queue_count) % ELM_RX_QUEUE];
+    memset(msg, 0, offsetof(PASSTHRU_MSG, Data));
+    msg->ProtocolID = device->protocol_id;
+    msg->RxStatus = is_29bit(device) ? CAN_29BIT_ID : 0;
+    msg->Timestamp = static_cast<unsigned long>(timestamp);
+    msg->DataSize = UDS_CAN_ID_SIZE + length;
+    msg->ExtraDataIndex = msg->DataSize;
+    put_id(msg->Data, id);
+    memcpy(msg->Data + UDS_CAN_ID_SIZE, data, length);
+    device->queue_count++;
+    pthread_cond_broadcast(&device->changed);
+}
+
+static ELM_RX_SESSION* session_for(ELM_DEVICE* device, unsigned int id, int create) {
+    ELM_RX_SESSION* free_session = nullptr;
+    for (unsigned int i = 0; i < ELM_RX_SESSIONS; i++) {
+        ELM_RX_SESSION* session = &device->sessions[i];
+        if (session->active && session->id == id) {
+            return session;
+        }
+        if (!session->active && free_session == nullptr) {
+            free_session = session;
+        }
+    }
+    if (!create) {
+        return nullptr;
+    }
+    return free_session != nullptr ? free_session : &device->sessions[0];
+}
+
+// The adapter handles flow control; only the frames it prints are reassembled here
+static void deliver_iso15765(ELM_DEVICE* device, unsigned int id, const unsigned char* data,
+                             unsigned int length, unsigned long long timestamp) {
+    if (length == 0) {
+        return;
+    }
+    unsigned char type = data[0] >> 4;
+    if (type == 0) {
+        unsigned int size = data[0] & 0x0F;
+        if (size > 0 && size < length) {
+            enqueue(device, id, data + 1, size, timestamp);
+        }
+    } else if (type == 1 && length >= 2) {
+        ELM_RX_SESSION* session = session_for(device, id, 1);
+        session->active = 1;
+        session->id = id;
+        session->length = ((data[0] & 0x0F) << 8) | data[1];
+        session->received = length - 2 < session->length ? length - 2 : session->length;
+        session->next_sn = 1;
+        session->timestamp = timestamp;
+        memcpy(session->data, data + 2, session->received);
+    } else if (type == 2) {
+        ELM_RX_SESSION* session = session_for(device, id, 0);
+        if (session == nullptr) {
+            return;
+        }
+        if ((data[0] & 0x0F) != session->next_sn) {
+            LOGE("ELM327 consecutive frame out of sequence from 0x%X", id);
+            session->active = 0;
+            return;
+        }
+        session->next_sn = (session->next_sn + 1) & 0x0F;
+        unsigned int chunk = length - 1;
+        if (chunk > session->length - session->received) {
+            chunk = session->length - session->received;
+        }
+        memcpy(session->data + session->received, data + 1, chunk);
+        session->received += chunk;
+        if (session->received == session->length) {
+            enqueue(device, id, session->data, session->length, session->timestamp);
+            session->active = 0;
+        }
+    }
+}
+
+static void current_result(ELM_DEVICE* device, long result) {
+    if (device->busy) {
+        ELM_COMMAND* command = &device->commands[(device->sent - 1) % ELM_COMMAND_QUEUE];
+        if (command->result == STATUS_NOERROR) {
+            command->result = result;
+        }
+    }
+}
+
+// One complete line, parsed where it lies in the read buffer; mutex held
+static void process_line(ELM_DEVICE* device, const char* text, unsigned int length,
+                         unsigned long long timestamp) {
+    while (length > 0 && text[length - 1] == ' ') {
+        length--;
+    }
+    if (length == 0) {
+        return;
+    }
+    ELM_COMMAND* command = device->busy ? &device->commands[(device->sent - 1) % ELM_COMMAND_QUEUE] : nullptr;
+    if (command != nullptr && strlen(command->line) == length && memcmp(command->line, text, length) == 0) {
+        return;   // echo, until ATE0 takes effect
+    }
+
+    if (device->connected && (device->monitoring || (command != nullptr && command->kind == ELM_CMD_DATA))) {
+        unsigned char data[64];
+        unsigned int id;
+        int count = parse_frame(text, length, is_29bit(device) ? 8 : 3, &id, data, sizeof(data));
+        if (count >= 0) {
+            unsigned char raw_id[UDS_CAN_ID_SIZE];
+            put_id(raw_id, id);
+            if (passes_filters(device, raw_id)) {
+                if (device->protocol_id == ISO15765) {
+                    deliver_iso15765(device, id, data, static_cast<unsigned int>(count), timestamp);
+                } else {
+                    enqueue(device, id, data, static_cast<unsigned long>(count), timestamp);
+                }
+            }
+            return;
+        }
+    }
+
+    if (length == 1 && text[0] == '?') {
+        current_result(device, ERR_NOT_SUPPORTED);
+    } else if (length == 11 && memcmp(text, "BUFFER FULL", 11) == 0) {
+        device->buffer_full_count++;
+        LOGE("ELM327 buffer full, frames lost");
+    } else if ((length >= 5 && memcmp(text, "ERROR", 5) == 0) ||
+               (length >= 9 && memcmp(text + length - 9, "BUS ERROR", 9) == 0) ||
+               (length >= 9 && memcmp(text, "CAN ERROR", 9) == 0) ||
+               (length >= 6 && memcmp(text, "UNABLE", 6) == 0)) {
+        current_result(device, ERR_FAILED);
+        set_error("Adapter: %.*s", static_cast<int>(length), text);
+    }
+    if (command != nullptr) {
+        unsigned long used = strlen(command->reply);
+        if (used + length + 2 < ELM_REPLY_SIZE) {
+            if (used > 0) {
+                command->reply[used++] = '\n';
+            }
+            memcpy(command->reply + used, text, length);
+            command->reply[used + length] = '\0';
+        }
+    }
+}
+
+static void process_prompt(ELM_DEVICE* device) {
+    if (device->stopping) {
+        device->stopping = 0;
+        device->monitoring = 0;
+    } else if (device->busy) {
+        device->busy = 0;
+        device->done++;
+    } else {
+        return;
+    }
+    pthread_cond_broadcast(&device->changed);
+    pump(device);
+}
+
+static void* elm_rx_thread(void* arg) {
+    ELM_DEVICE* device = static_cast<ELM_DEVICE*>(arg);
+
+    while (device->running) {
+        struct pollfd pfd = { device->fd, POLLIN, 0 };
+        if (poll(&pfd, 1, ELM_POLL_MS) <= 0) {
+            continue;
+        }
+        pthread_mutex_lock(&device->mutex);
+        ssize_t count = read(device->fd, device->rx + device->rx_length, ELM_READ_BUFFER - device->rx_length);
+        if (count <= 0) {
+            if (count == 0 || (errno != EAGAIN && errno != EINTR)) {
+                LOGE("ELM327 link lost: %s", count == 0 ? "hangup" : strerror(errno));
+                device->link_lost = 1;
+                pthread_cond_broadcast(&device->changed);
+                pthread_mutex_unlock(&device->mutex);
+                break;
+            }
+            pthread_mutex_unlock(&device->mutex);
+            continue;
+        }
+        unsigned long long timestamp = now_us();
+        unsigned int end = device->rx_length + static_cast<unsigned int>(count);
+        unsigned int start = 0;
+        for (unsigned int i = device->rx_length; i < end; i++) {
+            char c = device->rx[i];
+            if (c == '\r' || c == '\n' || c == '>') {
+                process_line(device, device->rx + start, i - start, timestamp);
+                start = i + 1;
+                if (c == '>') {
+                    process_prompt(device);
+                }
+            } else if (c == '\0' || (i == start && c == ' ')) {
+                start = i + 1;   // NUL fill and indentation
+            }
+        }
+        // Keep the partial line; a line that fills the buffer is garbage
+        device->rx_length = end - start;
+        if (device->rx_length == ELM_READ_BUFFER) {
+            device->rx_length = 0;
+        }
+        memmove(device->rx, device->rx + start, device->rx_length);
+        pthread_mutex_unlock(&device->mutex);
+    }
+    return nullptr;
+}
+
+static long elm_open(void* name, unsigned long* device_id) {
+    if (device_id == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    const char* spec = name != nullptr && static_cast<const char*>(name)[0] != '\0'
+        ? static_cast<const char*>(name) : ELM_DEFAULT_DEVICE;
+    char path[ELM_PATH_SIZE];
+    if (strlen(spec) >= sizeof(path)) {
+        set_error("Invalid adapter device '%s'", spec);
+        return ERR_INVALID_DEVICE_ID;
+    }
+    strcpy(path, spec);
+    unsigned long baudrate = ELM_DEFAULT_BAUDRATE;
+    char* option = strchr(path, ',');
+    if (option != nullptr) {
+        *option++ = '\0';
+        baudrate = strtoul(option, nullptr, 10);
+    }
+
+    pthread_mutex_lock(&g_elm_mutex);
+    ELM_DEVICE* device = nullptr;
+    unsigned int index = 0;
+    for (; index < ELM_MAX_DEVICES; index++) {
+        if (!g_elm_devices[index].in_use) {
+            device = &g_elm_devices[index];
+            break;
+        }
+    }
+    if (device == nullptr) {
+        pthread_mutex_unlock(&g_elm_mutex);
+        return ERR_DEVICE_IN_USE;
+    }
+    memset(device, 0, sizeof(ELM_DEVICE));
+    device->fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (device->fd < 0) {
+        set_error("Cannot open %s: %s", path, strerror(errno));
+        pthread_mutex_unlock(&g_elm_mutex);
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+    long result = apply_line_settings(device->fd, baudrate);
+    if (result != STATUS_NOERROR) {
+        close(device->fd);
+        pthread_mutex_unlock(&g_elm_mutex);
+        return result;
+    }
+    ioctl(device->fd, TCFLSH, TCIOFLUSH);
+    strcpy(device->path, path);
+    pthread_mutex_init(&device->mutex, nullptr);
+    pthread_cond_init(&device->changed, nullptr);
+    device->running = 1;
+    if (pthread_create(&device->thread, nullptr, elm_rx_thread, device) != 0) {
+        close(device->fd);
+        pthread_mutex_unlock(&g_elm_mutex);
+        return ERR_FAILED;
+    }
+    device->in_use = 1;
+
+    pthread_mutex_lock(&device->mutex);
+    result = wait_ticket(device, issue(device, ELM_CMD_AT, "ATZ"), ELM_RESET_TIMEOUT_MS);
+    if (result == STATUS_NOERROR) {
+        // Queued together: the reader thread sends each as soon as the previous prompt arrives
+        long long first = issue(device, ELM_CMD_AT, "ATE0");
+        issue(device, ELM_CMD_AT, "ATL0");
+        issue(device, ELM_CMD_AT, "ATS0");
+        issue(device, ELM_CMD_AT, "ATH1");
+        long long info = issue(device, ELM_CMD_AT, "ATI");
+        result = wait_batch(device, first, info, ELM_COMMAND_TIMEOUT_MS);
+        if (result == STATUS_NOERROR) {
+            const char* reply = device->commands[info % ELM_COMMAND_QUEUE].reply;
+            const char* v = strstr(reply, " v");
+            if (v != nullptr) {
+                device->version = static_cast<unsigned int>(atoi(v + 2) * 10 + (v[3] == '.' ? atoi(v + 4) % 10 : 0));
+            }
+            set_firmware(device, reply);
+            // ELM327 answers '?' to ST commands
+            long long sti = issue(device, ELM_CMD_AT, "STI");
+            if (wait_ticket(device, sti, ELM_COMMAND_TIMEOUT_MS) == STATUS_NOERROR &&
+                strncmp(device->commands[sti % ELM_COMMAND_QUEUE].reply, "STN", 3) == 0) {
+                device->stn = 1;
+                set_firmware(device, device->commands[sti % ELM_COMMAND_QUEUE].reply);
+            }
+        }
+    }
+    pthread_mutex_unlock(&device->mutex);
+
+    if (result != STATUS_NOERROR) {
+        device->running = 0;
+        pthread_join(device->thread, nullptr);
+        close(device->fd);
+        pthread_cond_destroy(&device->changed);
+        pthread_mutex_destroy(&device->mutex);
+        device->in_use = 0;
+        pthread_mutex_unlock(&g_elm_mutex);
+        return result == ERR_TIMEOUT ? ERR_DEVICE_NOT_CONNECTED : result;
+    }
+    LOGI("ELM327 adapter on %s: %s", path, device->firmware);
+    *device_id = index + 1;
+    pthread_mutex_unlock(&g_elm_mutex);
+    return STATUS_NOERROR;
+}
+
+static void release_channel(ELM_DEVICE* device) {
+    pthread_mutex_lock(&device->mutex);
+    if (device->monitoring) {
+        // Leave the adapter at a prompt for the next connect
+        wait_ticket(device, issue(device, ELM_CMD_AT, "ATCAF1"), ELM_COMMAND_TIMEOUT_MS);
+    }
+    device->connected = 0;
+    free(device->queue);
+    device->queue = nullptr;
+    device->queue_count = 0;
+    memset(device->filters, 0, sizeof(device->filters));
+    memset(device->sessions, 0, sizeof(device->sessions));
+    clear_caches(device);
+    pthread_mutex_unlock(&device->mutex);
+}
+
+static long elm_close(unsigned long device_id) {
+    pthread_mutex_lock(&g_elm_mutex);
+    ELM_DEVICE* device = device_for(device_id);
+    if (device == nullptr) {
+        pthread_mutex_unlock(&g_elm_mutex);
+        return ERR_INVALID_DEVICE_ID;
+    }
+    if (device->connected) {
+        release_channel(device);
+    }
+    device->running = 0;
+    pthread_join(device->thread, nullptr);
+    close(device->fd);
+    pthread_cond_destroy(&device->changed);
+    pthread_mutex_destroy(&device->mutex);
+    device->in_use = 0;
+    pthread_mutex_unlock(&g_elm_mutex);
+    return STATUS_NOERROR;
+}
+
+static long elm_connect(unsigned long device_id, unsigned long protocol_id, unsigned long flags,
+                        unsigned long baudrate, unsigned long* channel_id) {
+    if (channel_id == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (protocol_id != ISO15765 && protocol_id != CAN) {
+        return ERR_INVALID_PROTOCOL_ID;
+    }
+    // ATSP6..9: 11/29-bit at 500k/250k
+    int extended = (flags & CAN_29BIT_ID) != 0;
+    int protocol;
+    if (baudrate == 500000) {
+        protocol = extended ? 7 : 6;
+    } else if (baudrate == 250000) {
+        protocol = extended ? 9 : 8;
+    } else {
+        return ERR_INVALID_BAUDRATE;
+    }
+
+    pthread_mutex_lock(&g_elm_mutex);
+    ELM_DEVICE* device = device_for(device_id);
+    if (device == nullptr) {
+        pthread_mutex_unlock(&g_elm_mutex);
+        return ERR_INVALID_DEVICE_ID;
+    }
+    if (device->connected) {
+        pthread_mutex_unlock(&g_elm_mutex);
+        return ERR_CHANNEL_IN_USE;
+    }
+    PASSTHRU_MSG* queue = static_cast<PASSTHRU_MSG*>(malloc(ELM_RX_QUEUE * sizeof(PASSTHRU_MSG)));
+    if (queue == nullptr) {
+        pthread_mutex_unlock(&g_elm_mutex);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+
+    pthread_mutex_lock(&device->mutex);
+    clear_caches(device);
+    int iso15765 = protocol_id == ISO15765;
+    long long first = issue(device, ELM_CMD_AT, "ATSP%d", protocol);
+    issue(device, ELM_CMD_AT, iso15765 ? "ATCAF1" : "ATCAF0");
+    // Raw CAN writes must not wait for answers; monitoring shows them anyway
+    issue(device, ELM_CMD_AT, iso15765 ? "ATR1" : "ATR0");
+    long long last = issue(device, ELM_CMD_AT, "ATAR");
+    long result = wait_batch(device, first, last, ELM_COMMAND_TIMEOUT_MS);
+    if (result == STATUS_NOERROR) {
+        strcpy(device->receive_address, "ATAR");
+        device->protocol_id = protocol_id;
+        device->flags = flags;
+        device->queue = queue;
+        device->queue_head = 0;
+        device->queue_count = 0;
+        device->connected = 1;
+        *channel_id = device_id;
+    }
+    pthread_mutex_unlock(&device->mutex);
+    pthread_mutex_unlock(&g_elm_mutex);
+    if (result != STATUS_NOERROR) {
+        free(queue);
+    }
+    return result;
+}
+
+static long elm_disconnect(unsigned long channel_id) {
+    pthread_mutex_lock(&g_elm_mutex);
+    ELM_DEVICE* device = channel_for(channel_id);
+    if (device != nullptr) {
+        release_channel(device);
+    }
+    pthread_mutex_unlock(&g_elm_mutex);
+    return device != nullptr ? STATUS_NOERROR : ERR_INVALID_CHANNEL_ID;
+}
+
+static long elm_read_msgs(unsigned long channel_id, void* msgs, unsigned long* num_msgs,
+                          unsigned long timeout) {
+    if (msgs == nullptr || num_msgs == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    ELM_DEVICE* device = channel_for(channel_id);
+    if (device == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+
+    PASSTHRU_MSG* out = static_cast<PASSTHRU_MSG*>(msgs);
+    unsigned long max_msgs = *num_msgs;
+    unsigned long count = 0;
+    unsigned long long deadline = uds_now_ms() + timeout;
+
+    pthread_mutex_lock(&device->mutex);
+    while (device->queue_count == 0 && !device->link_lost && uds_now_ms() < deadline) {
+        wait_until_ms(device, deadline);
+    }
+    while (count < max_msgs && device->queue_count > 0) {
+        const PASSTHRU_MSG* msg = &device->queue[device->queue_head];
+        memcpy(&out[count++], msg, offsetof(PASSTHRU_MSG, Data) + msg->DataSize);
+        device->queue_head = (device->queue_head + 1) % ELM_RX_QUEUE;
+        device->queue_count--;
+    }
+    int lost = device->link_lost;
+    pthread_mutex_unlock(&device->mutex);
+
+    *num_msgs = count;
+    if (count > 0) {
+        return STATUS_NOERROR;
+    }
+    return lost ? ERR_DEVICE_NOT_CONNECTED : ERR_BUFFER_EMPTY;
+}
+
+static int is_functional(const ELM_DEVICE* device, unsigned int id) {
+    return is_29bit(device) ? (id & 0x1FFF00FF) == 0x18DB00F1 : id == 0x7DF;
+}
+
+static const ELM_FILTER* flow_filter_for(const ELM_DEVICE* device, const unsigned char* tx_id) {
+    for (unsigned int i = 0; i < ELM_MAX_FILTERS; i++) {
+        const ELM_FILTER* filter = &device->filters[i];
+        if (filter->in_use && filter->type == FLOW_CONTROL_FILTER &&
+            memcmp(filter->flow_control, tx_id, UDS_CAN_ID_SIZE) == 0) {
+            return filter;
+        }
+    }
+    return nullptr;
+}
+
+static unsigned int get_id(const unsigned char* data) {
+    return (static_cast<unsigned int>(data[0]) << 24) | (static_cast<unsigned int>(data[1]) << 16) |
+           (static_cast<unsigned int>(data[2]) << 8) | data[3];
+}
+
+// Programs addressing for one request; only changed settings reach the adapter
+static void issue_addressing(ELM_DEVICE* device, const unsigned char* tx_id) {
+    unsigned int id = get_id(tx_id);
+    char line[ELM_CACHE_SIZE];
+    char text[12];
+
+    if (device->protocol_id == ISO15765) {
+        const ELM_FILTER* filter = is_functional(device, id) ? nullptr : flow_filter_for(device, tx_id);
+        if (filter != nullptr) {
+            format_id(device, get_id(filter->pattern), text, sizeof(text));
+            snprintf(line, sizeof(line), "ATCRA%s", text);
+            issue_cached(device, device->receive_address, line);
+            format_id(device, id, text, sizeof(text));
+            snprintf(line, sizeof(line), "ATFCSH%s", text);
+            if (strcmp(device->flow_header, line) != 0) {
+                issue_cached(device, device->flow_header, line);
+                issue(device, ELM_CMD_AT, "ATFCSD300000");
+                issue(device, ELM_CMD_AT, "ATFCSM1");
+            }
+        } else {
+            issue_cached(device, device->receive_address, "ATAR");
+        }
+        if (device->stn) {
+            return;   // STPX carries the header
+        }
+    }
+
+    if (is_29bit(device)) {
+        snprintf(line, sizeof(line), "ATCP%02X", (id >> 24) & 0x1F);
+        if (strncmp(device->header, line, 6) != 0) {
+            issue(device, ELM_CMD_AT, "%s", line);
+            device->header[0] = '\0';
+        }
+        snprintf(line, sizeof(line), "ATCP%02XATSH%06X", (id >> 24) & 0x1F, id & 0xFFFFFF);
+        if (strcmp(device->header, line) != 0) {
+            issue(device, ELM_CMD_AT, "ATSH%06X", id & 0xFFFFFF);
+            snprintf(device->header, ELM_CACHE_SIZE, "%s", line);
+        }
+    } else {
+        snprintf(line, sizeof(line), "ATSH%03X", id & 0x7FF);
+        issue_cached(device, device->header, line);
+    }
+}
+
+static void append_hex(char* out, const unsigned char* data, unsigned long length) {
+    static const char digits[] = "0123456789ABCDEF";
+    for (unsigned long i = 0; i < length; i++) {
+        *out++ = digits[data[i] >> 4];
+        *out++ = digits[data[i] & 0x0F];
+    }
+    *out = '\0';
+}
+
+// Queues the commands for one message and returns the ticket of its data line
+static long long queue_message(ELM_DEVICE* device, const PASSTHRU_MSG* msg) {
+    const unsigned char* payload = msg->Data + UDS_CAN_ID_SIZE;
+    unsigned long length = msg->DataSize - UDS_CAN_ID_SIZE;
+    unsigned int id = get_id(msg->Data);
+    char hex[ELM_STN_MAX_PAYLOAD * 2 + 1];
+    append_hex(hex, payload, length);
+
+    issue_addressing(device, msg->Data);
+    if (device->protocol_id == CAN) {
+        long long ticket = issue(device, ELM_CMD_AT, "%s", hex);
+        if (ticket >= 0 && device->can_filter[0] != '\0') {
+            issue(device, ELM_CMD_MONITOR, device->stn ? "STMA" : "ATMA");
+        }
+        return ticket;
+    }
+    // One physical response is expected; a functional request listens until the adapter times out
+    int single = !is_functional(device, id);
+    if (device->stn) {
+        char header[12];
+        format_id(device, id, header, sizeof(header));
+        return issue(device, ELM_CMD_DATA, single ? "STPX h:%s, d:%s, r:1" : "STPX h:%s, d:%s",
+                     header, hex);
+    }
+    return issue(device, ELM_CMD_DATA, single && device->version >= 13 ? "%s 1" : "%s", hex);
+}
+
+static long elm_write_msgs(unsigned long channel_id, void* msgs, unsigned long* num_msgs,
+                           unsigned long timeout) {
+    if (msgs == nullptr || num_msgs == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    ELM_DEVICE* device = channel_for(channel_id);
+    if (device == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+
+    const PASSTHRU_MSG* in = static_cast<const PASSTHRU_MSG*>(msgs);
+    unsigned long total = *num_msgs;
+    unsigned long queued = 0;
+    long result = STATUS_NOERROR;
+    long long first = -1;
+    long long last = -1;
+
+    pthread_mutex_lock(&device->mutex);
+    // Everything is queued up front so requests go out back to back at each prompt
+    for (; queued < total; queued++) {
+        const PASSTHRU_MSG* msg = &in[queued];
+        unsigned long limit = device->protocol_id == CAN ? 8 : device->stn ? ELM_STN_MAX_PAYLOAD : ELM_SF_MAX;
+        if (msg->ProtocolID != device->protocol_id) {
+            result = ERR_MSG_PROTOCOL_ID;
+            break;
+        }
+        if (msg->DataSize <= UDS_CAN_ID_SIZE || msg->DataSize - UDS_CAN_ID_SIZE > limit) {
+            set_error("%lu data bytes exceed what the adapter can send", msg->DataSize - UDS_CAN_ID_SIZE);
+            result = ERR_INVALID_MSG;
+            break;
+        }
+        // Room for addressing, data and a monitor restart
+        if (device->issued - device->done + 7 > ELM_COMMAND_QUEUE) {
+            result = ERR_BUFFER_FULL;
+            break;
+        }
+        long long ticket = queue_message(device, msg);
+        if (first < 0) {
+            first = ticket;
+        }
+        last = ticket;
+    }
+    if (last >= 0 && timeout > 0) {
+        long waited = wait_batch(device, first, last, timeout);
+        if (result == STATUS_NOERROR) {
+            result = waited;
+        }
+    }
+    pthread_mutex_unlock(&device->mutex);
+
+    *num_msgs = queued;
+    return result;
+}
+
+// CAN channels capture with monitor-all; the adapter filter narrows it when one pass filter is set
+static void program_monitor(ELM_DEVICE* device) {
+    const ELM_FILTER* pass = nullptr;
+    unsigned int passes = 0;
+    for (unsigned int i = 0; i < ELM_MAX_FILTERS; i++) {
+        if (device->filters[i].in_use && device->filters[i].type == PASS_FILTER) {
+            pass = &device->filters[i];
+            passes++;
+        }
+    }
+    char line[ELM_CACHE_SIZE];
+    char text[12];
+    if (passes == 0) {
+        if (device->monitoring) {
+            issue(device, ELM_CMD_AT, "ATCAF0");
+        }
+        device->can_filter[0] = '\0';
+        return;
+    }
+    if (passes == 1) {
+        format_id(device, get_id(pass->pattern), text, sizeof(text));
+        snprintf(line, sizeof(line), "ATCF%s", text);
+        format_id(device, get_id(pass->mask), text, sizeof(text));
+    } else {
+        format_id(device, 0, text, sizeof(text));
+        snprintf(line, sizeof(line), "ATCF%s", text);
+    }
+    if (strcmp(device->can_filter, line) != 0) {
+        issue(device, ELM_CMD_AT, "%s", line);
+        issue(device, ELM_CMD_AT, "ATCM%s", text);
+        snprintf(device->can_filter, ELM_CACHE_SIZE, "%s", line);
+    }
+    if (!device->monitoring || device->sent < device->issued) {
+        issue(device, ELM_CMD_MONITOR, device->stn ? "STMA" : "ATMA");
+    }
+}
+
+static long elm_start_msg_filter(unsigned long channel_id, unsigned long filter_type, void* mask,
+                                 void* pattern, void* flow_control, unsigned long* filter_id) {
+    if (filter_id == nullptr || mask == nullptr || pattern == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    ELM_DEVICE* device = channel_for(channel_id);
+    if (device == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+    const PASSTHRU_MSG* mask_msg = static_cast<const PASSTHRU_MSG*>(mask);
+    const PASSTHRU_MSG* pattern_msg = static_cast<const PASSTHRU_MSG*>(pattern);
+    const PASSTHRU_MSG* flow_msg = static_cast<const PASSTHRU_MSG*>(flow_control);
+    if (filter_type != PASS_FILTER && filter_type != BLOCK_FILTER && filter_type != FLOW_CONTROL_FILTER) {
+        return ERR_INVALID_MSG;
+    }
+    if ((filter_type == FLOW_CONTROL_FILTER) != (device->protocol_id == ISO15765 && flow_msg != nullptr)) {
+        return filter_type == FLOW_CONTROL_FILTER ? ERR_INVALID_MSG : ERR_NULL_PARAMETER;
+    }
+    if (mask_msg->DataSize < UDS_CAN_ID_SIZE || pattern_msg->DataSize < UDS_CAN_ID_SIZE ||
+        (flow_msg != nullptr && flow_msg->DataSize < UDS_CAN_ID_SIZE)) {
+        return ERR_INVALID_MSG;
+    }
+
+    pthread_mutex_lock(&device->mutex);
+    long result = ERR_FAILED;
+    for (unsigned int i = 0; i < ELM_MAX_FILTERS; i++) {
+        ELM_FILTER* filter = &device->filters[i];
+        if (filter->in_use) {
+            continue;
+        }
+        filter->in_use = 1;
+        filter->type = filter_type;
+        memcpy(filter->mask, mask_msg->Data, UDS_CAN_ID_SIZE);
+        memcpy(filter->pattern, pattern_msg->Data, UDS_CAN_ID_SIZE);
+        if (flow_msg != nullptr) {
+            memcpy(filter->flow_control, flow_msg->Data, UDS_CAN_ID_SIZE);
+        }
+        *filter_id = i + 1;
+        result = STATUS_NOERROR;
+        break;
+    }
+    if (result == STATUS_NOERROR && device->protocol_id == CAN) {
+        long long first = static_cast<long long>(device->issued);
+        program_monitor(device);
+        if (static_cast<long long>(device->issued) > first) {
+            result = wait_batch(device, first, static_cast<long long>(device->issued) - 1, ELM_COMMAND_TIMEOUT_MS);
+        }
+    }
+    pthread_mutex_unlock(&device->mutex);
+    return result;
+}
+
+static long elm_stop_msg_filter(unsigned long channel_id, unsigned long filter_id) {
+    ELM_DEVICE* device = channel_for(channel_id);
+    if (device == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+    if (filter_id == 0 || filter_id > ELM_MAX_FILTERS) {
+        return ERR_INVALID_FILTER_ID;
+    }
+    pthread_mutex_lock(&device->mutex);
+    long result = device->filters[filter_id - 1].in_use ? STATUS_NOERROR : ERR_INVALID_FILTER_ID;
+    device->filters[filter_id - 1].in_use = 0;
+    if (result == STATUS_NOERROR && device->protocol_id == CAN) {
+        long long first = static_cast<long long>(device->issued);
+        program_monitor(device);
+        if (static_cast<long long>(device->issued) > first) {
+            result = wait_batch(device, first, static_cast<long long>(device->issued) - 1, ELM_COMMAND_TIMEOUT_MS);
+        }
+    }
+    pthread_mutex_unlock(&device->mutex);
+    return result;
+}
+
+static long elm_set_programming_voltage(unsigned long device_id, unsigned long pin,
+                                        unsigned long voltage) {
+    return ERR_NOT_SUPPORTED;
+}
+
+static long elm_read_version(unsigned long device_id, char* firmware_version, char* dll_version,
+                             char* api_version) {
+    if (firmware_version == nullptr || dll_version == nullptr || api_version == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    ELM_DEVICE* device = device_for(device_id);
+    if (device == nullptr) {
+        return ERR_INVALID_DEVICE_ID;
+    }
+    snprintf(firmware_version, 80, "%s", device->firmware);
+    strcpy(dll_version, "SpaceTec ELM327 1.0");
+    strcpy(api_version, "04.04");
+    return STATUS_NOERROR;
+}
+
+static long elm_get_last_error(char* description) {
+    if (description == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    pthread_mutex_lock(&g_elm_error_mutex);
+    strcpy(description, g_elm_error);
+    pthread_mutex_unlock(&g_elm_error_mutex);
+    return STATUS_NOERROR;
+}
+
+static long read_vbatt(ELM_DEVICE* device, unsigned long* millivolts) {
+    if (millivolts == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    pthread_mutex_lock(&device->mutex);
+    long long ticket = issue(device, ELM_CMD_AT, "ATRV");
+    long result = wait_ticket(device, ticket, ELM_COMMAND_TIMEOUT_MS);
+    if (result == STATUS_NOERROR) {
+        // "12.6V"
+        *millivolts = static_cast<unsigned long>(strtod(device->commands[ticket % ELM_COMMAND_QUEUE].reply, nullptr) * 1000.0 + 0.5);
+    }
+    if (device->connected && device->protocol_id == CAN && device->can_filter[0] != '\0') {
+        issue(device, ELM_CMD_MONITOR, device->stn ? "STMA" : "ATMA");
+    }
+    pthread_mutex_unlock(&device->mutex);
+    return result;
+}
+
+static long elm_ioctl(unsigned long channel_id, unsigned long ioctl_id, void* input, void* output) {
+    if (ioctl_id == READ_VBATT) {
+        ELM_DEVICE* device = device_for(channel_id);
+        return device != nullptr ? read_vbatt(device, static_cast<unsigned long*>(output)) : ERR_INVALID_DEVICE_ID;
+    }
+    ELM_DEVICE* device = channel_for(channel_id);
+    if (device == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+    switch (ioctl_id) {
+        case CLEAR_TX_BUFFER:
+            // Drops requests the adapter has not seen yet
+            pthread_mutex_lock(&device->mutex);
+            for (unsigned long long ticket = device->sent; ticket < device->issued; ticket++) {
+                device->commands[ticket % ELM_COMMAND_QUEUE].result = ERR_FAILED;
+            }
+            device->issued = device->sent;
+            if (!device->busy) {
+                device->done = device->sent;
+            }
+            pthread_cond_broadcast(&device->changed);
+            pthread_mutex_unlock(&device->mutex);
+            return STATUS_NOERROR;
+        case CLEAR_RX_BUFFER:
+            pthread_mutex_lock(&device->mutex);
+            device->queue_count = 0;
+            pthread_mutex_unlock(&device->mutex);
+            return STATUS_NOERROR;
+        default:
+            return ERR_INVALID_IOCTL_ID;
+    }
+}
+
+J2534_LIBRARY* elm327_library(void) {
+    static J2534_LIBRARY library = {
+        nullptr,
+        elm_open,
+        elm_close,
+        elm_connect,
+        elm_disconnect,
+        elm_read_msgs,
+        elm_write_msgs,
+        elm_start_msg_filter,
+        elm_stop_msg_filter,
+        elm_set_programming_voltage,
+        elm_read_version,
+        elm_get_last_error,
+        elm_ioctl,
+    };
+    return &library;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeElm327Load
+ * Signature: ()J
+ *
+ * Selects the ELM327/STN backend in place of a J2534 DLL; nativePassThruOpen
+ * then takes the adapter tty ("/dev/rfcomm0", "/dev/ttyUSB0,115200").
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeElm327Load
+  (JNIEnv *env, jobject obj) {
+
+    J2534_LIBRARY* lib = elm327_library();
+    g_j2534_lib = lib;
+    g_last_error = STATUS_NOERROR;
+    return reinterpret_cast<jlong>(lib);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef ELM327_TRANSPORT_H
+#define ELM327_TRANSPORT_H
+
+#include <jni.h>
+#include "j2534_native.h"
+
+#define READ_VBATT 0x03                    // J2534 IOCTL, output is millivolts
+
+#define ELM_DEFAULT_DEVICE "/dev/rfcomm0"
+#define ELM_DEFAULT_BAUDRATE 38400          // serial side; Bluetooth SPP ignores it
+#define ELM_MAX_DEVICES 2
+#define ELM_MAX_FILTERS 8
+#define ELM_RX_QUEUE 64
+#define ELM_RX_SESSIONS 4                   // concurrent ISO-TP reassemblies
+#define ELM_COMMAND_QUEUE 32
+#define ELM_COMMAND_SIZE 600                // STPX line with a full inline payload
+#define ELM_REPLY_SIZE 128
+#define ELM_READ_BUFFER 1024
+#define ELM_LINE_MAX 512
+#define ELM_SF_MAX 7                        // ELM327 only transmits single frames
+#define ELM_STN_MAX_PAYLOAD 256             // inline STPX data
+#define ELM_RESET_TIMEOUT_MS 2500
+#define ELM_COMMAND_TIMEOUT_MS 1000
+#define ELM_REQUEST_TIMEOUT_MS 5000         // covers NRC 0x78 pending responses
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * PassThru function table for ELM327 and STN11xx/STN2xxx adapters over a
+ * Bluetooth SPP or USB serial tty. PassThruOpen takes "path[,baud]" (null
+ * opens /dev/rfcomm0), resets the adapter and detects STN firmware.
+ * PassThruConnect accepts ISO15765 (the adapter does ISO-TP flow control; the
+ * driver reassembles the frames it prints) and CAN (monitor-all capture with
+ * STMA or ATMA, started by the first pass filter). AT commands go through a
+ * queue that a native reader thread drains the moment each '>' prompt arrives,
+ * so a configuration batch or a run of requests costs no extra wakeups, and
+ * redundant header/filter commands are skipped. STN adapters transmit with
+ * STPX (header, data and expected response count in one line, multi-frame
+ * capable); ELM327 v1.3+ gets the response-count hint instead. The table is
+ * static and must not be passed to unload_j2534_library.
+ */
+J2534_LIBRARY* elm327_library(void);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeElm327Load
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeElm327Load
+  (JNIEnv *, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ELM327_TRANSPORT_H
@@ -0,0 +1,463 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "flash_compress.h"
+#include "j2534_jni.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// LZ4 block format limits
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12    // no match may start within the last 12 bytes
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 12
+
+typedef struct {
+    int valid;
+    unsigned long rx_id;
+    int codec;
+    unsigned char data_format;
+    unsigned int frame_size;
+    FLASH_COMPRESS_STATS stats;
+} FLASH_PROFILE;
+
+typedef struct {
+    unsigned char data[FLASH_FRAME_HEADER_SIZE + FLASH_MAX_FRAME_SIZE];
+    unsigned long length;
+    unsigned long raw_length;
+} COMPRESS_SLOT;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;
+    pthread_cond_t slot_free;
+    COMPRESS_SLOT slots[FLASH_COMPRESS_SLOTS];
+    unsigned int head;
+    unsigned int count;
+    int done;
+    int abort;
+    int codec;
+    unsigned int frame_size;
+    const unsigned char* data;
+    unsigned long size;
+    unsigned long long compress_us;
+    unsigned long long compressed_bytes;
+    unsigned int frames;
+} COMPRESS_PIPELINE;
+
+// Compression profiles keyed by ECU response ID
+static pthread_mutex_t g_profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FLASH_PROFILE g_profiles[FLASH_PROFILE_COUNT];
+
+static FLASH_PROFILE* find_profile(unsigned long rx_id) {
+    for (int i = 0; i < FLASH_PROFILE_COUNT; i++) {
+        if (g_profiles[i].valid && g_profiles[i].rx_id == rx_id) {
+            return &g_profiles[i];
+        }
+    }
+    return nullptr;
+}
+
+long flash_profile_set(unsigned long rx_id, int codec, unsigned char data_format,
+                       unsigned int frame_size) {
+    if (codec != FLASH_CODEC_NONE && codec != FLASH_CODEC_LZ4) {
+        return ERR_NOT_SUPPORTED;
+    }
+    if (frame_size == 0) {
+        frame_size = FLASH_DEFAULT_FRAME_SIZE;
+    }
+    if (frame_size > FLASH_MAX_FRAME_SIZE) {
+        return ERR_INVALID_MSG;
+    }
+
+    long result = STATUS_NOERROR;
+    pthread_mutex_lock(&g_profile_mutex);
+    FLASH_PROFILE* profile = find_profile(rx_id);
+    if (codec == FLASH_CODEC_NONE) {
+        if (profile != nullptr) {
+            profile->valid = 0;
+        }
+    } else {
+        for (int i = 0; profile == nullptr && i < FLASH_PROFILE_COUNT; i++) {
+            if (!g_profiles[i].valid) {
+                profile = &g_profiles[i];
+                memset(profile, 0, sizeof(FLASH_PROFILE));
+            }
+        }
+        if (profile == nullptr) {
+            result = ERR_BUFFER_FULL;
+        } else {
+            profile->valid = 1;
+            profile->rx_id = rx_id;
+            profile->codec = codec;
+            profile->data_format = data_format;
+            profile->frame_size = frame_size;
+        }
+    }
+    pthread_mutex_unlock(&g_profile_mutex);
+    return result;
+}
+
+int flash_profile_get(unsigned long rx_id, int* codec, unsigned char* data_format,
+                      unsigned int* frame_size) {
+    pthread_mutex_lock(&g_profile_mutex);
+    FLASH_PROFILE* profile = find_profile(rx_id);
+    if (profile != nullptr) {
+        *codec = profile->codec;
+        *data_format = profile->data_format;
+        *frame_size = profile->frame_size;
+    }
+    pthread_mutex_unlock(&g_profile_mutex);
+    return profile != nullptr;
+}
+
+static uint32_t read32(const unsigned char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static unsigned char* put_length(unsigned char* op, unsigned long length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = static_cast<unsigned char>(length);
+    return op;
+}
+
+// Emits literals [anchor, anchor + literals) followed by an optional match
+static unsigned char* put_sequence(unsigned char* op, const unsigned char* anchor, unsigned long literals,
+                                   unsigned long offset, unsigned long match) {
+    unsigned char* token = op++;
+    *token = static_cast<unsigned char>((literals >= 15 ? 15 : literals) << 4);
+    if (literals >= 15) {
+        op = put_length(op, literals - 15);
+    }
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    if (match > 0) {
+        *op++ = static_cast<unsigned char>(offset & 0xFF);
+        *op++ = static_cast<unsigned char>(offset >> 8);
+        unsigned long code = match - LZ4_MIN_MATCH;
+        *token |= static_cast<unsigned char>(code >= 15 ? 15 : code);
+        if (code >= 15) {
+            op = put_length(op, code - 15);
+        }
+    }
+    return op;
+}
+
+// Worst case bytes a sequence needs beyond its literals
+static unsigned long sequence_overhead(unsigned long literals, unsigned long match) {
+    return 1 + literals / 255 + 1 + 2 + match / 255 + 1;
+}
+
+unsigned long lz4_compress_block(const unsigned char* src, unsigned long length,
+                                 unsigned char* dst, unsigned long capacity) {
+    uint32_t table[1 << LZ4_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    unsigned char* op = dst;
+    unsigned long anchor = 0;
+    unsigned long ip = 0;
+
+    // Greedy parse with a single-entry hash table; positions are stored + 1 so 0 means empty
+    if (length > LZ4_MATCH_LIMIT) {
+        unsigned long limit = length - LZ4_MATCH_LIMIT;
+        while (ip < limit) {
+            uint32_t sequence = read32(src + ip);
+            uint32_t hash = (sequence * 2654435761U) >> (32 - LZ4_HASH_BITS);
+            unsigned long candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(ip + 1);
+
+            if (candidate == 0 || ip - (candidate - 1) > LZ4_MAX_OFFSET ||
+                read32(src + candidate - 1) != sequence) {
+                ip++;
+                continue;
+            }
+            unsigned long ref = candidate - 1;
+            unsigned long match = LZ4_MIN_MATCH;
+            while (ip + match < length - LZ4_LAST_LITERALS && src[ref + match] == src[ip + match]) {
+                match++;
+            }
+
+            unsigned long literals = ip - anchor;
+            if (static_cast<unsigned long>(op - dst) + literals + sequence_overhead(literals, match) > capacity) {
+                return 0;
+            }
+            op = put_sequence(op, src + anchor, literals, ip - ref, match);
+            ip += match;
+            anchor = ip;
+        }
+    }
+
+    unsigned long literals = length - anchor;
+    if (static_cast<unsigned long>(op - dst) + literals + sequence_overhead(literals, 0) > capacity) {
+        return 0;
+    }
+    op = put_sequence(op, src + anchor, literals, 0, 0);
+    return static_cast<unsigned long>(op - dst);
+}
+
+static unsigned long long thread_cpu_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000000ULL +
+           static_cast<unsigned long long>(ts.tv_nsec / 1000);
+}
+
+static void encode_frame(COMPRESS_PIPELINE* pipeline, COMPRESS_SLOT* slot, const unsigned char* src,
+                         unsigned long raw_length) {
+    unsigned long length = 0;
+    if (pipeline->codec == FLASH_CODEC_LZ4) {
+        // Anything that does not shrink the frame is stored
+        length = lz4_compress_block(src, raw_length, slot->data + FLASH_FRAME_HEADER_SIZE,
+                                    raw_length - 1);
+    }
+
+    unsigned int header;
+    if (length == 0) {
+        memcpy(slot->data + FLASH_FRAME_HEADER_SIZE, src, raw_length);
+        length = raw_length;
+        header = FLASH_FRAME_STORED | static_cast<unsigned int>(raw_length);
+    } else {
+        header = static_cast<unsigned int>(length);
+    }
+    slot->data[0] = static_cast<unsigned char>(header >> 8);
+    slot->data[1] = static_cast<unsigned char>(header & 0xFF);
+    slot->length = FLASH_FRAME_HEADER_SIZE + length;
+    slot->raw_length = raw_length;
+}
+
+static void* compress_worker(void* arg) {
+    COMPRESS_PIPELINE* pipeline = static_cast<COMPRESS_PIPELINE*>(arg);
+    unsigned long long start = thread_cpu_us();
+
+    for (unsigned long offset = 0; offset < pipeline->size; offset += pipeline->frame_size) {
+        pthread_mutex_lock(&pipeline->mutex);
+        while (pipeline->count == FLASH_COMPRESS_SLOTS && !pipeline->abort) {
+            pthread_cond_wait(&pipeline->slot_free, &pipeline->mutex);
+        }
+        if (pipeline->abort) {
+            pthread_mutex_unlock(&pipeline->mutex);
+            break;
+        }
+        // The tail slot is never touched by the consumer until count covers it
+        COMPRESS_SLOT* slot = &pipeline->slots[(pipeline->head + pipeline->count) % FLASH_COMPRESS_SLOTS];
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        unsigned long raw_length = pipeline->size - offset < pipeline->frame_size
+            ? pipeline->size - offset : pipeline->frame_size;
+        encode_frame(pipeline, slot, pipeline->data + offset, raw_length);
+
+        pthread_mutex_lock(&pipeline->mutex);
+        pipeline->count++;
+        pipeline->frames++;
+        pipeline->compressed_bytes += slot->length;
+        pthread_cond_signal(&pipeline->ready);
+        pthread_mutex_unlock(&pipeline->mutex);
+    }
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->compress_us = thread_cpu_us() - start;
+    pipeline->done = 1;
+    pthread_cond_signal(&pipeline->ready);
+    pthread_mutex_unlock(&pipeline->mutex);
+    return nullptr;
+}
+
+// Waits for the next compressed frame; null once the worker has finished
+static COMPRESS_SLOT* next_slot(COMPRESS_PIPELINE* pipeline, unsigned int* stalls) {
+    COMPRESS_SLOT* slot = nullptr;
+    pthread_mutex_lock(&pipeline->mutex);
+    if (pipeline->count == 0 && !pipeline->done) {
+        (*stalls)++;
+    }
+    while (pipeline->count == 0 && !pipeline->done) {
+        pthread_cond_wait(&pipeline->ready, &pipeline->mutex);
+    }
+    if (pipeline->count > 0) {
+        slot = &pipeline->slots[pipeline->head];
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    return slot;
+}
+
+static void release_slot(COMPRESS_PIPELINE* pipeline) {
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->head = (pipeline->head + 1) % FLASH_COMPRESS_SLOTS;
+    pipeline->count--;
+    pthread_cond_signal(&pipeline->slot_free);
+    pthread_mutex_unlock(&pipeline->mutex);
+}
+
+static void record_stats(unsigned long rx_id, const FLASH_COMPRESS_STATS* stats) {
+    pthread_mutex_lock(&g_profile_mutex);
+    FLASH_PROFILE* profile = find_profile(rx_id);
+    if (profile != nullptr) {
+        profile->stats = *stats;
+    }
+    pthread_mutex_unlock(&g_profile_mutex);
+}
+
+long flash_transfer_compressed(FLASH_SESSION* session, int codec, unsigned int frame_size,
+                               const unsigned char* data, unsigned long size) {
+    if (session->max_block_length == 0) {
+        return ERR_INVALID_DEVICE_STATE;
+    }
+    if (frame_size == 0 || frame_size > FLASH_MAX_FRAME_SIZE) {
+        return ERR_INVALID_MSG;
+    }
+
+    COMPRESS_PIPELINE* pipeline = static_cast<COMPRESS_PIPELINE*>(calloc(1, sizeof(COMPRESS_PIPELINE)));
+    if (pipeline == nullptr) {
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    pthread_mutex_init(&pipeline->mutex, nullptr);
+    pthread_cond_init(&pipeline->ready, nullptr);
+    pthread_cond_init(&pipeline->slot_free, nullptr);
+    pipeline->codec = codec;
+    pipeline->frame_size = frame_size;
+    pipeline->data = data;
+    pipeline->size = size;
+
+    pthread_t worker;
+    if (pthread_create(&worker, nullptr, compress_worker, pipeline) != 0) {
+        pthread_cond_destroy(&pipeline->slot_free);
+        pthread_cond_destroy(&pipeline->ready);
+        pthread_mutex_destroy(&pipeline->mutex);
+        free(pipeline);
+        return ERR_FAILED;
+    }
+
+    flash_set_phase(session, FLASH_PHASE_TRANSFER);
+
+    unsigned long long start = uds_now_ms();
+    unsigned long chunk = session->max_block_length - 2;
+    unsigned char req[ISOTP_MAX_MESSAGE];
+    unsigned long fill = 0;
+    unsigned long long pending_raw = 0;
+    unsigned int stalls = 0;
+    long result = STATUS_NOERROR;
+
+    COMPRESS_SLOT* slot = next_slot(pipeline, &stalls);
+    unsigned long position = 0;
+    while (result == STATUS_NOERROR && (slot != nullptr || fill > 0)) {
+        if (slot != nullptr) {
+            unsigned long take = slot->length - position < chunk - fill
+                ? slot->length - position : chunk - fill;
+            memcpy(req + 2 + fill, slot->data + position, take);
+            fill += take;
+            position += take;
+            if (position == slot->length) {
+                pending_raw += slot->raw_length;
+                release_slot(pipeline);
+                slot = next_slot(pipeline, &stalls);
+                position = 0;
+            }
+        }
+
+        // Full block, or the tail of the stream
+        if (fill == chunk || (slot == nullptr && fill > 0)) {
+            result = flash_send_block(session, req, fill);
+            fill = 0;
+            if (result == STATUS_NOERROR && session->progress != nullptr) {
+                __atomic_add_fetch(&session->progress->bytes_done, pending_raw, __ATOMIC_RELEASE);
+            }
+            pending_raw = 0;
+        }
+    }
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->abort = 1;
+    pthread_cond_signal(&pipeline->slot_free);
+    pthread_mutex_unlock(&pipeline->mutex);
+    pthread_join(worker, nullptr);
+
+    if (result == STATUS_NOERROR) {
+        FLASH_COMPRESS_STATS stats;
+        memset(&stats, 0, sizeof(stats));
+        stats.raw_bytes = size;
+        stats.compressed_bytes = pipeline->compressed_bytes;
+        stats.compress_us = pipeline->compress_us;
+        stats.transfer_ms = uds_now_ms() - start;
+        stats.frames = pipeline->frames;
+        stats.stalls = stalls;
+        if (stats.compressed_bytes > 0 && stats.raw_bytes > stats.compressed_bytes) {
+            stats.saved_ms = stats.transfer_ms * (stats.raw_bytes - stats.compressed_bytes) /
+                             stats.compressed_bytes;
+        }
+        record_stats(session->link.rx_id, &stats);
+        LOGI("Compressed transfer: %llu -> %llu bytes, %u stalls", stats.raw_bytes,
+             stats.compressed_bytes, stalls);
+    }
+
+    pthread_cond_destroy(&pipeline->slot_free);
+    pthread_cond_destroy(&pipeline->ready);
+    pthread_mutex_destroy(&pipeline->mutex);
+    free(pipeline);
+    return result;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFlashSetCompression
+ * Signature: (IIII)I
+ *
+ * Every later download to ecuRxId uses the codec and announces dataFormat in 0x34.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFlashSetCompression
+  (JNIEnv *env, jobject obj, jint ecu_rx_id, jint codec, jint data_format, jint frame_size) {
+
+    long result = flash_profile_set(static_cast<unsigned long>(ecu_rx_id), codec,
+                                    static_cast<unsigned char>(data_format),
+                                    frame_size > 0 ? static_cast<unsigned int>(frame_size) : 0);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return 0;
+    } else {
+        return -1;
+    }
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFlashCompressionStats
+ * Signature: (ILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFlashCompressionStats
+  (JNIEnv *env, jobject obj, jint ecu_rx_id, jobject stats_buffer) {
+
+    unsigned char* out = stats_buffer != nullptr
+        ? static_cast<unsigned char*>(env->GetDirectBufferAddress(stats_buffer)) : nullptr;
+    if (out == nullptr ||
+        env->GetDirectBufferCapacity(stats_buffer) < static_cast<jlong>(sizeof(FLASH_COMPRESS_STATS))) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_profile_mutex);
+    FLASH_PROFILE* profile = find_profile(static_cast<unsigned long>(ecu_rx_id));
+    if (profile != nullptr) {
+        memcpy(out, &profile->stats, sizeof(FLASH_COMPRESS_STATS));
+    }
+    pthread_mutex_unlock(&g_profile_mutex);
+
+    if (profile == nullptr) {
+        g_last_error = ERR_INVALID_MSG_ID;
+        return -1;
+    }
+    g_last_error = STATUS_NOERROR;
+    return static_cast<jint>(sizeof(FLASH_COMPRESS_STATS));
+}
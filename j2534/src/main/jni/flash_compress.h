@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef FLASH_COMPRESS_H
+#define FLASH_COMPRESS_H
+
+#include <jni.h>
+#include "uds_flash.h"
+
+// Codecs
+#define FLASH_CODEC_NONE 0
+#define FLASH_CODEC_LZ4 1   // LZ4 blocks in the frame container below
+
+/*
+ * Compressed stream: the region is cut into frame_size chunks that are compressed
+ * independently. Each frame is a big-endian u16 header followed by the payload;
+ * bit 15 of the header marks a stored (incompressible) frame, bits 0..14 give the
+ * payload length. Frames are packed back to back into TransferData blocks.
+ *
+ * This container is our own convention, not defined by ISO 14229 or by LZ4.
+ * Only set a compression profile for a bootloader built to unpack exactly
+ * this framing with the same frame_size; nothing on the bus checks it.
+ */
+#define FLASH_FRAME_STORED 0x8000
+#define FLASH_FRAME_HEADER_SIZE 2
+#define FLASH_DEFAULT_FRAME_SIZE 4096
+#define FLASH_MAX_FRAME_SIZE 16384
+
+// Frames compressed ahead of the bus
+#define FLASH_COMPRESS_SLOTS 4
+
+#define FLASH_PROFILE_COUNT 16
+
+// Statistics of the last compressed download per ECU (native byte order)
+typedef struct {
+    unsigned long long raw_bytes;
+    unsigned long long compressed_bytes;
+    unsigned long long compress_us;   // worker CPU time
+    unsigned long long transfer_ms;   // wall time of the TransferData phase
+    unsigned long long saved_ms;      // estimated bus time saved at the measured rate
+    unsigned int frames;
+    unsigned int stalls;              // times the bus waited for the compressor
+} FLASH_COMPRESS_STATS;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Selects the codec and its dataFormatIdentifier for one ECU; FLASH_CODEC_NONE removes it
+long flash_profile_set(unsigned long rx_id, int codec, unsigned char data_format,
+                       unsigned int frame_size);
+
+// Returns 1 and fills the outputs if the ECU has a compression profile
+int flash_profile_get(unsigned long rx_id, int* codec, unsigned char* data_format,
+                      unsigned int* frame_size);
+
+// LZ4 block compression; returns 0 if the output would exceed capacity
+unsigned long lz4_compress_block(const unsigned char* src, unsigned long length,
+                                 unsigned char* dst, unsigned long capacity);
+
+/*
+ * 0x36 phase for a compressed region: a worker thread compresses frames ahead of
+ * transmission while the caller's thread keeps the bus busy.
+ */
+long flash_transfer_compressed(FLASH_SESSION* session, int codec, unsigned int frame_size,
+                               const unsigned char* data, unsigned long size);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFlashSetCompression
+ * Signature: (IIII)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFlashSetCompression
+  (JNIEnv *, jobject, jint, jint, jint, jint);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFlashCompressionStats
+ * Signature: (ILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFlashCompressionStats
+  (JNIEnv *, jobject, jint, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLASH_COMPRESS_H
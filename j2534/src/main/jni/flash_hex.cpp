@@ -0,0 +1,662 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "flash_hex.h"
+#include "checksum.h"
+#include "uds_flash.h"
+#include "j2534_jni.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define HEX_DECODE_SSSE3 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HEX_DECODE_NEON 1
+#endif
+
+#define HEX_INITIAL_SEGMENT_CAPACITY 4096
+#define HEX_INVALID 0xFF
+
+static constexpr unsigned char hex_value(unsigned int c) {
+    return c >= '0' && c <= '9' ? static_cast<unsigned char>(c - '0')
+         : c >= 'A' && c <= 'F' ? static_cast<unsigned char>(c - 'A' + 10)
+         : c >= 'a' && c <= 'f' ? static_cast<unsigned char>(c - 'a' + 10)
+         : HEX_INVALID;
+}
+
+typedef struct {
+    unsigned char value[256];
+} HEX_TABLE;
+
+static constexpr HEX_TABLE build_hex_table() {
+    HEX_TABLE t = {};
+    for (unsigned int c = 0; c < 256; c++) {
+        t.value[c] = hex_value(c);
+    }
+    return t;
+}
+
+static constexpr HEX_TABLE g_hex = build_hex_table();
+
+#if defined(HEX_DECODE_NEON)
+// Maps 16 ASCII hex digits to nibbles; invalid lanes are cleared in *valid
+static uint8x16_t neon_nibbles(uint8x16_t c, uint8x16_t* valid) {
+    uint8x16_t digit = vsubq_u8(c, vdupq_n_u8('0'));
+    uint8x16_t alpha = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t is_digit = vcleq_u8(digit, vdupq_n_u8(9));
+    uint8x16_t is_alpha = vcleq_u8(alpha, vdupq_n_u8(5));
+    *valid = vandq_u8(*valid, vorrq_u8(is_digit, is_alpha));
+    return vbslq_u8(is_digit, digit, vaddq_u8(alpha, vdupq_n_u8(10)));
+}
+#endif
+
+int hex_decode(const char* src, unsigned char* dst, unsigned long byte_count) {
+#if defined(HEX_DECODE_SSSE3)
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i five = _mm_set1_epi8(5);
+    while (byte_count >= 8) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+        __m128i alpha = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+        __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, nine), digit);
+        __m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, five), alpha);
+        if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) != 0xFFFF) {
+            return 0;
+        }
+        __m128i nibbles = _mm_or_si128(_mm_and_si128(is_digit, digit),
+                                       _mm_andnot_si128(is_digit,
+                                                        _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+        // High nibble * 16 + low nibble per character pair, then narrow to bytes
+        __m128i words = _mm_maddubs_epi16(nibbles, _mm_set1_epi16(0x0110));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(words, words));
+        src += 16;
+        dst += 8;
+        byte_count -= 8;
+    }
+#elif defined(HEX_DECODE_NEON)
+    while (byte_count >= 16) {
+        uint8x16x2_t c = vld2q_u8(reinterpret_cast<const uint8_t*>(src));
+        uint8x16_t valid = vdupq_n_u8(0xFF);
+        uint8x16_t high = neon_nibbles(c.val[0], &valid);
+        uint8x16_t low = neon_nibbles(c.val[1], &valid);
+        if (vminvq_u8(valid) != 0xFF) {
+            return 0;
+        }
+        vst1q_u8(dst, vorrq_u8(vshlq_n_u8(high, 4), low));
+        src += 32;
+        dst += 16;
+        byte_count -= 16;
+    }
+#endif
+    while (byte_count--) {
+        unsigned char high = g_hex.value[static_cast<unsigned char>(src[0])];
+        unsigned char low = g_hex.value[static_cast<unsigned char>(src[1])];
+        if (high == HEX_INVALID || low == HEX_INVALID) {
+            return 0;
+        }
+        *dst++ = static_cast<unsigned char>((high << 4) | low);
+        src += 2;
+    }
+    return 1;
+}
+
+void hex_parser_init(HEX_PARSER* parser) {
+    memset(parser, 0, sizeof(HEX_PARSER));
+}
+
+void hex_parser_free(HEX_PARSER* parser) {
+    for (unsigned int i = 0; i < parser->segment_count; i++) {
+        free(parser->segments[i].data);
+    }
+    free(parser->segments);
+    parser->segments = nullptr;
+    parser->segment_count = 0;
+    parser->segment_capacity = 0;
+}
+
+static long reserve_segment_data(HEX_SEGMENT* segment, unsigned long length) {
+    if (length <= segment->capacity) {
+        return STATUS_NOERROR;
+    }
+    unsigned long capacity = segment->capacity > 0 ? segment->capacity : HEX_INITIAL_SEGMENT_CAPACITY;
+    while (capacity < length) {
+        capacity *= 2;
+    }
+    unsigned char* data = static_cast<unsigned char*>(realloc(segment->data, capacity));
+    if (data == nullptr) {
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    segment->data = data;
+    segment->capacity = capacity;
+    return STATUS_NOERROR;
+}
+
+static long add_data(HEX_PARSER* parser, unsigned long address, const unsigned char* data,
+                     unsigned long length) {
+    if (length == 0) {
+        return STATUS_NOERROR;
+    }
+
+    // Records are almost always sequential, so try the segment written last first
+    HEX_SEGMENT* segment = nullptr;
+    if (parser->segment_count > 0) {
+        HEX_SEGMENT* last = &parser->segments[parser->last_segment];
+        if (last->address + last->length == address) {
+            segment = last;
+        }
+    }
+    for (unsigned int i = 0; segment == nullptr && i < parser->segment_count; i++) {
+        if (parser->segments[i].address + parser->segments[i].length == address) {
+            segment = &parser->segments[i];
+            parser->last_segment = i;
+        }
+    }
+
+    if (segment == nullptr) {
+        if (parser->segment_count == parser->segment_capacity) {
+            unsigned int capacity = parser->segment_capacity > 0 ? parser->segment_capacity * 2 : 16;
+            HEX_SEGMENT* segments = static_cast<HEX_SEGMENT*>(
+                realloc(parser->segments, capacity * sizeof(HEX_SEGMENT)));
+            if (segments == nullptr) {
+                return ERR_INSUFFICIENT_MEMORY;
+            }
+            parser->segments = segments;
+            parser->segment_capacity = capacity;
+        }
+        parser->last_segment = parser->segment_count++;
+        segment = &parser->segments[parser->last_segment];
+        memset(segment, 0, sizeof(HEX_SEGMENT));
+        segment->address = address;
+    }
+
+    long result = reserve_segment_data(segment, segment->length + length);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+    memcpy(segment->data + segment->length, data, length);
+    segment->length += length;
+    return STATUS_NOERROR;
+}
+
+static unsigned long read_be(const unsigned char* p, unsigned int bytes) {
+    unsigned long value = 0;
+    for (unsigned int i = 0; i < bytes; i++) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+static unsigned int byte_sum(const unsigned char* p, unsigned long length) {
+    return checksum_add8(0, p, length) & 0xFF;
+}
+
+// :LLAAAATT<data>CC, all bytes sum to zero
+static long parse_ihex(HEX_PARSER* parser, const char* line, unsigned int length) {
+    unsigned char record[HEX_MAX_LINE / 2];
+    unsigned int count = (length - 1) / 2;
+    if ((length - 1) % 2 != 0 || count < 5 || !hex_decode(line + 1, record, count)) {
+        return ERR_INVALID_MSG;
+    }
+    if (record[0] + 5U != count || byte_sum(record, count) != 0) {
+        return ERR_INVALID_MSG;
+    }
+
+    unsigned long offset = read_be(record + 1, 2);
+    const unsigned char* data = record + 4;
+    switch (record[3]) {
+        case 0x00:
+            return add_data(parser, parser->base_address + offset, data, record[0]);
+        case 0x01:
+            parser->finished = 1;
+            return STATUS_NOERROR;
+        case 0x02:
+        case 0x04:
+            if (record[0] != 2) {
+                return ERR_INVALID_MSG;
+            }
+            parser->base_address = read_be(data, 2) << (record[3] == 0x02 ? 4 : 16);
+            return STATUS_NOERROR;
+        case 0x03:
+        case 0x05:
+            parser->entry_point = read_be(data, record[0] < 4 ? record[0] : 4);
+            return STATUS_NOERROR;
+        default:
+            return ERR_INVALID_MSG;
+    }
+}
+
+// S<type><count><address><data><checksum>, all bytes sum to 0xFF
+static long parse_srec(HEX_PARSER* parser, const char* line, unsigned int length) {
+    unsigned char record[HEX_MAX_LINE / 2];
+    unsigned int count = (length - 2) / 2;
+    if (length < 4 || (length - 2) % 2 != 0 || !hex_decode(line + 2, record, count)) {
+        return ERR_INVALID_MSG;
+    }
+    if (record[0] + 1U != count || byte_sum(record, count) != 0xFF) {
+        return ERR_INVALID_MSG;
+    }
+
+    unsigned int address_bytes;
+    switch (line[1]) {
+        case '0': case '5': case '6':
+            return STATUS_NOERROR;
+        case '1': case '9':
+            address_bytes = 2;
+            break;
+        case '2': case '8':
+            address_bytes = 3;
+            break;
+        case '3': case '7':
+            address_bytes = 4;
+            break;
+        default:
+            return ERR_INVALID_MSG;
+    }
+    if (record[0] < address_bytes + 1) {
+        return ERR_INVALID_MSG;
+    }
+
+    unsigned long address = read_be(record + 1, address_bytes);
+    if (line[1] >= '7') {
+        parser->entry_point = address;
+        parser->finished = 1;
+        return STATUS_NOERROR;
+    }
+    return add_data(parser, address, record + 1 + address_bytes, record[0] - address_bytes - 1);
+}
+
+static long parse_line(HEX_PARSER* parser) {
+    unsigned int length = parser->line_length;
+    parser->line_length = 0;
+    parser->line_number++;
+
+    const char* line = parser->line;
+    while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == ' ' ||
+                          line[length - 1] == '\t')) {
+        length--;
+    }
+    if (length == 0 || parser->finished) {
+        return STATUS_NOERROR;
+    }
+
+    int format = line[0] == ':' ? HEX_FORMAT_IHEX : line[0] == 'S' ? HEX_FORMAT_SREC
+                                                                   : HEX_FORMAT_UNKNOWN;
+    if (format == HEX_FORMAT_UNKNOWN ||
+        (parser->format != HEX_FORMAT_UNKNOWN && parser->format != format)) {
+        return ERR_INVALID_MSG;
+    }
+    parser->format = format;
+
+    return format == HEX_FORMAT_IHEX ? parse_ihex(parser, line, length)
+                                     : parse_srec(parser, line, length);
+}
+
+long hex_parser_feed(HEX_PARSER* parser, const char* text, unsigned long length) {
+    unsigned long pos = 0;
+    while (pos < length) {
+        const char* newline = static_cast<const char*>(memchr(text + pos, '\n', length - pos));
+        unsigned long end = newline != nullptr ? static_cast<unsigned long>(newline - text) : length;
+        unsigned long piece = end - pos;
+
+        if (parser->line_length + piece > HEX_MAX_LINE) {
+            LOGE("Flash container line %lu too long", parser->line_number + 1);
+            return ERR_INVALID_MSG;
+        }
+        memcpy(parser->line + parser->line_length, text + pos, piece);
+        parser->line_length += static_cast<unsigned int>(piece);
+        pos = end;
+
+        if (newline != nullptr) {
+            long result = parse_line(parser);
+            if (result != STATUS_NOERROR) {
+                LOGE("Invalid record at line %lu", parser->line_number);
+                return result;
+            }
+            pos++;
+        }
+    }
+    return STATUS_NOERROR;
+}
+
+static int compare_segments(const void* a, const void* b) {
+    unsigned long left = static_cast<const HEX_SEGMENT*>(a)->address;
+    unsigned long right = static_cast<const HEX_SEGMENT*>(b)->address;
+    return left < right ? -1 : left > right ? 1 : 0;
+}
+
+// Frees the segments past out after a failed merge and trims the count to the valid prefix
+static long drop_merged_segments(HEX_PARSER* parser, unsigned int out, long result) {
+    for (unsigned int i = out + 1; i < parser->segment_count; i++) {
+        free(parser->segments[i].data);
+        parser->segments[i].data = nullptr;
+    }
+    parser->segment_count = out + 1;
+    parser->last_segment = out;
+    return result;
+}
+
+long hex_parser_finish(HEX_PARSER* parser) {
+    if (parser->line_length > 0) {
+        long result = parse_line(parser);
+        if (result != STATUS_NOERROR) {
+            LOGE("Invalid record at line %lu", parser->line_number);
+            return result;
+        }
+    }
+    // A truncated Intel HEX file must not be flashed partially
+    if (parser->format == HEX_FORMAT_IHEX && !parser->finished) {
+        LOGE("Intel HEX input ends without an end-of-file record");
+        return ERR_INVALID_MSG;
+    }
+    if (parser->segment_count == 0) {
+        return STATUS_NOERROR;
+    }
+
+    qsort(parser->segments, parser->segment_count, sizeof(HEX_SEGMENT), compare_segments);
+
+    // Every slot owns its data or holds nullptr, so an early return leaves the
+    // array safe for hex_parser_free
+    unsigned int out = 0;
+    for (unsigned int i = 1; i < parser->segment_count; i++) {
+        HEX_SEGMENT* current = &parser->segments[out];
+        HEX_SEGMENT* next = &parser->segments[i];
+        unsigned long current_end = current->address + current->length;
+        if (next->address < current_end) {
+            LOGE("Overlapping data at 0x%lX", next->address);
+            return drop_merged_segments(parser, out, ERR_INVALID_MSG);
+        }
+        if (next->address == current_end) {
+            long result = reserve_segment_data(current, current->length + next->length);
+            if (result != STATUS_NOERROR) {
+                return drop_merged_segments(parser, out, result);
+            }
+            memcpy(current->data + current->length, next->data, next->length);
+            current->length += next->length;
+            free(next->data);
+            next->data = nullptr;
+        } else if (++out != i) {
+            parser->segments[out] = *next;
+            next->data = nullptr;
+        }
+    }
+    parser->segment_count = out + 1;
+    parser->last_segment = out;
+    return STATUS_NOERROR;
+}
+
+long hex_layout_regions(HEX_PARSER* parser, unsigned long alignment, unsigned char fill) {
+    if (alignment == 0) {
+        return ERR_INVALID_MSG;
+    }
+    if (parser->segment_count == 0) {
+        return STATUS_NOERROR;
+    }
+
+    HEX_SEGMENT* regions = static_cast<HEX_SEGMENT*>(calloc(parser->segment_count, sizeof(HEX_SEGMENT)));
+    if (regions == nullptr) {
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+
+    // Bounds first: aligned extents that touch or overlap form one region
+    unsigned int region_count = 0;
+    for (unsigned int i = 0; i < parser->segment_count; i++) {
+        const HEX_SEGMENT* segment = &parser->segments[i];
+        unsigned long start = segment->address - segment->address % alignment;
+        unsigned long end = segment->address + segment->length;
+        end += (alignment - end % alignment) % alignment;
+
+        if (region_count > 0 && start <= regions[region_count - 1].address + regions[region_count - 1].length) {
+            HEX_SEGMENT* region = &regions[region_count - 1];
+            region->length = end - region->address;
+        } else {
+            regions[region_count].address = start;
+            regions[region_count].length = end - start;
+            region_count++;
+        }
+    }
+
+    long result = STATUS_NOERROR;
+    unsigned int segment = 0;
+    for (unsigned int r = 0; r < region_count && result == STATUS_NOERROR; r++) {
+        HEX_SEGMENT* region = &regions[r];
+        region->data = static_cast<unsigned char*>(malloc(region->length));
+        if (region->data == nullptr) {
+            result = ERR_INSUFFICIENT_MEMORY;
+            break;
+        }
+        region->capacity = region->length;
+        memset(region->data, fill, region->length);
+
+        unsigned long region_end = region->address + region->length;
+        while (segment < parser->segment_count && parser->segments[segment].address < region_end) {
+            const HEX_SEGMENT* source = &parser->segments[segment];
+            memcpy(region->data + (source->address - region->address), source->data, source->length);
+            segment++;
+        }
+    }
+
+    if (result != STATUS_NOERROR) {
+        for (unsigned int r = 0; r < region_count; r++) {
+            free(regions[r].data);
+        }
+        free(regions);
+        return result;
+    }
+
+    hex_parser_free(parser);
+    parser->segments = regions;
+    parser->segment_count = region_count;
+    parser->segment_capacity = parser->segment_count;
+    parser->last_segment = region_count - 1;
+    return STATUS_NOERROR;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeHexOpen
+ * Signature: (I)J
+ *
+ * Parses an Intel HEX or S-record stream from fd (read to EOF, fd stays owned
+ * by the caller). Returns a handle for the other nativeHex calls, or 0.
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeHexOpen
+  (JNIEnv *env, jobject obj, jint fd) {
+
+    if (fd < 0) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return 0;
+    }
+
+    HEX_PARSER* parser = static_cast<HEX_PARSER*>(malloc(sizeof(HEX_PARSER)));
+    char* chunk = static_cast<char*>(malloc(HEX_READ_CHUNK));
+    if (parser == nullptr || chunk == nullptr) {
+        free(parser);
+        free(chunk);
+        g_last_error = ERR_INSUFFICIENT_MEMORY;
+        return 0;
+    }
+    hex_parser_init(parser);
+
+    long result = STATUS_NOERROR;
+    for (;;) {
+        ssize_t count = read(fd, chunk, HEX_READ_CHUNK);
+        if (count == 0) {
+            break;
+        }
+        if (count < 0) {
+            result = ERR_FAILED;
+            break;
+        }
+        result = hex_parser_feed(parser, chunk, static_cast<unsigned long>(count));
+        if (result != STATUS_NOERROR) {
+            break;
+        }
+    }
+    free(chunk);
+
+    if (result == STATUS_NOERROR) {
+        result = hex_parser_finish(parser);
+    }
+    g_last_error = result;
+    if (result != STATUS_NOERROR) {
+        hex_parser_free(parser);
+        free(parser);
+        return 0;
+    }
+
+    LOGI("Parsed %lu lines into %u segments", parser->line_number, parser->segment_count);
+    return reinterpret_cast<jlong>(parser);
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeHexLayout
+ * Signature: (JII)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeHexLayout
+  (JNIEnv *env, jobject obj, jlong handle, jint alignment, jint fill) {
+
+    HEX_PARSER* parser = reinterpret_cast<HEX_PARSER*>(handle);
+    if (parser == nullptr || alignment <= 0) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    long result = hex_layout_regions(parser, static_cast<unsigned long>(alignment),
+                                     static_cast<unsigned char>(fill));
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return static_cast<jint>(parser->segment_count);
+    } else {
+        return -1;
+    }
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeHexSegments
+ * Signature: (JLjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeHexSegments
+  (JNIEnv *env, jobject obj, jlong handle, jobject result_buffer) {
+
+    HEX_PARSER* parser = reinterpret_cast<HEX_PARSER*>(handle);
+    unsigned char* out = result_buffer != nullptr
+        ? static_cast<unsigned char*>(env->GetDirectBufferAddress(result_buffer)) : nullptr;
+    if (parser == nullptr || out == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    unsigned long capacity = static_cast<unsigned long>(env->GetDirectBufferCapacity(result_buffer));
+    if (static_cast<unsigned long>(parser->segment_count) * HEX_SEGMENT_RECORD_SIZE > capacity) {
+        g_last_error = ERR_BUFFER_OVERFLOW;
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < parser->segment_count; i++) {
+        const HEX_SEGMENT* segment = &parser->segments[i];
+        unsigned int record[3];
+        record[0] = static_cast<unsigned int>(segment->address);
+        record[1] = static_cast<unsigned int>(segment->length);
+        record[2] = crc32_update(0, segment->data, segment->length);
+        memcpy(out + i * HEX_SEGMENT_RECORD_SIZE, record, sizeof(record));
+    }
+
+    g_last_error = STATUS_NOERROR;
+    return static_cast<jint>(parser->segment_count);
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeHexFlash
+ * Signature: (JIIIIILjava/nio/ByteBuffer;)I
+ *
+ * Downloads every segment in address order; returns the number programmed.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeHexFlash
+  (JNIEnv *env, jobject obj, jlong handle, jint channel_id, jint flags, jint ecu_rx_id,
+   jint address_format, jint data_format, jobject progress_buffer) {
+
+    HEX_PARSER* parser = reinterpret_cast<HEX_PARSER*>(handle);
+    if (parser == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+    if (g_j2534_lib == nullptr) {
+        g_last_error = ERR_DEVICE_NOT_CONNECTED;
+        return -1;
+    }
+
+    FLASH_PROGRESS* progress = nullptr;
+    if (progress_buffer != nullptr) {
+        progress = static_cast<FLASH_PROGRESS*>(env->GetDirectBufferAddress(progress_buffer));
+        if (progress == nullptr ||
+            env->GetDirectBufferCapacity(progress_buffer) < static_cast<jlong>(sizeof(FLASH_PROGRESS))) {
+            g_last_error = ERR_NULL_PARAMETER;
+            return -1;
+        }
+        progress->bytes_done = 0;
+        progress->bytes_total = 0;
+        progress->nrc = 0;
+        progress->cancel = 0;
+        progress->phase = FLASH_PHASE_IDLE;
+        for (unsigned int i = 0; i < parser->segment_count; i++) {
+            progress->bytes_total += parser->segments[i].length;
+        }
+    }
+
+    UDS_LINK link;
+    unsigned long rx_id = static_cast<unsigned long>(ecu_rx_id);
+    unsigned long tx_flags = static_cast<unsigned long>(flags) | ISO15765_FRAME_PAD;
+    uds_link_init(&link, g_j2534_lib, static_cast<unsigned long>(channel_id),
+                  uds_physical_tx_id(rx_id), rx_id, tx_flags);
+
+    FLASH_SESSION session;
+    flash_session_init(&session, &link, static_cast<unsigned char>(address_format), progress);
+
+    unsigned int flashed = 0;
+    unsigned long filter_id = 0;
+    long result = uds_start_flow_control(g_j2534_lib, link.channel_id, link.tx_id, rx_id,
+                                         tx_flags, &filter_id);
+    if (result == STATUS_NOERROR) {
+        for (; flashed < parser->segment_count && result == STATUS_NOERROR; flashed++) {
+            const HEX_SEGMENT* segment = &parser->segments[flashed];
+            result = flash_download_region(&session, segment->address, segment->data,
+                                           segment->length, static_cast<unsigned char>(data_format));
+        }
+        g_j2534_lib->PassThruStopMsgFilter(link.channel_id, filter_id);
+    }
+    // Reported once for the whole image; each segment only moves through REQUEST..EXIT
+    flash_set_phase(&session, result == STATUS_NOERROR ? FLASH_PHASE_DONE : FLASH_PHASE_FAILED);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return static_cast<jint>(flashed);
+    } else {
+        return -1;
+    }
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeHexClose
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_spacetec_j2534_J2534Interface_nativeHexClose
+  (JNIEnv *env, jobject obj, jlong handle) {
+
+    HEX_PARSER* parser = reinterpret_cast<HEX_PARSER*>(handle);
+    if (parser != nullptr) {
+        hex_parser_free(parser);
+        free(parser);
+    }
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef FLASH_HEX_H
+#define FLASH_HEX_H
+
+#include <jni.h>
+
+#define HEX_FORMAT_UNKNOWN 0
+#define HEX_FORMAT_IHEX 1   // Intel HEX
+#define HEX_FORMAT_SREC 2   // Motorola S-record
+
+// Longest valid record line (255 data bytes) plus slack for whitespace
+#define HEX_MAX_LINE 600
+#define HEX_READ_CHUNK 65536
+
+// Segment record written by nativeHexSegments: u32 address, u32 length, u32 crc32
+#define HEX_SEGMENT_RECORD_SIZE 12
+
+// One contiguous run of image bytes
+typedef struct {
+    unsigned long address;
+    unsigned long length;
+    unsigned long capacity;
+    unsigned char* data;
+} HEX_SEGMENT;
+
+typedef struct {
+    int format;
+    char line[HEX_MAX_LINE];
+    unsigned int line_length;
+    unsigned long line_number;
+    unsigned long base_address;  // IHEX extended segment/linear address
+    unsigned long entry_point;
+    int finished;                // end-of-file record seen
+    HEX_SEGMENT* segments;
+    unsigned int segment_count;
+    unsigned int segment_capacity;
+    unsigned int last_segment;
+} HEX_PARSER;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void hex_parser_init(HEX_PARSER* parser);
+void hex_parser_free(HEX_PARSER* parser);
+
+// Consumes any amount of text; records may span chunk boundaries
+long hex_parser_feed(HEX_PARSER* parser, const char* text, unsigned long length);
+
+// Flushes the last line, sorts segments and merges the contiguous ones
+long hex_parser_finish(HEX_PARSER* parser);
+
+/*
+ * Rewrites the segment map into transfer regions: each region starts and ends on an
+ * alignment boundary, gaps inside a region are filled with fill. Segments whose
+ * aligned extents touch are coalesced.
+ */
+long hex_layout_regions(HEX_PARSER* parser, unsigned long alignment, unsigned char fill);
+
+// Decodes pairs of hex digits; returns 0 on any non-hex character
+int hex_decode(const char* src, unsigned char* dst, unsigned long byte_count);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeHexOpen
+ * Signature: (I)J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeHexOpen
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeHexLayout
+ * Signature: (JII)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeHexLayout
+  (JNIEnv *, jobject, jlong, jint, jint);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeHexSegments
+ * Signature: (JLjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeHexSegments
+  (JNIEnv *, jobject, jlong, jobject);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeHexFlash
+ * Signature: (JIIIIILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeHexFlash
+  (JNIEnv *, jobject, jlong, jint, jint, jint, jint, jint, jobject);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeHexClose
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_spacetec_j2534_J2534Interface_nativeHexClose
+  (JNIEnv *, jobject, jlong);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLASH_HEX_H
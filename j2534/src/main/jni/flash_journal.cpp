@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "flash_journal.h"
+#include "checksum.h"
+#include "flash_compress.h"
+#include "j2534_jni.h"
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+static_assert(sizeof(FLASH_CHECKPOINT) == 32, "checkpoint slots are 32 bytes on disk");
+
+static unsigned int record_crc(const FLASH_CHECKPOINT* record) {
+    return crc32_update(0, reinterpret_cast<const unsigned char*>(record),
+                        offsetof(FLASH_CHECKPOINT, record_crc32));
+}
+
+static long journal_sync(FLASH_JOURNAL* journal) {
+    journal->unsynced = 0;
+    journal->last_sync_ms = uds_now_ms();
+    if (fdatasync(journal->fd) != 0 && errno != EINVAL) {
+        LOGE("Journal sync failed: %s", strerror(errno));
+        return ERR_FAILED;
+    }
+    return STATUS_NOERROR;
+}
+
+static long journal_write(FLASH_JOURNAL* journal) {
+    FLASH_CHECKPOINT* record = &journal->record;
+    record->magic = FLASH_JOURNAL_MAGIC;
+    record->sequence++;
+    record->record_crc32 = record_crc(record);
+
+    off_t slot = static_cast<off_t>(record->sequence % FLASH_JOURNAL_SLOTS) * sizeof(FLASH_CHECKPOINT);
+    ssize_t written;
+    do {
+        written = pwrite(journal->fd, record, sizeof(FLASH_CHECKPOINT), slot);
+    } while (written < 0 && errno == EINTR);
+    if (written != static_cast<ssize_t>(sizeof(FLASH_CHECKPOINT))) {
+        LOGE("Journal write failed: %s", strerror(errno));
+        return ERR_FAILED;
+    }
+    journal->unsynced++;
+    return STATUS_NOERROR;
+}
+
+long flash_journal_open(FLASH_JOURNAL* journal, int fd) {
+    memset(journal, 0, sizeof(FLASH_JOURNAL));
+    if (fd < 0) {
+        return ERR_NULL_PARAMETER;
+    }
+    journal->fd = fd;
+    journal->last_sync_ms = uds_now_ms();
+
+    FLASH_CHECKPOINT slots[FLASH_JOURNAL_SLOTS];
+    ssize_t length = pread(fd, slots, sizeof(slots), 0);
+    if (length < 0) {
+        return ERR_FAILED;
+    }
+    for (unsigned int i = 0; i < FLASH_JOURNAL_SLOTS; i++) {
+        const FLASH_CHECKPOINT* slot = &slots[i];
+        if (static_cast<size_t>(length) < (i + 1) * sizeof(FLASH_CHECKPOINT) ||
+            slot->magic != FLASH_JOURNAL_MAGIC || slot->record_crc32 != record_crc(slot)) {
+            continue;
+        }
+        if (journal->record.magic == 0 ||
+            static_cast<int>(slot->sequence - journal->record.sequence) > 0) {
+            journal->record = *slot;
+        }
+    }
+    return STATUS_NOERROR;
+}
+
+unsigned long flash_journal_resume_offset(const FLASH_JOURNAL* journal, unsigned long address,
+                                          unsigned long size, unsigned int image_crc32,
+                                          unsigned char data_format) {
+    const FLASH_CHECKPOINT* record = &journal->record;
+    if (record->magic != FLASH_JOURNAL_MAGIC || record->state != FLASH_JOURNAL_TRANSFER ||
+        record->address != address || record->size != size ||
+        record->image_crc32 != image_crc32 || record->data_format != data_format ||
+        record->offset >= size) {
+        return 0;
+    }
+    return record->offset;
+}
+
+long flash_journal_checkpoint(FLASH_JOURNAL* journal, unsigned long offset,
+                              unsigned char block_counter) {
+    journal->record.offset = static_cast<unsigned int>(offset);
+    journal->record.block_counter = block_counter;
+    long result = journal_write(journal);
+    if (result == STATUS_NOERROR && (journal->unsynced >= FLASH_JOURNAL_SYNC_BLOCKS ||
+                                     uds_now_ms() - journal->last_sync_ms >= FLASH_JOURNAL_SYNC_MS)) {
+        result = journal_sync(journal);
+    }
+    return result;
+}
+
+// Starts a 0x34 for [address + offset, address + size); ERR_FAILED with last_nrc set if refused
+static long request_from(FLASH_SESSION* session, unsigned long address, unsigned long size,
+                         unsigned long offset, unsigned char data_format) {
+    if (offset > 0) {
+        // Whatever transfer the ECU still holds open is closed first; it may have none
+        flash_transfer_exit(session);
+        session->last_nrc = 0;
+        if (session->progress != nullptr) {
+            session->progress->nrc = 0;
+        }
+    }
+    return flash_request_download(session, address + offset, size - offset, data_format);
+}
+
+long flash_download_resumable(FLASH_SESSION* session, FLASH_JOURNAL* journal,
+                              unsigned long address, const unsigned char* data,
+                              unsigned long size, unsigned char data_format) {
+    // Compressed streams have no byte offset the ECU could restart at
+    int codec = FLASH_CODEC_NONE;
+    unsigned char profile_format = 0;
+    unsigned int frame_size = 0;
+    if (flash_profile_get(session->link.rx_id, &codec, &profile_format, &frame_size)) {
+        return flash_download(session, address, data, size, data_format);
+    }
+
+    unsigned int image_crc32 = crc32_update(0, data, size);
+    if (session->progress != nullptr) {
+        session->progress->image_crc32 = image_crc32;
+    }
+
+    unsigned long offset = flash_journal_resume_offset(journal, address, size, image_crc32,
+                                                       data_format);
+    long result = request_from(session, address, size, offset, data_format);
+    if (result == ERR_FAILED && offset > 0) {
+        LOGI("ECU 0x%lX refused resume at %lu (NRC 0x%02X), restarting",
+             session->link.rx_id, offset, session->last_nrc);
+        offset = 0;
+        result = request_from(session, address, size, 0, data_format);
+    } else if (result == STATUS_NOERROR && offset > 0) {
+        LOGI("Resuming download to 0x%lX at offset %lu of %lu", address, offset, size);
+    }
+
+    if (result == STATUS_NOERROR) {
+        FLASH_CHECKPOINT* record = &journal->record;
+        record->address = static_cast<unsigned int>(address);
+        record->size = static_cast<unsigned int>(size);
+        record->image_crc32 = image_crc32;
+        record->address_format = session->address_format;
+        record->data_format = data_format;
+        record->state = FLASH_JOURNAL_TRANSFER;
+        result = flash_journal_checkpoint(journal, offset, 0);
+    }
+
+    if (result == STATUS_NOERROR) {
+        if (session->progress != nullptr) {
+            __atomic_store_n(&session->progress->bytes_done, offset, __ATOMIC_RELEASE);
+        }
+        flash_set_phase(session, FLASH_PHASE_TRANSFER);
+
+        unsigned long chunk = session->max_block_length - 2;
+        unsigned char req[ISOTP_MAX_MESSAGE];
+        while (result == STATUS_NOERROR && offset < size) {
+            unsigned long length = size - offset < chunk ? size - offset : chunk;
+            memcpy(req + 2, data + offset, length);
+
+            result = flash_send_block(session, req, length);
+            if (result == STATUS_NOERROR) {
+                offset += length;
+                result = flash_journal_checkpoint(journal, offset,
+                                                  static_cast<unsigned char>(session->block_counter - 1));
+            }
+            if (result == STATUS_NOERROR && session->progress != nullptr) {
+                __atomic_store_n(&session->progress->bytes_done, offset, __ATOMIC_RELEASE);
+            }
+        }
+    }
+
+    if (result == STATUS_NOERROR) {
+        result = flash_transfer_exit(session);
+    }
+    if (result == STATUS_NOERROR) {
+        journal->record.state = FLASH_JOURNAL_COMPLETE;
+        result = journal_write(journal);
+    }
+    if (journal->unsynced > 0) {
+        long sync_result = journal_sync(journal);
+        if (result == STATUS_NOERROR) {
+            result = sync_result;
+        }
+    }
+
+    flash_set_phase(session, result == STATUS_NOERROR ? FLASH_PHASE_DONE : FLASH_PHASE_FAILED);
+    return result;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFlashDownloadResumable
+ * Signature: (IIIIJJJIIILjava/nio/ByteBuffer;)I
+ *
+ * nativeFlashDownload with a checkpoint journal in journal_fd. Calling it again
+ * with the same image and journal after a dropped link continues the download.
+ * Truncate the journal before erasing the region again, or the retry skips
+ * bytes the erase wiped.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFlashDownloadResumable
+  (JNIEnv *env, jobject obj, jint channel_id, jint flags, jint ecu_rx_id, jint fd,
+   jlong file_offset, jlong length, jlong memory_address, jint address_format,
+   jint data_format, jint journal_fd, jobject progress_buffer) {
+
+    if (g_j2534_lib == nullptr) {
+        g_last_error = ERR_DEVICE_NOT_CONNECTED;
+        return -1;
+    }
+
+    FLASH_PROGRESS* progress = nullptr;
+    if (progress_buffer != nullptr) {
+        progress = static_cast<FLASH_PROGRESS*>(env->GetDirectBufferAddress(progress_buffer));
+        if (progress == nullptr ||
+            env->GetDirectBufferCapacity(progress_buffer) < static_cast<jlong>(sizeof(FLASH_PROGRESS))) {
+            g_last_error = ERR_NULL_PARAMETER;
+            return -1;
+        }
+        progress->bytes_done = 0;
+        progress->bytes_total = static_cast<unsigned long long>(length);
+        progress->nrc = 0;
+        progress->cancel = 0;
+        progress->phase = FLASH_PHASE_IDLE;
+    }
+
+    FLASH_JOURNAL journal;
+    long result = flash_journal_open(&journal, journal_fd);
+    if (result != STATUS_NOERROR) {
+        g_last_error = result;
+        return -1;
+    }
+
+    FLASH_IMAGE image;
+    result = flash_image_map(&image, fd, static_cast<long long>(file_offset),
+                             static_cast<unsigned long>(length));
+    if (result != STATUS_NOERROR) {
+        g_last_error = result;
+        return -1;
+    }
+
+    UDS_LINK link;
+    unsigned long rx_id = static_cast<unsigned long>(ecu_rx_id);
+    unsigned long tx_flags = static_cast<unsigned long>(flags) | ISO15765_FRAME_PAD;
+    uds_link_init(&link, g_j2534_lib, static_cast<unsigned long>(channel_id),
+                  uds_physical_tx_id(rx_id), rx_id, tx_flags);
+
+    FLASH_SESSION session;
+    flash_session_init(&session, &link, static_cast<unsigned char>(address_format), progress);
+
+    unsigned long filter_id = 0;
+    result = uds_start_flow_control(g_j2534_lib, link.channel_id, link.tx_id, rx_id,
+                                    tx_flags, &filter_id);
+    if (result == STATUS_NOERROR) {
+        result = flash_download_resumable(&session, &journal,
+                                          static_cast<unsigned long>(memory_address),
+                                          image.data, image.size,
+                                          static_cast<unsigned char>(data_format));
+        g_j2534_lib->PassThruStopMsgFilter(link.channel_id, filter_id);
+    }
+    flash_image_unmap(&image);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return 0;
+    } else {
+        return -1;
+    }
+}
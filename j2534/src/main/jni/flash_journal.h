@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef FLASH_JOURNAL_H
+#define FLASH_JOURNAL_H
+
+#include <jni.h>
+#include "uds_flash.h"
+
+#define FLASH_JOURNAL_MAGIC 0x4A465053  // "SPFJ"
+
+// Checkpoints alternate between two slots so a torn write leaves the previous one
+#define FLASH_JOURNAL_SLOTS 2
+
+// Batched fsync: a checkpoint is forced to storage after this many blocks or this long
+#define FLASH_JOURNAL_SYNC_BLOCKS 32
+#define FLASH_JOURNAL_SYNC_MS 1000
+
+// Checkpoint states
+#define FLASH_JOURNAL_TRANSFER 1
+#define FLASH_JOURNAL_COMPLETE 2
+
+/*
+ * On-disk checkpoint (native byte order). offset only ever covers blocks the ECU
+ * has acknowledged, so every persisted record is a safe resume point.
+ */
+typedef struct {
+    unsigned int magic;
+    unsigned int sequence;
+    unsigned int address;
+    unsigned int size;
+    unsigned int offset;
+    unsigned int image_crc32;
+    unsigned char block_counter;   // counter of the last acknowledged 0x36
+    unsigned char address_format;
+    unsigned char data_format;
+    unsigned char state;
+    unsigned int record_crc32;     // CRC32 of the fields above
+} FLASH_CHECKPOINT;
+
+typedef struct {
+    int fd;
+    FLASH_CHECKPOINT record;       // latest record, written or recovered
+    unsigned int unsynced;
+    unsigned long long last_sync_ms;
+} FLASH_JOURNAL;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Recovers the newest valid checkpoint from fd; record.magic is 0 if there is none
+long flash_journal_open(FLASH_JOURNAL* journal, int fd);
+
+// Acknowledged bytes that can be skipped when flashing the same image again, or 0
+unsigned long flash_journal_resume_offset(const FLASH_JOURNAL* journal, unsigned long address,
+                                          unsigned long size, unsigned int image_crc32,
+                                          unsigned char data_format);
+
+// Records progress after an acknowledged block; fsyncs in batches
+long flash_journal_checkpoint(FLASH_JOURNAL* journal, unsigned long offset,
+                              unsigned char block_counter);
+
+/*
+ * flash_download with a checkpoint after every block. If the journal matches the
+ * image, the stale transfer is closed with 0x37 and 0x34 is reissued for the
+ * remaining bytes only; an ECU that refuses the partial region gets the full one.
+ * The journal only describes what the ECU holds while the region is untouched:
+ * callers that erase it again before retrying must discard the journal first.
+ */
+long flash_download_resumable(FLASH_SESSION* session, FLASH_JOURNAL* journal,
+                              unsigned long address, const unsigned char* data,
+                              unsigned long size, unsigned char data_format);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFlashDownloadResumable
+ * Signature: (IIIIJJJIIILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFlashDownloadResumable
+  (JNIEnv *, jobject, jint, jint, jint, jint, jlong, jlong, jlong, jint, jint, jint, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLASH_JOURNAL_H
@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "flash_multi.h"
+#include "checksum.h"
+#include "j2534_jni.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    unsigned int active;
+} FLASH_MULTI;
+
+typedef struct {
+    FLASH_JOB* job;
+    FLASH_MULTI* multi;
+    pthread_t thread;
+    int started;
+} FLASH_WORKER;
+
+static void* flash_job_thread(void* arg) {
+    FLASH_WORKER* worker = static_cast<FLASH_WORKER*>(arg);
+    FLASH_JOB* job = worker->job;
+
+    UDS_LINK link;
+    uds_link_init(&link, job->lib, job->channel_id, uds_physical_tx_id(job->rx_id), job->rx_id,
+                  job->tx_flags);
+
+    FLASH_SESSION session;
+    flash_session_init(&session, &link, job->address_format, job->progress);
+
+    unsigned long filter_id = 0;
+    long result = uds_start_flow_control(job->lib, link.channel_id, link.tx_id, job->rx_id,
+                                         job->tx_flags, &filter_id);
+    if (result == STATUS_NOERROR) {
+        result = flash_download(&session, job->memory_address, job->image.data, job->image.size,
+                                job->data_format);
+        job->lib->PassThruStopMsgFilter(link.channel_id, filter_id);
+    } else {
+        flash_set_phase(&session, FLASH_PHASE_FAILED);
+    }
+
+    pthread_mutex_lock(&worker->multi->mutex);
+    job->result = result;
+    __atomic_store_n(&job->finished, 1, __ATOMIC_RELEASE);
+    worker->multi->active--;
+    pthread_cond_broadcast(&worker->multi->changed);
+    pthread_mutex_unlock(&worker->multi->mutex);
+    return nullptr;
+}
+
+/*
+ * Pages in one chunk for the running session with the smallest lead over its
+ * transfer position. Reading through crc32_update both faults the mapping in and
+ * yields the image CRC once the job is fully prefetched. Returns 0 when every
+ * session is a full window ahead.
+ */
+static int prefetch_next(FLASH_JOB* jobs, unsigned int count) {
+    FLASH_JOB* next = nullptr;
+    unsigned long long next_lead = 0;
+
+    for (unsigned int i = 0; i < count; i++) {
+        FLASH_JOB* job = &jobs[i];
+        if (job->prefetched >= job->image.size) {
+            continue;
+        }
+        int finished = __atomic_load_n(&job->finished, __ATOMIC_ACQUIRE);
+        if (finished && job->result != STATUS_NOERROR) {
+            continue;
+        }
+        unsigned long long done = __atomic_load_n(&job->progress->bytes_done, __ATOMIC_ACQUIRE);
+        unsigned long long lead = job->prefetched > done ? job->prefetched - done : 0;
+        // Finished jobs only need the rest of their CRC, which is no longer urgent
+        if (finished) {
+            lead = FLASH_READAHEAD_WINDOW;
+        } else if (lead >= FLASH_READAHEAD_WINDOW) {
+            continue;
+        }
+        if (next == nullptr || lead < next_lead) {
+            next = job;
+            next_lead = lead;
+        }
+    }
+    if (next == nullptr) {
+        return 0;
+    }
+
+    unsigned long chunk = next->image.size - next->prefetched;
+    if (chunk > FLASH_READAHEAD_CHUNK) {
+        chunk = FLASH_READAHEAD_CHUNK;
+    }
+    next->crc = crc32_update(next->crc, next->image.data + next->prefetched, chunk);
+    next->prefetched += chunk;
+    if (next->prefetched == next->image.size) {
+        next->progress->image_crc32 = next->crc;
+    }
+    return 1;
+}
+
+unsigned int flash_multi_run(FLASH_JOB* jobs, unsigned int count) {
+    FLASH_MULTI multi;
+    pthread_mutex_init(&multi.mutex, nullptr);
+    pthread_cond_init(&multi.changed, nullptr);
+    multi.active = 0;
+
+    FLASH_WORKER workers[FLASH_MULTI_MAX_JOBS];
+    if (count > FLASH_MULTI_MAX_JOBS) {
+        count = FLASH_MULTI_MAX_JOBS;
+    }
+
+    pthread_mutex_lock(&multi.mutex);
+    for (unsigned int i = 0; i < count; i++) {
+        jobs[i].prefetched = 0;
+        jobs[i].crc = 0;
+        jobs[i].result = STATUS_NOERROR;
+        jobs[i].finished = 0;
+
+        workers[i].job = &jobs[i];
+        workers[i].multi = &multi;
+        workers[i].started = pthread_create(&workers[i].thread, nullptr, flash_job_thread,
+                                            &workers[i]) == 0;
+        if (workers[i].started) {
+            multi.active++;
+        } else {
+            jobs[i].result = ERR_FAILED;
+            jobs[i].finished = 1;
+        }
+    }
+    pthread_mutex_unlock(&multi.mutex);
+
+    // This thread is the I/O scheduler until every session has ended
+    for (;;) {
+        pthread_mutex_lock(&multi.mutex);
+        unsigned int active = multi.active;
+        pthread_mutex_unlock(&multi.mutex);
+
+        if (prefetch_next(jobs, count)) {
+            continue;
+        }
+        if (active == 0) {
+            break;
+        }
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += FLASH_SCHEDULER_IDLE_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&multi.mutex);
+        if (multi.active == active) {
+            pthread_cond_timedwait(&multi.changed, &multi.mutex, &deadline);
+        }
+        pthread_mutex_unlock(&multi.mutex);
+    }
+
+    unsigned int completed = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        if (workers[i].started) {
+            pthread_join(workers[i].thread, nullptr);
+        }
+        if (jobs[i].result == STATUS_NOERROR) {
+            completed++;
+        }
+    }
+    pthread_cond_destroy(&multi.changed);
+    pthread_mutex_destroy(&multi.mutex);
+    return completed;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFlashMulti
+ * Signature: ([J[I[JLjava/nio/ByteBuffer;[I)I
+ *
+ * libraries holds one nativeLoadLibrary handle per job (0 for the current
+ * library). progress, if given, holds one FLASH_PROGRESS per job and results
+ * receives each job's status. Blocks until every session has ended and returns
+ * the number that completed.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFlashMulti
+  (JNIEnv *env, jobject obj, jlongArray libraries, jintArray job_ints, jlongArray job_longs,
+   jobject progress_buffer, jintArray results) {
+
+    if (libraries == nullptr || job_ints == nullptr || job_longs == nullptr || results == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+    jsize count = env->GetArrayLength(libraries);
+    if (count <= 0 || count > FLASH_MULTI_MAX_JOBS ||
+        env->GetArrayLength(job_ints) != count * FLASH_MULTI_JOB_INTS ||
+        env->GetArrayLength(job_longs) != count * FLASH_MULTI_JOB_LONGS ||
+        env->GetArrayLength(results) < count) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    FLASH_PROGRESS* progress = nullptr;
+    FLASH_PROGRESS* owned_progress = nullptr;
+    if (progress_buffer != nullptr) {
+        progress = static_cast<FLASH_PROGRESS*>(env->GetDirectBufferAddress(progress_buffer));
+        if (progress == nullptr || env->GetDirectBufferCapacity(progress_buffer) <
+                static_cast<jlong>(count * sizeof(FLASH_PROGRESS))) {
+            g_last_error = ERR_NULL_PARAMETER;
+            return -1;
+        }
+    } else {
+        // The scheduler paces itself on bytes_done, so every job needs a counter
+        owned_progress = static_cast<FLASH_PROGRESS*>(calloc(count, sizeof(FLASH_PROGRESS)));
+        if (owned_progress == nullptr) {
+            g_last_error = ERR_INSUFFICIENT_MEMORY;
+            return -1;
+        }
+        progress = owned_progress;
+    }
+
+    jlong handles[FLASH_MULTI_MAX_JOBS];
+    jint ints[FLASH_MULTI_MAX_JOBS * FLASH_MULTI_JOB_INTS];
+    jlong longs[FLASH_MULTI_MAX_JOBS * FLASH_MULTI_JOB_LONGS];
+    env->GetLongArrayRegion(libraries, 0, count, handles);
+    env->GetIntArrayRegion(job_ints, 0, count * FLASH_MULTI_JOB_INTS, ints);
+    env->GetLongArrayRegion(job_longs, 0, count * FLASH_MULTI_JOB_LONGS, longs);
+
+    FLASH_JOB jobs[FLASH_MULTI_MAX_JOBS];
+    memset(jobs, 0, sizeof(jobs));
+    long result = STATUS_NOERROR;
+    jsize mapped = 0;
+    for (; mapped < count; mapped++) {
+        FLASH_JOB* job = &jobs[mapped];
+        const jint* in = &ints[mapped * FLASH_MULTI_JOB_INTS];
+        const jlong* region = &longs[mapped * FLASH_MULTI_JOB_LONGS];
+
+        job->lib = handles[mapped] != 0 ? reinterpret_cast<J2534_LIBRARY*>(handles[mapped])
+                                        : g_j2534_lib;
+        if (job->lib == nullptr) {
+            result = ERR_DEVICE_NOT_CONNECTED;
+            break;
+        }
+        job->channel_id = static_cast<unsigned long>(in[0]);
+        job->tx_flags = static_cast<unsigned long>(in[1]) | ISO15765_FRAME_PAD;
+        job->rx_id = static_cast<unsigned long>(in[2]);
+        job->address_format = static_cast<unsigned char>(in[4]);
+        job->data_format = static_cast<unsigned char>(in[5]);
+        job->memory_address = static_cast<unsigned long>(region[2]);
+
+        result = flash_image_map(&job->image, in[3], static_cast<long long>(region[0]),
+                                 static_cast<unsigned long>(region[1]));
+        if (result != STATUS_NOERROR) {
+            break;
+        }
+
+        job->progress = &progress[mapped];
+        job->progress->bytes_done = 0;
+        job->progress->bytes_total = static_cast<unsigned long long>(region[1]);
+        job->progress->nrc = 0;
+        job->progress->image_crc32 = 0;
+    }
+
+    jint status[FLASH_MULTI_MAX_JOBS];
+    jint completed = 0;
+    if (result == STATUS_NOERROR) {
+        completed = static_cast<jint>(flash_multi_run(jobs, static_cast<unsigned int>(count)));
+        for (jsize i = 0; i < count; i++) {
+            status[i] = static_cast<jint>(jobs[i].result);
+            if (result == STATUS_NOERROR) {
+                result = jobs[i].result;
+            }
+        }
+        env->SetIntArrayRegion(results, 0, count, status);
+    }
+
+    for (jsize i = 0; i < mapped; i++) {
+        flash_image_unmap(&jobs[i].image);
+    }
+    free(owned_progress);
+    g_last_error = result;
+
+    if (mapped < count) {
+        return -1;
+    }
+    LOGI("Multi-ECU flash: %d of %d sessions completed", completed, count);
+    return completed;
+}
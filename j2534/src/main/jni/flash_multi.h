@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef FLASH_MULTI_H
+#define FLASH_MULTI_H
+
+#include <jni.h>
+#include "uds_flash.h"
+
+#define FLASH_MULTI_MAX_JOBS 16
+
+// Per-job layout of the Java int[] and long[] job descriptions
+#define FLASH_MULTI_JOB_INTS 6   // channel, flags, ecuRx, fd, addressFormat, dataFormat
+#define FLASH_MULTI_JOB_LONGS 3  // fileOffset, length, memoryAddress
+
+// I/O scheduler: image bytes kept resident ahead of each session's transfer position
+#define FLASH_READAHEAD_WINDOW (1024 * 1024)
+#define FLASH_READAHEAD_CHUNK (64 * 1024)
+#define FLASH_SCHEDULER_IDLE_MS 10
+
+/*
+ * One download on its own channel. lib may differ per job so sessions on
+ * different pass-thru devices run side by side; nothing here touches g_j2534_lib.
+ */
+typedef struct {
+    J2534_LIBRARY* lib;
+    unsigned long channel_id;
+    unsigned long tx_flags;
+    unsigned long rx_id;
+    unsigned char address_format;
+    unsigned char data_format;
+    unsigned long memory_address;
+    FLASH_IMAGE image;
+    FLASH_PROGRESS* progress;
+    unsigned long prefetched;   // image bytes already faulted in by the scheduler
+    unsigned int crc;           // CRC32 of the prefetched bytes
+    long result;
+    int finished;
+} FLASH_JOB;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Runs every job on its own worker thread. The calling thread becomes the I/O
+ * scheduler: it pages image data in ahead of whichever session is closest to
+ * running dry, so storage reads never stall a bus. Returns the number of jobs
+ * that completed; per-job status is left in job->result.
+ */
+unsigned int flash_multi_run(FLASH_JOB* jobs, unsigned int count);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFlashMulti
+ * Signature: ([J[I[JLjava/nio/ByteBuffer;[I)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFlashMulti
+  (JNIEnv *, jobject, jlongArray, jintArray, jlongArray, jobject, jintArray);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLASH_MULTI_H
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "j1939_dm.h"
+#include "uds_client.h"
+#include "j2534_jni.h"
+#include <stdlib.h>
+#include <string.h>
+
+static_assert(sizeof(J1939_DTC) == 8, "DTC records are 8 bytes in the change ring");
+
+static int dtc_before(const J1939_DTC* a, const J1939_DTC* b) {
+    return a->spn != b->spn ? a->spn < b->spn : a->fmi < b->fmi;
+}
+
+// Decodes and sorts the DTC list; DM1 sets are short, so insertion sort is enough
+static unsigned int decode_dtcs(const unsigned char* data, unsigned long length, J1939_DTC* dtcs) {
+    unsigned int count = 0;
+    for (unsigned long offset = J1939_DM_LAMP_SIZE; offset + J1939_DM_DTC_SIZE <= length;
+         offset += J1939_DM_DTC_SIZE) {
+        const unsigned char* raw = data + offset;
+        J1939_DTC dtc;
+        dtc.spn = raw[0] | (static_cast<unsigned int>(raw[1]) << 8) |
+                  (static_cast<unsigned int>(raw[2] & 0xE0) << 11);
+        dtc.fmi = raw[2] & 0x1F;
+        dtc.conversion = raw[3] >> 7;
+        dtc.occurrence = raw[3] & 0x7F;
+        dtc.reserved = 0;
+        // SPN 0 / FMI 0 stands for "no DTC"; all ones is padding
+        if ((dtc.spn == 0 && dtc.fmi == 0) || (dtc.spn == 0x7FFFF && dtc.fmi == 0x1F)) {
+            continue;
+        }
+        unsigned int i = count++;
+        while (i > 0 && dtc_before(&dtc, &dtcs[i - 1])) {
+            dtcs[i] = dtcs[i - 1];
+            i--;
+        }
+        dtcs[i] = dtc;
+    }
+    return count;
+}
+
+static void write_record(J1939_DM_TRACKER* tracker, int kind, unsigned char source,
+                         const J1939_DM_SET* set, unsigned long long unchanged_ms) {
+    if (tracker->ring == nullptr) {
+        return;
+    }
+    unsigned char* slot = tracker->ring + J1939_DM_RING_HEADER_SIZE +
+                          (tracker->seq % tracker->slot_count) * J1939_DM_SLOT_SIZE;
+
+    unsigned int stored = set->count;
+    if (stored > J1939_DM_SLOT_DTCS) {
+        stored = J1939_DM_SLOT_DTCS;
+        unsigned int* truncated = reinterpret_cast<unsigned int*>(tracker->ring + 16);
+        __atomic_store_n(truncated, *truncated + 1, __ATOMIC_RELAXED);
+    }
+
+    unsigned int timestamp = static_cast<unsigned int>(set->changed_ms - tracker->epoch_ms);
+    unsigned short stored16 = static_cast<unsigned short>(stored);
+    unsigned int unchanged = unchanged_ms > 0xFFFFFFFFULL ? 0xFFFFFFFFU : static_cast<unsigned int>(unchanged_ms);
+    memcpy(slot, &timestamp, 4);
+    slot[4] = source;
+    slot[5] = static_cast<unsigned char>(kind);
+    memcpy(slot + 6, &set->lamp, 2);
+    memcpy(slot + 8, &set->count, 2);
+    memcpy(slot + 10, &stored16, 2);
+    memcpy(slot + 12, &unchanged, 4);
+    memcpy(slot + J1939_DM_RECORD_HEADER_SIZE, set->dtcs, stored * sizeof(J1939_DTC));
+
+    tracker->seq++;
+    __atomic_store_n(reinterpret_cast<unsigned long long*>(tracker->ring), tracker->seq, __ATOMIC_RELEASE);
+}
+
+int j1939_dm_process(J1939_DM_TRACKER* tracker, int kind, unsigned char source,
+                     const unsigned char* data, unsigned long length) {
+    if (kind < 0 || kind >= J1939_DM_KINDS || length < J1939_DM_LAMP_SIZE) {
+        return 0;
+    }
+    tracker->messages++;
+
+    J1939_DM_SET* set = tracker->sets[kind][source];
+    int first = set == nullptr;
+    if (first) {
+        set = static_cast<J1939_DM_SET*>(calloc(1, sizeof(J1939_DM_SET)));
+        if (set == nullptr) {
+            return 0;
+        }
+        tracker->sets[kind][source] = set;
+    }
+
+    J1939_DTC dtcs[J1939_DM_MAX_DTCS];
+    unsigned int count = decode_dtcs(data, length, dtcs);
+    unsigned short lamp = static_cast<unsigned short>(data[0] | (data[1] << 8));
+
+    // The steady state: same lamps, same DTCs, same counters
+    if (!first && lamp == set->lamp && count == set->count &&
+        memcmp(dtcs, set->dtcs, count * sizeof(J1939_DTC)) == 0) {
+        return 0;
+    }
+
+    unsigned long long now = uds_now_ms();
+    unsigned long long unchanged_ms = first ? 0 : now - set->changed_ms;
+    set->lamp = lamp;
+    set->count = static_cast<unsigned short>(count);
+    set->changed_ms = now;
+    memcpy(set->dtcs, dtcs, count * sizeof(J1939_DTC));
+    tracker->changes++;
+    write_record(tracker, kind, source, set, unchanged_ms);
+    return 1;
+}
+
+static void dm_handler(void* context, unsigned long pgn, unsigned char priority,
+                       unsigned char source, unsigned char destination,
+                       const unsigned char* data, unsigned long length) {
+    j1939_dm_process(static_cast<J1939_DM_TRACKER*>(context),
+                     pgn == J1939_PGN_DM1 ? J1939_DM_KIND_DM1 : J1939_DM_KIND_DM2,
+                     source, data, length);
+}
+
+long j1939_dm_init(J1939_DM_TRACKER* tracker, unsigned char* ring, unsigned long ring_size,
+                   unsigned long long epoch_ms) {
+    memset(tracker, 0, sizeof(J1939_DM_TRACKER));
+    tracker->epoch_ms = epoch_ms;
+    if (ring == nullptr) {
+        return STATUS_NOERROR;
+    }
+    if (ring_size < J1939_DM_RING_HEADER_SIZE + J1939_DM_SLOT_SIZE) {
+        return ERR_INVALID_MSG;
+    }
+    tracker->ring = ring;
+    tracker->slot_count = static_cast<unsigned int>((ring_size - J1939_DM_RING_HEADER_SIZE) / J1939_DM_SLOT_SIZE);
+    memset(ring, 0, J1939_DM_RING_HEADER_SIZE);
+    unsigned int slot_size = J1939_DM_SLOT_SIZE;
+    memcpy(ring + 8, &tracker->slot_count, 4);
+    memcpy(ring + 12, &slot_size, 4);
+    return STATUS_NOERROR;
+}
+
+void j1939_dm_free(J1939_DM_TRACKER* tracker) {
+    for (int kind = 0; kind < J1939_DM_KINDS; kind++) {
+        for (int source = 0; source < 256; source++) {
+            free(tracker->sets[kind][source]);
+            tracker->sets[kind][source] = nullptr;
+        }
+    }
+}
+
+long j1939_dm_attach(J1939_DM_TRACKER* tracker, J1939_STACK* stack) {
+    const unsigned long pgns[] = {J1939_PGN_DM1, J1939_PGN_DM2};
+    return j1939_register_all(stack, pgns, 2, dm_handler, tracker);
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeJ1939TrackDm
+ * Signature: (JLjava/nio/ByteBuffer;)I
+ *
+ * Moves DM1/DM2 of a running nativeJ1939Start stack out of its message ring:
+ * they are decoded on the RX thread and only changed sets reach ring_buffer.
+ * The tracker lives until nativeJ1939Stop. The stack must not already route
+ * DM1 or DM2 explicitly (ERR_NOT_UNIQUE).
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeJ1939TrackDm
+  (JNIEnv *env, jobject obj, jlong handle, jobject ring_buffer) {
+
+    J1939_JAVA_STACK* java = reinterpret_cast<J1939_JAVA_STACK*>(handle);
+    unsigned char* ring = ring_buffer != nullptr
+        ? static_cast<unsigned char*>(env->GetDirectBufferAddress(ring_buffer)) : nullptr;
+    if (java == nullptr || ring == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+    if (java->dm_tracker != nullptr) {
+        g_last_error = ERR_NOT_UNIQUE;
+        return -1;
+    }
+
+    J1939_DM_TRACKER* tracker = static_cast<J1939_DM_TRACKER*>(malloc(sizeof(J1939_DM_TRACKER)));
+    if (tracker == nullptr) {
+        g_last_error = ERR_INSUFFICIENT_MEMORY;
+        return -1;
+    }
+    long result = j1939_dm_init(tracker, ring,
+                                static_cast<unsigned long>(env->GetDirectBufferCapacity(ring_buffer)),
+                                java->epoch_ms);
+    if (result == STATUS_NOERROR) {
+        // Kept before attaching: the RX thread starts writing as soon as the routes are live
+        java->dm_ring_ref = env->NewGlobalRef(ring_buffer);
+        java->dm_tracker = tracker;
+        result = j1939_dm_attach(tracker, &java->stack);
+    }
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return 0;
+    }
+    // Attaching routes both PGNs or neither, so nothing can reach the tracker now
+    if (java->dm_tracker != nullptr) {
+        env->DeleteGlobalRef(java->dm_ring_ref);
+        java->dm_ring_ref = nullptr;
+        java->dm_tracker = nullptr;
+    }
+    free(tracker);
+    return -1;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef J1939_DM_H
+#define J1939_DM_H
+
+#include <jni.h>
+#include "j1939_stack.h"
+
+// J1939-73 diagnostic messages
+#define J1939_PGN_DM1 0xFECA    // active DTCs
+#define J1939_PGN_DM2 0xFECB    // previously active DTCs
+
+#define J1939_DM_KIND_DM1 0
+#define J1939_DM_KIND_DM2 1
+#define J1939_DM_KINDS 2
+
+#define J1939_DM_LAMP_SIZE 2
+#define J1939_DM_DTC_SIZE 4
+#define J1939_DM_MAX_DTCS ((J1939_MAX_MESSAGE - J1939_DM_LAMP_SIZE) / J1939_DM_DTC_SIZE)
+
+// One decoded DTC (SPN conversion method 4)
+typedef struct {
+    unsigned int spn;
+    unsigned char fmi;
+    unsigned char occurrence;
+    unsigned char conversion;      // CM bit as sent; 1 marks a pre-method-4 SPN layout
+    unsigned char reserved;
+} J1939_DTC;
+
+// Current set of one source for DM1 or DM2, sorted by SPN then FMI
+typedef struct {
+    unsigned short lamp;           // lamp status byte | flash byte << 8
+    unsigned short count;
+    unsigned long long changed_ms;
+    J1939_DTC dtcs[J1939_DM_MAX_DTCS];
+} J1939_DM_SET;
+
+/*
+ * Change ring shared with Java (native byte order). A record is written only
+ * when a source's set differs from what it last sent:
+ *    0  u64 write_seq     records written so far, stored with release semantics
+ *    8  u32 slot_count
+ *   12  u32 slot_size     J1939_DM_SLOT_SIZE
+ *   16  u32 truncated     records whose set did not fit a slot
+ *   20  u32 reserved
+ *   24  slots[slot_count]: u32 timestamp_ms, u8 source, u8 kind, u16 lamp,
+ *       u16 count, u16 stored, u32 unchanged_ms (age of the previous set),
+ *       J1939_DTC dtcs[stored]
+ */
+#define J1939_DM_RING_HEADER_SIZE 24
+#define J1939_DM_RECORD_HEADER_SIZE 16
+#define J1939_DM_SLOT_DTCS 62
+#define J1939_DM_SLOT_SIZE (J1939_DM_RECORD_HEADER_SIZE + J1939_DM_SLOT_DTCS * 8)
+
+typedef struct {
+    J1939_DM_SET* sets[J1939_DM_KINDS][256];   // allocated when a source first reports
+    unsigned char* ring;
+    unsigned int slot_count;
+    unsigned long long seq;
+    unsigned long long epoch_ms;
+    unsigned int messages;
+    unsigned int changes;
+} J1939_DM_TRACKER;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ring may be null when only j1939_dm_process results are wanted
+long j1939_dm_init(J1939_DM_TRACKER* tracker, unsigned char* ring, unsigned long ring_size,
+                   unsigned long long epoch_ms);
+void j1939_dm_free(J1939_DM_TRACKER* tracker);
+
+// Routes DM1 and DM2 of stack to the tracker, both or neither; may be called while the stack runs
+long j1939_dm_attach(J1939_DM_TRACKER* tracker, J1939_STACK* stack);
+
+/*
+ * Decodes one DM1/DM2 message and updates the source's set. Returns 1 when
+ * the set or lamp status changed (and a record was written), 0 otherwise.
+ */
+int j1939_dm_process(J1939_DM_TRACKER* tracker, int kind, unsigned char source,
+                     const unsigned char* data, unsigned long length);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeJ1939TrackDm
+ * Signature: (JLjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeJ1939TrackDm
+  (JNIEnv *, jobject, jlong, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // J1939_DM_H
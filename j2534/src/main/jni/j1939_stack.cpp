@@ -0,0 +1,842 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "j1939_stack.h"
+#include "j1939_dm.h"
+#include "uds_client.h"
+#include "j2534_jni.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// TP.CM_Abort reasons
+#define J1939_ABORT_NO_RESOURCES 2
+#define J1939_ABORT_TIMEOUT 3
+
+static unsigned long make_can_id(unsigned char priority, unsigned long pgn,
+                                 unsigned char destination, unsigned char source) {
+    unsigned long can_id = (static_cast<unsigned long>(priority & 0x07) << 26) |
+                           ((pgn & 0x3FF00UL) << 8) | source;
+    if (((pgn >> 8) & 0xFF) < 240) {
+        can_id |= static_cast<unsigned long>(destination) << 8;   // PDU1: PS is the destination
+    } else {
+        can_id |= (pgn & 0xFF) << 8;                              // PDU2: PS is the group extension
+    }
+    return can_id;
+}
+
+static unsigned long parse_can_id(unsigned long can_id, unsigned char* destination) {
+    if (((can_id >> 16) & 0xFF) < 240) {
+        *destination = static_cast<unsigned char>(can_id >> 8);
+        return (can_id >> 8) & 0x3FF00UL;
+    }
+    *destination = J1939_GLOBAL_ADDRESS;
+    return (can_id >> 8) & 0x3FFFFUL;
+}
+
+static unsigned long long name_value(const unsigned char name[8]) {
+    unsigned long long value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | name[i];
+    }
+    return value;
+}
+
+static void wait_until(J1939_STACK* stack, unsigned long long deadline_ms) {
+    unsigned long long now = uds_now_ms();
+    if (deadline_ms <= now) {
+        return;
+    }
+    unsigned long long wait_ms = deadline_ms - now;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += static_cast<time_t>(wait_ms / 1000);
+    deadline.tv_nsec += static_cast<long>(wait_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&stack->state_changed, &stack->state_mutex, &deadline);
+}
+
+static long write_frame(J1939_STACK* stack, unsigned long can_id, const unsigned char* data,
+                        unsigned long length) {
+    PASSTHRU_MSG msg;
+    memset(&msg, 0, sizeof(PASSTHRU_MSG));
+    msg.ProtocolID = CAN;
+    msg.TxFlags = CAN_29BIT_ID;
+    msg.DataSize = UDS_CAN_ID_SIZE + length;
+    msg.Data[0] = static_cast<unsigned char>(can_id >> 24);
+    msg.Data[1] = static_cast<unsigned char>(can_id >> 16);
+    msg.Data[2] = static_cast<unsigned char>(can_id >> 8);
+    msg.Data[3] = static_cast<unsigned char>(can_id);
+    memcpy(msg.Data + UDS_CAN_ID_SIZE, data, length);
+
+    pthread_mutex_lock(&stack->tx_mutex);
+    unsigned long num_msgs = 1;
+    long result = stack->lib->PassThruWriteMsgs(stack->channel_id, &msg, &num_msgs, 0);
+    pthread_mutex_unlock(&stack->tx_mutex);
+    return result;
+}
+
+static long send_tp_cm(J1939_STACK* stack, unsigned char destination, unsigned char control,
+                       unsigned char b1, unsigned char b2, unsigned char b3, unsigned char b4,
+                       unsigned long pgn) {
+    unsigned char frame[8] = {
+        control, b1, b2, b3, b4,
+        static_cast<unsigned char>(pgn),
+        static_cast<unsigned char>(pgn >> 8),
+        static_cast<unsigned char>(pgn >> 16),
+    };
+    return write_frame(stack, make_can_id(7, J1939_PGN_TP_CM, destination, stack->address),
+                       frame, sizeof(frame));
+}
+
+static void send_claim(J1939_STACK* stack) {
+    write_frame(stack, make_can_id(J1939_DEFAULT_PRIORITY, J1939_PGN_ADDRESS_CLAIMED,
+                                   J1939_GLOBAL_ADDRESS, stack->address),
+                stack->name, sizeof(stack->name));
+}
+
+static unsigned int route_slot(unsigned long pgn) {
+    unsigned int hash = static_cast<unsigned int>(pgn) * 0x9E3779B1u;
+    return hash >> (32 - J1939_DISPATCH_BITS);
+}
+
+static void dispatch(J1939_STACK* stack, unsigned long pgn, unsigned char priority,
+                     unsigned char source, unsigned char destination,
+                     const unsigned char* data, unsigned long length) {
+    stack->messages++;
+    const J1939_ROUTE* route = &stack->any_route;
+    for (unsigned int i = 0, slot = route_slot(pgn); i < J1939_DISPATCH_SIZE;
+         i++, slot = (slot + 1) & (J1939_DISPATCH_SIZE - 1)) {
+        if (!__atomic_load_n(&stack->routes[slot].in_use, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        if (stack->routes[slot].pgn == pgn) {
+            route = &stack->routes[slot];
+            break;
+        }
+    }
+    if (__atomic_load_n(&route->in_use, __ATOMIC_ACQUIRE)) {
+        route->handler(route->context, pgn, priority, source, destination, data, length);
+    }
+}
+
+// The route is filled before in_use is published, so the RX thread never sees half of it
+static long set_route(J1939_STACK* stack, J1939_ROUTE* route, unsigned long pgn,
+                      J1939_HANDLER handler, void* context) {
+    if (route->in_use && stack->running) {
+        return ERR_NOT_UNIQUE;   // the RX thread may be inside the old handler
+    }
+    route->pgn = pgn;
+    route->handler = handler;
+    route->context = context;
+    __atomic_store_n(&route->in_use, 1, __ATOMIC_RELEASE);
+    return STATUS_NOERROR;
+}
+
+// Existing route of pgn or the first free slot in its probe chain, skipping slots in claimed
+static J1939_ROUTE* find_route(J1939_STACK* stack, unsigned long pgn,
+                               J1939_ROUTE* const* claimed, unsigned int claimed_count) {
+    if (pgn == J1939_PGN_ANY) {
+        return &stack->any_route;
+    }
+    for (unsigned int i = 0, slot = route_slot(pgn); i < J1939_DISPATCH_SIZE;
+         i++, slot = (slot + 1) & (J1939_DISPATCH_SIZE - 1)) {
+        J1939_ROUTE* route = &stack->routes[slot];
+        int taken = 0;
+        for (unsigned int c = 0; c < claimed_count; c++) {
+            taken |= claimed[c] == route;
+        }
+        if (!taken && (!route->in_use || route->pgn == pgn)) {
+            return route;
+        }
+    }
+    return nullptr;
+}
+
+long j1939_register(J1939_STACK* stack, unsigned long pgn, J1939_HANDLER handler, void* context) {
+    return j1939_register_all(stack, &pgn, 1, handler, context);
+}
+
+long j1939_register_all(J1939_STACK* stack, const unsigned long* pgns, unsigned int count,
+                        J1939_HANDLER handler, void* context) {
+    if (handler == nullptr || pgns == nullptr || count == 0 || count > J1939_DISPATCH_SIZE) {
+        return ERR_NULL_PARAMETER;
+    }
+    J1939_ROUTE* routes[J1939_DISPATCH_SIZE];
+    long result = STATUS_NOERROR;
+
+    // Every slot is checked before the first route is published
+    pthread_mutex_lock(&stack->state_mutex);
+    for (unsigned int i = 0; i < count && result == STATUS_NOERROR; i++) {
+        routes[i] = find_route(stack, pgns[i], routes, i);
+        if (routes[i] == nullptr) {
+            result = ERR_BUFFER_FULL;
+        } else if (routes[i]->in_use && stack->running) {
+            result = ERR_NOT_UNIQUE;   // the RX thread may be inside the old handler
+        }
+    }
+    for (unsigned int i = 0; i < count && result == STATUS_NOERROR; i++) {
+        result = set_route(stack, routes[i], pgns[i], handler, context);
+    }
+    pthread_mutex_unlock(&stack->state_mutex);
+    return result;
+}
+
+static J1939_RX_SESSION* find_session(J1939_STACK* stack, unsigned char source,
+                                      unsigned char destination) {
+    for (unsigned int i = 0; i < J1939_MAX_RX_SESSIONS; i++) {
+        J1939_RX_SESSION* session = &stack->sessions[i];
+        if (session->in_use && session->source == source && session->destination == destination) {
+            return session;
+        }
+    }
+    return nullptr;
+}
+
+// A new announcement from the same pair replaces an unfinished one
+static J1939_RX_SESSION* open_session(J1939_STACK* stack, unsigned char source,
+                                      unsigned char destination) {
+    J1939_RX_SESSION* session = find_session(stack, source, destination);
+    for (unsigned int i = 0; session == nullptr && i < J1939_MAX_RX_SESSIONS; i++) {
+        if (!stack->sessions[i].in_use) {
+            session = &stack->sessions[i];
+        }
+    }
+    if (session != nullptr) {
+        session->in_use = 1;
+        session->source = source;
+        session->destination = destination;
+        session->received = 0;
+    }
+    return session;
+}
+
+static int addressed_to_us(const J1939_STACK* stack, unsigned char destination) {
+    return stack->claim_state == J1939_CLAIMED && destination == stack->address;
+}
+
+static void send_cts(J1939_STACK* stack, J1939_RX_SESSION* session) {
+    unsigned int remaining = session->packets - session->received;
+    unsigned int window = remaining < J1939_CTS_WINDOW ? remaining : J1939_CTS_WINDOW;
+    if (session->max_per_cts != 0xFF && window > session->max_per_cts) {
+        window = session->max_per_cts;
+    }
+    session->window_end = static_cast<unsigned char>(session->received + window);
+    send_tp_cm(stack, session->source, J1939_TP_CTS, static_cast<unsigned char>(window),
+               static_cast<unsigned char>(session->received + 1), 0xFF, 0xFF, session->pgn);
+    session->deadline = uds_now_ms() + J1939_T2_MS;
+}
+
+static void handle_tp_cm(J1939_STACK* stack, unsigned char priority, unsigned char source,
+                         unsigned char destination, const unsigned char* data) {
+    unsigned char control = data[0];
+    unsigned long pgn = data[5] | (static_cast<unsigned long>(data[6]) << 8) |
+                        (static_cast<unsigned long>(data[7]) << 16);
+    unsigned int size = data[1] | (static_cast<unsigned int>(data[2]) << 8);
+
+    if (control == J1939_TP_BAM || control == J1939_TP_RTS) {
+        unsigned char packets = data[3];
+        if (size <= 8 || size > J1939_MAX_MESSAGE ||
+            packets != (size + J1939_TP_PACKET_SIZE - 1) / J1939_TP_PACKET_SIZE) {
+            return;
+        }
+        int broadcast = control == J1939_TP_BAM;
+        J1939_RX_SESSION* session = open_session(stack, source,
+                                                 broadcast ? J1939_GLOBAL_ADDRESS : destination);
+        if (session == nullptr) {
+            if (!broadcast && addressed_to_us(stack, destination)) {
+                send_tp_cm(stack, source, J1939_TP_ABORT, J1939_ABORT_NO_RESOURCES,
+                           0xFF, 0xFF, 0xFF, pgn);
+            }
+            return;
+        }
+        session->broadcast = broadcast;
+        session->priority = priority;
+        session->pgn = pgn;
+        session->size = size;
+        session->packets = packets;
+        session->max_per_cts = broadcast ? 0xFF : data[4];
+        session->window_end = packets;
+        session->deadline = uds_now_ms() + (broadcast ? J1939_T1_MS : J1939_T2_MS);
+        if (!broadcast && addressed_to_us(stack, destination)) {
+            send_cts(stack, session);
+        }
+        return;
+    }
+
+    // The remaining messages steer our outgoing transfer
+    if (control == J1939_TP_CTS || control == J1939_TP_EOM_ACK || control == J1939_TP_ABORT) {
+        pthread_mutex_lock(&stack->state_mutex);
+        J1939_TX_SESSION* tx = &stack->tx;
+        if (tx->active && destination == stack->address && source == tx->destination && pgn == tx->pgn) {
+            if (control == J1939_TP_CTS) {
+                tx->cts_received = 1;
+                tx->granted = data[1];
+                tx->next_packet = data[2];
+            } else if (control == J1939_TP_EOM_ACK) {
+                tx->complete = 1;
+            } else {
+                tx->aborted = 1;
+            }
+            pthread_cond_broadcast(&stack->state_changed);
+        }
+        pthread_mutex_unlock(&stack->state_mutex);
+    }
+    if (control == J1939_TP_ABORT) {
+        // Either side may abort; drop the reassembly in both directions
+        J1939_RX_SESSION* session = find_session(stack, source, destination);
+        if (session == nullptr) {
+            session = find_session(stack, destination, source);
+        }
+        if (session != nullptr) {
+            session->in_use = 0;
+            stack->aborts++;
+        }
+    }
+}
+
+static void handle_tp_dt(J1939_STACK* stack, unsigned char source, unsigned char destination,
+                         const unsigned char* data) {
+    J1939_RX_SESSION* session = find_session(stack, source, destination);
+    if (session == nullptr) {
+        return;
+    }
+    unsigned char sequence = data[0];
+    int ours = !session->broadcast && addressed_to_us(stack, destination);
+    if (sequence <= session->received) {
+        return;   // retransmission of a packet we already hold
+    }
+    if (sequence != session->received + 1) {
+        if (ours) {
+            send_cts(stack, session);   // ask again from the first missing packet
+        } else {
+            session->in_use = 0;
+            stack->aborts++;
+        }
+        return;
+    }
+
+    unsigned int offset = (sequence - 1) * J1939_TP_PACKET_SIZE;
+    unsigned int count = session->size - offset < J1939_TP_PACKET_SIZE
+        ? session->size - offset : J1939_TP_PACKET_SIZE;
+    memcpy(session->data + offset, data + 1, count);
+    session->received = sequence;
+    session->deadline = uds_now_ms() + J1939_T1_MS;
+
+    if (session->received == session->packets) {
+        session->in_use = 0;
+        if (ours) {
+            send_tp_cm(stack, source, J1939_TP_EOM_ACK, static_cast<unsigned char>(session->size),
+                       static_cast<unsigned char>(session->size >> 8), session->packets, 0xFF,
+                       session->pgn);
+        }
+        dispatch(stack, session->pgn, session->priority, session->source, session->destination,
+                 session->data, session->size);
+    } else if (ours && session->received == session->window_end) {
+        send_cts(stack, session);
+    }
+}
+
+static int pick_address(const J1939_STACK* stack) {
+    for (int address = J1939_DYNAMIC_ADDRESS_FIRST; address <= J1939_DYNAMIC_ADDRESS_LAST; address++) {
+        if (!stack->claimed_by[address] && address != stack->address) {
+            return address;
+        }
+    }
+    return -1;
+}
+
+static void handle_address_claim(J1939_STACK* stack, unsigned char source, const unsigned char* data) {
+    if (source < J1939_NULL_ADDRESS) {
+        stack->claimed_by[source] = 1;
+    }
+
+    pthread_mutex_lock(&stack->state_mutex);
+    if ((stack->claim_state == J1939_CLAIMING || stack->claim_state == J1939_CLAIMED) &&
+        source == stack->address && memcmp(data, stack->name, 8) != 0) {
+        // The lower NAME keeps the address
+        if (name_value(stack->name) < name_value(data)) {
+            send_claim(stack);
+        } else {
+            int address = (stack->name[7] & 0x80) ? pick_address(stack) : -1;   // arbitrary address capable
+            if (address >= 0) {
+                stack->address = static_cast<unsigned char>(address);
+                stack->claim_state = J1939_CLAIMING;
+                stack->claim_deadline = uds_now_ms() + J1939_CLAIM_WAIT_MS;
+            } else {
+                stack->address = J1939_NULL_ADDRESS;
+                stack->claim_state = J1939_CANNOT_CLAIM;
+            }
+            send_claim(stack);
+            LOGI("J1939 address lost to another node, now 0x%02X", stack->address);
+            pthread_cond_broadcast(&stack->state_changed);
+        }
+    }
+    pthread_mutex_unlock(&stack->state_mutex);
+}
+
+void j1939_process_frame(J1939_STACK* stack, unsigned long can_id, const unsigned char* data,
+                         unsigned long length) {
+    unsigned char destination = J1939_GLOBAL_ADDRESS;
+    unsigned long pgn = parse_can_id(can_id, &destination);
+    unsigned char source = static_cast<unsigned char>(can_id);
+    unsigned char priority = static_cast<unsigned char>((can_id >> 26) & 0x07);
+
+    if (pgn == J1939_PGN_TP_CM) {
+        if (length >= 8) {
+            handle_tp_cm(stack, priority, source, destination, data);
+        }
+        return;
+    }
+    if (pgn == J1939_PGN_TP_DT) {
+        if (length >= 8) {
+            handle_tp_dt(stack, source, destination, data);
+        }
+        return;
+    }
+    if (pgn == J1939_PGN_ADDRESS_CLAIMED && length >= 8) {
+        handle_address_claim(stack, source, data);
+    } else if (pgn == J1939_PGN_REQUEST && length >= 3 &&
+               (data[0] | (data[1] << 8) | (static_cast<unsigned long>(data[2]) << 16)) == J1939_PGN_ADDRESS_CLAIMED &&
+               (destination == J1939_GLOBAL_ADDRESS || destination == stack->address)) {
+        pthread_mutex_lock(&stack->state_mutex);
+        if (stack->claim_state != J1939_LISTEN_ONLY) {
+            send_claim(stack);
+        }
+        pthread_mutex_unlock(&stack->state_mutex);
+    }
+    dispatch(stack, pgn, priority, source, destination, data, length);
+}
+
+void j1939_check_timeouts(J1939_STACK* stack) {
+    unsigned long long now = uds_now_ms();
+    for (unsigned int i = 0; i < J1939_MAX_RX_SESSIONS; i++) {
+        J1939_RX_SESSION* session = &stack->sessions[i];
+        if (!session->in_use || now < session->deadline) {
+            continue;
+        }
+        if (!session->broadcast && addressed_to_us(stack, session->destination)) {
+            send_tp_cm(stack, session->source, J1939_TP_ABORT, J1939_ABORT_TIMEOUT,
+                       0xFF, 0xFF, 0xFF, session->pgn);
+        }
+        session->in_use = 0;
+        stack->aborts++;
+    }
+
+    pthread_mutex_lock(&stack->state_mutex);
+    if (stack->claim_state == J1939_CLAIMING && now >= stack->claim_deadline) {
+        stack->claim_state = J1939_CLAIMED;
+        LOGI("J1939 address 0x%02X claimed", stack->address);
+        pthread_cond_broadcast(&stack->state_changed);
+    }
+    pthread_mutex_unlock(&stack->state_mutex);
+}
+
+static void* j1939_rx_thread(void* arg) {
+    J1939_STACK* stack = static_cast<J1939_STACK*>(arg);
+    PASSTHRU_MSG* msgs = static_cast<PASSTHRU_MSG*>(malloc(J1939_RX_BATCH * sizeof(PASSTHRU_MSG)));
+    if (msgs == nullptr) {
+        return nullptr;
+    }
+
+    while (stack->running) {
+        unsigned long num_msgs = J1939_RX_BATCH;
+        long result = stack->lib->PassThruReadMsgs(stack->channel_id, msgs, &num_msgs,
+                                                   J1939_RX_TIMEOUT_MS);
+        if (result != STATUS_NOERROR && result != ERR_BUFFER_EMPTY && result != ERR_TIMEOUT) {
+            LOGE("J1939 read failed: %ld", result);
+            break;
+        }
+        for (unsigned long i = 0; i < num_msgs; i++) {
+            const PASSTHRU_MSG* msg = &msgs[i];
+            // CAN_ID_BOTH channels also deliver 11-bit frames, which are not J1939
+            if ((msg->RxStatus & TX_MSG_TYPE) || !(msg->RxStatus & CAN_29BIT_ID) ||
+                msg->DataSize < UDS_CAN_ID_SIZE) {
+                continue;
+            }
+            j1939_process_frame(stack, uds_message_can_id(msg) & 0x1FFFFFFFUL,
+                                msg->Data + UDS_CAN_ID_SIZE, msg->DataSize - UDS_CAN_ID_SIZE);
+        }
+        j1939_check_timeouts(stack);
+    }
+    free(msgs);
+    return nullptr;
+}
+
+long j1939_stack_init(J1939_STACK* stack, J2534_LIBRARY* lib, unsigned long channel_id,
+                      const unsigned char name[8], unsigned char preferred_address) {
+    memset(stack, 0, sizeof(J1939_STACK));
+    if (lib == nullptr || lib->PassThruReadMsgs == nullptr || lib->PassThruWriteMsgs == nullptr) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+    stack->sessions = static_cast<J1939_RX_SESSION*>(
+        calloc(J1939_MAX_RX_SESSIONS, sizeof(J1939_RX_SESSION)));
+    if (stack->sessions == nullptr) {
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    stack->lib = lib;
+    stack->channel_id = channel_id;
+    memcpy(stack->name, name, sizeof(stack->name));
+    stack->preferred_address = preferred_address;
+    stack->address = J1939_NULL_ADDRESS;
+    stack->claim_state = J1939_LISTEN_ONLY;
+    pthread_mutex_init(&stack->tx_mutex, nullptr);
+    pthread_mutex_init(&stack->tp_mutex, nullptr);
+    pthread_mutex_init(&stack->state_mutex, nullptr);
+    pthread_cond_init(&stack->state_changed, nullptr);
+    return STATUS_NOERROR;
+}
+
+void j1939_stack_free(J1939_STACK* stack) {
+    pthread_cond_destroy(&stack->state_changed);
+    pthread_mutex_destroy(&stack->state_mutex);
+    pthread_mutex_destroy(&stack->tp_mutex);
+    pthread_mutex_destroy(&stack->tx_mutex);
+    free(stack->sessions);
+    stack->sessions = nullptr;
+}
+
+long j1939_start(J1939_STACK* stack) {
+    PASSTHRU_MSG mask;
+    PASSTHRU_MSG pattern;
+    memset(&mask, 0, sizeof(mask));
+    memset(&pattern, 0, sizeof(pattern));
+    mask.ProtocolID = pattern.ProtocolID = CAN;
+    mask.TxFlags = pattern.TxFlags = CAN_29BIT_ID;
+    mask.DataSize = pattern.DataSize = UDS_CAN_ID_SIZE;
+
+    long result = stack->lib->PassThruStartMsgFilter(stack->channel_id, PASS_FILTER, &mask, &pattern,
+                                                     nullptr, &stack->filter_id);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+
+    stack->running = 1;
+    if (pthread_create(&stack->thread, nullptr, j1939_rx_thread, stack) != 0) {
+        stack->running = 0;
+        stack->lib->PassThruStopMsgFilter(stack->channel_id, stack->filter_id);
+        return ERR_FAILED;
+    }
+
+    static const unsigned char listen_only[8] = { 0 };
+    if (memcmp(stack->name, listen_only, sizeof(listen_only)) == 0) {
+        return STATUS_NOERROR;
+    }
+
+    pthread_mutex_lock(&stack->state_mutex);
+    stack->address = stack->preferred_address;
+    stack->claim_state = J1939_CLAIMING;
+    stack->claim_deadline = uds_now_ms() + J1939_CLAIM_WAIT_MS;
+    send_claim(stack);
+    unsigned long long give_up = uds_now_ms() + 4 * J1939_CLAIM_WAIT_MS;
+    while (stack->claim_state == J1939_CLAIMING && uds_now_ms() < give_up) {
+        wait_until(stack, give_up);
+    }
+    int state = stack->claim_state;
+    pthread_mutex_unlock(&stack->state_mutex);
+
+    if (state != J1939_CLAIMED) {
+        j1939_stop(stack);
+        return ERR_NOT_UNIQUE;
+    }
+    return STATUS_NOERROR;
+}
+
+void j1939_stop(J1939_STACK* stack) {
+    if (!stack->running) {
+        return;
+    }
+    stack->running = 0;
+    pthread_join(stack->thread, nullptr);
+    stack->lib->PassThruStopMsgFilter(stack->channel_id, stack->filter_id);
+}
+
+static long send_packets(J1939_STACK* stack, unsigned char destination, const unsigned char* data,
+                         unsigned long length, unsigned int first, unsigned int count, int paced) {
+    unsigned long can_id = make_can_id(7, J1939_PGN_TP_DT, destination, stack->address);
+    for (unsigned int packet = first; packet < first + count; packet++) {
+        unsigned char frame[8];
+        memset(frame, 0xFF, sizeof(frame));
+        frame[0] = static_cast<unsigned char>(packet);
+        unsigned long offset = (packet - 1) * J1939_TP_PACKET_SIZE;
+        if (offset >= length) {
+            return ERR_INVALID_MSG;
+        }
+        unsigned long chunk = length - offset < J1939_TP_PACKET_SIZE ? length - offset : J1939_TP_PACKET_SIZE;
+        memcpy(frame + 1, data + offset, chunk);
+
+        if (paced) {
+            struct timespec gap = { 0, J1939_BAM_GAP_MS * 1000000L };
+            nanosleep(&gap, nullptr);
+        }
+        long result = write_frame(stack, can_id, frame, sizeof(frame));
+        if (result != STATUS_NOERROR) {
+            return result;
+        }
+    }
+    return STATUS_NOERROR;
+}
+
+long j1939_send(J1939_STACK* stack, unsigned long pgn, unsigned char priority,
+                unsigned char destination, const unsigned char* data, unsigned long length) {
+    if (data == nullptr || length == 0) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (length > J1939_MAX_MESSAGE) {
+        return ERR_INVALID_MSG;
+    }
+    if (stack->claim_state != J1939_CLAIMED) {
+        return ERR_INVALID_DEVICE_STATE;
+    }
+    if (((pgn >> 8) & 0xFF) >= 240) {
+        destination = J1939_GLOBAL_ADDRESS;
+    }
+    if (length <= 8) {
+        return write_frame(stack, make_can_id(priority, pgn, destination, stack->address), data, length);
+    }
+
+    unsigned char packets = static_cast<unsigned char>((length + J1939_TP_PACKET_SIZE - 1) / J1939_TP_PACKET_SIZE);
+    unsigned char size_lo = static_cast<unsigned char>(length);
+    unsigned char size_hi = static_cast<unsigned char>(length >> 8);
+
+    pthread_mutex_lock(&stack->tp_mutex);
+    long result;
+    if (destination == J1939_GLOBAL_ADDRESS) {
+        result = send_tp_cm(stack, J1939_GLOBAL_ADDRESS, J1939_TP_BAM, size_lo, size_hi, packets,
+                            0xFF, pgn);
+        if (result == STATUS_NOERROR) {
+            result = send_packets(stack, J1939_GLOBAL_ADDRESS, data, length, 1, packets, 1);
+        }
+        pthread_mutex_unlock(&stack->tp_mutex);
+        return result;
+    }
+
+    pthread_mutex_lock(&stack->state_mutex);
+    memset(&stack->tx, 0, sizeof(J1939_TX_SESSION));
+    stack->tx.active = 1;
+    stack->tx.destination = destination;
+    stack->tx.pgn = pgn;
+    pthread_mutex_unlock(&stack->state_mutex);
+
+    result = send_tp_cm(stack, destination, J1939_TP_RTS, size_lo, size_hi, packets, 0xFF, pgn);
+
+    pthread_mutex_lock(&stack->state_mutex);
+    unsigned long long deadline = uds_now_ms() + J1939_T3_MS;
+    while (result == STATUS_NOERROR && !stack->tx.complete) {
+        if (stack->tx.aborted) {
+            result = ERR_FAILED;
+            break;
+        }
+        if (stack->tx.cts_received) {
+            stack->tx.cts_received = 0;
+            unsigned int granted = stack->tx.granted;
+            unsigned int next = stack->tx.next_packet;
+            if (granted == 0) {
+                deadline = uds_now_ms() + J1939_T4_MS;   // receiver holds the transfer
+                continue;
+            }
+            if (next == 0 || next + granted - 1 > packets) {
+                result = ERR_INVALID_MSG;
+                break;
+            }
+            pthread_mutex_unlock(&stack->state_mutex);
+            result = send_packets(stack, destination, data, length, next, granted, 0);
+            pthread_mutex_lock(&stack->state_mutex);
+            deadline = uds_now_ms() + J1939_T3_MS;
+            continue;
+        }
+        if (uds_now_ms() >= deadline) {
+            result = ERR_TIMEOUT;
+            break;
+        }
+        wait_until(stack, deadline);
+    }
+    stack->tx.active = 0;
+    pthread_mutex_unlock(&stack->state_mutex);
+
+    if (result == ERR_TIMEOUT || result == ERR_INVALID_MSG) {
+        send_tp_cm(stack, destination, J1939_TP_ABORT, J1939_ABORT_TIMEOUT, 0xFF, 0xFF, 0xFF, pgn);
+    }
+    pthread_mutex_unlock(&stack->tp_mutex);
+    return result;
+}
+
+static void ring_handler(void* context, unsigned long pgn, unsigned char priority,
+                         unsigned char source, unsigned char destination,
+                         const unsigned char* data, unsigned long length) {
+    J1939_JAVA_STACK* java = static_cast<J1939_JAVA_STACK*>(context);
+    unsigned char* slot = java->ring + J1939_RING_HEADER_SIZE +
+                          (java->seq % java->slot_count) * J1939_RING_SLOT_SIZE;
+
+    unsigned int stored = length;
+    if (stored > J1939_RING_SLOT_SIZE - J1939_RECORD_HEADER_SIZE) {
+        stored = J1939_RING_SLOT_SIZE - J1939_RECORD_HEADER_SIZE;
+        unsigned int* truncated = reinterpret_cast<unsigned int*>(java->ring + 16);
+        __atomic_store_n(truncated, *truncated + 1, __ATOMIC_RELAXED);
+    }
+
+    unsigned int timestamp = static_cast<unsigned int>(uds_now_ms() - java->epoch_ms);
+    unsigned int pgn32 = static_cast<unsigned int>(pgn);
+    unsigned short length16 = static_cast<unsigned short>(length);
+    unsigned short stored16 = static_cast<unsigned short>(stored);
+    memcpy(slot, &timestamp, 4);
+    memcpy(slot + 4, &pgn32, 4);
+    slot[8] = priority;
+    slot[9] = source;
+    slot[10] = destination;
+    slot[11] = 0;
+    memcpy(slot + 12, &length16, 2);
+    memcpy(slot + 14, &stored16, 2);
+    memcpy(slot + J1939_RECORD_HEADER_SIZE, data, stored);
+
+    java->seq++;
+    __atomic_store_n(reinterpret_cast<unsigned long long*>(java->ring), java->seq, __ATOMIC_RELEASE);
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeJ1939Start
+ * Signature: (IJI[ILjava/nio/ByteBuffer;)J
+ *
+ * channel_id must be a CAN channel connected with CAN_29BIT_ID or CAN_ID_BOTH;
+ * 11-bit frames are ignored.
+ * name 0 starts a listen-only monitor. pgns selects the PGNs copied into the
+ * ring; null or empty copies every message.
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeJ1939Start
+  (JNIEnv *env, jobject obj, jint channel_id, jlong name, jint preferred_address,
+   jintArray pgns, jobject ring_buffer) {
+
+    unsigned char* ring = ring_buffer != nullptr
+        ? static_cast<unsigned char*>(env->GetDirectBufferAddress(ring_buffer)) : nullptr;
+    if (ring == nullptr ||
+        env->GetDirectBufferCapacity(ring_buffer) < J1939_RING_HEADER_SIZE + J1939_RING_SLOT_SIZE) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return 0;
+    }
+    if (g_j2534_lib == nullptr) {
+        g_last_error = ERR_DEVICE_NOT_CONNECTED;
+        return 0;
+    }
+
+    J1939_JAVA_STACK* java = static_cast<J1939_JAVA_STACK*>(calloc(1, sizeof(J1939_JAVA_STACK)));
+    if (java == nullptr) {
+        g_last_error = ERR_INSUFFICIENT_MEMORY;
+        return 0;
+    }
+
+    unsigned char name_bytes[8];
+    for (int i = 0; i < 8; i++) {
+        name_bytes[i] = static_cast<unsigned char>(static_cast<unsigned long long>(name) >> (8 * i));
+    }
+    long result = j1939_stack_init(&java->stack, g_j2534_lib, static_cast<unsigned long>(channel_id),
+                                   name_bytes, static_cast<unsigned char>(preferred_address));
+    if (result != STATUS_NOERROR) {
+        free(java);
+        g_last_error = result;
+        return 0;
+    }
+
+    java->ring = ring;
+    java->slot_count = static_cast<unsigned int>(
+        (env->GetDirectBufferCapacity(ring_buffer) - J1939_RING_HEADER_SIZE) / J1939_RING_SLOT_SIZE);
+    java->epoch_ms = uds_now_ms();
+    memset(ring, 0, J1939_RING_HEADER_SIZE);
+    unsigned int slot_size = J1939_RING_SLOT_SIZE;
+    memcpy(ring + 8, &java->slot_count, 4);
+    memcpy(ring + 12, &slot_size, 4);
+
+    jsize count = pgns != nullptr ? env->GetArrayLength(pgns) : 0;
+    if (count == 0) {
+        j1939_register(&java->stack, J1939_PGN_ANY, ring_handler, java);
+    } else {
+        jint* values = env->GetIntArrayElements(pgns, nullptr);
+        for (jsize i = 0; i < count && result == STATUS_NOERROR; i++) {
+            result = j1939_register(&java->stack, static_cast<unsigned long>(values[i]), ring_handler, java);
+        }
+        env->ReleaseIntArrayElements(pgns, values, JNI_ABORT);
+    }
+
+    if (result == STATUS_NOERROR) {
+        result = j1939_start(&java->stack);
+    }
+    g_last_error = result;
+    if (result != STATUS_NOERROR) {
+        j1939_stack_free(&java->stack);
+        free(java);
+        return 0;
+    }
+
+    // The RX thread writes into the buffer until stop, so keep it reachable
+    java->ring_ref = env->NewGlobalRef(ring_buffer);
+    return reinterpret_cast<jlong>(java);
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeJ1939Send
+ * Signature: (JIII[B)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeJ1939Send
+  (JNIEnv *env, jobject obj, jlong handle, jint pgn, jint priority, jint destination,
+   jbyteArray data) {
+
+    J1939_JAVA_STACK* java = reinterpret_cast<J1939_JAVA_STACK*>(handle);
+    if (java == nullptr || data == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    jsize length = env->GetArrayLength(data);
+    if (length <= 0 || length > J1939_MAX_MESSAGE) {
+        g_last_error = ERR_INVALID_MSG;
+        return -1;
+    }
+    unsigned char payload[J1939_MAX_MESSAGE];
+    env->GetByteArrayRegion(data, 0, length, reinterpret_cast<jbyte*>(payload));
+
+    long result = j1939_send(&java->stack, static_cast<unsigned long>(pgn),
+                             static_cast<unsigned char>(priority), static_cast<unsigned char>(destination),
+                             payload, static_cast<unsigned long>(length));
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return 0;
+    } else {
+        return -1;
+    }
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeJ1939Stop
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeJ1939Stop
+  (JNIEnv *env, jobject obj, jlong handle) {
+
+    J1939_JAVA_STACK* java = reinterpret_cast<J1939_JAVA_STACK*>(handle);
+    if (java == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    j1939_stop(&java->stack);
+    j1939_stack_free(&java->stack);
+    if (java->dm_tracker != nullptr) {
+        j1939_dm_free(static_cast<J1939_DM_TRACKER*>(java->dm_tracker));
+        free(java->dm_tracker);
+        env->DeleteGlobalRef(java->dm_ring_ref);
+    }
+    env->DeleteGlobalRef(java->ring_ref);
+    free(java);
+    g_last_error = STATUS_NOERROR;
+    return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef J1939_STACK_H
+#define J1939_STACK_H
+
+#include <jni.h>
+#include <pthread.h>
+#include "j2534_native.h"
+
+// Parameter group numbers handled by the stack itself
+#define J1939_PGN_REQUEST 0xEA00
+#define J1939_PGN_ADDRESS_CLAIMED 0xEE00
+#define J1939_PGN_TP_CM 0xEC00
+#define J1939_PGN_TP_DT 0xEB00
+#define J1939_PGN_ANY 0xFFFFFFFFUL    // dispatch entry for every PGN without its own handler
+
+#define J1939_GLOBAL_ADDRESS 0xFF
+#define J1939_NULL_ADDRESS 0xFE
+#define J1939_DEFAULT_PRIORITY 6
+// Addresses an arbitrary address capable node may pick from
+#define J1939_DYNAMIC_ADDRESS_FIRST 128
+#define J1939_DYNAMIC_ADDRESS_LAST 247
+
+// TP.CM control bytes
+#define J1939_TP_RTS 16
+#define J1939_TP_CTS 17
+#define J1939_TP_EOM_ACK 19
+#define J1939_TP_BAM 32
+#define J1939_TP_ABORT 255
+
+#define J1939_TP_PACKET_SIZE 7
+#define J1939_MAX_PACKETS 255
+#define J1939_MAX_MESSAGE (J1939_MAX_PACKETS * J1939_TP_PACKET_SIZE)   // 1785 bytes
+
+// J1939-21 transport timing
+#define J1939_T1_MS 750     // gap between data packets
+#define J1939_T2_MS 1250    // data after CTS
+#define J1939_T3_MS 1250    // CTS or EOM after data
+#define J1939_T4_MS 1050    // CTS after a hold
+#define J1939_BAM_GAP_MS 50 // minimum spacing of BAM data packets
+#define J1939_CTS_WINDOW 16 // packets requested per CTS
+#define J1939_CLAIM_WAIT_MS 250
+
+#define J1939_MAX_RX_SESSIONS 64
+#define J1939_DISPATCH_BITS 7
+#define J1939_DISPATCH_SIZE (1 << J1939_DISPATCH_BITS)
+#define J1939_RX_BATCH 32
+#define J1939_RX_TIMEOUT_MS 20
+
+// Address claim states
+#define J1939_LISTEN_ONLY 0
+#define J1939_CLAIMING 1
+#define J1939_CLAIMED 2
+#define J1939_CANNOT_CLAIM 3
+
+/*
+ * Message ring shared with Java (native byte order), filled by the RX thread:
+ *    0  u64 write_seq     records written so far, stored with release semantics
+ *    8  u32 slot_count
+ *   12  u32 slot_size     J1939_RING_SLOT_SIZE
+ *   16  u32 truncated     messages longer than a slot's data area
+ *   20  u32 reserved
+ *   24  slots[slot_count]: u32 timestamp_ms, u32 pgn, u8 priority, u8 source,
+ *       u8 destination, u8 reserved, u16 length, u16 stored, u8 data[stored]
+ */
+#define J1939_RING_HEADER_SIZE 24
+#define J1939_RECORD_HEADER_SIZE 16
+#define J1939_RING_SLOT_SIZE (J1939_RECORD_HEADER_SIZE + 256)
+
+// Called on the stack's RX thread for every complete message
+typedef void (*J1939_HANDLER)(void* context, unsigned long pgn, unsigned char priority,
+                              unsigned char source, unsigned char destination,
+                              const unsigned char* data, unsigned long length);
+
+typedef struct {
+    int in_use;
+    unsigned long pgn;
+    J1939_HANDLER handler;
+    void* context;
+} J1939_ROUTE;
+
+// Reassembly of one BAM or RTS/CTS transfer, keyed by source and destination
+typedef struct {
+    int in_use;
+    int broadcast;
+    unsigned char source;
+    unsigned char destination;
+    unsigned char priority;
+    unsigned long pgn;
+    unsigned int size;
+    unsigned char packets;
+    unsigned char received;       // packets in order so far
+    unsigned char window_end;     // last packet of the current CTS window
+    unsigned char max_per_cts;
+    unsigned long long deadline;
+    unsigned char data[J1939_MAX_MESSAGE];
+} J1939_RX_SESSION;
+
+// Outgoing RTS/CTS transfer; the RX thread feeds it CTS and EOM
+typedef struct {
+    int active;
+    unsigned char destination;
+    unsigned long pgn;
+    int cts_received;
+    unsigned char next_packet;    // first packet of the granted window
+    unsigned char granted;        // 0 holds the transfer
+    int complete;
+    int aborted;
+} J1939_TX_SESSION;
+
+typedef struct {
+    J2534_LIBRARY* lib;
+    unsigned long channel_id;
+    unsigned long filter_id;
+    unsigned char name[8];
+    unsigned char address;
+    unsigned char preferred_address;
+    int claim_state;
+    unsigned long long claim_deadline;
+    unsigned char claimed_by[256]; // addresses seen in other nodes' claims
+    J1939_ROUTE routes[J1939_DISPATCH_SIZE];
+    J1939_ROUTE any_route;
+    J1939_RX_SESSION* sessions;
+    pthread_mutex_t tx_mutex;      // one frame writer at a time
+    pthread_mutex_t tp_mutex;      // one outgoing transport session at a time
+    pthread_mutex_t state_mutex;
+    pthread_cond_t state_changed;
+    J1939_TX_SESSION tx;
+    pthread_t thread;
+    volatile int running;
+    unsigned int messages;
+    unsigned int aborts;
+} J1939_STACK;
+
+// State behind a nativeJ1939Start handle
+typedef struct {
+    J1939_STACK stack;
+    unsigned char* ring;
+    unsigned int slot_count;
+    unsigned long long seq;
+    unsigned long long epoch_ms;
+    jobject ring_ref;
+    void* dm_tracker;              // J1939_DM_TRACKER from nativeJ1939TrackDm, freed on stop
+    jobject dm_ring_ref;
+} J1939_JAVA_STACK;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// name all zero leaves the stack listen-only: it reassembles and dispatches but never transmits
+long j1939_stack_init(J1939_STACK* stack, J2534_LIBRARY* lib, unsigned long channel_id,
+                      const unsigned char name[8], unsigned char preferred_address);
+void j1939_stack_free(J1939_STACK* stack);
+
+/*
+ * Routes a PGN (or J1939_PGN_ANY) to handler; handlers run on the RX thread.
+ * New PGNs may be added while the stack runs, but a routed PGN keeps its
+ * handler until j1939_stop (ERR_NOT_UNIQUE).
+ */
+long j1939_register(J1939_STACK* stack, unsigned long pgn, J1939_HANDLER handler, void* context);
+
+// j1939_register for several PGNs at once; on failure none of them is routed
+long j1939_register_all(J1939_STACK* stack, const unsigned long* pgns, unsigned int count,
+                        J1939_HANDLER handler, void* context);
+
+// Opens the 29-bit pass filter, starts the RX thread and claims an address
+long j1939_start(J1939_STACK* stack);
+void j1939_stop(J1939_STACK* stack);
+
+// Feeds one received frame; j1939_start's thread calls this for every frame read
+void j1939_process_frame(J1939_STACK* stack, unsigned long can_id, const unsigned char* data,
+                         unsigned long length);
+
+// Expires transport sessions whose timers have run out
+void j1939_check_timeouts(J1939_STACK* stack);
+
+/*
+ * Sends a message: single frame up to 8 bytes, BAM for longer global messages
+ * and RTS/CTS for longer destination specific ones (blocking until EOM).
+ */
+long j1939_send(J1939_STACK* stack, unsigned long pgn, unsigned char priority,
+                unsigned char destination, const unsigned char* data, unsigned long length);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeJ1939Start
+ * Signature: (IJI[ILjava/nio/ByteBuffer;)J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeJ1939Start
+  (JNIEnv *, jobject, jint, jlong, jint, jintArray, jobject);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeJ1939Send
+ * Signature: (JIII[B)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeJ1939Send
+  (JNIEnv *, jobject, jlong, jint, jint, jint, jbyteArray);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeJ1939Stop
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeJ1939Stop
+  (JNIEnv *, jobject, jlong);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // J1939_STACK_H
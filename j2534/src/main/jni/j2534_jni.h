@@ -52,6 +52,10 @@
 #define SCI_B_ENGINE 9
 #define SCI_B_TRANS 10
 
+// J2534-2 CAN FD protocol IDs
+#define FD_CAN_PS 0x8011
+#define FD_ISO15765_PS 0x8012
+
 // J2534 filter types
 #define PASS_FILTER 1
 #define BLOCK_FILTER 2
@@ -63,6 +67,20 @@
 #define CAN_ISO_BRP 0x0400
 #define CAN_HS_DATA 0x0800
 
+// J2534 TxFlags
+#define ISO15765_FRAME_PAD 0x0040
+#define ISO15765_ADDR_TYPE 0x0080
+
+// J2534-2 CAN FD TxFlags, also reported in RxStatus
+#define CAN_FD_BRS 0x01000000
+#define CAN_FD_FORMAT 0x02000000
+
+// J2534 RxStatus bits
+#define TX_MSG_TYPE 0x0001
+#define START_OF_MESSAGE 0x0002
+#define TX_INDICATION 0x0008
+#define ISO15765_PADDING_ERROR 0x0010
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -0,0 +1,1028 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "kline_transport.h"
+#include "uds_client.h"
+#include "j2534_jni.h"
+#include <asm/termbits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/serial.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define KLINE_PATH_SIZE 64
+#define KLINE_READ_CHUNK 64
+#define KLINE_IDLE_POLL_MS 20
+
+typedef struct {
+    int in_use;
+    char path[KLINE_PATH_SIZE];
+    int echo;                         // the interface reads back every byte it sends
+    int connected;
+} KLINE_DEVICE;
+
+typedef struct {
+    int in_use;
+    unsigned long type;
+    unsigned long length;
+    unsigned char mask[KLINE_FILTER_SIZE];
+    unsigned char pattern[KLINE_FILTER_SIZE];
+} KLINE_FILTER;
+
+// SET_CONFIG values, in J2534 units
+typedef struct {
+    unsigned long data_rate;
+    unsigned long loopback;
+    unsigned long p1_max;
+    unsigned long p3_min;
+    unsigned long p4_min;
+    unsigned long w1;
+    unsigned long w2;
+    unsigned long w3;
+    unsigned long w4;
+    unsigned long w5;
+    unsigned long tidle;
+    unsigned long tinil;
+    unsigned long twup;
+    unsigned long parity;
+    unsigned long five_baud_mod;
+} KLINE_CONFIG;
+
+typedef struct {
+    int in_use;
+    int fd;
+    unsigned long device_id;
+    unsigned long protocol_id;
+    unsigned long flags;
+    int echo;
+    KLINE_CONFIG config;
+    pthread_mutex_t mutex;            // everything the RX thread touches
+    pthread_cond_t changed;
+    pthread_mutex_t tx_mutex;         // one writer or init sequence at a time
+    pthread_t thread;
+    volatile int running;
+    unsigned long long last_activity_us;
+    // Receive framing
+    unsigned char frame[KLINE_MAX_MESSAGE];
+    unsigned int frame_length;
+    unsigned int frame_expected;      // ISO 14230 total length once the header is in, else 0
+    unsigned long long last_rx_us;
+    unsigned int checksum_errors;
+    // Echo of the byte being sent
+    int echo_pending;
+    unsigned char echo_byte;
+    int echo_error;
+    // Raw bytes during a five baud init
+    int init_active;
+    unsigned char init_bytes[16];
+    unsigned int init_count;
+    // Fast init response capture
+    int capture;
+    int captured;
+    PASSTHRU_MSG* capture_msg;
+    PASSTHRU_MSG* queue;
+    unsigned int queue_head;
+    unsigned int queue_count;
+    KLINE_FILTER filters[KLINE_MAX_FILTERS];
+} KLINE_CHANNEL;
+
+static pthread_mutex_t g_kline_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_kline_error_mutex = PTHREAD_MUTEX_INITIALIZER;
+static KLINE_DEVICE g_kline_devices[KLINE_MAX_DEVICES];
+static KLINE_CHANNEL g_kline_channels[KLINE_MAX_DEVICES];   // K-line is a single wire: one channel per device
+static char g_kline_error[128];
+
+static void set_error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&g_kline_error_mutex);
+    vsnprintf(g_kline_error, sizeof(g_kline_error), format, args);
+    pthread_mutex_unlock(&g_kline_error_mutex);
+    va_end(args);
+}
+
+static KLINE_CHANNEL* channel_for(unsigned long channel_id) {
+    if (channel_id == 0 || channel_id > KLINE_MAX_DEVICES || !g_kline_channels[channel_id - 1].in_use) {
+        return nullptr;
+    }
+    return &g_kline_channels[channel_id - 1];
+}
+
+static unsigned long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// Absolute deadlines keep scheduling jitter from accumulating over a message
+static void sleep_until_us(unsigned long long deadline_us) {
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(deadline_us / 1000000ULL);
+    ts.tv_nsec = static_cast<long>(deadline_us % 1000000ULL) * 1000L;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+}
+
+static unsigned long long half_ms_us(unsigned long value) {
+    return static_cast<unsigned long long>(value) * 500ULL;
+}
+
+static unsigned long long ms_us(unsigned long value) {
+    return static_cast<unsigned long long>(value) * 1000ULL;
+}
+
+// Waits on the channel condition (mutex held) until deadline_us on the monotonic clock
+static void wait_until_us(KLINE_CHANNEL* channel, unsigned long long deadline_us) {
+    unsigned long long now = now_us();
+    if (deadline_us <= now) {
+        return;
+    }
+    unsigned long long wait_us = deadline_us - now;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += static_cast<time_t>(wait_us / 1000000ULL);
+    deadline.tv_nsec += static_cast<long>(wait_us % 1000000ULL) * 1000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&channel->changed, &channel->mutex, &deadline);
+}
+
+static void default_config(KLINE_CONFIG* config, unsigned long baudrate) {
+    config->data_rate = baudrate != 0 ? baudrate : KLINE_DEFAULT_BAUDRATE;
+    config->loopback = 0;
+    config->p1_max = 40;      // 20 ms
+    config->p3_min = 110;     // 55 ms
+    config->p4_min = 10;      // 5 ms
+    config->w1 = 300;
+    config->w2 = 20;
+    config->w3 = 20;
+    config->w4 = 50;
+    config->w5 = 300;
+    config->tidle = 300;
+    config->tinil = 25;
+    config->twup = 50;
+    config->parity = 0;
+    config->five_baud_mod = 0;
+}
+
+// Raw 8-bit line at any rate; termios2 takes 10400 baud without a custom divisor
+static long apply_line_settings(KLINE_CHANNEL* channel) {
+    struct termios2 tio;
+    if (ioctl(channel->fd, TCGETS2, &tio) != 0) {
+        set_error("TCGETS2 failed: %s", strerror(errno));
+        return ERR_FAILED;
+    }
+    tio.c_iflag = IGNBRK | IGNPAR;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+    tio.c_cflag = CS8 | CREAD | CLOCAL | BOTHER | (BOTHER << IBSHIFT);
+    if (channel->config.parity != 0) {
+        tio.c_cflag |= PARENB | (channel->config.parity == 1 ? PARODD : 0);
+    }
+    tio.c_ispeed = static_cast<speed_t>(channel->config.data_rate);
+    tio.c_ospeed = static_cast<speed_t>(channel->config.data_rate);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (ioctl(channel->fd, TCSETS2, &tio) != 0) {
+        set_error("Cannot set %lu baud: %s", channel->config.data_rate, strerror(errno));
+        return ERR_INVALID_BAUDRATE;
+    }
+
+    // USB serial bridges otherwise hold received bytes for up to 16 ms
+    struct serial_struct serial;
+    if (ioctl(channel->fd, TIOCGSERIAL, &serial) == 0) {
+        serial.flags |= ASYNC_LOW_LATENCY;
+        ioctl(channel->fd, TIOCSSERIAL, &serial);
+    }
+    return STATUS_NOERROR;
+}
+
+static unsigned char checksum(const unsigned char* data, unsigned long length) {
+    unsigned char sum = 0;
+    for (unsigned long i = 0; i < length; i++) {
+        sum = static_cast<unsigned char>(sum + data[i]);
+    }
+    return sum;
+}
+
+static int passes_filters(const KLINE_CHANNEL* channel, const unsigned char* data, unsigned long length) {
+    int passed = 0;
+    for (unsigned int i = 0; i < KLINE_MAX_FILTERS; i++) {
+        const KLINE_FILTER* filter = &channel->filters[i];
+        if (!filter->in_use || length < filter->length) {
+            continue;
+        }
+        int match = 1;
+        for (unsigned long j = 0; j < filter->length && match; j++) {
+            match = (data[j] & filter->mask[j]) == (filter->pattern[j] & filter->mask[j]);
+        }
+        if (match && filter->type == BLOCK_FILTER) {
+            return 0;
+        }
+        if (match && filter->type == PASS_FILTER) {
+            passed = 1;
+        }
+    }
+    return passed;
+}
+
+// Called with mutex held
+static void enqueue(KLINE_CHANNEL* channel, const unsigned char* data, unsigned long length,
+                    unsigned long rx_status, unsigned long extra_index, unsigned long long timestamp_us) {
+    if (channel->queue_count == KLINE_RX_QUEUE) {
+        LOGE("K-line receive queue full, message dropped");
+        return;
+    }
+    PASSTHRU_MSG* msg = &channel->queue[(channel->queue_head + channel->queue_count) % KLINE_RX_QUEUE];
+    memset(msg, 0, offsetof(PASSTHRU_MSG, Data));
+    msg->ProtocolID = channel->protocol_id;
+    msg->RxStatus = rx_status;
+    msg->Timestamp = static_cast<unsigned long>(timestamp_us);
+    msg->DataSize = length;
+    msg->ExtraDataIndex = extra_index;
+    memcpy(msg->Data, data, length);
+    channel->queue_count++;
+    pthread_cond_broadcast(&channel->changed);
+}
+
+static void end_frame(KLINE_CHANNEL* channel) {
+    unsigned int length = channel->frame_length;
+    channel->frame_length = 0;
+    unsigned int expected = channel->frame_expected;
+    channel->frame_expected = 0;
+
+    if (channel->protocol_id == ISO14230 && expected != 0 && length != expected) {
+        LOGE("K-line message cut after %u of %u bytes", length, expected);
+        return;
+    }
+    int with_checksum = !(channel->flags & ISO9141_NO_CHECKSUM);
+    if (length < (with_checksum ? 2U : 1U)) {
+        return;
+    }
+    if (with_checksum && checksum(channel->frame, length - 1) != channel->frame[length - 1]) {
+        channel->checksum_errors++;
+        LOGE("K-line checksum error in %u byte message", length);
+        return;
+    }
+
+    unsigned long extra_index = with_checksum ? length - 1 : length;
+    if (channel->capture && !channel->captured) {
+        PASSTHRU_MSG* msg = channel->capture_msg;
+        memset(msg, 0, offsetof(PASSTHRU_MSG, Data));
+        msg->ProtocolID = channel->protocol_id;
+        msg->Timestamp = static_cast<unsigned long>(channel->last_rx_us);
+        msg->DataSize = length;
+        msg->ExtraDataIndex = extra_index;
+        memcpy(msg->Data, channel->frame, length);
+        channel->captured = 1;
+        pthread_cond_broadcast(&channel->changed);
+        return;
+    }
+    if (passes_filters(channel, channel->frame, length)) {
+        enqueue(channel, channel->frame, length, 0, extra_index, channel->last_rx_us);
+    }
+}
+
+// ISO 14230 header: format byte (address mode, 6-bit length), optional target/source, optional length byte
+static void update_expected(KLINE_CHANNEL* channel) {
+    unsigned char format = channel->frame[0];
+    unsigned int header = 1 + ((format & 0xC0) ? 2 : 0);
+    unsigned int data_length = format & 0x3F;
+    if (data_length == 0) {
+        header++;
+        if (channel->frame_length < header) {
+            return;
+        }
+        data_length = channel->frame[header - 1];
+    }
+    int with_checksum = !(channel->flags & ISO9141_NO_CHECKSUM);
+    channel->frame_expected = header + data_length + (with_checksum ? 1 : 0);
+}
+
+static void process_byte(KLINE_CHANNEL* channel, unsigned char value, unsigned long long timestamp_us) {
+    channel->last_activity_us = timestamp_us;
+    if (channel->echo_pending) {
+        // Anything but our own byte means another node drove the line at the same time
+        channel->echo_error = value != channel->echo_byte;
+        channel->echo_pending = 0;
+        pthread_cond_broadcast(&channel->changed);
+        return;
+    }
+    if (channel->init_active) {
+        if (channel->init_count < sizeof(channel->init_bytes)) {
+            channel->init_bytes[channel->init_count++] = value;
+        }
+        pthread_cond_broadcast(&channel->changed);
+        return;
+    }
+
+    if (channel->frame_length > 0 &&
+        timestamp_us - channel->last_rx_us > half_ms_us(channel->config.p1_max)) {
+        end_frame(channel);
+    }
+    channel->last_rx_us = timestamp_us;
+    channel->frame[channel->frame_length++] = value;
+
+    if (channel->protocol_id == ISO14230 && channel->frame_expected == 0) {
+        update_expected(channel);
+    }
+    if ((channel->frame_expected != 0 && channel->frame_length >= channel->frame_expected) ||
+        channel->frame_length == KLINE_MAX_MESSAGE) {
+        end_frame(channel);
+    }
+}
+
+static void* kline_rx_thread(void* arg) {
+    KLINE_CHANNEL* channel = static_cast<KLINE_CHANNEL*>(arg);
+    unsigned char buffer[KLINE_READ_CHUNK];
+
+    while (channel->running) {
+        // With a message in progress, wake up exactly when its P1_MAX gap runs out
+        int timeout_ms = KLINE_IDLE_POLL_MS;
+        pthread_mutex_lock(&channel->mutex);
+        if (channel->frame_length > 0) {
+            unsigned long long end_us = channel->last_rx_us + half_ms_us(channel->config.p1_max);
+            unsigned long long now = now_us();
+            timeout_ms = end_us > now ? static_cast<int>((end_us - now + 999) / 1000) : 0;
+        }
+        pthread_mutex_unlock(&channel->mutex);
+
+        struct pollfd pfd = { channel->fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, timeout_ms);
+        ssize_t count = 0;
+        if (ready > 0) {
+            count = read(channel->fd, buffer, sizeof(buffer));
+            if (count < 0 && errno != EAGAIN && errno != EINTR) {
+                LOGE("K-line read failed: %s", strerror(errno));
+                break;
+            }
+        }
+        unsigned long long timestamp = now_us();
+
+        pthread_mutex_lock(&channel->mutex);
+        for (ssize_t i = 0; i < count; i++) {
+            process_byte(channel, buffer[i], timestamp);
+        }
+        if (channel->frame_length > 0 &&
+            timestamp - channel->last_rx_us > half_ms_us(channel->config.p1_max)) {
+            end_frame(channel);
+        }
+        pthread_mutex_unlock(&channel->mutex);
+    }
+    return nullptr;
+}
+
+// Sends bytes with P4_MIN between them, checking each echo; tx_mutex held
+static long send_bytes(KLINE_CHANNEL* channel, const unsigned char* data, unsigned long length) {
+    unsigned long long byte_us = 10000000ULL / channel->config.data_rate + 1;
+    for (unsigned long i = 0; i < length; i++) {
+        pthread_mutex_lock(&channel->mutex);
+        channel->echo_pending = channel->echo;
+        channel->echo_byte = data[i];
+        channel->echo_error = 0;
+        pthread_mutex_unlock(&channel->mutex);
+
+        ssize_t written;
+        do {
+            written = write(channel->fd, &data[i], 1);
+        } while (written < 0 && (errno == EINTR || errno == EAGAIN));
+        if (written != 1) {
+            set_error("K-line write failed: %s", strerror(errno));
+            return ERR_FAILED;
+        }
+
+        if (channel->echo) {
+            pthread_mutex_lock(&channel->mutex);
+            unsigned long long deadline = now_us() + 2 * byte_us + ms_us(KLINE_USB_SLACK_MS);
+            while (channel->echo_pending && now_us() < deadline) {
+                wait_until_us(channel, deadline);
+            }
+            int missing = channel->echo_pending;
+            int collision = channel->echo_error;
+            channel->echo_pending = 0;
+            pthread_mutex_unlock(&channel->mutex);
+            if (missing || collision) {
+                set_error(missing ? "No echo from K-line interface" : "K-line collision on byte %lu", i);
+                return ERR_FAILED;
+            }
+        } else {
+            ioctl(channel->fd, TCSBRK, 1);   // tcdrain
+        }
+
+        unsigned long long sent_us = now_us();
+        pthread_mutex_lock(&channel->mutex);
+        channel->last_activity_us = sent_us;
+        pthread_mutex_unlock(&channel->mutex);
+        if (i + 1 < length) {
+            sleep_until_us(sent_us + half_ms_us(channel->config.p4_min));
+        }
+    }
+    return STATUS_NOERROR;
+}
+
+// Message bytes plus checksum as they go on the line
+static unsigned long build_wire(const KLINE_CHANNEL* channel, const PASSTHRU_MSG* msg, unsigned char* wire) {
+    memcpy(wire, msg->Data, msg->DataSize);
+    unsigned long length = msg->DataSize;
+    if (!(channel->flags & ISO9141_NO_CHECKSUM)) {
+        wire[length] = checksum(msg->Data, length);
+        length++;
+    }
+    return length;
+}
+
+static long send_message(KLINE_CHANNEL* channel, const PASSTHRU_MSG* msg) {
+    if (msg->DataSize == 0 || msg->DataSize >= KLINE_MAX_MESSAGE) {
+        return ERR_INVALID_MSG;
+    }
+    unsigned char wire[KLINE_MAX_MESSAGE];
+    unsigned long length = build_wire(channel, msg, wire);
+
+    pthread_mutex_lock(&channel->mutex);
+    unsigned long long start_us = channel->last_activity_us + half_ms_us(channel->config.p3_min);
+    pthread_mutex_unlock(&channel->mutex);
+    sleep_until_us(start_us);
+
+    long result = send_bytes(channel, wire, length);
+    if (result == STATUS_NOERROR && channel->config.loopback) {
+        pthread_mutex_lock(&channel->mutex);
+        enqueue(channel, wire, length, TX_MSG_TYPE, msg->DataSize, now_us());
+        pthread_mutex_unlock(&channel->mutex);
+    }
+    return result;
+}
+
+// Waits (mutex held) for the next raw init byte within window_ms
+static int next_init_byte(KLINE_CHANNEL* channel, unsigned int* index, unsigned long window_ms,
+                          unsigned char* value) {
+    unsigned long long deadline = now_us() + ms_us(window_ms + KLINE_USB_SLACK_MS);
+    while (*index >= channel->init_count && now_us() < deadline) {
+        wait_until_us(channel, deadline);
+    }
+    if (*index >= channel->init_count) {
+        return 0;
+    }
+    *value = channel->init_bytes[(*index)++];
+    return 1;
+}
+
+static long five_baud_init(KLINE_CHANNEL* channel, const SBYTE_ARRAY* input, SBYTE_ARRAY* output) {
+    if (input == nullptr || output == nullptr || input->BytePtr == nullptr || output->BytePtr == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (input->NumOfBytes != 1 || output->NumOfBytes < 2) {
+        return ERR_INVALID_MSG;
+    }
+    unsigned char address = input->BytePtr[0];
+
+    pthread_mutex_lock(&channel->tx_mutex);
+    pthread_mutex_lock(&channel->mutex);
+    unsigned long long start_us = channel->last_activity_us + ms_us(channel->config.w5);
+    pthread_mutex_unlock(&channel->mutex);
+    sleep_until_us(start_us);
+
+    // Start bit, eight data bits LSB first; the stop bit is the released line
+    start_us = now_us();
+    for (int bit = 0; bit < 9; bit++) {
+        int level = bit == 0 ? 0 : (address >> (bit - 1)) & 1;
+        ioctl(channel->fd, level ? TIOCCBRK : TIOCSBRK);
+        sleep_until_us(start_us + ms_us(KLINE_FIVE_BAUD_BIT_MS) * (bit + 1));
+    }
+    ioctl(channel->fd, TIOCCBRK);
+
+    pthread_mutex_lock(&channel->mutex);
+    channel->frame_length = 0;
+    channel->init_count = 0;
+    channel->init_active = 1;
+
+    // The stop bit lasts one more bit time, so the sync byte may follow it by W1
+    unsigned int index = 0;
+    unsigned char sync = 0;
+    unsigned char kb1 = 0;
+    unsigned char kb2 = 0;
+    long result = STATUS_NOERROR;
+    if (!next_init_byte(channel, &index, KLINE_FIVE_BAUD_BIT_MS + channel->config.w1, &sync) || sync != 0x55) {
+        set_error("No 0x55 sync after five baud address 0x%02X", address);
+        result = ERR_TIMEOUT;
+    } else if (!next_init_byte(channel, &index, channel->config.w2, &kb1) ||
+               !next_init_byte(channel, &index, channel->config.w3, &kb2)) {
+        set_error("Key bytes missing after sync");
+        result = ERR_TIMEOUT;
+    }
+    pthread_mutex_unlock(&channel->mutex);
+
+    unsigned long mod = channel->config.five_baud_mod;
+    if (result == STATUS_NOERROR && (mod == 0 || mod == 1)) {
+        sleep_until_us(now_us() + ms_us(channel->config.w4));
+        unsigned char inverted = static_cast<unsigned char>(~kb2);
+        result = send_bytes(channel, &inverted, 1);
+    }
+    if (result == STATUS_NOERROR && (mod == 0 || mod == 2)) {
+        pthread_mutex_lock(&channel->mutex);
+        unsigned char answer = 0;
+        if (!next_init_byte(channel, &index, channel->config.w4, &answer) ||
+            answer != static_cast<unsigned char>(~address)) {
+            set_error("ECU 0x%02X did not confirm five baud init", address);
+            result = ERR_FAILED;
+        }
+        pthread_mutex_unlock(&channel->mutex);
+    }
+
+    pthread_mutex_lock(&channel->mutex);
+    channel->init_active = 0;
+    channel->last_activity_us = now_us();
+    pthread_mutex_unlock(&channel->mutex);
+    pthread_mutex_unlock(&channel->tx_mutex);
+
+    if (result == STATUS_NOERROR) {
+        output->BytePtr[0] = kb1;
+        output->BytePtr[1] = kb2;
+        output->NumOfBytes = 2;
+        LOGI("Five baud init of 0x%02X: key bytes %02X %02X", address, kb1, kb2);
+    }
+    return result;
+}
+
+static long fast_init(KLINE_CHANNEL* channel, const PASSTHRU_MSG* request, PASSTHRU_MSG* response) {
+    if (request == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (request->DataSize == 0 || request->DataSize >= KLINE_MAX_MESSAGE) {
+        return ERR_INVALID_MSG;
+    }
+    PASSTHRU_MSG* captured = static_cast<PASSTHRU_MSG*>(malloc(sizeof(PASSTHRU_MSG)));
+    if (captured == nullptr) {
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    unsigned char wire[KLINE_MAX_MESSAGE];
+    unsigned long length = build_wire(channel, request, wire);
+
+    pthread_mutex_lock(&channel->tx_mutex);
+    pthread_mutex_lock(&channel->mutex);
+    unsigned long long start_us = channel->last_activity_us + ms_us(channel->config.tidle);
+    pthread_mutex_unlock(&channel->mutex);
+    sleep_until_us(start_us);
+
+    // Wake-up pattern: TiniL low, then high for the rest of TWUP
+    start_us = now_us();
+    ioctl(channel->fd, TIOCSBRK);
+    sleep_until_us(start_us + ms_us(channel->config.tinil));
+    ioctl(channel->fd, TIOCCBRK);
+    sleep_until_us(start_us + ms_us(channel->config.twup));
+
+    pthread_mutex_lock(&channel->mutex);
+    channel->frame_length = 0;
+    channel->frame_expected = 0;
+    channel->capture_msg = captured;
+    channel->captured = 0;
+    channel->capture = 1;
+    pthread_mutex_unlock(&channel->mutex);
+
+    long result = send_bytes(channel, wire, length);
+
+    pthread_mutex_lock(&channel->mutex);
+    unsigned long long deadline = now_us() + ms_us(KLINE_INIT_RESPONSE_MS);
+    while (result == STATUS_NOERROR && !channel->captured && now_us() < deadline) {
+        wait_until_us(channel, deadline);
+    }
+    if (result == STATUS_NOERROR && !channel->captured) {
+        set_error("No response to fast init");
+        result = ERR_TIMEOUT;
+    }
+    channel->capture = 0;
+    channel->capture_msg = nullptr;
+    pthread_mutex_unlock(&channel->mutex);
+    pthread_mutex_unlock(&channel->tx_mutex);
+
+    if (result == STATUS_NOERROR && response != nullptr) {
+        memcpy(response, captured, offsetof(PASSTHRU_MSG, Data) + captured->DataSize);
+    }
+    free(captured);
+    return result;
+}
+
+static long get_set_config(KLINE_CHANNEL* channel, SCONFIG_LIST* list, int set) {
+    if (list == nullptr || (list->NumOfParams > 0 && list->ConfigPtr == nullptr)) {
+        return ERR_NULL_PARAMETER;
+    }
+    KLINE_CONFIG* config = &channel->config;
+    long result = STATUS_NOERROR;
+    int rate_changed = 0;
+
+    pthread_mutex_lock(&channel->mutex);
+    for (unsigned long i = 0; i < list->NumOfParams && result == STATUS_NOERROR; i++) {
+        SCONFIG* item = &list->ConfigPtr[i];
+        unsigned long* field = nullptr;
+        switch (item->Parameter) {
+            case DATA_RATE: field = &config->data_rate; rate_changed = set; break;
+            case LOOPBACK: field = &config->loopback; break;
+            case P1_MAX: field = &config->p1_max; break;
+            case P3_MIN: field = &config->p3_min; break;
+            case P4_MIN: field = &config->p4_min; break;
+            case W1: field = &config->w1; break;
+            case W2: field = &config->w2; break;
+            case W3: field = &config->w3; break;
+            case W4: field = &config->w4; break;
+            case W5: field = &config->w5; break;
+            case TIDLE: field = &config->tidle; break;
+            case TINIL: field = &config->tinil; break;
+            case TWUP: field = &config->twup; break;
+            case PARITY: field = &config->parity; rate_changed = set; break;
+            case FIVE_BAUD_MOD: field = &config->five_baud_mod; break;
+            case P1_MIN:
+            case P2_MIN:
+            case P2_MAX:
+            case P3_MAX:
+            case P4_MAX:
+            case DATA_BITS:
+                // Accepted for compatibility; the ECU owns these limits
+                if (!set) {
+                    item->Value = 0;
+                }
+                continue;
+            default:
+                result = ERR_NOT_SUPPORTED;
+                continue;
+        }
+        if (!set) {
+            item->Value = *field;
+        } else if ((item->Parameter == DATA_RATE && item->Value == 0) ||
+                   (item->Parameter == PARITY && item->Value > 2)) {
+            result = ERR_INVALID_IOCTL_VALUE;
+        } else {
+            *field = item->Value;
+        }
+    }
+    pthread_mutex_unlock(&channel->mutex);
+
+    if (result == STATUS_NOERROR && rate_changed) {
+        result = apply_line_settings(channel);
+    }
+    return result;
+}
+
+static long kline_open(void* name, unsigned long* device_id) {
+    if (device_id == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    const char* spec = name != nullptr && static_cast<const char*>(name)[0] != '\0'
+        ? static_cast<const char*>(name) : KLINE_DEFAULT_DEVICE;
+    char path[KLINE_PATH_SIZE];
+    if (strlen(spec) >= sizeof(path)) {
+        set_error("Invalid K-line device '%s'", spec);
+        return ERR_INVALID_DEVICE_ID;
+    }
+    strcpy(path, spec);
+    int echo = 1;
+    char* option = strchr(path, ',');
+    if (option != nullptr) {
+        *option++ = '\0';
+        echo = strcmp(option, "noecho") != 0;
+    }
+    if (access(path, R_OK | W_OK) != 0) {
+        set_error("Cannot access %s: %s", path, strerror(errno));
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+
+    pthread_mutex_lock(&g_kline_mutex);
+    long result = ERR_DEVICE_IN_USE;
+    for (unsigned int i = 0; i < KLINE_MAX_DEVICES; i++) {
+        if (!g_kline_devices[i].in_use) {
+            g_kline_devices[i].in_use = 1;
+            g_kline_devices[i].echo = echo;
+            g_kline_devices[i].connected = 0;
+            strcpy(g_kline_devices[i].path, path);
+            *device_id = i + 1;
+            result = STATUS_NOERROR;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_kline_mutex);
+    return result;
+}
+
+static void release_channel(KLINE_CHANNEL* channel) {
+    channel->running = 0;
+    pthread_join(channel->thread, nullptr);
+    close(channel->fd);
+    free(channel->queue);
+    pthread_cond_destroy(&channel->changed);
+    pthread_mutex_destroy(&channel->mutex);
+    pthread_mutex_destroy(&channel->tx_mutex);
+    g_kline_devices[channel->device_id - 1].connected = 0;
+    memset(channel, 0, sizeof(KLINE_CHANNEL));
+}
+
+static long kline_disconnect(unsigned long channel_id) {
+    pthread_mutex_lock(&g_kline_mutex);
+    KLINE_CHANNEL* channel = channel_for(channel_id);
+    if (channel != nullptr) {
+        release_channel(channel);
+    }
+    pthread_mutex_unlock(&g_kline_mutex);
+    return channel != nullptr ? STATUS_NOERROR : ERR_INVALID_CHANNEL_ID;
+}
+
+static long kline_close(unsigned long device_id) {
+    if (device_id == 0 || device_id > KLINE_MAX_DEVICES) {
+        return ERR_INVALID_DEVICE_ID;
+    }
+    pthread_mutex_lock(&g_kline_mutex);
+    long result = ERR_INVALID_DEVICE_ID;
+    if (g_kline_devices[device_id - 1].in_use) {
+        if (g_kline_channels[device_id - 1].in_use) {
+            release_channel(&g_kline_channels[device_id - 1]);
+        }
+        g_kline_devices[device_id - 1].in_use = 0;
+        result = STATUS_NOERROR;
+    }
+    pthread_mutex_unlock(&g_kline_mutex);
+    return result;
+}
+
+static long kline_connect(unsigned long device_id, unsigned long protocol_id, unsigned long flags,
+                          unsigned long baudrate, unsigned long* channel_id) {
+    if (channel_id == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (protocol_id != ISO9141 && protocol_id != ISO14230) {
+        return ERR_INVALID_PROTOCOL_ID;
+    }
+    if (device_id == 0 || device_id > KLINE_MAX_DEVICES || !g_kline_devices[device_id - 1].in_use) {
+        return ERR_INVALID_DEVICE_ID;
+    }
+
+    pthread_mutex_lock(&g_kline_mutex);
+    KLINE_DEVICE* device = &g_kline_devices[device_id - 1];
+    KLINE_CHANNEL* channel = &g_kline_channels[device_id - 1];
+    if (device->connected) {
+        pthread_mutex_unlock(&g_kline_mutex);
+        return ERR_CHANNEL_IN_USE;
+    }
+
+    memset(channel, 0, sizeof(KLINE_CHANNEL));
+    channel->fd = open(device->path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (channel->fd < 0) {
+        set_error("Cannot open %s: %s", device->path, strerror(errno));
+        pthread_mutex_unlock(&g_kline_mutex);
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+    channel->device_id = device_id;
+    channel->protocol_id = protocol_id;
+    channel->flags = flags;
+    channel->echo = device->echo;
+    default_config(&channel->config, baudrate);
+    long result = apply_line_settings(channel);
+    if (result == STATUS_NOERROR) {
+        channel->queue = static_cast<PASSTHRU_MSG*>(malloc(KLINE_RX_QUEUE * sizeof(PASSTHRU_MSG)));
+        if (channel->queue == nullptr) {
+            result = ERR_INSUFFICIENT_MEMORY;
+        }
+    }
+    if (result != STATUS_NOERROR) {
+        close(channel->fd);
+        memset(channel, 0, sizeof(KLINE_CHANNEL));
+        pthread_mutex_unlock(&g_kline_mutex);
+        return result;
+    }
+
+    ioctl(channel->fd, TCFLSH, TCIOFLUSH);
+    pthread_mutex_init(&channel->mutex, nullptr);
+    pthread_cond_init(&channel->changed, nullptr);
+    pthread_mutex_init(&channel->tx_mutex, nullptr);
+    channel->last_activity_us = now_us();
+    channel->running = 1;
+    if (pthread_create(&channel->thread, nullptr, kline_rx_thread, channel) != 0) {
+        close(channel->fd);
+        free(channel->queue);
+        memset(channel, 0, sizeof(KLINE_CHANNEL));
+        pthread_mutex_unlock(&g_kline_mutex);
+        return ERR_FAILED;
+    }
+    channel->in_use = 1;
+    device->connected = 1;
+    *channel_id = device_id;
+    pthread_mutex_unlock(&g_kline_mutex);
+    return STATUS_NOERROR;
+}
+
+static long kline_read_msgs(unsigned long channel_id, void* msgs, unsigned long* num_msgs,
+                            unsigned long timeout) {
+    if (msgs == nullptr || num_msgs == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    KLINE_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+
+    PASSTHRU_MSG* out = static_cast<PASSTHRU_MSG*>(msgs);
+    unsigned long max_msgs = *num_msgs;
+    unsigned long count = 0;
+    unsigned long long deadline = now_us() + ms_us(timeout);
+
+    pthread_mutex_lock(&channel->mutex);
+    while (channel->queue_count == 0 && now_us() < deadline) {
+        wait_until_us(channel, deadline);
+    }
+    while (count < max_msgs && channel->queue_count > 0) {
+        const PASSTHRU_MSG* msg = &channel->queue[channel->queue_head];
+        memcpy(&out[count++], msg, offsetof(PASSTHRU_MSG, Data) + msg->DataSize);
+        channel->queue_head = (channel->queue_head + 1) % KLINE_RX_QUEUE;
+        channel->queue_count--;
+    }
+    pthread_mutex_unlock(&channel->mutex);
+
+    *num_msgs = count;
+    return count > 0 ? STATUS_NOERROR : ERR_BUFFER_EMPTY;
+}
+
+static long kline_write_msgs(unsigned long channel_id, void* msgs, unsigned long* num_msgs,
+                             unsigned long timeout) {
+    if (msgs == nullptr || num_msgs == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    KLINE_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+
+    const PASSTHRU_MSG* in = static_cast<const PASSTHRU_MSG*>(msgs);
+    unsigned long total = *num_msgs;
+    unsigned long sent = 0;
+    long result = STATUS_NOERROR;
+
+    pthread_mutex_lock(&channel->tx_mutex);
+    while (result == STATUS_NOERROR && sent < total) {
+        if (in[sent].ProtocolID != channel->protocol_id) {
+            result = ERR_MSG_PROTOCOL_ID;
+            break;
+        }
+        result = send_message(channel, &in[sent]);
+        if (result == STATUS_NOERROR) {
+            sent++;
+        }
+    }
+    pthread_mutex_unlock(&channel->tx_mutex);
+
+    *num_msgs = sent;
+    return result;
+}
+
+static long kline_start_msg_filter(unsigned long channel_id, unsigned long filter_type, void* mask,
+                                   void* pattern, void* flow_control, unsigned long* filter_id) {
+    if (filter_id == nullptr || mask == nullptr || pattern == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    KLINE_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+    if (filter_type != PASS_FILTER && filter_type != BLOCK_FILTER) {
+        return ERR_INVALID_MSG;
+    }
+    const PASSTHRU_MSG* mask_msg = static_cast<const PASSTHRU_MSG*>(mask);
+    const PASSTHRU_MSG* pattern_msg = static_cast<const PASSTHRU_MSG*>(pattern);
+    if (mask_msg->DataSize > KLINE_FILTER_SIZE || mask_msg->DataSize != pattern_msg->DataSize) {
+        return ERR_INVALID_MSG;
+    }
+
+    pthread_mutex_lock(&channel->mutex);
+    long result = ERR_FAILED;
+    for (unsigned int i = 0; i < KLINE_MAX_FILTERS; i++) {
+        KLINE_FILTER* filter = &channel->filters[i];
+        if (filter->in_use) {
+            continue;
+        }
+        filter->in_use = 1;
+        filter->type = filter_type;
+        filter->length = mask_msg->DataSize;
+        memcpy(filter->mask, mask_msg->Data, filter->length);
+        memcpy(filter->pattern, pattern_msg->Data, filter->length);
+        *filter_id = i + 1;
+        result = STATUS_NOERROR;
+        break;
+    }
+    pthread_mutex_unlock(&channel->mutex);
+    return result;
+}
+
+static long kline_stop_msg_filter(unsigned long channel_id, unsigned long filter_id) {
+    KLINE_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+    if (filter_id == 0 || filter_id > KLINE_MAX_FILTERS) {
+        return ERR_INVALID_FILTER_ID;
+    }
+    pthread_mutex_lock(&channel->mutex);
+    long result = channel->filters[filter_id - 1].in_use ? STATUS_NOERROR : ERR_INVALID_FILTER_ID;
+    channel->filters[filter_id - 1].in_use = 0;
+    pthread_mutex_unlock(&channel->mutex);
+    return result;
+}
+
+static long kline_set_programming_voltage(unsigned long device_id, unsigned long pin,
+                                          unsigned long voltage) {
+    return ERR_NOT_SUPPORTED;
+}
+
+static long kline_read_version(unsigned long device_id, char* firmware_version, char* dll_version,
+                               char* api_version) {
+    if (firmware_version == nullptr || dll_version == nullptr || api_version == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    strcpy(firmware_version, "Serial K-line");
+    strcpy(dll_version, "SpaceTec K-line 1.0");
+    strcpy(api_version, "04.04");
+    return STATUS_NOERROR;
+}
+
+static long kline_get_last_error(char* description) {
+    if (description == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    pthread_mutex_lock(&g_kline_error_mutex);
+    strcpy(description, g_kline_error);
+    pthread_mutex_unlock(&g_kline_error_mutex);
+    return STATUS_NOERROR;
+}
+
+static long kline_ioctl(unsigned long channel_id, unsigned long ioctl_id, void* input, void* output) {
+    KLINE_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+    switch (ioctl_id) {
+        case GET_CONFIG:
+            return get_set_config(channel, static_cast<SCONFIG_LIST*>(input), 0);
+        case SET_CONFIG:
+            return get_set_config(channel, static_cast<SCONFIG_LIST*>(input), 1);
+        case FIVE_BAUD_INIT:
+            return five_baud_init(channel, static_cast<const SBYTE_ARRAY*>(input),
+                                  static_cast<SBYTE_ARRAY*>(output));
+        case FAST_INIT:
+            return fast_init(channel, static_cast<const PASSTHRU_MSG*>(input),
+                             static_cast<PASSTHRU_MSG*>(output));
+        case CLEAR_TX_BUFFER:
+            return STATUS_NOERROR;   // writes are synchronous
+        case CLEAR_RX_BUFFER:
+            pthread_mutex_lock(&channel->mutex);
+            channel->queue_count = 0;
+            pthread_mutex_unlock(&channel->mutex);
+            return STATUS_NOERROR;
+        default:
+            return ERR_INVALID_IOCTL_ID;
+    }
+}
+
+J2534_LIBRARY* kline_library(void) {
+    static J2534_LIBRARY library = {
+        nullptr,
+        kline_open,
+        kline_close,
+        kline_connect,
+        kline_disconnect,
+        kline_read_msgs,
+        kline_write_msgs,
+        kline_start_msg_filter,
+        kline_stop_msg_filter,
+        kline_set_programming_voltage,
+        kline_read_version,
+        kline_get_last_error,
+        kline_ioctl,
+    };
+    return &library;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeKlineLoad
+ * Signature: ()J
+ *
+ * Selects the serial K-line backend in place of a J2534 DLL; nativePassThruOpen
+ * then takes the tty path as its device name.
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeKlineLoad
+  (JNIEnv *env, jobject obj) {
+
+    J2534_LIBRARY* lib = kline_library();
+    g_j2534_lib = lib;
+    g_last_error = STATUS_NOERROR;
+    return reinterpret_cast<jlong>(lib);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef KLINE_TRANSPORT_H
+#define KLINE_TRANSPORT_H
+
+#include <jni.h>
+#include "j2534_native.h"
+
+// J2534 IOCTL IDs handled by the K-line table
+#define GET_CONFIG 0x01
+#define SET_CONFIG 0x02
+#define FIVE_BAUD_INIT 0x04
+#define FAST_INIT 0x05
+#define CLEAR_TX_BUFFER 0x07
+#define CLEAR_RX_BUFFER 0x08
+
+// J2534 configuration parameters (P timings in 0.5 ms, W/T timings in ms)
+#define DATA_RATE 0x01
+#define LOOPBACK 0x03
+#define P1_MIN 0x06
+#define P1_MAX 0x07
+#define P2_MIN 0x08
+#define P2_MAX 0x09
+#define P3_MIN 0x0A
+#define P3_MAX 0x0B
+#define P4_MIN 0x0C
+#define P4_MAX 0x0D
+#define W1 0x0E
+#define W2 0x0F
+#define W3 0x10
+#define W4 0x11
+#define W5 0x12
+#define TIDLE 0x13
+#define TINIL 0x14
+#define TWUP 0x15
+#define PARITY 0x16
+#define DATA_BITS 0x20
+#define FIVE_BAUD_MOD 0x21
+
+// Connect flags
+#define ISO9141_NO_CHECKSUM 0x0200
+#define ISO9141_K_LINE_ONLY 0x1000
+
+#define KLINE_DEFAULT_DEVICE "/dev/ttyUSB0"
+#define KLINE_DEFAULT_BAUDRATE 10400
+#define KLINE_MAX_MESSAGE 264          // ISO 14230: format, target, source, length, 255 data, checksum
+#define KLINE_MAX_DEVICES 2
+#define KLINE_MAX_FILTERS 10
+#define KLINE_FILTER_SIZE 12
+#define KLINE_RX_QUEUE 32
+#define KLINE_FIVE_BAUD_BIT_MS 200
+#define KLINE_INIT_RESPONSE_MS 300     // StartCommunication response after a fast init
+#define KLINE_USB_SLACK_MS 20          // USB serial latency added to receive windows
+
+// Byte array of the FIVE_BAUD_INIT IOCTL
+typedef struct {
+    unsigned long NumOfBytes;
+    unsigned char* BytePtr;
+} SBYTE_ARRAY;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * PassThru function table for ISO 9141 and ISO 14230 over a serial K-line
+ * interface (KKL/FTDI style). PassThruOpen takes the tty path, optionally
+ * followed by ",noecho" for interfaces that do not read back their own
+ * bytes; null opens /dev/ttyUSB0. A native thread reads the line and frames
+ * messages by the ISO 14230 length or, for ISO 9141, by the P1_MAX gap.
+ * Writes keep P3_MIN before and P4_MIN between bytes with absolute monotonic
+ * deadlines and check every echoed byte for collisions. FAST_INIT and
+ * FIVE_BAUD_INIT drive the wake-up patterns with line breaks. Unless the
+ * channel was connected with ISO9141_NO_CHECKSUM, the checksum is appended on
+ * transmit and verified on receive, where it stays as the last byte with
+ * ExtraDataIndex pointing at it. The table is static and must not be passed
+ * to unload_j2534_library.
+ */
+J2534_LIBRARY* kline_library(void);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeKlineLoad
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeKlineLoad
+  (JNIEnv *, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KLINE_TRANSPORT_H
@@ -0,0 +1,416 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "obd_live_scheduler.h"
+#include "j2534_jni.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define OBD_SUPPORT_CACHE_SIZE 16
+
+// Supported-PID bitmaps survive scheduler instances; discovery costs two round trips
+typedef struct {
+    int valid;
+    unsigned long channel_id;
+    unsigned long rx_id;
+    unsigned char supported[32];
+} OBD_SUPPORT_ENTRY;
+
+static pthread_mutex_t g_support_mutex = PTHREAD_MUTEX_INITIALIZER;
+static OBD_SUPPORT_ENTRY g_support_cache[OBD_SUPPORT_CACHE_SIZE];
+static unsigned int g_support_next = 0;
+
+static int pid_supported(const unsigned char* bitmap, unsigned char pid) {
+    return (bitmap[pid >> 3] >> (7 - (pid & 7))) & 1;
+}
+
+static void set_pid_supported(unsigned char* bitmap, unsigned char pid) {
+    bitmap[pid >> 3] |= static_cast<unsigned char>(0x80 >> (pid & 7));
+}
+
+static int cache_lookup(unsigned long channel_id, unsigned long rx_id, unsigned char* bitmap) {
+    int found = 0;
+    pthread_mutex_lock(&g_support_mutex);
+    for (unsigned int i = 0; i < OBD_SUPPORT_CACHE_SIZE; i++) {
+        OBD_SUPPORT_ENTRY* entry = &g_support_cache[i];
+        if (entry->valid && entry->channel_id == channel_id && entry->rx_id == rx_id) {
+            memcpy(bitmap, entry->supported, sizeof(entry->supported));
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_support_mutex);
+    return found;
+}
+
+static void cache_store(unsigned long channel_id, unsigned long rx_id, const unsigned char* bitmap) {
+    pthread_mutex_lock(&g_support_mutex);
+    OBD_SUPPORT_ENTRY* entry = &g_support_cache[g_support_next];
+    g_support_next = (g_support_next + 1) % OBD_SUPPORT_CACHE_SIZE;
+    entry->valid = 1;
+    entry->channel_id = channel_id;
+    entry->rx_id = rx_id;
+    memcpy(entry->supported, bitmap, sizeof(entry->supported));
+    pthread_mutex_unlock(&g_support_mutex);
+}
+
+typedef struct {
+    unsigned char* out;
+    unsigned long capacity;
+    unsigned long length;
+    unsigned long timestamp;
+    unsigned long samples;
+    int full;
+} OBD_SAMPLE_WRITER;
+
+static void collect_bitmap(void* context, unsigned char pid, const unsigned char* data,
+                           unsigned int length) {
+    unsigned char* supported = static_cast<unsigned char*>(context);
+    if (!obd_pid_is_support_bitmap(pid) || length != 4) {
+        return;
+    }
+    for (unsigned int bit = 0; bit < 32; bit++) {
+        if (data[bit >> 3] & (0x80 >> (bit & 7))) {
+            set_pid_supported(supported, static_cast<unsigned char>(pid + 1 + bit));
+        }
+    }
+}
+
+static void write_sample(void* context, unsigned char pid, const unsigned char* data,
+                         unsigned int length) {
+    OBD_SAMPLE_WRITER* writer = static_cast<OBD_SAMPLE_WRITER*>(context);
+    unsigned long record = (OBD_SAMPLE_HEADER_SIZE + length + 3) & ~3UL;
+    if (writer->full || writer->length + record > writer->capacity) {
+        writer->full = 1;
+        return;
+    }
+
+    unsigned char* rec = writer->out + writer->length;
+    rec[0] = static_cast<unsigned char>(writer->timestamp);
+    rec[1] = static_cast<unsigned char>(writer->timestamp >> 8);
+    rec[2] = static_cast<unsigned char>(writer->timestamp >> 16);
+    rec[3] = static_cast<unsigned char>(writer->timestamp >> 24);
+    rec[4] = pid;
+    rec[5] = static_cast<unsigned char>(length);
+    rec[6] = 0;
+    rec[7] = 0;
+    memcpy(rec + OBD_SAMPLE_HEADER_SIZE, data, length);
+    memset(rec + OBD_SAMPLE_HEADER_SIZE + length, 0, record - OBD_SAMPLE_HEADER_SIZE - length);
+
+    writer->length += record;
+    writer->samples++;
+}
+
+long obd_live_create(J2534_LIBRARY* lib, unsigned long channel_id, unsigned long rx_id,
+                     unsigned long tx_flags, OBD_LIVE_SCHEDULER** scheduler) {
+    if (scheduler == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (lib == nullptr) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+
+    OBD_LIVE_SCHEDULER* s = static_cast<OBD_LIVE_SCHEDULER*>(calloc(1, sizeof(OBD_LIVE_SCHEDULER)));
+    if (s == nullptr) {
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+
+    uds_link_init(&s->link, lib, channel_id, uds_physical_tx_id(rx_id), rx_id, tx_flags);
+    long result = uds_start_flow_control(lib, channel_id, s->link.tx_id, rx_id, tx_flags,
+                                         &s->filter_id);
+    if (result != STATUS_NOERROR) {
+        free(s);
+        return result;
+    }
+
+    s->epoch_ms = uds_now_ms();
+    *scheduler = s;
+    return STATUS_NOERROR;
+}
+
+void obd_live_destroy(OBD_LIVE_SCHEDULER* scheduler) {
+    if (scheduler == nullptr) {
+        return;
+    }
+    J2534_LIBRARY* lib = scheduler->link.lib;
+    if (lib != nullptr && lib->PassThruStopMsgFilter != nullptr) {
+        lib->PassThruStopMsgFilter(scheduler->link.channel_id, scheduler->filter_id);
+    }
+    LOGI("OBD live: %lu requests, %lu samples", scheduler->requests, scheduler->samples);
+    free(scheduler);
+}
+
+static long query_bitmaps(OBD_LIVE_SCHEDULER* s, const unsigned char* bases, unsigned int count) {
+    unsigned char req[1 + OBD_MAX_PIDS_PER_REQUEST];
+    unsigned char resp[UDS_MAX_PAYLOAD];
+    unsigned long resp_len = sizeof(resp);
+
+    req[0] = OBD_SERVICE_CURRENT_DATA;
+    memcpy(req + 1, bases, count);
+
+    long result = uds_transact(&s->link, req, 1 + count, resp, &resp_len);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+
+    obd_walk_response(resp, resp_len, collect_bitmap, s->supported);
+    return STATUS_NOERROR;
+}
+
+long obd_live_discover(OBD_LIVE_SCHEDULER* scheduler) {
+    if (scheduler == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (cache_lookup(scheduler->link.channel_id, scheduler->link.rx_id, scheduler->supported)) {
+        return STATUS_NOERROR;
+    }
+
+    // Unsupported bitmap PIDs are simply omitted from the answer, so ask for six at once
+    static const unsigned char first_bases[] = {0x00, 0x20, 0x40, 0x60, 0x80, 0xA0};
+    static const unsigned char last_bases[] = {0xC0, 0xE0};
+
+    memset(scheduler->supported, 0, sizeof(scheduler->supported));
+    long result = query_bitmaps(scheduler, first_bases, sizeof(first_bases));
+    if (result == STATUS_NOERROR && pid_supported(scheduler->supported, 0xC0)) {
+        result = query_bitmaps(scheduler, last_bases, sizeof(last_bases));
+    }
+    if (result == STATUS_NOERROR) {
+        cache_store(scheduler->link.channel_id, scheduler->link.rx_id, scheduler->supported);
+    }
+    return result;
+}
+
+unsigned int obd_live_set_pids(OBD_LIVE_SCHEDULER* scheduler, const unsigned char* pids,
+                               const unsigned long* periods_ms, unsigned int count) {
+    scheduler->pid_count = 0;
+    unsigned long long now = uds_now_ms();
+
+    for (unsigned int i = 0; i < count && scheduler->pid_count < OBD_LIVE_MAX_PIDS; i++) {
+        if (!pid_supported(scheduler->supported, pids[i]) || obd_pid_data_length(pids[i]) == 0) {
+            continue;
+        }
+
+        // Rate-monotonic priority: keep the table ordered by period, shortest first
+        unsigned int pos = scheduler->pid_count;
+        unsigned long period = periods_ms[i] ? periods_ms[i] : 1;
+        while (pos > 0 && scheduler->pids[pos - 1].period_ms > period) {
+            scheduler->pids[pos] = scheduler->pids[pos - 1];
+            pos--;
+        }
+        scheduler->pids[pos].pid = pids[i];
+        scheduler->pids[pos].period_ms = period;
+        scheduler->pids[pos].next_due = now;
+        scheduler->pid_count++;
+    }
+    return scheduler->pid_count;
+}
+
+/*
+ * Packs the next request: every due PID in priority order, then, if slots remain,
+ * PIDs within half a period of their deadline so each round trip carries as many
+ * samples as J1979 allows.
+ */
+static unsigned int pack_request(OBD_LIVE_SCHEDULER* s, unsigned long long now,
+                                 unsigned int* slots) {
+    unsigned int packed = 0;
+    for (unsigned int i = 0; i < s->pid_count && packed < OBD_MAX_PIDS_PER_REQUEST; i++) {
+        if (s->pids[i].next_due <= now) {
+            slots[packed++] = i;
+        }
+    }
+    if (packed == 0) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < s->pid_count && packed < OBD_MAX_PIDS_PER_REQUEST; i++) {
+        OBD_LIVE_PID* entry = &s->pids[i];
+        if (entry->next_due > now && entry->next_due - now <= entry->period_ms / 2) {
+            slots[packed++] = i;
+        }
+    }
+    return packed;
+}
+
+static unsigned long long earliest_due(const OBD_LIVE_SCHEDULER* s) {
+    unsigned long long earliest = ~0ULL;
+    for (unsigned int i = 0; i < s->pid_count; i++) {
+        if (s->pids[i].next_due < earliest) {
+            earliest = s->pids[i].next_due;
+        }
+    }
+    return earliest;
+}
+
+long obd_live_run(OBD_LIVE_SCHEDULER* scheduler, unsigned long duration_ms,
+                  unsigned char* out, unsigned long out_capacity, unsigned long* out_length) {
+    if (scheduler == nullptr || out == nullptr || out_length == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    *out_length = 0;
+    if (scheduler->pid_count == 0) {
+        return STATUS_NOERROR;
+    }
+
+    unsigned char req[1 + OBD_MAX_PIDS_PER_REQUEST];
+    unsigned char resp[UDS_MAX_PAYLOAD];
+    unsigned int slots[OBD_MAX_PIDS_PER_REQUEST];
+    OBD_SAMPLE_WRITER writer;
+    writer.out = out;
+    writer.capacity = out_capacity;
+    writer.length = 0;
+    writer.timestamp = 0;
+    writer.samples = 0;
+    writer.full = 0;
+
+    long result = STATUS_NOERROR;
+    unsigned long long end = uds_now_ms() + duration_ms;
+
+    for (unsigned long long now = uds_now_ms(); now < end && !writer.full; now = uds_now_ms()) {
+        unsigned int packed = pack_request(scheduler, now, slots);
+        if (packed == 0) {
+            unsigned long long wake = earliest_due(scheduler);
+            if (wake > end) {
+                wake = end;
+            }
+            usleep(static_cast<useconds_t>((wake - now) * 1000));
+            continue;
+        }
+
+        req[0] = OBD_SERVICE_CURRENT_DATA;
+        for (unsigned int i = 0; i < packed; i++) {
+            req[1 + i] = scheduler->pids[slots[i]].pid;
+            // Reschedule from the deadline, skipping slots missed while the bus was busy
+            OBD_LIVE_PID* entry = &scheduler->pids[slots[i]];
+            entry->next_due += entry->period_ms;
+            if (entry->next_due <= now) {
+                entry->next_due = now + entry->period_ms;
+            }
+        }
+
+        unsigned long resp_len = sizeof(resp);
+        result = uds_transact(&scheduler->link, req, 1 + packed, resp, &resp_len);
+        scheduler->requests++;
+        if (result == ERR_TIMEOUT) {
+            continue;
+        }
+        if (result != STATUS_NOERROR) {
+            break;
+        }
+
+        writer.timestamp = static_cast<unsigned long>(uds_now_ms() - scheduler->epoch_ms);
+        obd_walk_response(resp, resp_len, write_sample, &writer);
+    }
+
+    scheduler->samples += writer.samples;
+    *out_length = writer.length;
+    return result == ERR_TIMEOUT ? STATUS_NOERROR : result;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeObdLiveCreate
+ * Signature: (III)J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeObdLiveCreate
+  (JNIEnv *env, jobject obj, jint channel_id, jint flags, jint ecu_rx_id) {
+
+    OBD_LIVE_SCHEDULER* scheduler = nullptr;
+    long result = obd_live_create(g_j2534_lib, static_cast<unsigned long>(channel_id),
+                                  static_cast<unsigned long>(ecu_rx_id),
+                                  static_cast<unsigned long>(flags) | ISO15765_FRAME_PAD,
+                                  &scheduler);
+    if (result == STATUS_NOERROR) {
+        result = obd_live_discover(scheduler);
+        if (result != STATUS_NOERROR) {
+            obd_live_destroy(scheduler);
+        }
+    }
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return reinterpret_cast<jlong>(scheduler);
+    } else {
+        return 0;
+    }
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeObdLiveSetPids
+ * Signature: (J[I[I)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeObdLiveSetPids
+  (JNIEnv *env, jobject obj, jlong handle, jintArray pids, jintArray periods_ms) {
+
+    OBD_LIVE_SCHEDULER* scheduler = reinterpret_cast<OBD_LIVE_SCHEDULER*>(handle);
+    if (scheduler == nullptr || pids == nullptr || periods_ms == nullptr ||
+        env->GetArrayLength(pids) != env->GetArrayLength(periods_ms)) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    jsize count = env->GetArrayLength(pids);
+    if (count > OBD_LIVE_MAX_PIDS) {
+        count = OBD_LIVE_MAX_PIDS;
+    }
+
+    jint pid_values[OBD_LIVE_MAX_PIDS];
+    jint period_values[OBD_LIVE_MAX_PIDS];
+    env->GetIntArrayRegion(pids, 0, count, pid_values);
+    env->GetIntArrayRegion(periods_ms, 0, count, period_values);
+
+    unsigned char pid_bytes[OBD_LIVE_MAX_PIDS] = {0};
+    unsigned long periods[OBD_LIVE_MAX_PIDS] = {0};
+    for (jsize i = 0; i < count; i++) {
+        pid_bytes[i] = static_cast<unsigned char>(pid_values[i]);
+        periods[i] = period_values[i] > 0 ? static_cast<unsigned long>(period_values[i]) : 1;
+    }
+
+    g_last_error = STATUS_NOERROR;
+    return static_cast<jint>(obd_live_set_pids(scheduler, pid_bytes, periods,
+                                               static_cast<unsigned int>(count)));
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeObdLiveRun
+ * Signature: (JLjava/nio/ByteBuffer;I)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeObdLiveRun
+  (JNIEnv *env, jobject obj, jlong handle, jobject sample_buffer, jint duration_ms) {
+
+    OBD_LIVE_SCHEDULER* scheduler = reinterpret_cast<OBD_LIVE_SCHEDULER*>(handle);
+    unsigned char* out = sample_buffer != nullptr
+        ? static_cast<unsigned char*>(env->GetDirectBufferAddress(sample_buffer)) : nullptr;
+    if (scheduler == nullptr || out == nullptr || duration_ms < 0) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    unsigned long length = 0;
+    long result = obd_live_run(scheduler, static_cast<unsigned long>(duration_ms), out,
+                               static_cast<unsigned long>(env->GetDirectBufferCapacity(sample_buffer)),
+                               &length);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return static_cast<jint>(length);
+    } else {
+        return -1;
+    }
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeObdLiveDestroy
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_spacetec_j2534_J2534Interface_nativeObdLiveDestroy
+  (JNIEnv *env, jobject obj, jlong handle) {
+    obd_live_destroy(reinterpret_cast<OBD_LIVE_SCHEDULER*>(handle));
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef OBD_LIVE_SCHEDULER_H
+#define OBD_LIVE_SCHEDULER_H
+
+#include <jni.h>
+#include "uds_client.h"
+#include "obd_pids.h"
+
+#define OBD_LIVE_MAX_PIDS 64
+
+/*
+ * Sample record written by obd_live_run (little endian, 4-byte aligned):
+ *   u32 timestamp_ms (since scheduler creation), u8 pid, u8 length, u16 reserved,
+ *   data[length], pad
+ */
+#define OBD_SAMPLE_HEADER_SIZE 8
+
+typedef struct {
+    unsigned char pid;
+    unsigned long period_ms;
+    unsigned long long next_due;
+} OBD_LIVE_PID;
+
+typedef struct {
+    UDS_LINK link;
+    unsigned long filter_id;
+    unsigned char supported[32];
+    OBD_LIVE_PID pids[OBD_LIVE_MAX_PIDS];
+    unsigned int pid_count;
+    unsigned long long epoch_ms;
+    unsigned long requests;
+    unsigned long samples;
+} OBD_LIVE_SCHEDULER;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+long obd_live_create(J2534_LIBRARY* lib, unsigned long channel_id, unsigned long rx_id,
+                     unsigned long tx_flags, OBD_LIVE_SCHEDULER** scheduler);
+void obd_live_destroy(OBD_LIVE_SCHEDULER* scheduler);
+
+// Learns (or recalls from the per-ECU cache) which PIDs the ECU supports
+long obd_live_discover(OBD_LIVE_SCHEDULER* scheduler);
+
+// Replaces the PID set; unsupported PIDs are dropped. Returns the number scheduled.
+unsigned int obd_live_set_pids(OBD_LIVE_SCHEDULER* scheduler, const unsigned char* pids,
+                               const unsigned long* periods_ms, unsigned int count);
+
+// Runs the schedule for duration_ms or until the sample buffer is full
+long obd_live_run(OBD_LIVE_SCHEDULER* scheduler, unsigned long duration_ms,
+                  unsigned char* out, unsigned long out_capacity, unsigned long* out_length);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeObdLiveCreate
+ * Signature: (III)J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeObdLiveCreate
+  (JNIEnv *, jobject, jint, jint, jint);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeObdLiveSetPids
+ * Signature: (J[I[I)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeObdLiveSetPids
+  (JNIEnv *, jobject, jlong, jintArray, jintArray);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeObdLiveRun
+ * Signature: (JLjava/nio/ByteBuffer;I)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeObdLiveRun
+  (JNIEnv *, jobject, jlong, jobject, jint);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeObdLiveDestroy
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_spacetec_j2534_J2534Interface_nativeObdLiveDestroy
+  (JNIEnv *, jobject, jlong);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OBD_LIVE_SCHEDULER_H
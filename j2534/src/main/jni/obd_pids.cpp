@@ -0,0 +1,509 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "obd_pids.h"
+#include "obd_live_scheduler.h"
+#include "j2534_jni.h"
+#include <stdint.h>
+#include <string.h>
+
+// Service 01 data lengths per SAE J1979-DA, indexed by PID (0 = not defined)
+static constexpr unsigned char g_pid_lengths[256] = {
+    /* 0x00 */ 4, 4, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1,
+    /* 0x10 */ 2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2,
+    /* 0x20 */ 4, 2, 2, 2, 4, 4, 4, 4, 4, 4, 4, 4, 1, 1, 1, 1,
+    /* 0x30 */ 1, 2, 2, 1, 4, 4, 4, 4, 4, 4, 4, 4, 2, 2, 2, 2,
+    /* 0x40 */ 4, 4, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 4,
+    /* 0x50 */ 4, 1, 1, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 1,
+    /* 0x60 */ 4, 1, 1, 2, 5, 2, 5, 3, 7, 7, 5, 5, 5, 11, 9, 3,
+    /* 0x70 */ 10, 6, 5, 5, 5, 7, 7, 5, 9, 9, 7, 7, 9, 1, 1, 13,
+    /* 0x80 */ 4, 41, 41, 9, 1, 10, 5, 5, 13, 41, 41, 7, 17, 1, 1, 7,
+    /* 0x90 */ 3, 5, 2, 3, 12, 0, 0, 0, 9, 9, 6, 4, 17, 4, 2, 9,
+    /* 0xA0 */ 4, 9, 2, 9, 4, 4, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0xB0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0xC0 */ 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0xD0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0xE0 */ 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 0xF0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+/*
+ * One engineering value inside a PID: raw = big-endian unsigned of byte_count bytes
+ * at byte_offset, optionally (raw >> shift) & mask or sign-extended, then
+ * value = raw * scale + offset.
+ */
+typedef struct {
+    unsigned char pid;
+    unsigned char byte_offset;
+    unsigned char byte_count;
+    unsigned char shift;
+    unsigned int mask;
+    unsigned char is_signed;
+    unsigned char unit;
+    float scale;
+    float offset;
+} OBD_SIGNAL;
+
+#define LINEAR(pid, at, n, scale, offset, unit) {pid, at, n, 0, 0, 0, unit, scale, offset}
+#define SIGNED(pid, at, n, scale, offset, unit) {pid, at, n, 0, 0, 1, unit, scale, offset}
+#define BITS(pid, at, shift, mask) {pid, at, 1, shift, mask, 0, OBD_UNIT_NONE, 1.0f, 0.0f}
+
+// AECD timer pairs #1 and #2 for five AECDs, u32 seconds each after the support byte
+#define AECD_TIMERS(pid) \
+    LINEAR(pid, 1, 4, 1.0f, 0.0f, OBD_UNIT_SECONDS), LINEAR(pid, 5, 4, 1.0f, 0.0f, OBD_UNIT_SECONDS), \
+    LINEAR(pid, 9, 4, 1.0f, 0.0f, OBD_UNIT_SECONDS), LINEAR(pid, 13, 4, 1.0f, 0.0f, OBD_UNIT_SECONDS), \
+    LINEAR(pid, 17, 4, 1.0f, 0.0f, OBD_UNIT_SECONDS), LINEAR(pid, 21, 4, 1.0f, 0.0f, OBD_UNIT_SECONDS), \
+    LINEAR(pid, 25, 4, 1.0f, 0.0f, OBD_UNIT_SECONDS), LINEAR(pid, 29, 4, 1.0f, 0.0f, OBD_UNIT_SECONDS), \
+    LINEAR(pid, 33, 4, 1.0f, 0.0f, OBD_UNIT_SECONDS), LINEAR(pid, 37, 4, 1.0f, 0.0f, OBD_UNIT_SECONDS)
+
+#define PCT_255 (100.0f / 255.0f)
+#define PCT_TRIM (100.0f / 128.0f)
+
+/*
+ * Formula table per SAE J1979-DA, ordered by PID. Bit-encoded PIDs are exported
+ * as raw bytes. 0x88 (SCR inducement), 0x8B (aftertreatment status) and 0x8C
+ * (wide-range O2) are delimited in responses but not decoded.
+ */
+static constexpr OBD_SIGNAL g_signals[] = {
+    BITS(0x01, 0, 7, 0x01),                                   // MIL on
+    BITS(0x01, 0, 0, 0x7F),                                   // confirmed DTC count
+    LINEAR(0x03, 0, 1, 1.0f, 0.0f, OBD_UNIT_NONE),            // fuel system 1 status
+    LINEAR(0x03, 1, 1, 1.0f, 0.0f, OBD_UNIT_NONE),            // fuel system 2 status
+    LINEAR(0x04, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // calculated load
+    LINEAR(0x05, 0, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),       // coolant temperature
+    LINEAR(0x06, 0, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),  // STFT bank 1
+    LINEAR(0x07, 0, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),  // LTFT bank 1
+    LINEAR(0x08, 0, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),  // STFT bank 2
+    LINEAR(0x09, 0, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),  // LTFT bank 2
+    LINEAR(0x0A, 0, 1, 3.0f, 0.0f, OBD_UNIT_KPA),             // fuel pressure
+    LINEAR(0x0B, 0, 1, 1.0f, 0.0f, OBD_UNIT_KPA),             // intake manifold pressure
+    LINEAR(0x0C, 0, 2, 0.25f, 0.0f, OBD_UNIT_RPM),            // engine speed
+    LINEAR(0x0D, 0, 1, 1.0f, 0.0f, OBD_UNIT_KMH),             // vehicle speed
+    LINEAR(0x0E, 0, 1, 0.5f, -64.0f, OBD_UNIT_DEGREES),       // timing advance
+    LINEAR(0x0F, 0, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),       // intake air temperature
+    LINEAR(0x10, 0, 2, 0.01f, 0.0f, OBD_UNIT_GRAMS_PER_SEC),  // MAF air flow rate
+    LINEAR(0x11, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // throttle position
+    LINEAR(0x12, 0, 1, 1.0f, 0.0f, OBD_UNIT_NONE),            // commanded secondary air status
+    LINEAR(0x13, 0, 1, 1.0f, 0.0f, OBD_UNIT_NONE),            // O2 sensors present, 2 banks
+    LINEAR(0x14, 0, 1, 0.005f, 0.0f, OBD_UNIT_VOLTS),         // O2 sensors 1..8: voltage, STFT
+    LINEAR(0x14, 1, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x15, 0, 1, 0.005f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x15, 1, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x16, 0, 1, 0.005f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x16, 1, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x17, 0, 1, 0.005f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x17, 1, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x18, 0, 1, 0.005f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x18, 1, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x19, 0, 1, 0.005f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x19, 1, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x1A, 0, 1, 0.005f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x1A, 1, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x1B, 0, 1, 0.005f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x1B, 1, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x1C, 0, 1, 1.0f, 0.0f, OBD_UNIT_NONE),            // OBD standard
+    LINEAR(0x1D, 0, 1, 1.0f, 0.0f, OBD_UNIT_NONE),            // O2 sensors present, 4 banks
+    BITS(0x1E, 0, 0, 0x01),                                   // PTO active
+    LINEAR(0x1F, 0, 2, 1.0f, 0.0f, OBD_UNIT_SECONDS),         // run time since start
+    LINEAR(0x21, 0, 2, 1.0f, 0.0f, OBD_UNIT_KM),              // distance with MIL on
+    LINEAR(0x22, 0, 2, 0.079f, 0.0f, OBD_UNIT_KPA),           // fuel rail pressure (vacuum)
+    LINEAR(0x23, 0, 2, 10.0f, 0.0f, OBD_UNIT_KPA),            // fuel rail gauge pressure
+    LINEAR(0x24, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),  // wide-band O2 1..8: lambda, voltage
+    LINEAR(0x24, 2, 2, 8.0f / 65536.0f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x25, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),
+    LINEAR(0x25, 2, 2, 8.0f / 65536.0f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x26, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),
+    LINEAR(0x26, 2, 2, 8.0f / 65536.0f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x27, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),
+    LINEAR(0x27, 2, 2, 8.0f / 65536.0f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x28, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),
+    LINEAR(0x28, 2, 2, 8.0f / 65536.0f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x29, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),
+    LINEAR(0x29, 2, 2, 8.0f / 65536.0f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x2A, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),
+    LINEAR(0x2A, 2, 2, 8.0f / 65536.0f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x2B, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),
+    LINEAR(0x2B, 2, 2, 8.0f / 65536.0f, 0.0f, OBD_UNIT_VOLTS),
+    LINEAR(0x2C, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // commanded EGR
+    LINEAR(0x2D, 0, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),  // EGR error
+    LINEAR(0x2E, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // commanded evaporative purge
+    LINEAR(0x2F, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // fuel tank level
+    LINEAR(0x30, 0, 1, 1.0f, 0.0f, OBD_UNIT_COUNT),           // warm-ups since codes cleared
+    LINEAR(0x31, 0, 2, 1.0f, 0.0f, OBD_UNIT_KM),              // distance since codes cleared
+    SIGNED(0x32, 0, 2, 0.25f, 0.0f, OBD_UNIT_PA),             // evap system vapor pressure
+    LINEAR(0x33, 0, 1, 1.0f, 0.0f, OBD_UNIT_KPA),             // barometric pressure
+    LINEAR(0x34, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),  // wide-band O2 1..8: lambda, current
+    LINEAR(0x34, 2, 2, 1.0f / 256.0f, -128.0f, OBD_UNIT_MILLIAMPS),
+    LINEAR(0x35, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),
+    LINEAR(0x35, 2, 2, 1.0f / 256.0f, -128.0f, OBD_UNIT_MILLIAMPS),
+    LINEAR(0x36, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),
+    LINEAR(0x36, 2, 2, 1.0f / 256.0f, -128.0f, OBD_UNIT_MILLIAMPS),
+    LINEAR(0x37, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),
+    LINEAR(0x37, 2, 2, 1.0f / 256.0f, -128.0f, OBD_UNIT_MILLIAMPS),
+    LINEAR(0x38, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),
+    LINEAR(0x38, 2, 2, 1.0f / 256.0f, -128.0f, OBD_UNIT_MILLIAMPS),
+    LINEAR(0x39, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),
+    LINEAR(0x39, 2, 2, 1.0f / 256.0f, -128.0f, OBD_UNIT_MILLIAMPS),
+    LINEAR(0x3A, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),
+    LINEAR(0x3A, 2, 2, 1.0f / 256.0f, -128.0f, OBD_UNIT_MILLIAMPS),
+    LINEAR(0x3B, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),
+    LINEAR(0x3B, 2, 2, 1.0f / 256.0f, -128.0f, OBD_UNIT_MILLIAMPS),
+    LINEAR(0x3C, 0, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),       // catalyst temperatures
+    LINEAR(0x3D, 0, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x3E, 0, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x3F, 0, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x41, 1, 1, 1.0f, 0.0f, OBD_UNIT_NONE),            // monitor status this cycle: B, C, D
+    LINEAR(0x41, 2, 1, 1.0f, 0.0f, OBD_UNIT_NONE),
+    LINEAR(0x41, 3, 1, 1.0f, 0.0f, OBD_UNIT_NONE),
+    LINEAR(0x42, 0, 2, 0.001f, 0.0f, OBD_UNIT_VOLTS),         // control module voltage
+    LINEAR(0x43, 0, 2, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // absolute load
+    LINEAR(0x44, 0, 2, 2.0f / 65536.0f, 0.0f, OBD_UNIT_RATIO),  // commanded equivalence ratio
+    LINEAR(0x45, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // relative throttle position
+    LINEAR(0x46, 0, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),       // ambient air temperature
+    LINEAR(0x47, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // absolute throttle B/C, pedal D/E/F
+    LINEAR(0x48, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x49, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x4A, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x4B, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x4C, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // commanded throttle actuator
+    LINEAR(0x4D, 0, 2, 1.0f, 0.0f, OBD_UNIT_MINUTES),         // time run with MIL on
+    LINEAR(0x4E, 0, 2, 1.0f, 0.0f, OBD_UNIT_MINUTES),         // time since codes cleared
+    LINEAR(0x4F, 0, 1, 1.0f, 0.0f, OBD_UNIT_RATIO),           // maximum equivalence ratio
+    LINEAR(0x4F, 1, 1, 1.0f, 0.0f, OBD_UNIT_VOLTS),           // maximum O2 voltage
+    LINEAR(0x4F, 2, 1, 1.0f, 0.0f, OBD_UNIT_MILLIAMPS),       // maximum O2 current
+    LINEAR(0x4F, 3, 1, 10.0f, 0.0f, OBD_UNIT_KPA),            // maximum intake pressure
+    LINEAR(0x50, 0, 1, 10.0f, 0.0f, OBD_UNIT_GRAMS_PER_SEC),  // maximum MAF
+    LINEAR(0x51, 0, 1, 1.0f, 0.0f, OBD_UNIT_NONE),            // fuel type
+    LINEAR(0x52, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // ethanol percentage
+    LINEAR(0x53, 0, 2, 0.005f, 0.0f, OBD_UNIT_KPA),           // absolute evap vapor pressure
+    SIGNED(0x54, 0, 2, 1.0f, 0.0f, OBD_UNIT_PA),              // evap system vapor pressure
+    LINEAR(0x55, 0, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),  // secondary O2 trims
+    LINEAR(0x56, 0, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x57, 0, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x58, 0, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x59, 0, 2, 10.0f, 0.0f, OBD_UNIT_KPA),            // fuel rail absolute pressure
+    LINEAR(0x5A, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // relative pedal position
+    LINEAR(0x5B, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // hybrid battery remaining
+    LINEAR(0x5C, 0, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),       // engine oil temperature
+    LINEAR(0x5D, 0, 2, 1.0f / 128.0f, -210.0f, OBD_UNIT_DEGREES),  // injection timing
+    LINEAR(0x5E, 0, 2, 0.05f, 0.0f, OBD_UNIT_LITERS_PER_HOUR),     // engine fuel rate
+    LINEAR(0x5F, 0, 1, 1.0f, 0.0f, OBD_UNIT_NONE),            // emission requirements
+    LINEAR(0x61, 0, 1, 1.0f, -125.0f, OBD_UNIT_PERCENT),      // driver demand torque
+    LINEAR(0x62, 0, 1, 1.0f, -125.0f, OBD_UNIT_PERCENT),      // actual torque
+    LINEAR(0x63, 0, 2, 1.0f, 0.0f, OBD_UNIT_NEWTON_METERS),   // reference torque
+    LINEAR(0x64, 0, 1, 1.0f, -125.0f, OBD_UNIT_PERCENT),      // torque at idle, points 1..4
+    LINEAR(0x64, 1, 1, 1.0f, -125.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x64, 2, 1, 1.0f, -125.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x64, 3, 1, 1.0f, -125.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x64, 4, 1, 1.0f, -125.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x65, 0, 1, 1.0f, 0.0f, OBD_UNIT_NONE),            // auxiliary inputs: supported, state
+    LINEAR(0x65, 1, 1, 1.0f, 0.0f, OBD_UNIT_NONE),
+    LINEAR(0x66, 1, 2, 1.0f / 32.0f, 0.0f, OBD_UNIT_GRAMS_PER_SEC),  // MAF sensors A, B
+    LINEAR(0x66, 3, 2, 1.0f / 32.0f, 0.0f, OBD_UNIT_GRAMS_PER_SEC),
+    LINEAR(0x67, 1, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),       // coolant sensors 1, 2
+    LINEAR(0x67, 2, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x68, 1, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),       // intake air sensors 1, 2
+    LINEAR(0x68, 2, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x69, 1, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // EGR A, B: commanded, actual, error
+    LINEAR(0x69, 2, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x69, 3, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x69, 4, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x69, 5, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x69, 6, 1, PCT_TRIM, -100.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x6A, 1, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // intake air flow A, B: commanded, relative
+    LINEAR(0x6A, 2, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x6A, 3, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x6A, 4, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x6B, 1, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),       // EGR temperatures
+    LINEAR(0x6B, 2, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x6B, 3, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x6B, 4, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x6C, 1, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // throttle actuator A, B: commanded, relative
+    LINEAR(0x6C, 2, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x6C, 3, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x6C, 4, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x6D, 1, 2, 10.0f, 0.0f, OBD_UNIT_KPA),            // fuel pressure A, B: commanded, actual, temp
+    LINEAR(0x6D, 3, 2, 10.0f, 0.0f, OBD_UNIT_KPA),
+    LINEAR(0x6D, 5, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x6D, 6, 2, 10.0f, 0.0f, OBD_UNIT_KPA),
+    LINEAR(0x6D, 8, 2, 10.0f, 0.0f, OBD_UNIT_KPA),
+    LINEAR(0x6D, 10, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x6E, 1, 2, 10.0f, 0.0f, OBD_UNIT_KPA),            // injection pressure A, B: commanded, actual
+    LINEAR(0x6E, 3, 2, 10.0f, 0.0f, OBD_UNIT_KPA),
+    LINEAR(0x6E, 5, 2, 10.0f, 0.0f, OBD_UNIT_KPA),
+    LINEAR(0x6E, 7, 2, 10.0f, 0.0f, OBD_UNIT_KPA),
+    LINEAR(0x6F, 1, 1, 1.0f, 0.0f, OBD_UNIT_KPA),             // turbo compressor inlet pressure A, B
+    LINEAR(0x6F, 2, 1, 1.0f, 0.0f, OBD_UNIT_KPA),
+    LINEAR(0x70, 1, 2, 1.0f / 32.0f, 0.0f, OBD_UNIT_KPA),     // boost pressure A, B: commanded, actual
+    LINEAR(0x70, 3, 2, 1.0f / 32.0f, 0.0f, OBD_UNIT_KPA),
+    LINEAR(0x70, 5, 2, 1.0f / 32.0f, 0.0f, OBD_UNIT_KPA),
+    LINEAR(0x70, 7, 2, 1.0f / 32.0f, 0.0f, OBD_UNIT_KPA),
+    LINEAR(0x71, 1, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // VGT A, B: commanded, position
+    LINEAR(0x71, 2, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x71, 3, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x71, 4, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x72, 1, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // wastegate A, B: commanded, position
+    LINEAR(0x72, 2, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x72, 3, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x72, 4, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x73, 1, 2, 0.01f, 0.0f, OBD_UNIT_KPA),            // exhaust pressure banks 1, 2
+    LINEAR(0x73, 3, 2, 0.01f, 0.0f, OBD_UNIT_KPA),
+    LINEAR(0x74, 1, 2, 10.0f, 0.0f, OBD_UNIT_RPM),            // turbo speed A, B
+    LINEAR(0x74, 3, 2, 10.0f, 0.0f, OBD_UNIT_RPM),
+    LINEAR(0x75, 1, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),       // turbo A: compressor in/out, turbine in/out
+    LINEAR(0x75, 2, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x75, 3, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x75, 5, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x76, 1, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),       // turbo B
+    LINEAR(0x76, 2, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x76, 3, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x76, 5, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x77, 1, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),       // charge air cooler temperatures
+    LINEAR(0x77, 2, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x77, 3, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x77, 4, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x78, 1, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),       // exhaust gas temperatures bank 1
+    LINEAR(0x78, 3, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x78, 5, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x78, 7, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x79, 1, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),       // exhaust gas temperatures bank 2
+    LINEAR(0x79, 3, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x79, 5, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x79, 7, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    SIGNED(0x7A, 1, 2, 0.01f, 0.0f, OBD_UNIT_KPA),            // DPF bank 1: delta, inlet, outlet pressure
+    LINEAR(0x7A, 3, 2, 0.01f, 0.0f, OBD_UNIT_KPA),
+    LINEAR(0x7A, 5, 2, 0.01f, 0.0f, OBD_UNIT_KPA),
+    SIGNED(0x7B, 1, 2, 0.01f, 0.0f, OBD_UNIT_KPA),            // DPF bank 2
+    LINEAR(0x7B, 3, 2, 0.01f, 0.0f, OBD_UNIT_KPA),
+    LINEAR(0x7B, 5, 2, 0.01f, 0.0f, OBD_UNIT_KPA),
+    LINEAR(0x7C, 1, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),       // DPF temperatures: inlet, outlet per bank
+    LINEAR(0x7C, 3, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x7C, 5, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x7C, 7, 2, 0.1f, -40.0f, OBD_UNIT_CELSIUS),
+    LINEAR(0x7D, 0, 1, 1.0f, 0.0f, OBD_UNIT_NONE),            // NOx NTE control area status
+    LINEAR(0x7E, 0, 1, 1.0f, 0.0f, OBD_UNIT_NONE),            // PM NTE control area status
+    LINEAR(0x7F, 1, 4, 1.0f, 0.0f, OBD_UNIT_SECONDS),         // run time: total, idle, PTO
+    LINEAR(0x7F, 5, 4, 1.0f, 0.0f, OBD_UNIT_SECONDS),
+    LINEAR(0x7F, 9, 4, 1.0f, 0.0f, OBD_UNIT_SECONDS),
+    AECD_TIMERS(0x81),                                        // AECD #1..#5 run times
+    AECD_TIMERS(0x82),                                        // AECD #6..#10
+    LINEAR(0x83, 1, 2, 1.0f, 0.0f, OBD_UNIT_PPM),             // NOx sensor concentrations
+    LINEAR(0x83, 3, 2, 1.0f, 0.0f, OBD_UNIT_PPM),
+    LINEAR(0x83, 5, 2, 1.0f, 0.0f, OBD_UNIT_PPM),
+    LINEAR(0x83, 7, 2, 1.0f, 0.0f, OBD_UNIT_PPM),
+    LINEAR(0x84, 0, 1, 1.0f, -40.0f, OBD_UNIT_CELSIUS),       // manifold surface temperature
+    LINEAR(0x85, 1, 2, 0.005f, 0.0f, OBD_UNIT_LITERS_PER_HOUR),// reagent: demand, use, level, NWI time
+    LINEAR(0x85, 3, 2, 0.005f, 0.0f, OBD_UNIT_LITERS_PER_HOUR),
+    LINEAR(0x85, 5, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),
+    LINEAR(0x85, 6, 4, 1.0f, 0.0f, OBD_UNIT_SECONDS),
+    LINEAR(0x86, 1, 2, 0.0125f, 0.0f, OBD_UNIT_MG_PER_M3),    // PM sensor banks 1, 2
+    LINEAR(0x86, 3, 2, 0.0125f, 0.0f, OBD_UNIT_MG_PER_M3),
+    LINEAR(0x87, 1, 2, 1.0f / 32.0f, 0.0f, OBD_UNIT_KPA),     // intake manifold pressure A, B
+    LINEAR(0x87, 3, 2, 1.0f / 32.0f, 0.0f, OBD_UNIT_KPA),
+    AECD_TIMERS(0x89),                                        // AECD #11..#15
+    AECD_TIMERS(0x8A),                                        // AECD #16..#20
+    LINEAR(0x8D, 0, 1, PCT_255, 0.0f, OBD_UNIT_PERCENT),      // throttle position G
+    LINEAR(0x8E, 0, 1, 1.0f, -125.0f, OBD_UNIT_PERCENT),      // engine friction torque
+    LINEAR(0xA6, 0, 4, 0.1f, 0.0f, OBD_UNIT_KM),              // odometer
+};
+
+#define OBD_SIGNAL_COUNT (sizeof(g_signals) / sizeof(g_signals[0]))
+
+// First signal and signal count per PID, built at compile time from g_signals
+typedef struct {
+    unsigned short first[256];
+    unsigned char count[256];
+} OBD_PID_INDEX;
+
+static constexpr OBD_PID_INDEX build_pid_index() {
+    OBD_PID_INDEX index = {};
+    for (unsigned int i = OBD_SIGNAL_COUNT; i-- > 0;) {
+        index.first[g_signals[i].pid] = static_cast<unsigned short>(i);
+        index.count[g_signals[i].pid]++;
+    }
+    return index;
+}
+
+static constexpr bool signal_table_valid() {
+    for (unsigned int i = 0; i < OBD_SIGNAL_COUNT; i++) {
+        const OBD_SIGNAL& s = g_signals[i];
+        if (i > 0 && g_signals[i - 1].pid > s.pid) {
+            return false;
+        }
+        if (s.byte_count == 0 || s.byte_count > 4 ||
+            s.byte_offset + s.byte_count > g_pid_lengths[s.pid]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(signal_table_valid(), "J1979 signal table must be PID-ordered and within PID lengths");
+
+static constexpr OBD_PID_INDEX g_pid_index = build_pid_index();
+
+unsigned int obd_pid_data_length(unsigned char pid) {
+    return g_pid_lengths[pid];
+}
+
+int obd_pid_is_support_bitmap(unsigned char pid) {
+    return (pid & 0x1F) == 0;
+}
+
+void obd_walk_response(const unsigned char* response, unsigned long length,
+                       obd_pid_visitor visitor, void* context) {
+    if (length < 1 || response[0] != OBD_SERVICE_CURRENT_DATA + OBD_POSITIVE_RESPONSE_OFFSET) {
+        return;
+    }
+    unsigned long pos = 1;
+    while (pos < length) {
+        unsigned char pid = response[pos];
+        unsigned int data_length = obd_pid_data_length(pid);
+        if (data_length == 0 || pos + 1 + data_length > length) {
+            return;
+        }
+        visitor(context, pid, response + pos + 1, data_length);
+        pos += 1 + data_length;
+    }
+}
+
+static float decode_signal(const OBD_SIGNAL* signal, const unsigned char* data) {
+    const unsigned char* p = data + signal->byte_offset;
+    uint32_t raw = 0;
+    for (unsigned int i = 0; i < signal->byte_count; i++) {
+        raw = (raw << 8) | p[i];
+    }
+    if (signal->mask != 0) {
+        raw = (raw >> signal->shift) & signal->mask;
+    }
+    if (signal->is_signed) {
+        unsigned int bits = signal->byte_count * 8;
+        int32_t value = static_cast<int32_t>(raw << (32 - bits)) >> (32 - bits);
+        return static_cast<float>(value) * signal->scale + signal->offset;
+    }
+    return static_cast<float>(raw) * signal->scale + signal->offset;
+}
+
+long obd_decode_samples(const unsigned char* samples, unsigned long length,
+                        unsigned char* out, unsigned long out_capacity, unsigned long* count) {
+    if (samples == nullptr || out == nullptr || count == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (out_capacity < OBD_DECODED_HEADER_SIZE) {
+        return ERR_BUFFER_OVERFLOW;
+    }
+
+    uint32_t capacity = static_cast<uint32_t>((out_capacity - OBD_DECODED_HEADER_SIZE) / 10);
+    float* values = reinterpret_cast<float*>(out + OBD_DECODED_HEADER_SIZE);
+    uint32_t* timestamps = reinterpret_cast<uint32_t*>(out + OBD_DECODED_HEADER_SIZE + 4UL * capacity);
+    uint16_t* ids = reinterpret_cast<uint16_t*>(out + OBD_DECODED_HEADER_SIZE + 8UL * capacity);
+
+    uint32_t decoded = 0;
+    long result = STATUS_NOERROR;
+    unsigned long pos = 0;
+
+    while (pos + OBD_SAMPLE_HEADER_SIZE <= length) {
+        const unsigned char* rec = samples + pos;
+        uint32_t timestamp = static_cast<uint32_t>(rec[0]) | (static_cast<uint32_t>(rec[1]) << 8) |
+                             (static_cast<uint32_t>(rec[2]) << 16) | (static_cast<uint32_t>(rec[3]) << 24);
+        unsigned char pid = rec[4];
+        unsigned int data_length = rec[5];
+        if (pos + OBD_SAMPLE_HEADER_SIZE + data_length > length) {
+            break;
+        }
+
+        if (data_length == g_pid_lengths[pid]) {
+            unsigned int first = g_pid_index.first[pid];
+            unsigned int signals = g_pid_index.count[pid];
+            if (decoded + signals > capacity) {
+                result = ERR_BUFFER_OVERFLOW;
+                break;
+            }
+            for (unsigned int s = 0; s < signals; s++) {
+                values[decoded] = decode_signal(&g_signals[first + s], rec + OBD_SAMPLE_HEADER_SIZE);
+                timestamps[decoded] = timestamp;
+                ids[decoded] = static_cast<uint16_t>(first + s);
+                decoded++;
+            }
+        }
+        pos += (OBD_SAMPLE_HEADER_SIZE + data_length + 3) & ~3UL;
+    }
+
+    memcpy(out, &decoded, sizeof(decoded));
+    memcpy(out + 4, &capacity, sizeof(capacity));
+    *count = decoded;
+    return result;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeObdDecodeSamples
+ * Signature: (Ljava/nio/ByteBuffer;ILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeObdDecodeSamples
+  (JNIEnv *env, jobject obj, jobject sample_buffer, jint length, jobject decoded_buffer) {
+
+    if (sample_buffer == nullptr || decoded_buffer == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    const unsigned char* samples =
+        static_cast<const unsigned char*>(env->GetDirectBufferAddress(sample_buffer));
+    unsigned char* out = static_cast<unsigned char*>(env->GetDirectBufferAddress(decoded_buffer));
+    if (samples == nullptr || out == nullptr || length < 0 ||
+        length > env->GetDirectBufferCapacity(sample_buffer)) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    unsigned long count = 0;
+    long result = obd_decode_samples(samples, static_cast<unsigned long>(length), out,
+                                     static_cast<unsigned long>(env->GetDirectBufferCapacity(decoded_buffer)),
+                                     &count);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return static_cast<jint>(count);
+    } else {
+        return -1;
+    }
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeObdSignalTable
+ * Signature: (Ljava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeObdSignalTable
+  (JNIEnv *env, jobject obj, jobject table_buffer) {
+
+    unsigned char* out = table_buffer != nullptr
+        ? static_cast<unsigned char*>(env->GetDirectBufferAddress(table_buffer)) : nullptr;
+    if (out == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+    if (static_cast<unsigned long>(env->GetDirectBufferCapacity(table_buffer)) <
+        OBD_SIGNAL_COUNT * OBD_SIGNAL_INFO_SIZE) {
+        g_last_error = ERR_BUFFER_OVERFLOW;
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < OBD_SIGNAL_COUNT; i++) {
+        unsigned char* entry = out + i * OBD_SIGNAL_INFO_SIZE;
+        entry[0] = g_signals[i].pid;
+        entry[1] = g_signals[i].unit;
+        entry[2] = g_signals[i].byte_offset;
+        entry[3] = g_signals[i].byte_count;
+        memcpy(entry + 4, &g_signals[i].scale, sizeof(float));
+        memcpy(entry + 8, &g_signals[i].offset, sizeof(float));
+    }
+
+    g_last_error = STATUS_NOERROR;
+    return static_cast<jint>(OBD_SIGNAL_COUNT);
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef OBD_PIDS_H
+#define OBD_PIDS_H
+
+#include <jni.h>
+
+// OBD-II services
+#define OBD_SERVICE_CURRENT_DATA 0x01
+#define OBD_POSITIVE_RESPONSE_OFFSET 0x40
+
+// J1979 allows up to six PIDs in one service 01 request on CAN
+#define OBD_MAX_PIDS_PER_REQUEST 6
+
+// Engineering units of decoded signals
+#define OBD_UNIT_NONE 0
+#define OBD_UNIT_PERCENT 1
+#define OBD_UNIT_CELSIUS 2
+#define OBD_UNIT_KPA 3
+#define OBD_UNIT_PA 4
+#define OBD_UNIT_RPM 5
+#define OBD_UNIT_KMH 6
+#define OBD_UNIT_DEGREES 7
+#define OBD_UNIT_GRAMS_PER_SEC 8
+#define OBD_UNIT_VOLTS 9
+#define OBD_UNIT_MILLIAMPS 10
+#define OBD_UNIT_SECONDS 11
+#define OBD_UNIT_MINUTES 12
+#define OBD_UNIT_KM 13
+#define OBD_UNIT_RATIO 14
+#define OBD_UNIT_COUNT 15
+#define OBD_UNIT_LITERS_PER_HOUR 16
+#define OBD_UNIT_NEWTON_METERS 17
+#define OBD_UNIT_PPM 18
+#define OBD_UNIT_MG_PER_M3 19
+
+/*
+ * Decoded signal output layout (native byte order), N = (capacity - 8) / 10:
+ *    0  u32 count
+ *    4  u32 N
+ *    8  f32 values[N]
+ *    8 + 4N  u32 timestamps_ms[N]
+ *    8 + 8N  u16 signal_ids[N]   index into the signal table
+ */
+#define OBD_DECODED_HEADER_SIZE 8
+
+// Signal table export: u8 pid, u8 unit, u8 byte_offset, u8 byte_count, f32 scale, f32 offset
+#define OBD_SIGNAL_INFO_SIZE 12
+
+// Called for every PID record delimited in a service 01 response
+typedef void (*obd_pid_visitor)(void* context, unsigned char pid,
+                                const unsigned char* data, unsigned int length);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Data bytes following the PID in a service 01 response, 0 when unknown
+unsigned int obd_pid_data_length(unsigned char pid);
+
+// True for the 0x00, 0x20, ... 0xE0 "PIDs supported" bitmaps
+int obd_pid_is_support_bitmap(unsigned char pid);
+
+// Walks a positive service 01 response; stops at the first PID of unknown length
+void obd_walk_response(const unsigned char* response, unsigned long length,
+                       obd_pid_visitor visitor, void* context);
+
+/*
+ * Decodes a buffer of obd_live_run sample records into the signal output layout.
+ * Covers the J1979-DA service 01 PIDs up to 0x8E plus 0xA6. Records of 0x88,
+ * 0x8B and 0x8C are skipped; 0x02 only carries data in service 02.
+ */
+long obd_decode_samples(const unsigned char* samples, unsigned long length,
+                        unsigned char* out, unsigned long out_capacity, unsigned long* count);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeObdDecodeSamples
+ * Signature: (Ljava/nio/ByteBuffer;ILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeObdDecodeSamples
+  (JNIEnv *, jobject, jobject, jint, jobject);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeObdSignalTable
+ * Signature: (Ljava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeObdSignalTable
+  (JNIEnv *, jobject, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OBD_PIDS_H
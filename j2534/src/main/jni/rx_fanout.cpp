@@ -0,0 +1,624 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "rx_fanout.h"
+#include "j2534_jni.h"
+#include "uds_client.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FANOUT_RECORD_HEADER_SIZE 20
+
+static void wait_until(pthread_cond_t* cond, pthread_mutex_t* mutex, unsigned long long deadline_ms) {
+    unsigned long long now = uds_now_ms();
+    if (deadline_ms <= now) {
+        return;
+    }
+    unsigned long long wait_ms = deadline_ms - now;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += static_cast<time_t>(wait_ms / 1000);
+    deadline.tv_nsec += static_cast<long>(wait_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(cond, mutex, &deadline);
+}
+
+static FANOUT_SUBSCRIBER* subscriber_for(FANOUT_HUB* hub, unsigned int subscriber_id) {
+    if (subscriber_id == 0 || subscriber_id > FANOUT_MAX_SUBSCRIBERS) {
+        return nullptr;
+    }
+    FANOUT_SUBSCRIBER* subscriber = &hub->subscribers[subscriber_id - 1];
+    return subscriber->active ? subscriber : nullptr;
+}
+
+// Caller holds hub->mutex
+static void put_back(FANOUT_HUB* hub, FANOUT_FRAME* frame) {
+    if (frame->data != frame->inline_data) {
+        free(frame->data);
+        frame->data = frame->inline_data;
+    }
+    hub->free_list[hub->free_count++] = static_cast<unsigned int>(frame - hub->pool);
+}
+
+static int matches(const FANOUT_SUBSCRIBER* subscriber, const PASSTHRU_MSG* msg) {
+    if (msg->DataSize < subscriber->filter_length) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < subscriber->filter_length; i++) {
+        if ((msg->Data[i] & subscriber->mask[i]) != subscriber->pattern[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Caller holds hub->mutex; waits while a blocking subscriber among targets has no room
+static int wait_for_room(FANOUT_HUB* hub, unsigned int targets) {
+    while (hub->running) {
+        int full = 0;
+        for (unsigned int s = 0; s < FANOUT_MAX_SUBSCRIBERS; s++) {
+            const FANOUT_SUBSCRIBER* subscriber = &hub->subscribers[s];
+            if ((targets & (1u << s)) && subscriber->active && subscriber->policy == FANOUT_BLOCK &&
+                subscriber->count == FANOUT_QUEUE) {
+                full = 1;
+                break;
+            }
+        }
+        if (!full) {
+            return 1;
+        }
+        wait_until(&hub->writable, &hub->mutex, uds_now_ms() + FANOUT_IDLE_TIMEOUT_MS);
+    }
+    return 0;
+}
+
+static FANOUT_FRAME* fill_frame(FANOUT_HUB* hub, const PASSTHRU_MSG* msg) {
+    if (hub->free_count == 0) {
+        return nullptr;
+    }
+    FANOUT_FRAME* frame = &hub->pool[hub->free_list[hub->free_count - 1]];
+    if (msg->DataSize > FANOUT_INLINE_DATA) {
+        frame->data = static_cast<unsigned char*>(malloc(msg->DataSize));
+        if (frame->data == nullptr) {
+            frame->data = frame->inline_data;
+            return nullptr;
+        }
+    }
+    hub->free_count--;
+
+    frame->refcount = 0;
+    frame->protocol_id = msg->ProtocolID;
+    frame->rx_status = msg->RxStatus;
+    frame->timestamp = msg->Timestamp;
+    frame->data_size = msg->DataSize;
+    frame->extra_data_index = msg->ExtraDataIndex;
+    memcpy(frame->data, msg->Data, msg->DataSize);
+    return frame;
+}
+
+// Caller holds hub->mutex
+static void publish(FANOUT_HUB* hub, const PASSTHRU_MSG* msg) {
+    unsigned int targets = 0;
+    for (unsigned int s = 0; s < FANOUT_MAX_SUBSCRIBERS; s++) {
+        if (hub->subscribers[s].active && matches(&hub->subscribers[s], msg)) {
+            targets |= 1u << s;
+        }
+    }
+    if (targets == 0 || !wait_for_room(hub, targets)) {
+        return;
+    }
+
+    // Frames still held by subscribers that never release them can exhaust the pool
+    FANOUT_FRAME* frame = fill_frame(hub, msg);
+    unsigned int index = frame != nullptr ? static_cast<unsigned int>(frame - hub->pool) : 0;
+
+    for (unsigned int s = 0; s < FANOUT_MAX_SUBSCRIBERS; s++) {
+        FANOUT_SUBSCRIBER* subscriber = &hub->subscribers[s];
+        // Unsubscribed while the pump waited for room
+        if (!(targets & (1u << s)) || !subscriber->active) {
+            continue;
+        }
+        if (frame == nullptr || subscriber->count == FANOUT_QUEUE) {
+            subscriber->dropped++;
+            continue;
+        }
+        subscriber->queue[(subscriber->head + subscriber->count) % FANOUT_QUEUE] = index;
+        subscriber->count++;
+        subscriber->delivered++;
+        frame->refcount++;
+        pthread_cond_signal(&subscriber->readable);
+    }
+
+    if (frame != nullptr && frame->refcount == 0) {
+        put_back(hub, frame);
+    }
+}
+
+static void* fanout_pump(void* arg) {
+    FANOUT_HUB* hub = static_cast<FANOUT_HUB*>(arg);
+    PASSTHRU_MSG* msgs = static_cast<PASSTHRU_MSG*>(malloc(FANOUT_BATCH * sizeof(PASSTHRU_MSG)));
+    if (msgs == nullptr) {
+        LOGE("Fan-out pump for channel %lu out of memory", hub->channel_id);
+        return nullptr;
+    }
+
+    while (hub->running) {
+        // Block for one message, then take whatever else is queued without waiting
+        unsigned long num_msgs = 1;
+        long result = hub->lib->PassThruReadMsgs(hub->channel_id, msgs, &num_msgs,
+                                                 FANOUT_IDLE_TIMEOUT_MS);
+        if (result == STATUS_NOERROR && num_msgs == 1) {
+            unsigned long more = FANOUT_BATCH - 1;
+            result = hub->lib->PassThruReadMsgs(hub->channel_id, msgs + 1, &more, 0);
+            num_msgs += more;
+        }
+        if (result != STATUS_NOERROR && result != ERR_BUFFER_EMPTY && result != ERR_TIMEOUT) {
+            LOGE("Fan-out read on channel %lu failed: %ld", hub->channel_id, result);
+            break;
+        }
+
+        pthread_mutex_lock(&hub->mutex);
+        for (unsigned long i = 0; i < num_msgs && hub->running; i++) {
+            publish(hub, &msgs[i]);
+        }
+        pthread_mutex_unlock(&hub->mutex);
+    }
+
+    free(msgs);
+    return nullptr;
+}
+
+long fanout_start(FANOUT_HUB* hub, J2534_LIBRARY* lib, unsigned long channel_id,
+                  unsigned long protocol_id) {
+    if (hub == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (lib == nullptr || lib->PassThruReadMsgs == nullptr) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+
+    memset(hub, 0, sizeof(*hub));
+    hub->lib = lib;
+    hub->channel_id = channel_id;
+    hub->protocol_id = protocol_id;
+    hub->pool = static_cast<FANOUT_FRAME*>(calloc(FANOUT_POOL, sizeof(FANOUT_FRAME)));
+    hub->free_list = static_cast<unsigned int*>(malloc(FANOUT_POOL * sizeof(unsigned int)));
+    if (hub->pool == nullptr || hub->free_list == nullptr) {
+        free(hub->pool);
+        free(hub->free_list);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    for (unsigned int i = 0; i < FANOUT_POOL; i++) {
+        hub->pool[i].data = hub->pool[i].inline_data;
+        hub->free_list[i] = FANOUT_POOL - 1 - i;
+    }
+    hub->free_count = FANOUT_POOL;
+
+    long result = STATUS_NOERROR;
+    if (protocol_id == CAN || protocol_id == FD_CAN_PS) {
+        PASSTHRU_MSG mask;
+        PASSTHRU_MSG pattern;
+        memset(&mask, 0, sizeof(mask));
+        memset(&pattern, 0, sizeof(pattern));
+        mask.ProtocolID = pattern.ProtocolID = protocol_id;
+        mask.DataSize = pattern.DataSize = UDS_CAN_ID_SIZE;
+        result = lib->PassThruStartMsgFilter(channel_id, PASS_FILTER, &mask, &pattern, nullptr,
+                                             &hub->filter_id);
+        hub->has_filter = result == STATUS_NOERROR;
+    }
+
+    if (result == STATUS_NOERROR) {
+        pthread_mutex_init(&hub->mutex, nullptr);
+        pthread_cond_init(&hub->writable, nullptr);
+        for (unsigned int s = 0; s < FANOUT_MAX_SUBSCRIBERS; s++) {
+            pthread_cond_init(&hub->subscribers[s].readable, nullptr);
+        }
+        hub->running = 1;
+        if (pthread_create(&hub->thread, nullptr, fanout_pump, hub) != 0) {
+            hub->running = 0;
+            for (unsigned int s = 0; s < FANOUT_MAX_SUBSCRIBERS; s++) {
+                pthread_cond_destroy(&hub->subscribers[s].readable);
+            }
+            pthread_cond_destroy(&hub->writable);
+            pthread_mutex_destroy(&hub->mutex);
+            result = ERR_FAILED;
+        }
+    }
+
+    if (result != STATUS_NOERROR) {
+        if (hub->has_filter) {
+            lib->PassThruStopMsgFilter(channel_id, hub->filter_id);
+        }
+        free(hub->pool);
+        free(hub->free_list);
+        return result;
+    }
+
+    LOGI("Fan-out started on channel %lu", channel_id);
+    return STATUS_NOERROR;
+}
+
+long fanout_stop(FANOUT_HUB* hub) {
+    if (hub == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    pthread_mutex_lock(&hub->mutex);
+    hub->running = 0;
+    pthread_cond_broadcast(&hub->writable);
+    for (unsigned int s = 0; s < FANOUT_MAX_SUBSCRIBERS; s++) {
+        pthread_cond_broadcast(&hub->subscribers[s].readable);
+    }
+    pthread_mutex_unlock(&hub->mutex);
+    pthread_join(hub->thread, nullptr);
+
+    if (hub->has_filter) {
+        hub->lib->PassThruStopMsgFilter(hub->channel_id, hub->filter_id);
+    }
+
+    for (unsigned int i = 0; i < FANOUT_POOL; i++) {
+        if (hub->pool[i].data != hub->pool[i].inline_data) {
+            free(hub->pool[i].data);
+        }
+    }
+    for (unsigned int s = 0; s < FANOUT_MAX_SUBSCRIBERS; s++) {
+        pthread_cond_destroy(&hub->subscribers[s].readable);
+    }
+    pthread_cond_destroy(&hub->writable);
+    pthread_mutex_destroy(&hub->mutex);
+    free(hub->pool);
+    free(hub->free_list);
+    hub->pool = nullptr;
+    hub->free_list = nullptr;
+    return STATUS_NOERROR;
+}
+
+long fanout_subscribe(FANOUT_HUB* hub, const unsigned char* mask, const unsigned char* pattern,
+                      unsigned int length, int policy, unsigned int* subscriber_id) {
+    if (hub == nullptr || subscriber_id == nullptr ||
+        (length != 0 && (mask == nullptr || pattern == nullptr))) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (length > FANOUT_FILTER_SIZE || (policy != FANOUT_DROP && policy != FANOUT_BLOCK)) {
+        return ERR_INVALID_MSG;
+    }
+
+    pthread_mutex_lock(&hub->mutex);
+    long result = ERR_FAILED;
+    for (unsigned int s = 0; s < FANOUT_MAX_SUBSCRIBERS; s++) {
+        FANOUT_SUBSCRIBER* subscriber = &hub->subscribers[s];
+        if (subscriber->active) {
+            continue;
+        }
+        for (unsigned int i = 0; i < length; i++) {
+            subscriber->mask[i] = mask[i];
+            subscriber->pattern[i] = pattern[i] & mask[i];
+        }
+        subscriber->filter_length = length;
+        subscriber->policy = policy;
+        subscriber->head = 0;
+        subscriber->count = 0;
+        subscriber->delivered = 0;
+        subscriber->dropped = 0;
+        subscriber->active = 1;
+        *subscriber_id = s + 1;
+        result = STATUS_NOERROR;
+        break;
+    }
+    pthread_mutex_unlock(&hub->mutex);
+
+    if (result != STATUS_NOERROR) {
+        LOGE("Fan-out on channel %lu already has %d subscribers", hub->channel_id,
+             FANOUT_MAX_SUBSCRIBERS);
+    }
+    return result;
+}
+
+long fanout_unsubscribe(FANOUT_HUB* hub, unsigned int subscriber_id) {
+    if (hub == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    pthread_mutex_lock(&hub->mutex);
+    FANOUT_SUBSCRIBER* subscriber = subscriber_for(hub, subscriber_id);
+    if (subscriber == nullptr) {
+        pthread_mutex_unlock(&hub->mutex);
+        return ERR_INVALID_FILTER_ID;
+    }
+
+    while (subscriber->count > 0) {
+        FANOUT_FRAME* frame = &hub->pool[subscriber->queue[subscriber->head]];
+        subscriber->head = (subscriber->head + 1) % FANOUT_QUEUE;
+        subscriber->count--;
+        if (__atomic_sub_fetch(&frame->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+            put_back(hub, frame);
+        }
+    }
+    subscriber->active = 0;
+    pthread_cond_broadcast(&subscriber->readable);
+    pthread_cond_broadcast(&hub->writable);
+    pthread_mutex_unlock(&hub->mutex);
+    return STATUS_NOERROR;
+}
+
+// Pops the oldest frame if its data fits in max_size bytes
+static long next_frame(FANOUT_HUB* hub, unsigned int subscriber_id, unsigned long timeout_ms,
+                       unsigned long max_size, FANOUT_FRAME** frame) {
+    pthread_mutex_lock(&hub->mutex);
+    FANOUT_SUBSCRIBER* subscriber = subscriber_for(hub, subscriber_id);
+    unsigned long long deadline = uds_now_ms() + timeout_ms;
+    while (subscriber != nullptr && subscriber->count == 0 && hub->running &&
+           uds_now_ms() < deadline) {
+        wait_until(&subscriber->readable, &hub->mutex, deadline);
+        subscriber = subscriber_for(hub, subscriber_id);
+    }
+
+    long result = STATUS_NOERROR;
+    if (subscriber == nullptr) {
+        result = ERR_INVALID_FILTER_ID;
+    } else if (subscriber->count == 0) {
+        result = ERR_BUFFER_EMPTY;
+    } else if (hub->pool[subscriber->queue[subscriber->head]].data_size > max_size) {
+        result = ERR_BUFFER_OVERFLOW;
+    } else {
+        *frame = &hub->pool[subscriber->queue[subscriber->head]];
+        subscriber->head = (subscriber->head + 1) % FANOUT_QUEUE;
+        subscriber->count--;
+        if (subscriber->policy == FANOUT_BLOCK) {
+            pthread_cond_signal(&hub->writable);
+        }
+    }
+    pthread_mutex_unlock(&hub->mutex);
+    return result;
+}
+
+long fanout_next(FANOUT_HUB* hub, unsigned int subscriber_id, unsigned long timeout_ms,
+                 FANOUT_FRAME** frame) {
+    if (hub == nullptr || frame == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    return next_frame(hub, subscriber_id, timeout_ms, ~0UL, frame);
+}
+
+void fanout_release(FANOUT_HUB* hub, FANOUT_FRAME* frame) {
+    if (hub == nullptr || frame == nullptr) {
+        return;
+    }
+    if (__atomic_sub_fetch(&frame->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&hub->mutex);
+        put_back(hub, frame);
+        pthread_mutex_unlock(&hub->mutex);
+    }
+}
+
+long fanout_subscriber_stats(FANOUT_HUB* hub, unsigned int subscriber_id,
+                             unsigned long long* delivered, unsigned long long* dropped,
+                             unsigned int* queued) {
+    if (hub == nullptr || delivered == nullptr || dropped == nullptr || queued == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    pthread_mutex_lock(&hub->mutex);
+    FANOUT_SUBSCRIBER* subscriber = subscriber_for(hub, subscriber_id);
+    long result = ERR_INVALID_FILTER_ID;
+    if (subscriber != nullptr) {
+        *delivered = subscriber->delivered;
+        *dropped = subscriber->dropped;
+        *queued = subscriber->count;
+        result = STATUS_NOERROR;
+    }
+    pthread_mutex_unlock(&hub->mutex);
+    return result;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFanoutStart
+ * Signature: (II)J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFanoutStart
+  (JNIEnv *env, jobject obj, jint channel_id, jint protocol_id) {
+
+    if (g_j2534_lib == nullptr) {
+        g_last_error = ERR_DEVICE_NOT_CONNECTED;
+        return 0;
+    }
+
+    FANOUT_HUB* hub = static_cast<FANOUT_HUB*>(calloc(1, sizeof(FANOUT_HUB)));
+    if (hub == nullptr) {
+        g_last_error = ERR_INSUFFICIENT_MEMORY;
+        return 0;
+    }
+
+    long result = fanout_start(hub, g_j2534_lib, static_cast<unsigned long>(channel_id),
+                               static_cast<unsigned long>(protocol_id));
+    g_last_error = result;
+    if (result != STATUS_NOERROR) {
+        free(hub);
+        return 0;
+    }
+    return reinterpret_cast<jlong>(hub);
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFanoutSubscribe
+ * Signature: (J[B[BI)I
+ *
+ * Returns the subscriber ID, or 0 on failure. Null mask and pattern match
+ * every message.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFanoutSubscribe
+  (JNIEnv *env, jobject obj, jlong handle, jbyteArray mask, jbyteArray pattern, jint policy) {
+
+    FANOUT_HUB* hub = reinterpret_cast<FANOUT_HUB*>(handle);
+    if (hub == nullptr || (mask == nullptr) != (pattern == nullptr)) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return 0;
+    }
+
+    unsigned char mask_bytes[FANOUT_FILTER_SIZE];
+    unsigned char pattern_bytes[FANOUT_FILTER_SIZE];
+    jsize length = 0;
+    if (mask != nullptr) {
+        length = env->GetArrayLength(mask);
+        if (length != env->GetArrayLength(pattern) || length > FANOUT_FILTER_SIZE) {
+            g_last_error = ERR_INVALID_MSG;
+            return 0;
+        }
+        env->GetByteArrayRegion(mask, 0, length, reinterpret_cast<jbyte*>(mask_bytes));
+        env->GetByteArrayRegion(pattern, 0, length, reinterpret_cast<jbyte*>(pattern_bytes));
+    }
+
+    unsigned int subscriber_id = 0;
+    long result = fanout_subscribe(hub, length > 0 ? mask_bytes : nullptr,
+                                   length > 0 ? pattern_bytes : nullptr,
+                                   static_cast<unsigned int>(length), policy, &subscriber_id);
+    g_last_error = result;
+    return result == STATUS_NOERROR ? static_cast<jint>(subscriber_id) : 0;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFanoutRead
+ * Signature: (JILjava/nio/ByteBuffer;I)I
+ *
+ * Copies as many queued messages as fit into the direct buffer, waiting up to
+ * timeout ms for the first one, and returns their count (-1 on error). Each
+ * record is u32 ProtocolID, RxStatus, Timestamp, DataSize, ExtraDataIndex in
+ * native byte order, then Data padded to a multiple of 4 bytes.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFanoutRead
+  (JNIEnv *env, jobject obj, jlong handle, jint subscriber_id, jobject buffer, jint timeout) {
+
+    FANOUT_HUB* hub = reinterpret_cast<FANOUT_HUB*>(handle);
+    unsigned char* out = buffer != nullptr
+        ? static_cast<unsigned char*>(env->GetDirectBufferAddress(buffer)) : nullptr;
+    if (hub == nullptr || out == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+    unsigned long capacity = static_cast<unsigned long>(env->GetDirectBufferCapacity(buffer));
+
+    unsigned long used = 0;
+    jint count = 0;
+    long result = STATUS_NOERROR;
+    while (used + FANOUT_RECORD_HEADER_SIZE <= capacity) {
+        FANOUT_FRAME* frame = nullptr;
+        result = next_frame(hub, static_cast<unsigned int>(subscriber_id),
+                            count == 0 ? static_cast<unsigned long>(timeout) : 0,
+                            capacity - used - FANOUT_RECORD_HEADER_SIZE, &frame);
+        if (result != STATUS_NOERROR) {
+            break;
+        }
+
+        unsigned int header[5] = {
+            static_cast<unsigned int>(frame->protocol_id),
+            static_cast<unsigned int>(frame->rx_status),
+            static_cast<unsigned int>(frame->timestamp),
+            static_cast<unsigned int>(frame->data_size),
+            static_cast<unsigned int>(frame->extra_data_index)
+        };
+        memcpy(out + used, header, sizeof(header));
+        memcpy(out + used + FANOUT_RECORD_HEADER_SIZE, frame->data, frame->data_size);
+        used += (FANOUT_RECORD_HEADER_SIZE + frame->data_size + 3) & ~3UL;
+        count++;
+        fanout_release(hub, frame);
+    }
+
+    if (count > 0) {
+        g_last_error = STATUS_NOERROR;
+        return count;
+    }
+    g_last_error = result;
+    return result == ERR_BUFFER_EMPTY ? 0 : -1;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFanoutStats
+ * Signature: (JI[J)I
+ *
+ * Fills stats with delivered, dropped and currently queued message counts.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFanoutStats
+  (JNIEnv *env, jobject obj, jlong handle, jint subscriber_id, jlongArray stats) {
+
+    FANOUT_HUB* hub = reinterpret_cast<FANOUT_HUB*>(handle);
+    if (hub == nullptr || stats == nullptr || env->GetArrayLength(stats) < 3) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    unsigned long long delivered = 0;
+    unsigned long long dropped = 0;
+    unsigned int queued = 0;
+    long result = fanout_subscriber_stats(hub, static_cast<unsigned int>(subscriber_id),
+                                          &delivered, &dropped, &queued);
+    g_last_error = result;
+    if (result != STATUS_NOERROR) {
+        return -1;
+    }
+
+    jlong values[3] = { static_cast<jlong>(delivered), static_cast<jlong>(dropped),
+                        static_cast<jlong>(queued) };
+    env->SetLongArrayRegion(stats, 0, 3, values);
+    return 0;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFanoutUnsubscribe
+ * Signature: (JI)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFanoutUnsubscribe
+  (JNIEnv *env, jobject obj, jlong handle, jint subscriber_id) {
+
+    FANOUT_HUB* hub = reinterpret_cast<FANOUT_HUB*>(handle);
+    if (hub == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    long result = fanout_unsubscribe(hub, static_cast<unsigned int>(subscriber_id));
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return 0;
+    } else {
+        return -1;
+    }
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFanoutStop
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFanoutStop
+  (JNIEnv *env, jobject obj, jlong handle) {
+
+    FANOUT_HUB* hub = reinterpret_cast<FANOUT_HUB*>(handle);
+    if (hub == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    long result = fanout_stop(hub);
+    free(hub);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return 0;
+    } else {
+        return -1;
+    }
+}
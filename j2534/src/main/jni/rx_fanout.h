@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef RX_FANOUT_H
+#define RX_FANOUT_H
+
+#include <jni.h>
+#include <pthread.h>
+#include "j2534_native.h"
+
+#define FANOUT_MAX_SUBSCRIBERS 8
+#define FANOUT_QUEUE 256                    // frames one subscriber may hold
+#define FANOUT_BATCH 32
+#define FANOUT_IDLE_TIMEOUT_MS 20
+#define FANOUT_FILTER_SIZE 12               // CAN ID prefix plus the first data bytes
+#define FANOUT_INLINE_DATA 72               // CAN FD frame with ID prefix; longer messages go to the heap
+#define FANOUT_POOL (FANOUT_MAX_SUBSCRIBERS * FANOUT_QUEUE + FANOUT_BATCH)
+
+// Slow subscriber policies
+#define FANOUT_DROP 0                       // frames that find the queue full are skipped and counted
+#define FANOUT_BLOCK 1                      // the pump waits, pushing back into the adapter queue
+
+// Received message shared by every subscriber it matched; read-only for subscribers
+typedef struct {
+    unsigned int refcount;
+    unsigned long protocol_id;
+    unsigned long rx_status;
+    unsigned long timestamp;
+    unsigned long data_size;
+    unsigned long extra_data_index;
+    unsigned char* data;
+    unsigned char inline_data[FANOUT_INLINE_DATA];
+} FANOUT_FRAME;
+
+typedef struct {
+    int active;
+    unsigned char mask[FANOUT_FILTER_SIZE];
+    unsigned char pattern[FANOUT_FILTER_SIZE];
+    unsigned int filter_length;
+    int policy;
+    unsigned int queue[FANOUT_QUEUE];   // pool indices, oldest at head
+    unsigned int head;
+    unsigned int count;
+    unsigned long long delivered;
+    unsigned long long dropped;
+    pthread_cond_t readable;
+} FANOUT_SUBSCRIBER;
+
+typedef struct {
+    J2534_LIBRARY* lib;
+    unsigned long channel_id;
+    unsigned long protocol_id;
+    unsigned long filter_id;
+    int has_filter;
+    FANOUT_FRAME* pool;
+    unsigned int* free_list;
+    unsigned int free_count;
+    FANOUT_SUBSCRIBER subscribers[FANOUT_MAX_SUBSCRIBERS];
+    pthread_mutex_t mutex;
+    pthread_cond_t writable;
+    pthread_t thread;
+    volatile int running;
+} FANOUT_HUB;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Becomes the only reader of a connected channel. A native pump copies each
+ * received message once into a pooled frame and queues a reference to it for
+ * every subscriber whose mask/pattern matches; the frame returns to the pool
+ * when the last of them releases it. CAN and FD_CAN_PS channels get a
+ * pass-all filter, other protocols keep the filters their owner set up.
+ */
+long fanout_start(FANOUT_HUB* hub, J2534_LIBRARY* lib, unsigned long channel_id,
+                  unsigned long protocol_id);
+
+// Stops the pump and frees the pool; subscribers must no longer be reading
+long fanout_stop(FANOUT_HUB* hub);
+
+// mask and pattern cover the first length bytes of Data (ID prefix first); length 0 matches all
+long fanout_subscribe(FANOUT_HUB* hub, const unsigned char* mask, const unsigned char* pattern,
+                      unsigned int length, int policy, unsigned int* subscriber_id);
+
+long fanout_unsubscribe(FANOUT_HUB* hub, unsigned int subscriber_id);
+
+/*
+ * Takes the subscriber's oldest frame without copying it, waiting up to
+ * timeout_ms. The frame stays valid until fanout_release.
+ */
+long fanout_next(FANOUT_HUB* hub, unsigned int subscriber_id, unsigned long timeout_ms,
+                 FANOUT_FRAME** frame);
+
+void fanout_release(FANOUT_HUB* hub, FANOUT_FRAME* frame);
+
+long fanout_subscriber_stats(FANOUT_HUB* hub, unsigned int subscriber_id,
+                             unsigned long long* delivered, unsigned long long* dropped,
+                             unsigned int* queued);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFanoutStart
+ * Signature: (II)J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFanoutStart
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFanoutSubscribe
+ * Signature: (J[B[BI)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFanoutSubscribe
+  (JNIEnv *, jobject, jlong, jbyteArray, jbyteArray, jint);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFanoutRead
+ * Signature: (JILjava/nio/ByteBuffer;I)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFanoutRead
+  (JNIEnv *, jobject, jlong, jint, jobject, jint);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFanoutStats
+ * Signature: (JI[J)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFanoutStats
+  (JNIEnv *, jobject, jlong, jint, jlongArray);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFanoutUnsubscribe
+ * Signature: (JI)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFanoutUnsubscribe
+  (JNIEnv *, jobject, jlong, jint);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFanoutStop
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFanoutStop
+  (JNIEnv *, jobject, jlong);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RX_FANOUT_H
@@ -0,0 +1,785 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "socketcan_transport.h"
+#include "uds_client.h"
+#include "j2534_jni.h"
+#include <errno.h>
+#include <linux/can.h>
+#include <linux/can/isotp.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef struct {
+    int in_use;
+    char interface[IFNAMSIZ];
+    int ifindex;
+} SOCKETCAN_DEVICE;
+
+typedef struct {
+    int in_use;
+    unsigned long type;
+    unsigned long mask;
+    unsigned long pattern;
+    unsigned long flow_control;
+    int isotp_fd;                     // flow control filters own a kernel ISO-TP socket
+} SOCKETCAN_FILTER;
+
+typedef struct {
+    int in_use;
+    int fd;
+    unsigned long device_id;
+    unsigned long protocol_id;
+    unsigned long flags;
+    pthread_mutex_t filter_mutex;
+    SOCKETCAN_FILTER filters[SOCKETCAN_MAX_FILTERS];
+} SOCKETCAN_CHANNEL;
+
+static pthread_mutex_t g_socketcan_mutex = PTHREAD_MUTEX_INITIALIZER;
+static SOCKETCAN_DEVICE g_socketcan_devices[SOCKETCAN_MAX_DEVICES];
+static SOCKETCAN_CHANNEL g_socketcan_channels[SOCKETCAN_MAX_CHANNELS];
+static char g_socketcan_error[128];
+
+static void set_error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&g_socketcan_mutex);
+    vsnprintf(g_socketcan_error, sizeof(g_socketcan_error), format, args);
+    pthread_mutex_unlock(&g_socketcan_mutex);
+    va_end(args);
+}
+
+static SOCKETCAN_CHANNEL* channel_for(unsigned long channel_id) {
+    if (channel_id == 0 || channel_id > SOCKETCAN_MAX_CHANNELS ||
+        !g_socketcan_channels[channel_id - 1].in_use) {
+        return nullptr;
+    }
+    return &g_socketcan_channels[channel_id - 1];
+}
+
+static int is_fd_protocol(unsigned long protocol_id) {
+    return protocol_id == FD_CAN_PS || protocol_id == FD_ISO15765_PS;
+}
+
+static int is_isotp_protocol(unsigned long protocol_id) {
+    return protocol_id == ISO15765 || protocol_id == FD_ISO15765_PS;
+}
+
+// CAN FD frames come in 0..8, 12, 16, 20, 24, 32, 48 and 64 bytes
+static unsigned int fd_frame_length(unsigned int length) {
+    static const unsigned char lengths[] = { 12, 16, 20, 24, 32, 48, 64 };
+    if (length <= CAN_MAX_DLEN) {
+        return length;
+    }
+    for (unsigned int i = 0; i < sizeof(lengths); i++) {
+        if (length <= lengths[i]) {
+            return lengths[i];
+        }
+    }
+    return 0;
+}
+
+static canid_t socket_can_id(unsigned long can_id, unsigned long flags) {
+    return (flags & CAN_29BIT_ID)
+        ? static_cast<canid_t>((can_id & CAN_EFF_MASK) | CAN_EFF_FLAG)
+        : static_cast<canid_t>(can_id & CAN_SFF_MASK);
+}
+
+static void put_can_id(PASSTHRU_MSG* msg, unsigned long can_id) {
+    msg->Data[0] = static_cast<unsigned char>(can_id >> 24);
+    msg->Data[1] = static_cast<unsigned char>(can_id >> 16);
+    msg->Data[2] = static_cast<unsigned char>(can_id >> 8);
+    msg->Data[3] = static_cast<unsigned char>(can_id);
+}
+
+static long socketcan_open(void* name, unsigned long* device_id) {
+    if (device_id == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    const char* interface = name != nullptr && static_cast<const char*>(name)[0] != '\0'
+        ? static_cast<const char*>(name) : SOCKETCAN_DEFAULT_INTERFACE;
+    if (strlen(interface) >= IFNAMSIZ) {
+        set_error("Invalid CAN interface '%s'", interface);
+        return ERR_INVALID_DEVICE_ID;
+    }
+    int ifindex = static_cast<int>(if_nametoindex(interface));
+    if (ifindex == 0) {
+        set_error("CAN interface '%s' not found", interface);
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+
+    pthread_mutex_lock(&g_socketcan_mutex);
+    long result = ERR_DEVICE_IN_USE;
+    for (unsigned int i = 0; i < SOCKETCAN_MAX_DEVICES; i++) {
+        if (!g_socketcan_devices[i].in_use) {
+            g_socketcan_devices[i].in_use = 1;
+            strcpy(g_socketcan_devices[i].interface, interface);
+            g_socketcan_devices[i].ifindex = ifindex;
+            *device_id = i + 1;
+            result = STATUS_NOERROR;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_socketcan_mutex);
+    return result;
+}
+
+static void release_channel(SOCKETCAN_CHANNEL* channel) {
+    for (unsigned int i = 0; i < SOCKETCAN_MAX_FILTERS; i++) {
+        if (channel->filters[i].in_use && channel->filters[i].isotp_fd >= 0) {
+            close(channel->filters[i].isotp_fd);
+        }
+    }
+    close(channel->fd);
+    pthread_mutex_destroy(&channel->filter_mutex);
+    memset(channel, 0, sizeof(SOCKETCAN_CHANNEL));
+}
+
+static long socketcan_disconnect(unsigned long channel_id) {
+    pthread_mutex_lock(&g_socketcan_mutex);
+    SOCKETCAN_CHANNEL* channel = channel_for(channel_id);
+    if (channel != nullptr) {
+        release_channel(channel);
+    }
+    pthread_mutex_unlock(&g_socketcan_mutex);
+    return channel != nullptr ? STATUS_NOERROR : ERR_INVALID_CHANNEL_ID;
+}
+
+static long socketcan_close(unsigned long device_id) {
+    if (device_id == 0 || device_id > SOCKETCAN_MAX_DEVICES) {
+        return ERR_INVALID_DEVICE_ID;
+    }
+    pthread_mutex_lock(&g_socketcan_mutex);
+    long result = ERR_INVALID_DEVICE_ID;
+    if (g_socketcan_devices[device_id - 1].in_use) {
+        for (unsigned int i = 0; i < SOCKETCAN_MAX_CHANNELS; i++) {
+            if (g_socketcan_channels[i].in_use && g_socketcan_channels[i].device_id == device_id) {
+                release_channel(&g_socketcan_channels[i]);
+            }
+        }
+        g_socketcan_devices[device_id - 1].in_use = 0;
+        result = STATUS_NOERROR;
+    }
+    pthread_mutex_unlock(&g_socketcan_mutex);
+    return result;
+}
+
+/*
+ * Loads the pass filters into the kernel so unwanted traffic never reaches
+ * user space. With no pass filter the socket receives nothing, as J2534 requires.
+ */
+static long apply_filters(SOCKETCAN_CHANNEL* channel) {
+    struct can_filter filters[SOCKETCAN_MAX_FILTERS];
+    int count = 0;
+    for (unsigned int i = 0; i < SOCKETCAN_MAX_FILTERS; i++) {
+        const SOCKETCAN_FILTER* filter = &channel->filters[i];
+        if (!filter->in_use || filter->type != PASS_FILTER) {
+            continue;
+        }
+        filters[count].can_id = static_cast<canid_t>(filter->pattern & filter->mask);
+        filters[count].can_mask = static_cast<canid_t>(filter->mask);
+        if (!(channel->flags & CAN_ID_BOTH)) {
+            // Frames of the other ID length than the channel's are not wanted
+            filters[count].can_mask |= CAN_EFF_FLAG;
+            if (channel->flags & CAN_29BIT_ID) {
+                filters[count].can_id |= CAN_EFF_FLAG;
+            }
+        }
+        count++;
+    }
+    if (setsockopt(channel->fd, SOL_CAN_RAW, CAN_RAW_FILTER, count > 0 ? filters : nullptr,
+                   static_cast<socklen_t>(count * sizeof(struct can_filter))) != 0) {
+        set_error("CAN_RAW_FILTER failed: %s", strerror(errno));
+        return ERR_FAILED;
+    }
+    return STATUS_NOERROR;
+}
+
+static long socketcan_connect(unsigned long device_id, unsigned long protocol_id, unsigned long flags,
+                              unsigned long baudrate, unsigned long* channel_id) {
+    if (channel_id == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (protocol_id != CAN && protocol_id != FD_CAN_PS && !is_isotp_protocol(protocol_id)) {
+        return ERR_INVALID_PROTOCOL_ID;
+    }
+    if (device_id == 0 || device_id > SOCKETCAN_MAX_DEVICES || !g_socketcan_devices[device_id - 1].in_use) {
+        return ERR_INVALID_DEVICE_ID;
+    }
+
+    // The bit rate belongs to the interface (ip link set ... bitrate), not the socket
+    int fd = socket(PF_CAN, SOCK_RAW | SOCK_CLOEXEC, CAN_RAW);
+    if (fd < 0) {
+        set_error("CAN socket failed: %s", strerror(errno));
+        return ERR_FAILED;
+    }
+    int rcvbuf = SOCKETCAN_RCVBUF;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    int fd_frames = 1;
+    if (is_fd_protocol(protocol_id) &&
+        setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &fd_frames, sizeof(fd_frames)) != 0) {
+        set_error("CAN FD not supported: %s", strerror(errno));
+        close(fd);
+        return ERR_NOT_SUPPORTED;
+    }
+
+    struct sockaddr_can address;
+    memset(&address, 0, sizeof(address));
+    address.can_family = AF_CAN;
+    address.can_ifindex = g_socketcan_devices[device_id - 1].ifindex;
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+        set_error("Binding %s failed: %s", g_socketcan_devices[device_id - 1].interface, strerror(errno));
+        close(fd);
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+
+    pthread_mutex_lock(&g_socketcan_mutex);
+    long result = ERR_CHANNEL_IN_USE;
+    for (unsigned int i = 0; i < SOCKETCAN_MAX_CHANNELS; i++) {
+        SOCKETCAN_CHANNEL* channel = &g_socketcan_channels[i];
+        if (channel->in_use) {
+            continue;
+        }
+        memset(channel, 0, sizeof(SOCKETCAN_CHANNEL));
+        channel->in_use = 1;
+        channel->fd = fd;
+        channel->device_id = device_id;
+        channel->protocol_id = protocol_id;
+        channel->flags = flags;
+        pthread_mutex_init(&channel->filter_mutex, nullptr);
+        result = apply_filters(channel);
+        if (result == STATUS_NOERROR) {
+            *channel_id = i + 1;
+        } else {
+            release_channel(channel);
+            fd = -1;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&g_socketcan_mutex);
+    if (result == ERR_CHANNEL_IN_USE) {
+        close(fd);
+    }
+    return result;
+}
+
+static int blocked(SOCKETCAN_CHANNEL* channel, unsigned long can_id) {
+    for (unsigned int i = 0; i < SOCKETCAN_MAX_FILTERS; i++) {
+        const SOCKETCAN_FILTER* filter = &channel->filters[i];
+        if (filter->in_use && filter->type == BLOCK_FILTER &&
+            (can_id & filter->mask) == (filter->pattern & filter->mask)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * ISO15765 channels read whole messages from the ISO-TP socket of each flow
+ * control filter; the kernel has already done flow control and reassembly.
+ */
+static long read_isotp(SOCKETCAN_CHANNEL* channel, PASSTHRU_MSG* out, unsigned long* num_msgs,
+                       unsigned long long deadline) {
+    unsigned long max_msgs = *num_msgs;
+    unsigned long count = 0;
+    struct pollfd pfds[SOCKETCAN_MAX_FILTERS];
+    unsigned long rx_ids[SOCKETCAN_MAX_FILTERS];
+
+    while (count < max_msgs) {
+        unsigned int sockets = 0;
+        pthread_mutex_lock(&channel->filter_mutex);
+        for (unsigned int i = 0; i < SOCKETCAN_MAX_FILTERS; i++) {
+            if (channel->filters[i].in_use && channel->filters[i].isotp_fd >= 0) {
+                pfds[sockets].fd = channel->filters[i].isotp_fd;
+                pfds[sockets].events = POLLIN;
+                pfds[sockets].revents = 0;
+                rx_ids[sockets++] = channel->filters[i].pattern;
+            }
+        }
+        pthread_mutex_unlock(&channel->filter_mutex);
+
+        unsigned long before = count;
+        for (unsigned int i = 0; i < sockets && count < max_msgs; i++) {
+            PASSTHRU_MSG* msg = &out[count];
+            ssize_t length = recv(pfds[i].fd, msg->Data + UDS_CAN_ID_SIZE, UDS_MAX_PAYLOAD, MSG_DONTWAIT);
+            if (length <= 0) {
+                if (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    // Protocol errors (ECOMM, EILSEQ) drop the message, as a J2534 device would
+                    LOGE("ISO-TP receive from 0x%lX failed: %s", rx_ids[i], strerror(errno));
+                }
+                continue;
+            }
+            msg->ProtocolID = channel->protocol_id;
+            msg->RxStatus = (channel->flags & CAN_29BIT_ID) ? CAN_29BIT_ID : 0;
+            if (channel->protocol_id == FD_ISO15765_PS) {
+                msg->RxStatus |= CAN_FD_FORMAT;
+            }
+            msg->TxFlags = 0;
+            msg->Timestamp = static_cast<unsigned long>(uds_now_ms() * 1000ULL);
+            msg->DataSize = UDS_CAN_ID_SIZE + static_cast<unsigned long>(length);
+            msg->ExtraDataIndex = msg->DataSize;
+            put_can_id(msg, rx_ids[i]);
+            count++;
+        }
+        if (count > before) {
+            continue;
+        }
+        unsigned long long now = uds_now_ms();
+        if (count > 0 || now >= deadline) {
+            break;
+        }
+        // With no filter yet this just sleeps out the timeout
+        poll(pfds, sockets, static_cast<int>(deadline - now));
+    }
+
+    *num_msgs = count;
+    return count > 0 ? STATUS_NOERROR : ERR_BUFFER_EMPTY;
+}
+
+static long socketcan_read_msgs(unsigned long channel_id, void* msgs, unsigned long* num_msgs,
+                                unsigned long timeout) {
+    if (msgs == nullptr || num_msgs == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    SOCKETCAN_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+
+    PASSTHRU_MSG* out = static_cast<PASSTHRU_MSG*>(msgs);
+    unsigned long max_msgs = *num_msgs;
+    unsigned long count = 0;
+    unsigned long long deadline = uds_now_ms() + timeout;
+
+    if (is_isotp_protocol(channel->protocol_id)) {
+        return read_isotp(channel, out, num_msgs, deadline);
+    }
+
+    // canfd_frame starts like can_frame; the received length tells them apart
+    struct canfd_frame frames[SOCKETCAN_BATCH];
+    struct iovec iov[SOCKETCAN_BATCH];
+    struct mmsghdr headers[SOCKETCAN_BATCH];
+
+    while (count < max_msgs) {
+        unsigned int batch = max_msgs - count < SOCKETCAN_BATCH
+            ? static_cast<unsigned int>(max_msgs - count) : SOCKETCAN_BATCH;
+        memset(headers, 0, batch * sizeof(struct mmsghdr));
+        for (unsigned int i = 0; i < batch; i++) {
+            iov[i].iov_base = &frames[i];
+            iov[i].iov_len = sizeof(struct canfd_frame);
+            headers[i].msg_hdr.msg_iov = &iov[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int received = recvmmsg(channel->fd, headers, batch, MSG_DONTWAIT, nullptr);
+        if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            set_error("CAN read failed: %s", strerror(errno));
+            *num_msgs = count;
+            return count > 0 ? STATUS_NOERROR : ERR_FAILED;
+        }
+        if (received <= 0) {
+            // Once something is ready, only drain what already arrived
+            unsigned long long now = uds_now_ms();
+            if (count > 0 || now >= deadline) {
+                break;
+            }
+            struct pollfd pfd = { channel->fd, POLLIN, 0 };
+            poll(&pfd, 1, static_cast<int>(deadline - now));
+            continue;
+        }
+
+        unsigned long timestamp = static_cast<unsigned long>(uds_now_ms() * 1000ULL);
+        for (int i = 0; i < received; i++) {
+            const struct canfd_frame* frame = &frames[i];
+            if (frame->can_id & (CAN_ERR_FLAG | CAN_RTR_FLAG)) {
+                continue;
+            }
+            int extended = (frame->can_id & CAN_EFF_FLAG) != 0;
+            unsigned long can_id = frame->can_id & (extended ? CAN_EFF_MASK : CAN_SFF_MASK);
+            if (blocked(channel, can_id)) {
+                continue;
+            }
+            int fd_frame = headers[i].msg_len == CANFD_MTU;
+            unsigned int max_length = fd_frame ? CANFD_MAX_DLEN : CAN_MAX_DLEN;
+            unsigned int length = frame->len <= max_length ? frame->len : max_length;
+            PASSTHRU_MSG* msg = &out[count++];
+            msg->ProtocolID = channel->protocol_id;
+            msg->RxStatus = extended ? CAN_29BIT_ID : 0;
+            if (fd_frame) {
+                msg->RxStatus |= CAN_FD_FORMAT | ((frame->flags & CANFD_BRS) ? CAN_FD_BRS : 0);
+            }
+            msg->TxFlags = 0;
+            msg->Timestamp = timestamp;
+            msg->DataSize = UDS_CAN_ID_SIZE + length;
+            msg->ExtraDataIndex = msg->DataSize;
+            put_can_id(msg, can_id);
+            memcpy(msg->Data + UDS_CAN_ID_SIZE, frame->data, length);
+        }
+    }
+
+    *num_msgs = count;
+    return count > 0 ? STATUS_NOERROR : ERR_BUFFER_EMPTY;
+}
+
+// Functional requests have no flow control partner: a single frame goes out on the raw socket
+static long send_single_frame(SOCKETCAN_CHANNEL* channel, const PASSTHRU_MSG* msg) {
+    unsigned long length = msg->DataSize - UDS_CAN_ID_SIZE;
+    int fd_frame = channel->protocol_id == FD_ISO15765_PS && (msg->TxFlags & CAN_FD_FORMAT);
+    // Up to 7 bytes take a one-byte PCI; CAN FD escapes longer single frames with 0x00 and a length byte
+    unsigned int pci = length <= 7 ? 1 : 2;
+    if (length == 0 || length + pci > (fd_frame ? CANFD_MAX_DLEN : CAN_MAX_DLEN)) {
+        set_error("%lu bytes to 0x%lX need a flow control filter", length, uds_message_can_id(msg));
+        return ERR_NO_FLOW_CONTROL;
+    }
+
+    struct canfd_frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id = socket_can_id(uds_message_can_id(msg), channel->flags | msg->TxFlags);
+    unsigned int frame_length = static_cast<unsigned int>(length) + pci;
+    if (pci == 1) {
+        frame.data[0] = static_cast<unsigned char>(length);
+    } else {
+        frame.data[1] = static_cast<unsigned char>(length);
+    }
+    memcpy(frame.data + pci, msg->Data + UDS_CAN_ID_SIZE, length);
+    if (fd_frame) {
+        frame_length = fd_frame_length(frame_length);
+        frame.flags = (msg->TxFlags & CAN_FD_BRS) ? CANFD_BRS : 0;
+    } else if (msg->TxFlags & ISO15765_FRAME_PAD) {
+        frame_length = CAN_MAX_DLEN;
+    }
+    memset(frame.data + pci + length, SOCKETCAN_ISOTP_PAD, frame_length - pci - length);
+    frame.len = static_cast<unsigned char>(frame_length);
+
+    if (write(channel->fd, &frame, fd_frame ? CANFD_MTU : CAN_MTU) < 0) {
+        set_error("CAN write failed: %s", strerror(errno));
+        return ERR_FAILED;
+    }
+    return STATUS_NOERROR;
+}
+
+static long write_isotp(SOCKETCAN_CHANNEL* channel, const PASSTHRU_MSG* in, unsigned long* num_msgs) {
+    unsigned long total = *num_msgs;
+    unsigned long sent = 0;
+    long result = STATUS_NOERROR;
+
+    for (; sent < total; sent++) {
+        const PASSTHRU_MSG* msg = &in[sent];
+        if (msg->ProtocolID != channel->protocol_id) {
+            result = ERR_MSG_PROTOCOL_ID;
+            break;
+        }
+        if (msg->DataSize <= UDS_CAN_ID_SIZE) {
+            result = ERR_INVALID_MSG;
+            break;
+        }
+        unsigned long can_id = uds_message_can_id(msg);
+        int fd = -1;
+        pthread_mutex_lock(&channel->filter_mutex);
+        for (unsigned int i = 0; i < SOCKETCAN_MAX_FILTERS && fd < 0; i++) {
+            const SOCKETCAN_FILTER* filter = &channel->filters[i];
+            if (filter->in_use && filter->isotp_fd >= 0 && filter->flow_control == can_id) {
+                fd = filter->isotp_fd;
+            }
+        }
+        pthread_mutex_unlock(&channel->filter_mutex);
+
+        if (fd < 0) {
+            result = send_single_frame(channel, msg);
+        } else if (send(fd, msg->Data + UDS_CAN_ID_SIZE, msg->DataSize - UDS_CAN_ID_SIZE, 0) < 0) {
+            // Blocks only while the previous message to this ECU is still segmenting
+            set_error("ISO-TP send to 0x%lX failed: %s", can_id, strerror(errno));
+            result = errno == ECOMM ? ERR_TIMEOUT : ERR_FAILED;
+        }
+        if (result != STATUS_NOERROR) {
+            break;
+        }
+    }
+
+    *num_msgs = sent;
+    return result;
+}
+
+static long socketcan_write_msgs(unsigned long channel_id, void* msgs, unsigned long* num_msgs,
+                                 unsigned long timeout) {
+    if (msgs == nullptr || num_msgs == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    SOCKETCAN_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+
+    const PASSTHRU_MSG* in = static_cast<const PASSTHRU_MSG*>(msgs);
+    unsigned long total = *num_msgs;
+    unsigned long sent = 0;
+    unsigned long long deadline = uds_now_ms() + timeout;
+    long result = STATUS_NOERROR;
+
+    if (is_isotp_protocol(channel->protocol_id)) {
+        return write_isotp(channel, in, num_msgs);
+    }
+
+    struct canfd_frame frames[SOCKETCAN_BATCH];
+    struct iovec iov[SOCKETCAN_BATCH];
+    struct mmsghdr headers[SOCKETCAN_BATCH];
+
+    while (result == STATUS_NOERROR && sent < total) {
+        unsigned int batch = 0;
+        memset(headers, 0, sizeof(headers));
+        while (batch < SOCKETCAN_BATCH && sent + batch < total) {
+            const PASSTHRU_MSG* msg = &in[sent + batch];
+            int fd_frame = channel->protocol_id == FD_CAN_PS && (msg->TxFlags & CAN_FD_FORMAT);
+            unsigned long length = msg->DataSize - UDS_CAN_ID_SIZE;
+            if (msg->DataSize < UDS_CAN_ID_SIZE || length > (fd_frame ? CANFD_MAX_DLEN : CAN_MAX_DLEN) ||
+                (fd_frame && fd_frame_length(static_cast<unsigned int>(length)) != length)) {
+                result = ERR_INVALID_MSG;
+                break;
+            }
+            struct canfd_frame* frame = &frames[batch];
+            memset(frame, 0, sizeof(struct canfd_frame));
+            frame->can_id = socket_can_id(uds_message_can_id(msg), msg->TxFlags);
+            frame->len = static_cast<unsigned char>(length);
+            if (fd_frame && (msg->TxFlags & CAN_FD_BRS)) {
+                frame->flags = CANFD_BRS;
+            }
+            memcpy(frame->data, msg->Data + UDS_CAN_ID_SIZE, length);
+            iov[batch].iov_base = frame;
+            iov[batch].iov_len = fd_frame ? CANFD_MTU : CAN_MTU;
+            headers[batch].msg_hdr.msg_iov = &iov[batch];
+            headers[batch].msg_hdr.msg_iovlen = 1;
+            batch++;
+        }
+        if (batch == 0) {
+            break;
+        }
+
+        int written = sendmmsg(channel->fd, headers, batch, MSG_DONTWAIT);
+        if (written > 0) {
+            sent += written;
+            continue;
+        }
+        if (written < 0 && errno != EAGAIN && errno != ENOBUFS && errno != EINTR) {
+            set_error("CAN write failed: %s", strerror(errno));
+            result = ERR_FAILED;
+            break;
+        }
+        // Transmit queue full: wait for the bus to drain it
+        unsigned long long now = uds_now_ms();
+        if (timeout == 0 || now >= deadline) {
+            result = ERR_TIMEOUT;
+            break;
+        }
+        struct pollfd pfd = { channel->fd, POLLOUT, 0 };
+        if (poll(&pfd, 1, static_cast<int>(deadline - now)) == 0) {
+            // ENOBUFS does not wake POLLOUT on every driver, so back off briefly
+            usleep(1000);
+        }
+    }
+
+    *num_msgs = sent;
+    return result;
+}
+
+/*
+ * Binds a kernel ISO-TP socket to the filter's pattern (ECU response ID) and
+ * flow control ID (tester request ID). For FD_ISO15765_PS it generates 64-byte
+ * CAN FD frames, with bit-rate switching when CAN_FD_BRS is set, and the
+ * kernel applies the ISO 15765-2:2016 long single frame and first frame forms.
+ */
+static long open_isotp(SOCKETCAN_CHANNEL* channel, SOCKETCAN_FILTER* filter, unsigned long tx_flags) {
+    unsigned long flags = channel->flags | tx_flags;
+    int fd = socket(PF_CAN, SOCK_DGRAM | SOCK_CLOEXEC, CAN_ISOTP);
+    if (fd < 0) {
+        set_error("ISO-TP sockets unavailable (can-isotp): %s", strerror(errno));
+        return ERR_NOT_SUPPORTED;
+    }
+
+    struct can_isotp_options options;
+    memset(&options, 0, sizeof(options));
+    options.frame_txtime = CAN_ISOTP_DEFAULT_FRAME_TXTIME;
+    options.txpad_content = SOCKETCAN_ISOTP_PAD;
+    options.rxpad_content = SOCKETCAN_ISOTP_PAD;
+    if ((flags & ISO15765_FRAME_PAD) || channel->protocol_id == FD_ISO15765_PS) {
+        options.flags |= CAN_ISOTP_TX_PADDING;
+    }
+    long result = STATUS_NOERROR;
+    if (setsockopt(fd, SOL_CAN_ISOTP, CAN_ISOTP_OPTS, &options, sizeof(options)) != 0) {
+        set_error("CAN_ISOTP_OPTS failed: %s", strerror(errno));
+        result = ERR_FAILED;
+    }
+    if (result == STATUS_NOERROR && channel->protocol_id == FD_ISO15765_PS) {
+        struct can_isotp_ll_options link;
+        link.mtu = CANFD_MTU;
+        link.tx_dl = CANFD_MAX_DLEN;
+        link.tx_flags = (flags & CAN_FD_BRS) ? CANFD_BRS : 0;
+        if (setsockopt(fd, SOL_CAN_ISOTP, CAN_ISOTP_LL_OPTS, &link, sizeof(link)) != 0) {
+            set_error("ISO-TP over CAN FD not supported: %s", strerror(errno));
+            result = ERR_NOT_SUPPORTED;
+        }
+    }
+
+    struct sockaddr_can address;
+    memset(&address, 0, sizeof(address));
+    address.can_family = AF_CAN;
+    address.can_ifindex = g_socketcan_devices[channel->device_id - 1].ifindex;
+    address.can_addr.tp.rx_id = socket_can_id(filter->pattern, flags);
+    address.can_addr.tp.tx_id = socket_can_id(filter->flow_control, flags);
+    if (result == STATUS_NOERROR && bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+        set_error("Binding ISO-TP 0x%lX/0x%lX failed: %s", filter->flow_control, filter->pattern, strerror(errno));
+        result = ERR_FAILED;
+    }
+    if (result != STATUS_NOERROR) {
+        close(fd);
+        return result;
+    }
+    filter->isotp_fd = fd;
+    return STATUS_NOERROR;
+}
+
+static long socketcan_start_msg_filter(unsigned long channel_id, unsigned long filter_type, void* mask,
+                                       void* pattern, void* flow_control, unsigned long* filter_id) {
+    if (filter_id == nullptr || mask == nullptr || pattern == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    SOCKETCAN_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+    int isotp = is_isotp_protocol(channel->protocol_id);
+    if (isotp ? filter_type != FLOW_CONTROL_FILTER : (filter_type != PASS_FILTER && filter_type != BLOCK_FILTER)) {
+        return ERR_NOT_SUPPORTED;
+    }
+    if (isotp && flow_control == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    pthread_mutex_lock(&channel->filter_mutex);
+    long result = ERR_FAILED;
+    for (unsigned int i = 0; i < SOCKETCAN_MAX_FILTERS; i++) {
+        SOCKETCAN_FILTER* filter = &channel->filters[i];
+        if (filter->in_use) {
+            continue;
+        }
+        filter->in_use = 1;
+        filter->type = filter_type;
+        filter->mask = uds_message_can_id(static_cast<const PASSTHRU_MSG*>(mask));
+        filter->pattern = uds_message_can_id(static_cast<const PASSTHRU_MSG*>(pattern));
+        filter->isotp_fd = -1;
+        if (isotp) {
+            const PASSTHRU_MSG* flow_msg = static_cast<const PASSTHRU_MSG*>(flow_control);
+            filter->flow_control = uds_message_can_id(flow_msg);
+            result = open_isotp(channel, filter, flow_msg->TxFlags);
+        } else {
+            result = filter_type == PASS_FILTER ? apply_filters(channel) : STATUS_NOERROR;
+        }
+        if (result == STATUS_NOERROR) {
+            *filter_id = i + 1;
+        } else {
+            filter->in_use = 0;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&channel->filter_mutex);
+    return result;
+}
+
+static long socketcan_stop_msg_filter(unsigned long channel_id, unsigned long filter_id) {
+    SOCKETCAN_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+    if (filter_id == 0 || filter_id > SOCKETCAN_MAX_FILTERS) {
+        return ERR_INVALID_FILTER_ID;
+    }
+    pthread_mutex_lock(&channel->filter_mutex);
+    SOCKETCAN_FILTER* filter = &channel->filters[filter_id - 1];
+    long result = filter->in_use ? STATUS_NOERROR : ERR_INVALID_FILTER_ID;
+    int reload = filter->in_use && filter->type == PASS_FILTER;
+    if (filter->in_use && filter->isotp_fd >= 0) {
+        close(filter->isotp_fd);
+    }
+    filter->in_use = 0;
+    if (reload) {
+        result = apply_filters(channel);
+    }
+    pthread_mutex_unlock(&channel->filter_mutex);
+    return result;
+}
+
+static long socketcan_set_programming_voltage(unsigned long device_id, unsigned long pin,
+                                              unsigned long voltage) {
+    return ERR_NOT_SUPPORTED;
+}
+
+static long socketcan_read_version(unsigned long device_id, char* firmware_version, char* dll_version,
+                                   char* api_version) {
+    if (firmware_version == nullptr || dll_version == nullptr || api_version == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    strcpy(firmware_version, "Linux SocketCAN");
+    strcpy(dll_version, "SpaceTec SocketCAN 1.0");
+    strcpy(api_version, "04.04");
+    return STATUS_NOERROR;
+}
+
+static long socketcan_get_last_error(char* description) {
+    if (description == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    pthread_mutex_lock(&g_socketcan_mutex);
+    strcpy(description, g_socketcan_error);
+    pthread_mutex_unlock(&g_socketcan_mutex);
+    return STATUS_NOERROR;
+}
+
+static long socketcan_ioctl(unsigned long channel_id, unsigned long ioctl_id, void* input, void* output) {
+    return ERR_NOT_SUPPORTED;
+}
+
+J2534_LIBRARY* socketcan_library(void) {
+    static J2534_LIBRARY library = {
+        nullptr,
+        socketcan_open,
+        socketcan_close,
+        socketcan_connect,
+        socketcan_disconnect,
+        socketcan_read_msgs,
+        socketcan_write_msgs,
+        socketcan_start_msg_filter,
+        socketcan_stop_msg_filter,
+        socketcan_set_programming_voltage,
+        socketcan_read_version,
+        socketcan_get_last_error,
+        socketcan_ioctl,
+    };
+    return &library;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeSocketCanLoad
+ * Signature: ()J
+ *
+ * Selects the SocketCAN backend in place of a J2534 DLL; nativePassThruOpen
+ * then takes the interface name as its device name.
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeSocketCanLoad
+  (JNIEnv *env, jobject obj) {
+
+    J2534_LIBRARY* lib = socketcan_library();
+    g_j2534_lib = lib;
+    g_last_error = STATUS_NOERROR;
+    return reinterpret_cast<jlong>(lib);
+}
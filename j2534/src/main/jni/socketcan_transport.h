@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef SOCKETCAN_TRANSPORT_H
+#define SOCKETCAN_TRANSPORT_H
+
+#include <jni.h>
+#include "j2534_native.h"
+
+#define SOCKETCAN_DEFAULT_INTERFACE "can0"
+#define SOCKETCAN_MAX_DEVICES 4
+#define SOCKETCAN_MAX_CHANNELS 8
+#define SOCKETCAN_MAX_FILTERS 16
+#define SOCKETCAN_BATCH 32           // frames moved per recvmmsg/sendmmsg
+#define SOCKETCAN_RCVBUF (1024 * 1024)
+#define SOCKETCAN_ISOTP_PAD 0x00      // ISO15765_FRAME_PAD pads with zeroes
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * PassThru function table over Linux SocketCAN, for bench work on can0 or
+ * vcan0 without a J2534 device. PassThruOpen takes the interface name (null
+ * for can0). CAN and FD_CAN_PS channels use raw sockets: pass filters are
+ * loaded into the kernel as CAN_RAW_FILTER, block filters are applied on read,
+ * and on FD_CAN_PS messages with CAN_FD_FORMAT travel as canfd_frame (CAN_FD_BRS
+ * for bit-rate switching, reported back in RxStatus). ISO15765 and
+ * FD_ISO15765_PS channels take flow control filters only, each backed by a
+ * kernel ISO-TP socket (can-isotp); requests to an ID without one go out as a
+ * single frame. The table is static and must not be passed to
+ * unload_j2534_library.
+ */
+J2534_LIBRARY* socketcan_library(void);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeSocketCanLoad
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeSocketCanLoad
+  (JNIEnv *, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SOCKETCAN_TRANSPORT_H
@@ -0,0 +1,809 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "tp20_transport.h"
+#include "uds_client.h"
+#include "j2534_jni.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Connection states
+#define TP20_CLOSED 0
+#define TP20_SETUP 1
+#define TP20_PARAMS 2
+#define TP20_OPEN 3
+
+typedef struct {
+    int state;
+    unsigned char destination;
+    unsigned long tx_id;                 // ECU receives on this ID
+    unsigned long rx_id;                 // ECU transmits on this ID
+    unsigned int block_size;
+    unsigned long t1_ms;                 // ACK timeout
+    unsigned long t3_us;                 // minimum gap between data frames
+    unsigned char tx_seq;
+    unsigned char rx_seq;
+    int sending;
+    int ack_pending;
+    unsigned char ack_expected;
+    int acked;
+    int not_ready;
+    unsigned long long last_tx_ms;
+    unsigned long long test_sent_ms;     // outstanding channel test, 0 if none
+    int rx_active;
+    unsigned int rx_length;
+    unsigned int rx_expected;
+    unsigned char rx_data[TP20_MAX_MESSAGE];
+} TP20_CONNECTION;
+
+typedef struct {
+    int in_use;
+    unsigned long device_id;
+    unsigned long base_channel_id;
+    unsigned long base_filter_id;
+    pthread_mutex_t mutex;               // connections and the receive queue
+    pthread_cond_t changed;
+    pthread_mutex_t send_mutex;          // one outgoing message at a time
+    pthread_mutex_t write_mutex;         // frame writes to base; taken after mutex
+    pthread_t thread;
+    volatile int running;
+    TP20_CONNECTION connections[TP20_MAX_CONNECTIONS];
+    PASSTHRU_MSG* queue;
+    unsigned int queue_head;
+    unsigned int queue_count;
+    unsigned int dropped;
+    unsigned int filters;                // bit n set: filter n + 1 in use
+} TP20_CHANNEL;
+
+static pthread_mutex_t g_tp20_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_tp20_error_mutex = PTHREAD_MUTEX_INITIALIZER;   // RX threads report errors while g_tp20_mutex joins them
+static J2534_LIBRARY* g_tp20_base = nullptr;
+static TP20_CHANNEL g_tp20_channels[TP20_MAX_CHANNELS];
+static char g_tp20_error[128];
+
+static void set_error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&g_tp20_error_mutex);
+    vsnprintf(g_tp20_error, sizeof(g_tp20_error), format, args);
+    pthread_mutex_unlock(&g_tp20_error_mutex);
+    va_end(args);
+}
+
+static TP20_CHANNEL* channel_for(unsigned long channel_id) {
+    if (channel_id == 0 || channel_id > TP20_MAX_CHANNELS || !g_tp20_channels[channel_id - 1].in_use) {
+        return nullptr;
+    }
+    return &g_tp20_channels[channel_id - 1];
+}
+
+// Timing parameter byte: two unit bits (0.1, 1, 10, 100 ms) and a six bit scale
+static unsigned long timing_us(unsigned char value) {
+    static const unsigned long unit_us[4] = { 100, 1000, 10000, 100000 };
+    return unit_us[value >> 6] * (value & 0x3F);
+}
+
+static void wait_until(TP20_CHANNEL* channel, unsigned long long deadline_ms) {
+    unsigned long long now = uds_now_ms();
+    if (deadline_ms <= now) {
+        return;
+    }
+    unsigned long long wait_ms = deadline_ms - now;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += static_cast<time_t>(wait_ms / 1000);
+    deadline.tv_nsec += static_cast<long>(wait_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&channel->changed, &channel->mutex, &deadline);
+}
+
+static void build_frame(PASSTHRU_MSG* msg, unsigned long can_id, const unsigned char* data,
+                        unsigned long length) {
+    memset(msg, 0, offsetof(PASSTHRU_MSG, Data));
+    msg->ProtocolID = CAN;
+    msg->DataSize = UDS_CAN_ID_SIZE + length;
+    msg->Data[0] = 0;
+    msg->Data[1] = 0;
+    msg->Data[2] = static_cast<unsigned char>(can_id >> 8);
+    msg->Data[3] = static_cast<unsigned char>(can_id);
+    memcpy(msg->Data + UDS_CAN_ID_SIZE, data, length);
+}
+
+static long write_frames(TP20_CHANNEL* channel, PASSTHRU_MSG* frames, unsigned long count) {
+    pthread_mutex_lock(&channel->write_mutex);
+    unsigned long num_msgs = count;
+    long result = g_tp20_base->PassThruWriteMsgs(channel->base_channel_id, frames, &num_msgs, 0);
+    pthread_mutex_unlock(&channel->write_mutex);
+    return result;
+}
+
+static long write_frame(TP20_CHANNEL* channel, unsigned long can_id, const unsigned char* data,
+                        unsigned long length) {
+    PASSTHRU_MSG msg;
+    build_frame(&msg, can_id, data, length);
+    return write_frames(channel, &msg, 1);
+}
+
+static void send_params(TP20_CHANNEL* channel, TP20_CONNECTION* connection, unsigned char type) {
+    unsigned char frame[6] = { type, TP20_BLOCK_SIZE, TP20_T1_PARAM, 0xFF, TP20_T3_PARAM, 0xFF };
+    write_frame(channel, connection->tx_id, frame, sizeof(frame));
+    connection->last_tx_ms = uds_now_ms();
+}
+
+static void send_ack(TP20_CHANNEL* channel, TP20_CONNECTION* connection) {
+    unsigned char frame = static_cast<unsigned char>(TP20_OP_ACK | connection->rx_seq);
+    write_frame(channel, connection->tx_id, &frame, 1);
+}
+
+static void close_connection(TP20_CHANNEL* channel, TP20_CONNECTION* connection) {
+    connection->state = TP20_CLOSED;
+    connection->rx_active = 0;
+    connection->ack_pending = 0;
+    pthread_cond_broadcast(&channel->changed);
+}
+
+static void enqueue(TP20_CHANNEL* channel, const TP20_CONNECTION* connection) {
+    if (channel->queue_count == TP20_RX_QUEUE) {
+        channel->dropped++;
+        LOGE("TP2.0 receive queue full, response from 0x%02X dropped", connection->destination);
+        return;
+    }
+    PASSTHRU_MSG* msg = &channel->queue[(channel->queue_head + channel->queue_count) % TP20_RX_QUEUE];
+    memset(msg, 0, offsetof(PASSTHRU_MSG, Data));
+    msg->ProtocolID = ISO15765;
+    msg->Timestamp = static_cast<unsigned long>(uds_now_ms() * 1000ULL);
+    msg->DataSize = UDS_CAN_ID_SIZE + connection->rx_length;
+    msg->ExtraDataIndex = msg->DataSize;
+    msg->Data[0] = 0;
+    msg->Data[1] = 0;
+    msg->Data[2] = 0;
+    msg->Data[3] = connection->destination;
+    memcpy(msg->Data + UDS_CAN_ID_SIZE, connection->rx_data, connection->rx_length);
+    channel->queue_count++;
+    pthread_cond_broadcast(&channel->changed);
+}
+
+static void handle_data(TP20_CHANNEL* channel, TP20_CONNECTION* connection,
+                        const unsigned char* data, unsigned long length) {
+    unsigned char op = data[0] & 0xF0;
+    unsigned char seq = data[0] & 0x0F;
+    if (seq != connection->rx_seq) {
+        // Lost frame: drop the message and point the ECU back at the expected packet
+        connection->rx_active = 0;
+        send_ack(channel, connection);
+        return;
+    }
+    connection->rx_seq = (seq + 1) & 0x0F;
+
+    const unsigned char* payload = data + 1;
+    unsigned long count = length - 1;
+    if (!connection->rx_active) {
+        if (count < 2) {
+            return;
+        }
+        connection->rx_expected = ((static_cast<unsigned int>(payload[0]) << 8) | payload[1]) & 0x7FFF;
+        connection->rx_length = 0;
+        connection->rx_active = connection->rx_expected <= TP20_MAX_MESSAGE;
+        payload += 2;
+        count -= 2;
+    }
+    if (connection->rx_active) {
+        if (count > connection->rx_expected - connection->rx_length) {
+            count = connection->rx_expected - connection->rx_length;
+        }
+        memcpy(connection->rx_data + connection->rx_length, payload, count);
+        connection->rx_length += count;
+    }
+
+    if (op == TP20_OP_WAIT_ACK || op == TP20_OP_LAST_WAIT_ACK) {
+        send_ack(channel, connection);
+    }
+    if ((op == TP20_OP_LAST || op == TP20_OP_LAST_WAIT_ACK) && connection->rx_active) {
+        connection->rx_active = 0;
+        if (connection->rx_length == connection->rx_expected) {
+            enqueue(channel, connection);
+        }
+    }
+}
+
+static void handle_frame(TP20_CHANNEL* channel, unsigned long can_id, const unsigned char* data,
+                         unsigned long length) {
+    for (unsigned int i = 0; i < TP20_MAX_CONNECTIONS; i++) {
+        TP20_CONNECTION* connection = &channel->connections[i];
+        if (connection->state == TP20_CLOSED) {
+            continue;
+        }
+
+        if (connection->state == TP20_SETUP && can_id == TP20_SETUP_ID + static_cast<unsigned long>(connection->destination)) {
+            if (length >= 7 && data[1] == TP20_SETUP_POSITIVE) {
+                connection->rx_id = data[2] | (static_cast<unsigned long>(data[3] & 0x07) << 8);
+                connection->tx_id = data[4] | (static_cast<unsigned long>(data[5] & 0x07) << 8);
+                connection->state = TP20_PARAMS;
+                send_params(channel, connection, TP20_PARAMS_REQUEST);
+            } else if (length >= 2) {
+                set_error("ECU 0x%02X refused TP2.0 channel (0x%02X)", connection->destination, data[1]);
+                close_connection(channel, connection);
+            }
+            return;
+        }
+        if (connection->state < TP20_PARAMS || can_id != connection->rx_id || length == 0) {
+            continue;
+        }
+
+        unsigned char type = data[0];
+        if (type == TP20_PARAMS_RESPONSE && length >= 6) {
+            connection->block_size = data[1] != 0 && data[1] < TP20_BLOCK_SIZE ? data[1] : TP20_BLOCK_SIZE;
+            connection->t1_ms = (timing_us(data[2]) + 999) / 1000;
+            connection->t3_us = timing_us(data[4]);
+            if (connection->t1_ms < TP20_RX_TIMEOUT_MS) {
+                connection->t1_ms = TP20_RX_TIMEOUT_MS;
+            }
+            connection->test_sent_ms = 0;
+            if (connection->state == TP20_PARAMS) {
+                connection->state = TP20_OPEN;
+                pthread_cond_broadcast(&channel->changed);
+            }
+        } else if (type == TP20_CHANNEL_TEST) {
+            send_params(channel, connection, TP20_PARAMS_RESPONSE);
+        } else if (type == TP20_DISCONNECT) {
+            write_frame(channel, connection->tx_id, &type, 1);
+            close_connection(channel, connection);
+        } else if (type == TP20_BREAK) {
+            connection->rx_active = 0;
+        } else if ((type & 0xF0) == TP20_OP_ACK || (type & 0xF0) == TP20_OP_NOT_READY) {
+            if (connection->ack_pending && (type & 0x0F) == connection->ack_expected) {
+                if ((type & 0xF0) == TP20_OP_ACK) {
+                    connection->acked = 1;
+                    connection->ack_pending = 0;
+                } else {
+                    connection->not_ready = 1;
+                }
+                pthread_cond_broadcast(&channel->changed);
+            }
+        } else if ((type & 0xF0) <= TP20_OP_LAST) {
+            handle_data(channel, connection, data, length);
+        }
+        return;
+    }
+}
+
+// Channel tests on idle connections; a test left unanswered closes the connection
+static void check_keepalive(TP20_CHANNEL* channel) {
+    unsigned long long now = uds_now_ms();
+    for (unsigned int i = 0; i < TP20_MAX_CONNECTIONS; i++) {
+        TP20_CONNECTION* connection = &channel->connections[i];
+        if (connection->state != TP20_OPEN || connection->sending) {
+            continue;
+        }
+        if (connection->test_sent_ms != 0) {
+            if (now - connection->test_sent_ms >= TP20_KEEPALIVE_MS) {
+                LOGE("TP2.0 channel to 0x%02X lost", connection->destination);
+                close_connection(channel, connection);
+            }
+        } else if (now - connection->last_tx_ms >= TP20_KEEPALIVE_MS) {
+            unsigned char frame = TP20_CHANNEL_TEST;
+            write_frame(channel, connection->tx_id, &frame, 1);
+            connection->last_tx_ms = now;
+            connection->test_sent_ms = now;
+        }
+    }
+}
+
+static void* tp20_rx_thread(void* arg) {
+    TP20_CHANNEL* channel = static_cast<TP20_CHANNEL*>(arg);
+    PASSTHRU_MSG* msgs = static_cast<PASSTHRU_MSG*>(malloc(TP20_RX_BATCH * sizeof(PASSTHRU_MSG)));
+    if (msgs == nullptr) {
+        return nullptr;
+    }
+
+    while (channel->running) {
+        unsigned long num_msgs = TP20_RX_BATCH;
+        long result = g_tp20_base->PassThruReadMsgs(channel->base_channel_id, msgs, &num_msgs,
+                                                    TP20_RX_TIMEOUT_MS);
+        if (result != STATUS_NOERROR && result != ERR_BUFFER_EMPTY && result != ERR_TIMEOUT) {
+            LOGE("TP2.0 read failed: %ld", result);
+            num_msgs = 0;
+        }
+
+        pthread_mutex_lock(&channel->mutex);
+        for (unsigned long i = 0; i < num_msgs; i++) {
+            const PASSTHRU_MSG* msg = &msgs[i];
+            if ((msg->RxStatus & TX_MSG_TYPE) || msg->DataSize <= UDS_CAN_ID_SIZE) {
+                continue;
+            }
+            handle_frame(channel, uds_message_can_id(msg), msg->Data + UDS_CAN_ID_SIZE,
+                         msg->DataSize - UDS_CAN_ID_SIZE);
+        }
+        check_keepalive(channel);
+        pthread_mutex_unlock(&channel->mutex);
+    }
+    free(msgs);
+    return nullptr;
+}
+
+// Called with mutex held; returns the open connection to destination, setting one up if needed
+static long open_connection(TP20_CHANNEL* channel, unsigned char destination,
+                            TP20_CONNECTION** result_connection) {
+    TP20_CONNECTION* free_slot = nullptr;
+    unsigned int free_index = 0;
+    for (unsigned int i = 0; i < TP20_MAX_CONNECTIONS; i++) {
+        TP20_CONNECTION* connection = &channel->connections[i];
+        if (connection->state == TP20_OPEN && connection->destination == destination) {
+            *result_connection = connection;
+            return STATUS_NOERROR;
+        }
+        if (connection->state == TP20_CLOSED && free_slot == nullptr) {
+            free_slot = connection;
+            free_index = i;
+        }
+    }
+    if (free_slot == nullptr) {
+        return ERR_FAILED;
+    }
+
+    TP20_CONNECTION* connection = free_slot;
+    memset(connection, 0, offsetof(TP20_CONNECTION, rx_data));
+    connection->destination = destination;
+    connection->rx_id = TP20_TESTER_RX_BASE + free_index;
+    connection->block_size = TP20_BLOCK_SIZE;
+    connection->state = TP20_SETUP;
+
+    unsigned char frame[7] = {
+        destination, TP20_SETUP_REQUEST, 0x00, TP20_ID_INVALID,
+        static_cast<unsigned char>(connection->rx_id),
+        static_cast<unsigned char>(connection->rx_id >> 8),
+        TP20_APP_KWP,
+    };
+    long result = write_frame(channel, TP20_SETUP_ID, frame, sizeof(frame));
+    unsigned long long deadline = uds_now_ms() + TP20_SETUP_TIMEOUT_MS;
+    while (result == STATUS_NOERROR && connection->state != TP20_OPEN) {
+        if (connection->state == TP20_CLOSED) {
+            result = ERR_FAILED;
+        } else if (uds_now_ms() >= deadline) {
+            set_error("No TP2.0 channel setup response from 0x%02X", destination);
+            result = ERR_TIMEOUT;
+        } else {
+            wait_until(channel, deadline);
+        }
+    }
+    if (result != STATUS_NOERROR) {
+        connection->state = TP20_CLOSED;
+        return result;
+    }
+    LOGI("TP2.0 channel to 0x%02X open: tx 0x%03lX rx 0x%03lX, block %u, T1 %lu ms, T3 %lu us",
+         destination, connection->tx_id, connection->rx_id, connection->block_size,
+         connection->t1_ms, connection->t3_us);
+    *result_connection = connection;
+    return STATUS_NOERROR;
+}
+
+// Waits (mutex held) for the ACK of the block just written
+static long wait_ack(TP20_CHANNEL* channel, TP20_CONNECTION* connection) {
+    unsigned long long deadline = uds_now_ms() + connection->t1_ms;
+    unsigned int stalls = 0;
+    while (connection->ack_pending) {
+        if (connection->state != TP20_OPEN) {
+            return ERR_FAILED;
+        }
+        if (connection->not_ready) {
+            // The ECU is busy; give it another T1 for the same block
+            connection->not_ready = 0;
+            if (++stalls > TP20_ACK_WAIT_LIMIT) {
+                break;
+            }
+            deadline = uds_now_ms() + connection->t1_ms;
+        }
+        if (uds_now_ms() >= deadline) {
+            break;
+        }
+        wait_until(channel, deadline);
+    }
+    if (connection->ack_pending) {
+        set_error("No TP2.0 ACK from 0x%02X", connection->destination);
+        connection->ack_pending = 0;
+        return ERR_TIMEOUT;
+    }
+    return STATUS_NOERROR;
+}
+
+static void pause_us(unsigned long us) {
+    struct timespec gap = { static_cast<time_t>(us / 1000000), static_cast<long>(us % 1000000) * 1000L };
+    nanosleep(&gap, nullptr);
+}
+
+static long send_message(TP20_CHANNEL* channel, unsigned char destination,
+                         const unsigned char* data, unsigned long length) {
+    pthread_mutex_lock(&channel->mutex);
+    TP20_CONNECTION* connection = nullptr;
+    long result = open_connection(channel, destination, &connection);
+    if (result != STATUS_NOERROR) {
+        pthread_mutex_unlock(&channel->mutex);
+        return result;
+    }
+    connection->sending = 1;
+
+    PASSTHRU_MSG frames[TP20_BLOCK_SIZE];
+    unsigned long offset = 0;
+    while (result == STATUS_NOERROR && offset < length) {
+        // Build one block; the ECU acknowledges its last frame
+        unsigned int count = 0;
+        int need_ack = 0;
+        while (count < connection->block_size && offset < length && !need_ack) {
+            unsigned char frame[8];
+            unsigned long header = 1;
+            if (offset == 0) {
+                frame[1] = static_cast<unsigned char>(length >> 8);
+                frame[2] = static_cast<unsigned char>(length);
+                header = 3;
+            }
+            unsigned long chunk = length - offset < 8 - header ? length - offset : 8 - header;
+            memcpy(frame + header, data + offset, chunk);
+            offset += chunk;
+
+            int last = offset == length;
+            need_ack = last || count + 1 == connection->block_size;
+            unsigned char op = last ? TP20_OP_LAST_WAIT_ACK : need_ack ? TP20_OP_WAIT_ACK : TP20_OP_MORE;
+            frame[0] = static_cast<unsigned char>(op | connection->tx_seq);
+            connection->tx_seq = (connection->tx_seq + 1) & 0x0F;
+            build_frame(&frames[count++], connection->tx_id, frame, header + chunk);
+        }
+
+        connection->ack_pending = 1;
+        connection->acked = 0;
+        connection->not_ready = 0;
+        connection->ack_expected = connection->tx_seq;
+        unsigned long t3_us = connection->t3_us;
+        pthread_mutex_unlock(&channel->mutex);
+
+        if (t3_us < 1000) {
+            // Sub-millisecond T3 is met by the adapter's own frame spacing
+            result = write_frames(channel, frames, count);
+        } else {
+            for (unsigned int i = 0; i < count && result == STATUS_NOERROR; i++) {
+                if (i > 0) {
+                    pause_us(t3_us);
+                }
+                result = write_frames(channel, &frames[i], 1);
+            }
+        }
+
+        pthread_mutex_lock(&channel->mutex);
+        connection->last_tx_ms = uds_now_ms();
+        if (result == STATUS_NOERROR) {
+            result = wait_ack(channel, connection);
+        }
+    }
+
+    connection->sending = 0;
+    if (result != STATUS_NOERROR && connection->state == TP20_OPEN) {
+        // The sequence numbers can no longer be trusted; start over on the next request
+        unsigned char frame = TP20_DISCONNECT;
+        write_frame(channel, connection->tx_id, &frame, 1);
+        close_connection(channel, connection);
+    }
+    pthread_mutex_unlock(&channel->mutex);
+    return result;
+}
+
+static long tp20_open(void* name, unsigned long* device_id) {
+    if (g_tp20_base == nullptr || g_tp20_base->PassThruOpen == nullptr) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+    return g_tp20_base->PassThruOpen(name, device_id);
+}
+
+static void release_channel(TP20_CHANNEL* channel) {
+    channel->running = 0;
+    pthread_join(channel->thread, nullptr);
+
+    for (unsigned int i = 0; i < TP20_MAX_CONNECTIONS; i++) {
+        TP20_CONNECTION* connection = &channel->connections[i];
+        if (connection->state == TP20_OPEN) {
+            unsigned char frame = TP20_DISCONNECT;
+            write_frame(channel, connection->tx_id, &frame, 1);
+        }
+    }
+    g_tp20_base->PassThruStopMsgFilter(channel->base_channel_id, channel->base_filter_id);
+    g_tp20_base->PassThruDisconnect(channel->base_channel_id);
+
+    free(channel->queue);
+    pthread_cond_destroy(&channel->changed);
+    pthread_mutex_destroy(&channel->mutex);
+    pthread_mutex_destroy(&channel->send_mutex);
+    pthread_mutex_destroy(&channel->write_mutex);
+    memset(channel, 0, sizeof(TP20_CHANNEL));
+}
+
+static long tp20_disconnect(unsigned long channel_id) {
+    pthread_mutex_lock(&g_tp20_mutex);
+    TP20_CHANNEL* channel = channel_for(channel_id);
+    if (channel != nullptr) {
+        release_channel(channel);
+    }
+    pthread_mutex_unlock(&g_tp20_mutex);
+    return channel != nullptr ? STATUS_NOERROR : ERR_INVALID_CHANNEL_ID;
+}
+
+static long tp20_close(unsigned long device_id) {
+    pthread_mutex_lock(&g_tp20_mutex);
+    for (unsigned int i = 0; i < TP20_MAX_CHANNELS; i++) {
+        if (g_tp20_channels[i].in_use && g_tp20_channels[i].device_id == device_id) {
+            release_channel(&g_tp20_channels[i]);
+        }
+    }
+    pthread_mutex_unlock(&g_tp20_mutex);
+    return g_tp20_base != nullptr ? g_tp20_base->PassThruClose(device_id) : ERR_DEVICE_NOT_CONNECTED;
+}
+
+static long tp20_connect(unsigned long device_id, unsigned long protocol_id, unsigned long flags,
+                         unsigned long baudrate, unsigned long* channel_id) {
+    if (channel_id == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (protocol_id != ISO15765) {
+        return ERR_INVALID_PROTOCOL_ID;
+    }
+    if (g_tp20_base == nullptr) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+
+    pthread_mutex_lock(&g_tp20_mutex);
+    TP20_CHANNEL* channel = nullptr;
+    unsigned int index = 0;
+    for (unsigned int i = 0; i < TP20_MAX_CHANNELS; i++) {
+        if (!g_tp20_channels[i].in_use) {
+            channel = &g_tp20_channels[i];
+            index = i;
+            break;
+        }
+    }
+    if (channel == nullptr) {
+        pthread_mutex_unlock(&g_tp20_mutex);
+        return ERR_CHANNEL_IN_USE;
+    }
+
+    memset(channel, 0, sizeof(TP20_CHANNEL));
+    channel->queue = static_cast<PASSTHRU_MSG*>(malloc(TP20_RX_QUEUE * sizeof(PASSTHRU_MSG)));
+    if (channel->queue == nullptr) {
+        pthread_mutex_unlock(&g_tp20_mutex);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+
+    long result = g_tp20_base->PassThruConnect(device_id, CAN, 0,
+                                               baudrate != 0 ? baudrate : TP20_DEFAULT_BAUDRATE,
+                                               &channel->base_channel_id);
+    if (result == STATUS_NOERROR) {
+        // Setup responses and dynamic IDs are only known later, so take every 11-bit frame
+        PASSTHRU_MSG mask;
+        PASSTHRU_MSG pattern;
+        memset(&mask, 0, sizeof(mask));
+        memset(&pattern, 0, sizeof(pattern));
+        mask.ProtocolID = pattern.ProtocolID = CAN;
+        mask.DataSize = pattern.DataSize = UDS_CAN_ID_SIZE;
+        result = g_tp20_base->PassThruStartMsgFilter(channel->base_channel_id, PASS_FILTER, &mask,
+                                                     &pattern, nullptr, &channel->base_filter_id);
+        if (result != STATUS_NOERROR) {
+            g_tp20_base->PassThruDisconnect(channel->base_channel_id);
+        }
+    }
+    if (result != STATUS_NOERROR) {
+        free(channel->queue);
+        channel->queue = nullptr;
+        pthread_mutex_unlock(&g_tp20_mutex);
+        return result;
+    }
+
+    channel->device_id = device_id;
+    pthread_mutex_init(&channel->mutex, nullptr);
+    pthread_cond_init(&channel->changed, nullptr);
+    pthread_mutex_init(&channel->send_mutex, nullptr);
+    pthread_mutex_init(&channel->write_mutex, nullptr);
+    channel->running = 1;
+    channel->in_use = 1;
+    if (pthread_create(&channel->thread, nullptr, tp20_rx_thread, channel) != 0) {
+        channel->running = 0;
+        g_tp20_base->PassThruStopMsgFilter(channel->base_channel_id, channel->base_filter_id);
+        g_tp20_base->PassThruDisconnect(channel->base_channel_id);
+        free(channel->queue);
+        memset(channel, 0, sizeof(TP20_CHANNEL));
+        pthread_mutex_unlock(&g_tp20_mutex);
+        return ERR_FAILED;
+    }
+    *channel_id = index + 1;
+    pthread_mutex_unlock(&g_tp20_mutex);
+    return STATUS_NOERROR;
+}
+
+static long tp20_read_msgs(unsigned long channel_id, void* msgs, unsigned long* num_msgs,
+                           unsigned long timeout) {
+    if (msgs == nullptr || num_msgs == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    TP20_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+
+    PASSTHRU_MSG* out = static_cast<PASSTHRU_MSG*>(msgs);
+    unsigned long max_msgs = *num_msgs;
+    unsigned long count = 0;
+    unsigned long long deadline = uds_now_ms() + timeout;
+
+    pthread_mutex_lock(&channel->mutex);
+    while (channel->queue_count == 0 && uds_now_ms() < deadline) {
+        wait_until(channel, deadline);
+    }
+    while (count < max_msgs && channel->queue_count > 0) {
+        const PASSTHRU_MSG* msg = &channel->queue[channel->queue_head];
+        memcpy(&out[count++], msg, offsetof(PASSTHRU_MSG, Data) + msg->DataSize);
+        channel->queue_head = (channel->queue_head + 1) % TP20_RX_QUEUE;
+        channel->queue_count--;
+    }
+    pthread_mutex_unlock(&channel->mutex);
+
+    *num_msgs = count;
+    return count > 0 ? STATUS_NOERROR : ERR_BUFFER_EMPTY;
+}
+
+static long tp20_write_msgs(unsigned long channel_id, void* msgs, unsigned long* num_msgs,
+                            unsigned long timeout) {
+    if (msgs == nullptr || num_msgs == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    TP20_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+
+    const PASSTHRU_MSG* in = static_cast<const PASSTHRU_MSG*>(msgs);
+    unsigned long total = *num_msgs;
+    unsigned long sent = 0;
+    long result = STATUS_NOERROR;
+
+    pthread_mutex_lock(&channel->send_mutex);
+    while (result == STATUS_NOERROR && sent < total) {
+        const PASSTHRU_MSG* msg = &in[sent];
+        if (msg->DataSize <= UDS_CAN_ID_SIZE || msg->DataSize > UDS_CAN_ID_SIZE + TP20_MAX_MESSAGE) {
+            result = ERR_INVALID_MSG;
+            break;
+        }
+        result = send_message(channel, static_cast<unsigned char>(uds_message_can_id(msg)),
+                              msg->Data + UDS_CAN_ID_SIZE, msg->DataSize - UDS_CAN_ID_SIZE);
+        if (result == STATUS_NOERROR) {
+            sent++;
+        }
+    }
+    pthread_mutex_unlock(&channel->send_mutex);
+
+    *num_msgs = sent;
+    return result;
+}
+
+// Responses are routed by connection, so filters only need IDs for the engines to release
+static long tp20_start_msg_filter(unsigned long channel_id, unsigned long filter_type, void* mask,
+                                  void* pattern, void* flow_control, unsigned long* filter_id) {
+    if (filter_id == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    TP20_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+    pthread_mutex_lock(&channel->mutex);
+    long result = ERR_FAILED;
+    for (unsigned int i = 0; i < TP20_MAX_FILTERS; i++) {
+        if (!(channel->filters & (1U << i))) {
+            channel->filters |= 1U << i;
+            *filter_id = i + 1;
+            result = STATUS_NOERROR;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&channel->mutex);
+    return result;
+}
+
+static long tp20_stop_msg_filter(unsigned long channel_id, unsigned long filter_id) {
+    TP20_CHANNEL* channel = channel_for(channel_id);
+    if (channel == nullptr) {
+        return ERR_INVALID_CHANNEL_ID;
+    }
+    if (filter_id == 0 || filter_id > TP20_MAX_FILTERS) {
+        return ERR_INVALID_FILTER_ID;
+    }
+    pthread_mutex_lock(&channel->mutex);
+    long result = (channel->filters & (1U << (filter_id - 1))) ? STATUS_NOERROR : ERR_INVALID_FILTER_ID;
+    channel->filters &= ~(1U << (filter_id - 1));
+    pthread_mutex_unlock(&channel->mutex);
+    return result;
+}
+
+static long tp20_set_programming_voltage(unsigned long device_id, unsigned long pin,
+                                         unsigned long voltage) {
+    return ERR_NOT_SUPPORTED;
+}
+
+static long tp20_read_version(unsigned long device_id, char* firmware_version, char* dll_version,
+                              char* api_version) {
+    if (g_tp20_base == nullptr) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+    return g_tp20_base->PassThruReadVersion(device_id, firmware_version, dll_version, api_version);
+}
+
+static long tp20_get_last_error(char* description) {
+    if (description == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    pthread_mutex_lock(&g_tp20_error_mutex);
+    strcpy(description, g_tp20_error);
+    pthread_mutex_unlock(&g_tp20_error_mutex);
+    return STATUS_NOERROR;
+}
+
+static long tp20_ioctl(unsigned long channel_id, unsigned long ioctl_id, void* input, void* output) {
+    return ERR_NOT_SUPPORTED;
+}
+
+J2534_LIBRARY* tp20_library(J2534_LIBRARY* base) {
+    static J2534_LIBRARY library = {
+        nullptr,
+        tp20_open,
+        tp20_close,
+        tp20_connect,
+        tp20_disconnect,
+        tp20_read_msgs,
+        tp20_write_msgs,
+        tp20_start_msg_filter,
+        tp20_stop_msg_filter,
+        tp20_set_programming_voltage,
+        tp20_read_version,
+        tp20_get_last_error,
+        tp20_ioctl,
+    };
+    if (base == &library) {
+        return nullptr;
+    }
+    pthread_mutex_lock(&g_tp20_mutex);
+    g_tp20_base = base;
+    pthread_mutex_unlock(&g_tp20_mutex);
+    return &library;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeTp20Load
+ * Signature: ()J
+ *
+ * Layers TP2.0 over the library loaded so far (a J2534 DLL or SocketCAN) and
+ * selects it; Open/Connect then go through TP2.0 and message IDs are ECU
+ * logical addresses.
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeTp20Load
+  (JNIEnv *env, jobject obj) {
+
+    if (g_j2534_lib == nullptr) {
+        g_last_error = ERR_DEVICE_NOT_CONNECTED;
+        return 0;
+    }
+    J2534_LIBRARY* lib = tp20_library(g_j2534_lib);
+    if (lib == nullptr) {
+        g_last_error = ERR_DEVICE_IN_USE;   // already loaded
+        return 0;
+    }
+    g_j2534_lib = lib;
+    g_last_error = STATUS_NOERROR;
+    return reinterpret_cast<jlong>(lib);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef TP20_TRANSPORT_H
+#define TP20_TRANSPORT_H
+
+#include <jni.h>
+#include "j2534_native.h"
+
+// VAG TP2.0 channel setup
+#define TP20_SETUP_ID 0x200               // responses arrive on 0x200 + ECU logical address
+#define TP20_SETUP_REQUEST 0xC0
+#define TP20_SETUP_POSITIVE 0xD0
+#define TP20_APP_KWP 0x01
+#define TP20_ID_INVALID 0x10              // "choose for me" bit in the high byte of an ID
+#define TP20_TESTER_RX_BASE 0x300          // connection n receives on 0x300 + n
+
+// Channel control frames
+#define TP20_PARAMS_REQUEST 0xA0
+#define TP20_PARAMS_RESPONSE 0xA1
+#define TP20_CHANNEL_TEST 0xA3
+#define TP20_BREAK 0xA4
+#define TP20_DISCONNECT 0xA8
+
+// Data frame opcodes (high nibble; the low nibble is the sequence number)
+#define TP20_OP_WAIT_ACK 0x00              // block end, more follow
+#define TP20_OP_MORE 0x10
+#define TP20_OP_LAST_WAIT_ACK 0x20
+#define TP20_OP_LAST 0x30
+#define TP20_OP_NOT_READY 0x90
+#define TP20_OP_ACK 0xB0
+
+// Parameters the tester proposes: 15 frames per block, T1 100 ms, T3 5 ms
+#define TP20_BLOCK_SIZE 15
+#define TP20_T1_PARAM 0x8A
+#define TP20_T3_PARAM 0x32
+
+#define TP20_MAX_MESSAGE 4095
+#define TP20_MAX_CHANNELS 4
+#define TP20_MAX_CONNECTIONS 8
+#define TP20_MAX_FILTERS 16
+#define TP20_RX_QUEUE 16
+#define TP20_RX_BATCH 32
+#define TP20_RX_TIMEOUT_MS 10
+#define TP20_SETUP_TIMEOUT_MS 500
+#define TP20_KEEPALIVE_MS 1000             // idle time before a channel test
+#define TP20_ACK_WAIT_LIMIT 10             // T1 periods a "not ready" ECU may stall a block
+#define TP20_DEFAULT_BAUDRATE 500000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * PassThru function table that runs TP2.0 over a raw CAN channel of base,
+ * so KWP2000 engines written against J2534_LIBRARY reach VAG ECUs unchanged.
+ * PassThruOpen and PassThruClose go straight to base. PassThruConnect accepts
+ * ISO15765 and connects base with CAN. The CAN ID field of a message is the ECU
+ * logical address (0x01 engine, 0x17 cluster, ...): the first write to an
+ * address sets up its dynamic channel, and responses carry the address they
+ * came from. ACKs and channel tests are handled on a native thread per channel.
+ * The table is static and must not be passed to unload_j2534_library.
+ */
+J2534_LIBRARY* tp20_library(J2534_LIBRARY* base);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeTp20Load
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeTp20Load
+  (JNIEnv *, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TP20_TRANSPORT_H
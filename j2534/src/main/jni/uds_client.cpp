@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "uds_client.h"
+#include "j2534_jni.h"
+#include <string.h>
+#include <time.h>
+
+unsigned long long uds_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000ULL +
+           static_cast<unsigned long long>(ts.tv_nsec / 1000000L);
+}
+
+void uds_link_init(UDS_LINK* link, J2534_LIBRARY* lib, unsigned long channel_id,
+                   unsigned long tx_id, unsigned long rx_id, unsigned long tx_flags) {
+    link->lib = lib;
+    link->channel_id = channel_id;
+    link->tx_id = tx_id;
+    link->rx_id = rx_id;
+    link->tx_flags = tx_flags;
+    link->p2_ms = UDS_DEFAULT_P2_MS;
+    link->p2_star_ms = UDS_DEFAULT_P2_STAR_MS;
+}
+
+unsigned long uds_physical_tx_id(unsigned long rx_id) {
+    if (rx_id > 0x7FF) {
+        // ISO 15765-4 normal fixed addressing: swap target and source address
+        unsigned long target = (rx_id >> 8) & 0xFF;
+        unsigned long source = rx_id & 0xFF;
+        return (rx_id & 0xFFFF0000UL) | (source << 8) | target;
+    }
+    return rx_id - 8;
+}
+
+unsigned long uds_message_can_id(const PASSTHRU_MSG* msg) {
+    return (static_cast<unsigned long>(msg->Data[0]) << 24) |
+           (static_cast<unsigned long>(msg->Data[1]) << 16) |
+           (static_cast<unsigned long>(msg->Data[2]) << 8) |
+           static_cast<unsigned long>(msg->Data[3]);
+}
+
+unsigned long uds_protocol_for(unsigned long tx_flags) {
+    return (tx_flags & CAN_FD_FORMAT) ? FD_ISO15765_PS : ISO15765;
+}
+
+int uds_is_rx_payload(const PASSTHRU_MSG* msg) {
+    if (msg->RxStatus & (TX_MSG_TYPE | START_OF_MESSAGE | TX_INDICATION)) {
+        return 0;
+    }
+    return msg->DataSize > UDS_CAN_ID_SIZE;
+}
+
+static void put_can_id(unsigned char* dst, unsigned long can_id) {
+    dst[0] = static_cast<unsigned char>(can_id >> 24);
+    dst[1] = static_cast<unsigned char>(can_id >> 16);
+    dst[2] = static_cast<unsigned char>(can_id >> 8);
+    dst[3] = static_cast<unsigned char>(can_id);
+}
+
+long uds_send(J2534_LIBRARY* lib, unsigned long channel_id, unsigned long tx_id,
+              unsigned long tx_flags, const unsigned char* payload, unsigned long length) {
+    if (lib == nullptr || lib->PassThruWriteMsgs == nullptr) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+    if (length == 0 || length > UDS_MAX_PAYLOAD) {
+        return ERR_INVALID_MSG;
+    }
+
+    PASSTHRU_MSG msg;
+    msg.ProtocolID = uds_protocol_for(tx_flags);
+    msg.RxStatus = 0;
+    msg.TxFlags = tx_flags;
+    msg.Timestamp = 0;
+    msg.DataSize = UDS_CAN_ID_SIZE + length;
+    msg.ExtraDataIndex = 0;
+    put_can_id(msg.Data, tx_id);
+    memcpy(msg.Data + UDS_CAN_ID_SIZE, payload, length);
+
+    unsigned long num_msgs = 1;
+    return lib->PassThruWriteMsgs(channel_id, &msg, &num_msgs, 0);
+}
+
+long uds_start_flow_control(J2534_LIBRARY* lib, unsigned long channel_id, unsigned long tx_id,
+                            unsigned long rx_id, unsigned long tx_flags, unsigned long* filter_id) {
+    if (lib == nullptr || lib->PassThruStartMsgFilter == nullptr) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+
+    PASSTHRU_MSG mask;
+    PASSTHRU_MSG pattern;
+    PASSTHRU_MSG flow_control;
+    memset(&mask, 0, sizeof(mask));
+    memset(&pattern, 0, sizeof(pattern));
+    memset(&flow_control, 0, sizeof(flow_control));
+
+    mask.ProtocolID = pattern.ProtocolID = flow_control.ProtocolID = uds_protocol_for(tx_flags);
+    mask.TxFlags = pattern.TxFlags = flow_control.TxFlags = tx_flags;
+    mask.DataSize = pattern.DataSize = flow_control.DataSize = UDS_CAN_ID_SIZE;
+    put_can_id(mask.Data, (tx_flags & CAN_29BIT_ID) ? 0x1FFFFFFFUL : 0x7FFUL);
+    put_can_id(pattern.Data, rx_id);
+    put_can_id(flow_control.Data, tx_id);
+
+    return lib->PassThruStartMsgFilter(channel_id, FLOW_CONTROL_FILTER,
+                                       &mask, &pattern, &flow_control, filter_id);
+}
+
+long uds_transact(UDS_LINK* link, const unsigned char* req, unsigned long req_len,
+                  unsigned char* resp, unsigned long* resp_len) {
+    if (link == nullptr || req == nullptr || resp == nullptr || resp_len == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (link->lib == nullptr || link->lib->PassThruReadMsgs == nullptr) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+
+    long result = uds_send(link->lib, link->channel_id, link->tx_id, link->tx_flags, req, req_len);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+
+    unsigned long long deadline = uds_now_ms() + link->p2_ms;
+    PASSTHRU_MSG msg;
+
+    for (;;) {
+        unsigned long long now = uds_now_ms();
+        if (now >= deadline) {
+            return ERR_TIMEOUT;
+        }
+
+        unsigned long num_msgs = 1;
+        result = link->lib->PassThruReadMsgs(link->channel_id, &msg, &num_msgs,
+                                             static_cast<unsigned long>(deadline - now));
+        if (result == ERR_BUFFER_EMPTY || result == ERR_TIMEOUT || num_msgs == 0) {
+            continue;
+        }
+        if (result != STATUS_NOERROR) {
+            return result;
+        }
+        if (!uds_is_rx_payload(&msg) || uds_message_can_id(&msg) != link->rx_id) {
+            continue;
+        }
+
+        const unsigned char* payload = msg.Data + UDS_CAN_ID_SIZE;
+        unsigned long length = msg.DataSize - UDS_CAN_ID_SIZE;
+
+        // Late answers to an earlier request or unsolicited frames from the ECU are
+        // skipped; only a response to this service ends the wait.
+        if (length >= 3 && payload[0] == UDS_NEGATIVE_RESPONSE && payload[1] == req[0]) {
+            if (payload[2] == UDS_NRC_RESPONSE_PENDING) {
+                deadline = uds_now_ms() + link->p2_star_ms;
+                continue;
+            }
+        } else if (length == 0 || payload[0] != req[0] + UDS_POSITIVE_RESPONSE_OFFSET) {
+            continue;
+        }
+
+        if (length > *resp_len) {
+            return ERR_BUFFER_OVERFLOW;
+        }
+        memcpy(resp, payload, length);
+        *resp_len = length;
+        return STATUS_NOERROR;
+    }
+}
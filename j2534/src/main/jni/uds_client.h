@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef UDS_CLIENT_H
+#define UDS_CLIENT_H
+
+#include "j2534_native.h"
+
+// UDS service identifiers used by the native engines
+#define UDS_SID_READ_DTC_INFORMATION 0x19
+#define UDS_NEGATIVE_RESPONSE 0x7F
+#define UDS_POSITIVE_RESPONSE_OFFSET 0x40
+
+// UDS negative response codes
+#define UDS_NRC_RESPONSE_PENDING 0x78
+
+// Default ISO 14229-2 session timings
+#define UDS_DEFAULT_P2_MS 50
+#define UDS_DEFAULT_P2_STAR_MS 5000
+
+// Bytes of CAN ID that prefix every ISO15765 PASSTHRU_MSG
+#define UDS_CAN_ID_SIZE 4
+#define UDS_MAX_PAYLOAD (sizeof(((PASSTHRU_MSG*)0)->Data) - UDS_CAN_ID_SIZE)
+
+// Largest message classic ISO-TP can carry (12-bit first frame length)
+#define ISOTP_MAX_MESSAGE 4095
+
+// Physical request/response pair between the tester and one ECU
+typedef struct {
+    J2534_LIBRARY* lib;
+    unsigned long channel_id;
+    unsigned long tx_id;
+    unsigned long rx_id;
+    unsigned long tx_flags;
+    unsigned long p2_ms;
+    unsigned long p2_star_ms;
+} UDS_LINK;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Monotonic clock in milliseconds
+unsigned long long uds_now_ms(void);
+
+void uds_link_init(UDS_LINK* link, J2534_LIBRARY* lib, unsigned long channel_id,
+                   unsigned long tx_id, unsigned long rx_id, unsigned long tx_flags);
+
+// Maps an ECU response ID to its physical request ID (0x7E8 -> 0x7E0, 0x18DAF1xx -> 0x18DAxxF1)
+unsigned long uds_physical_tx_id(unsigned long rx_id);
+
+unsigned long uds_message_can_id(const PASSTHRU_MSG* msg);
+
+// ISO15765, or FD_ISO15765_PS when tx_flags carry CAN_FD_FORMAT
+unsigned long uds_protocol_for(unsigned long tx_flags);
+
+// True for complete ISO15765 messages received from the bus (not indications or echoes)
+int uds_is_rx_payload(const PASSTHRU_MSG* msg);
+
+long uds_send(J2534_LIBRARY* lib, unsigned long channel_id, unsigned long tx_id,
+              unsigned long tx_flags, const unsigned char* payload, unsigned long length);
+
+long uds_start_flow_control(J2534_LIBRARY* lib, unsigned long channel_id, unsigned long tx_id,
+                            unsigned long rx_id, unsigned long tx_flags, unsigned long* filter_id);
+
+// Sends a request and waits for the final response, honouring responsePending (NRC 0x78).
+// On STATUS_NOERROR resp holds either the positive or the negative response.
+long uds_transact(UDS_LINK* link, const unsigned char* req, unsigned long req_len,
+                  unsigned char* resp, unsigned long* resp_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UDS_CLIENT_H
@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "uds_did_batch.h"
+#include "j2534_jni.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DID_LIMIT_CACHE_SIZE 16
+
+typedef struct {
+    unsigned short did;
+    unsigned short length;
+} DID_ENTRY;
+
+typedef struct {
+    int valid;
+    unsigned long channel_id;
+    unsigned long rx_id;
+    unsigned int max_dids;
+} DID_LIMIT_ENTRY;
+
+// Sorted DID length dictionary shared by every ECU link
+static pthread_mutex_t g_did_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DID_ENTRY g_did_dictionary[DID_DICTIONARY_SIZE];
+static unsigned int g_did_count = 0;
+
+// Largest number of DIDs per 0x22 request each ECU has accepted
+static DID_LIMIT_ENTRY g_limit_cache[DID_LIMIT_CACHE_SIZE];
+static unsigned int g_limit_next = 0;
+
+static unsigned int dictionary_find(unsigned short did) {
+    unsigned int low = 0;
+    unsigned int high = g_did_count;
+    while (low < high) {
+        unsigned int mid = (low + high) / 2;
+        if (g_did_dictionary[mid].did < did) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void did_dictionary_set(unsigned short did, unsigned short length) {
+    pthread_mutex_lock(&g_did_mutex);
+    unsigned int pos = dictionary_find(did);
+    if (pos < g_did_count && g_did_dictionary[pos].did == did) {
+        g_did_dictionary[pos].length = length;
+    } else if (g_did_count < DID_DICTIONARY_SIZE) {
+        memmove(&g_did_dictionary[pos + 1], &g_did_dictionary[pos],
+                (g_did_count - pos) * sizeof(DID_ENTRY));
+        g_did_dictionary[pos].did = did;
+        g_did_dictionary[pos].length = length;
+        g_did_count++;
+    }
+    pthread_mutex_unlock(&g_did_mutex);
+}
+
+int did_dictionary_get(unsigned short did, unsigned short* length) {
+    int found = 0;
+    pthread_mutex_lock(&g_did_mutex);
+    unsigned int pos = dictionary_find(did);
+    if (pos < g_did_count && g_did_dictionary[pos].did == did) {
+        *length = g_did_dictionary[pos].length;
+        found = 1;
+    }
+    pthread_mutex_unlock(&g_did_mutex);
+    return found;
+}
+
+static unsigned int limit_get(const UDS_LINK* link) {
+    unsigned int limit = DID_BATCH_MAX_DIDS;
+    pthread_mutex_lock(&g_did_mutex);
+    for (unsigned int i = 0; i < DID_LIMIT_CACHE_SIZE; i++) {
+        DID_LIMIT_ENTRY* entry = &g_limit_cache[i];
+        if (entry->valid && entry->channel_id == link->channel_id && entry->rx_id == link->rx_id) {
+            limit = entry->max_dids;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_did_mutex);
+    return limit;
+}
+
+static void limit_store(const UDS_LINK* link, unsigned int limit) {
+    pthread_mutex_lock(&g_did_mutex);
+    DID_LIMIT_ENTRY* slot = nullptr;
+    for (unsigned int i = 0; i < DID_LIMIT_CACHE_SIZE; i++) {
+        DID_LIMIT_ENTRY* entry = &g_limit_cache[i];
+        if (entry->valid && entry->channel_id == link->channel_id && entry->rx_id == link->rx_id) {
+            slot = entry;
+            break;
+        }
+    }
+    if (slot == nullptr) {
+        slot = &g_limit_cache[g_limit_next];
+        g_limit_next = (g_limit_next + 1) % DID_LIMIT_CACHE_SIZE;
+    }
+    slot->valid = 1;
+    slot->channel_id = link->channel_id;
+    slot->rx_id = link->rx_id;
+    slot->max_dids = limit;
+    pthread_mutex_unlock(&g_did_mutex);
+}
+
+typedef struct {
+    unsigned char* data;
+    unsigned long capacity;
+    unsigned long length;
+} DID_OUTPUT;
+
+static long emit_did(DID_OUTPUT* out, unsigned short did, unsigned char status, unsigned char nrc,
+                     const unsigned char* data, unsigned long length) {
+    unsigned long record = (DID_RECORD_HEADER_SIZE + length + 3) & ~3UL;
+    if (out->length + record > out->capacity) {
+        return ERR_BUFFER_OVERFLOW;
+    }
+
+    unsigned char* rec = out->data + out->length;
+    rec[0] = static_cast<unsigned char>(did);
+    rec[1] = static_cast<unsigned char>(did >> 8);
+    rec[2] = status;
+    rec[3] = nrc;
+    rec[4] = static_cast<unsigned char>(length);
+    rec[5] = static_cast<unsigned char>(length >> 8);
+    rec[6] = 0;
+    rec[7] = 0;
+    if (length > 0) {
+        memcpy(rec + DID_RECORD_HEADER_SIZE, data, length);
+    }
+    memset(rec + DID_RECORD_HEADER_SIZE + length, 0, record - DID_RECORD_HEADER_SIZE - length);
+    out->length += record;
+    return STATUS_NOERROR;
+}
+
+/*
+ * Picks the DIDs for the next request: a DID of unknown length goes alone (its
+ * length is learned from the answer); otherwise known DIDs are packed up to the
+ * ECU limit while the expected response still fits one ISO-TP message.
+ */
+static unsigned int plan_batch(const unsigned short* dids, unsigned int count, unsigned int limit) {
+    unsigned short length;
+    if (!did_dictionary_get(dids[0], &length)) {
+        return 1;
+    }
+
+    unsigned long expected = 1 + 2 + length;
+    unsigned int n = 1;
+    while (n < count && n < limit && 1 + 2 * (n + 1) <= UDS_MAX_PAYLOAD) {
+        if (!did_dictionary_get(dids[n], &length) || expected + 2 + length > ISOTP_MAX_MESSAGE) {
+            break;
+        }
+        expected += 2 + length;
+        n++;
+    }
+    return n;
+}
+
+// Splits a positive 0x62 response; DIDs the ECU left out are reported as missing
+static long split_response(const unsigned short* dids, unsigned int n,
+                           const unsigned char* resp, unsigned long resp_len, DID_OUTPUT* out) {
+    unsigned long pos = 1;
+    unsigned int next = 0;
+    long result = STATUS_NOERROR;
+
+    while (pos + 2 <= resp_len && next < n && result == STATUS_NOERROR) {
+        unsigned short did = static_cast<unsigned short>((resp[pos] << 8) | resp[pos + 1]);
+        unsigned int match = next;
+        while (match < n && dids[match] != did) {
+            match++;
+        }
+        if (match == n) {
+            break; // not one of ours; the rest cannot be delimited
+        }
+        for (; next < match && result == STATUS_NOERROR; next++) {
+            result = emit_did(out, dids[next], DID_STATUS_MISSING, 0, nullptr, 0);
+        }
+
+        unsigned short length;
+        unsigned long available = resp_len - pos - 2;
+        if (n == 1) {
+            length = static_cast<unsigned short>(available);
+            did_dictionary_set(did, length);
+        } else if (!did_dictionary_get(did, &length) || length > available) {
+            break;
+        }
+
+        if (result == STATUS_NOERROR) {
+            result = emit_did(out, did, DID_STATUS_OK, 0, resp + pos + 2, length);
+        }
+        pos += 2 + length;
+        next = match + 1;
+    }
+
+    for (; next < n && result == STATUS_NOERROR; next++) {
+        result = emit_did(out, dids[next], DID_STATUS_MISSING, 0, nullptr, 0);
+    }
+    return result;
+}
+
+long did_batch_read(UDS_LINK* link, const unsigned short* dids, unsigned int count,
+                    unsigned char* out, unsigned long out_capacity, unsigned long* out_length) {
+    if (link == nullptr || dids == nullptr || out == nullptr || out_length == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    DID_OUTPUT output;
+    output.data = out;
+    output.capacity = out_capacity;
+    output.length = 0;
+
+    unsigned char req[1 + 2 * DID_BATCH_MAX_DIDS];
+    unsigned char resp[UDS_MAX_PAYLOAD];
+    unsigned int limit = limit_get(link);
+    unsigned int requests = 0;
+    long result = STATUS_NOERROR;
+    unsigned int idx = 0;
+
+    while (idx < count && result == STATUS_NOERROR) {
+        unsigned int n = plan_batch(dids + idx, count - idx, limit);
+
+        req[0] = UDS_SID_READ_DATA_BY_IDENTIFIER;
+        for (unsigned int i = 0; i < n; i++) {
+            req[1 + 2 * i] = static_cast<unsigned char>(dids[idx + i] >> 8);
+            req[2 + 2 * i] = static_cast<unsigned char>(dids[idx + i]);
+        }
+
+        unsigned long resp_len = sizeof(resp);
+        result = uds_transact(link, req, 1 + 2 * n, resp, &resp_len);
+        requests++;
+        if (result != STATUS_NOERROR) {
+            break;
+        }
+
+        if (resp_len >= 3 && resp[0] == UDS_NEGATIVE_RESPONSE) {
+            unsigned char nrc = resp[2];
+            if (n > 1 && (nrc == UDS_NRC_INCORRECT_LENGTH || nrc == UDS_NRC_RESPONSE_TOO_LONG)) {
+                limit = n / 2;
+                limit_store(link, limit);
+                LOGI("DID batch: ECU 0x%lX limit lowered to %u DIDs", link->rx_id, limit);
+                continue;
+            }
+            for (unsigned int i = 0; i < n && result == STATUS_NOERROR; i++) {
+                result = emit_did(&output, dids[idx + i], DID_STATUS_NEGATIVE, nrc, nullptr, 0);
+            }
+        } else if (resp_len >= 1 && resp[0] == UDS_SID_READ_DATA_BY_IDENTIFIER + UDS_POSITIVE_RESPONSE_OFFSET) {
+            result = split_response(dids + idx, n, resp, resp_len, &output);
+        } else {
+            result = ERR_INVALID_MSG;
+        }
+        idx += n;
+    }
+
+    LOGI("DID batch: %u DIDs in %u requests", count, requests);
+    *out_length = output.length;
+    return result;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeUdsSetDidLengths
+ * Signature: ([I[I)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeUdsSetDidLengths
+  (JNIEnv *env, jobject obj, jintArray dids, jintArray lengths) {
+
+    if (dids == nullptr || lengths == nullptr ||
+        env->GetArrayLength(dids) != env->GetArrayLength(lengths)) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    jsize count = env->GetArrayLength(dids);
+    jint* did_values = env->GetIntArrayElements(dids, nullptr);
+    jint* length_values = env->GetIntArrayElements(lengths, nullptr);
+    for (jsize i = 0; i < count; i++) {
+        did_dictionary_set(static_cast<unsigned short>(did_values[i]),
+                           static_cast<unsigned short>(length_values[i]));
+    }
+    env->ReleaseIntArrayElements(lengths, length_values, JNI_ABORT);
+    env->ReleaseIntArrayElements(dids, did_values, JNI_ABORT);
+
+    g_last_error = STATUS_NOERROR;
+    return static_cast<jint>(count);
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeUdsReadDids
+ * Signature: (III[ILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeUdsReadDids
+  (JNIEnv *env, jobject obj, jint channel_id, jint flags, jint ecu_rx_id, jintArray dids,
+   jobject result_buffer) {
+
+    unsigned char* out = result_buffer != nullptr
+        ? static_cast<unsigned char*>(env->GetDirectBufferAddress(result_buffer)) : nullptr;
+    if (dids == nullptr || out == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+    if (g_j2534_lib == nullptr) {
+        g_last_error = ERR_DEVICE_NOT_CONNECTED;
+        return -1;
+    }
+
+    jsize count = env->GetArrayLength(dids);
+    unsigned short* did_values = static_cast<unsigned short*>(
+        malloc((count > 0 ? count : 1) * sizeof(unsigned short)));
+    if (did_values == nullptr) {
+        g_last_error = ERR_INSUFFICIENT_MEMORY;
+        return -1;
+    }
+    jint* values = env->GetIntArrayElements(dids, nullptr);
+    for (jsize i = 0; i < count; i++) {
+        did_values[i] = static_cast<unsigned short>(values[i]);
+    }
+    env->ReleaseIntArrayElements(dids, values, JNI_ABORT);
+
+    UDS_LINK link;
+    unsigned long rx_id = static_cast<unsigned long>(ecu_rx_id);
+    unsigned long tx_flags = static_cast<unsigned long>(flags) | ISO15765_FRAME_PAD;
+    uds_link_init(&link, g_j2534_lib, static_cast<unsigned long>(channel_id),
+                  uds_physical_tx_id(rx_id), rx_id, tx_flags);
+
+    unsigned long filter_id = 0;
+    unsigned long length = 0;
+    long result = uds_start_flow_control(g_j2534_lib, link.channel_id, link.tx_id, rx_id,
+                                         tx_flags, &filter_id);
+    if (result == STATUS_NOERROR) {
+        result = did_batch_read(&link, did_values, static_cast<unsigned int>(count), out,
+                                static_cast<unsigned long>(env->GetDirectBufferCapacity(result_buffer)),
+                                &length);
+        g_j2534_lib->PassThruStopMsgFilter(link.channel_id, filter_id);
+    }
+    free(did_values);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return static_cast<jint>(length);
+    } else {
+        return -1;
+    }
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef UDS_DID_BATCH_H
+#define UDS_DID_BATCH_H
+
+#include <jni.h>
+#include "uds_client.h"
+
+#define UDS_SID_READ_DATA_BY_IDENTIFIER 0x22
+
+// NRCs that mean "too many identifiers in one request"
+#define UDS_NRC_INCORRECT_LENGTH 0x13
+#define UDS_NRC_RESPONSE_TOO_LONG 0x14
+
+#define DID_DICTIONARY_SIZE 1024
+#define DID_BATCH_MAX_DIDS 64
+
+// Per-DID status in the packed result
+#define DID_STATUS_OK 0
+#define DID_STATUS_MISSING 1   // omitted from a positive multi-DID response
+#define DID_STATUS_NEGATIVE 2  // request answered with the NRC in the record
+
+/*
+ * Packed result record (little endian, 4-byte aligned):
+ *   u16 did, u8 status, u8 nrc, u16 length, u16 reserved, data[length], pad
+ */
+#define DID_RECORD_HEADER_SIZE 8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Registers known data lengths so DIDs can be packed and split
+void did_dictionary_set(unsigned short did, unsigned short length);
+int did_dictionary_get(unsigned short did, unsigned short* length);
+
+// Reads the DIDs in as few 0x22 requests as the ECU accepts
+long did_batch_read(UDS_LINK* link, const unsigned short* dids, unsigned int count,
+                    unsigned char* out, unsigned long out_capacity, unsigned long* out_length);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeUdsSetDidLengths
+ * Signature: ([I[I)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeUdsSetDidLengths
+  (JNIEnv *, jobject, jintArray, jintArray);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeUdsReadDids
+ * Signature: (III[ILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeUdsReadDids
+  (JNIEnv *, jobject, jint, jint, jint, jintArray, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UDS_DID_BATCH_H
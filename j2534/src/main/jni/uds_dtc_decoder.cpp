@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "uds_dtc_decoder.h"
+#include "j2534_jni.h"
+#include "j2534_native.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define DTC_DECODER_SSSE3 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DTC_DECODER_NEON 1
+#endif
+
+#define DTC_POSITIVE_RESPONSE 0x59
+
+static unsigned long align4(unsigned long value) {
+    return (value + 3) & ~3UL;
+}
+
+static int32_t read_dtc(const unsigned char* p) {
+    return static_cast<int32_t>((static_cast<uint32_t>(p[0]) << 16) |
+                                (static_cast<uint32_t>(p[1]) << 8) |
+                                static_cast<uint32_t>(p[2]));
+}
+
+static void put_u32(unsigned char* dst, uint32_t value) {
+    memcpy(dst, &value, sizeof(value));
+}
+
+/*
+ * DTC + trailing byte records (02, 0A, 14). Each 16-byte load holds four records;
+ * one shuffle turns the big-endian 3-byte DTCs into native int32 lanes and a second
+ * gathers the trailing bytes.
+ */
+static void decode_stride4(const unsigned char* src, unsigned long count,
+                           int32_t* dtcs, unsigned char* trailing) {
+    unsigned long i = 0;
+
+#if defined(DTC_DECODER_SSSE3)
+    const __m128i dtc_shuffle = _mm_setr_epi8(2, 1, 0, -128, 6, 5, 4, -128,
+                                              10, 9, 8, -128, 14, 13, 12, -128);
+    const __m128i byte_shuffle = _mm_setr_epi8(3, 7, 11, 15, -128, -128, -128, -128,
+                                               -128, -128, -128, -128, -128, -128, -128, -128);
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dtcs + i), _mm_shuffle_epi8(v, dtc_shuffle));
+        int32_t packed = _mm_cvtsi128_si32(_mm_shuffle_epi8(v, byte_shuffle));
+        memcpy(trailing + i, &packed, sizeof(packed));
+    }
+#elif defined(DTC_DECODER_NEON)
+    static const uint8_t dtc_index[16] = {2, 1, 0, 0xFF, 6, 5, 4, 0xFF,
+                                          10, 9, 8, 0xFF, 14, 13, 12, 0xFF};
+    static const uint8_t byte_index[16] = {3, 7, 11, 15, 0xFF, 0xFF, 0xFF, 0xFF,
+                                           0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    const uint8x16_t dtc_shuffle = vld1q_u8(dtc_index);
+    const uint8x16_t byte_shuffle = vld1q_u8(byte_index);
+    for (; i + 4 <= count; i += 4) {
+        uint8x16_t v = vld1q_u8(src + i * 4);
+        vst1q_u8(reinterpret_cast<uint8_t*>(dtcs + i), vqtbl1q_u8(v, dtc_shuffle));
+        uint32_t packed = vgetq_lane_u32(vreinterpretq_u32_u8(vqtbl1q_u8(v, byte_shuffle)), 0);
+        memcpy(trailing + i, &packed, sizeof(packed));
+    }
+#endif
+
+    for (; i < count; i++) {
+        dtcs[i] = read_dtc(src + i * 4);
+        trailing[i] = src[i * 4 + 3];
+    }
+}
+
+/*
+ * Severity + DTC + status records (42). Three 5-byte records fit a 16-byte load; the
+ * loop keeps a fourth record in range so the load never reads past the response.
+ */
+static void decode_stride5(const unsigned char* src, unsigned long count,
+                           int32_t* dtcs, unsigned char* statuses, unsigned char* severities) {
+    unsigned long i = 0;
+
+#if defined(DTC_DECODER_SSSE3)
+    const __m128i dtc_shuffle = _mm_setr_epi8(3, 2, 1, -128, 8, 7, 6, -128,
+                                              13, 12, 11, -128, -128, -128, -128, -128);
+    const __m128i byte_shuffle = _mm_setr_epi8(4, 9, 14, -128, 0, 5, 10, -128,
+                                               -128, -128, -128, -128, -128, -128, -128, -128);
+    for (; i + 4 <= count; i += 3) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 5));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dtcs + i), _mm_shuffle_epi8(v, dtc_shuffle));
+        __m128i bytes = _mm_shuffle_epi8(v, byte_shuffle);
+        int32_t status = _mm_cvtsi128_si32(bytes);
+        int32_t severity = _mm_cvtsi128_si32(_mm_srli_si128(bytes, 4));
+        memcpy(statuses + i, &status, 3);
+        memcpy(severities + i, &severity, 3);
+    }
+#elif defined(DTC_DECODER_NEON)
+    static const uint8_t dtc_index[16] = {3, 2, 1, 0xFF, 8, 7, 6, 0xFF,
+                                          13, 12, 11, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    static const uint8_t byte_index[16] = {4, 9, 14, 0xFF, 0, 5, 10, 0xFF,
+                                           0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    const uint8x16_t dtc_shuffle = vld1q_u8(dtc_index);
+    const uint8x16_t byte_shuffle = vld1q_u8(byte_index);
+    for (; i + 4 <= count; i += 3) {
+        uint8x16_t v = vld1q_u8(src + i * 5);
+        vst1q_u8(reinterpret_cast<uint8_t*>(dtcs + i), vqtbl1q_u8(v, dtc_shuffle));
+        uint32x4_t bytes = vreinterpretq_u32_u8(vqtbl1q_u8(v, byte_shuffle));
+        uint32_t status = vgetq_lane_u32(bytes, 0);
+        uint32_t severity = vgetq_lane_u32(bytes, 1);
+        memcpy(statuses + i, &status, 3);
+        memcpy(severities + i, &severity, 3);
+    }
+#endif
+
+    for (; i < count; i++) {
+        severities[i] = src[i * 5];
+        dtcs[i] = read_dtc(src + i * 5 + 1);
+        statuses[i] = src[i * 5 + 4];
+    }
+}
+
+long dtc_decode_response(const unsigned char* response, unsigned long length,
+                         unsigned char* out, unsigned long out_capacity, unsigned long* out_length) {
+    if (response == nullptr || out == nullptr || out_length == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (length < 2 || response[0] != DTC_POSITIVE_RESPONSE) {
+        return ERR_INVALID_MSG;
+    }
+
+    unsigned char sub_function = response[1];
+    unsigned char availability = 0;
+    unsigned char functional_group = 0;
+    unsigned char format = 0;
+    unsigned long first = 0;
+    unsigned long stride = 0;
+    unsigned long count = 0;
+    int has_status = 1;
+    int has_aux = 0;
+    int has_records = 0;
+
+    switch (sub_function) {
+        case DTC_SUB_BY_STATUS_MASK:
+        case DTC_SUB_SUPPORTED:
+            if (length < 3) {
+                return ERR_INVALID_MSG;
+            }
+            availability = response[2];
+            first = 3;
+            stride = 4;
+            break;
+        case DTC_SUB_FAULT_DETECTION_COUNTER:
+            first = 2;
+            stride = 4;
+            has_status = 0;
+            has_aux = 1;
+            break;
+        case DTC_SUB_WWH_OBD_BY_MASK:
+            if (length < 6) {
+                return ERR_INVALID_MSG;
+            }
+            functional_group = response[2];
+            availability = response[3];
+            format = response[5];
+            first = 6;
+            stride = 5;
+            has_aux = 1;
+            break;
+        case DTC_SUB_SNAPSHOT_BY_DTC:
+        case DTC_SUB_EXTENDED_BY_DTC:
+            if (length < 6) {
+                return ERR_INVALID_MSG;
+            }
+            first = 2;
+            count = 1;
+            has_records = 1;
+            break;
+        default:
+            return ERR_NOT_SUPPORTED;
+    }
+    if (stride != 0) {
+        count = (length - first) / stride;
+    }
+
+    unsigned long dtc_offset = DTC_COLUMNS_HEADER_SIZE;
+    unsigned long cursor = dtc_offset + count * 4;
+    unsigned long status_offset = 0;
+    unsigned long aux_offset = 0;
+    unsigned long record_offset = 0;
+    if (has_status) {
+        status_offset = cursor;
+        cursor = align4(cursor + count);
+    }
+    if (has_aux) {
+        aux_offset = cursor;
+        cursor = align4(cursor + count);
+    }
+    if (has_records) {
+        record_offset = cursor;
+        cursor += count * 8;
+    }
+    if (cursor > out_capacity) {
+        return ERR_BUFFER_OVERFLOW;
+    }
+
+    int32_t* dtcs = reinterpret_cast<int32_t*>(out + dtc_offset);
+    const unsigned char* records = response + first;
+
+    if (stride == 4) {
+        decode_stride4(records, count, dtcs, has_status ? out + status_offset : out + aux_offset);
+    } else if (stride == 5) {
+        decode_stride5(records, count, dtcs, out + status_offset, out + aux_offset);
+    } else {
+        dtcs[0] = read_dtc(records);
+        out[status_offset] = records[3];
+        put_u32(out + record_offset, 6);
+        put_u32(out + record_offset + 4, static_cast<uint32_t>(length - 6));
+    }
+
+    put_u32(out, static_cast<uint32_t>(count));
+    out[4] = sub_function;
+    out[5] = availability;
+    out[6] = functional_group;
+    out[7] = format;
+    put_u32(out + 8, static_cast<uint32_t>(dtc_offset));
+    put_u32(out + 12, static_cast<uint32_t>(status_offset));
+    put_u32(out + 16, static_cast<uint32_t>(aux_offset));
+    put_u32(out + 20, static_cast<uint32_t>(record_offset));
+    *out_length = cursor;
+    return STATUS_NOERROR;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeDecodeDtcResponse
+ * Signature: (Ljava/nio/ByteBuffer;ILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeDecodeDtcResponse
+  (JNIEnv *env, jobject obj, jobject response_buffer, jint length, jobject result_buffer) {
+
+    if (response_buffer == nullptr || result_buffer == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    const unsigned char* response =
+        static_cast<const unsigned char*>(env->GetDirectBufferAddress(response_buffer));
+    jlong response_capacity = env->GetDirectBufferCapacity(response_buffer);
+    unsigned char* out = static_cast<unsigned char*>(env->GetDirectBufferAddress(result_buffer));
+    jlong out_capacity = env->GetDirectBufferCapacity(result_buffer);
+
+    if (response == nullptr || out == nullptr || length < 0 || length > response_capacity) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    unsigned long out_length = 0;
+    long result = dtc_decode_response(response, static_cast<unsigned long>(length), out,
+                                      static_cast<unsigned long>(out_capacity), &out_length);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return static_cast<jint>(out_length);
+    } else {
+        return -1;
+    }
+}
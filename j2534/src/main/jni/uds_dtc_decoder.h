@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef UDS_DTC_DECODER_H
+#define UDS_DTC_DECODER_H
+
+#include <jni.h>
+
+// ReadDTCInformation sub-functions understood by the decoder
+#define DTC_SUB_BY_STATUS_MASK 0x02
+#define DTC_SUB_SNAPSHOT_BY_DTC 0x04
+#define DTC_SUB_EXTENDED_BY_DTC 0x06
+#define DTC_SUB_SUPPORTED 0x0A
+#define DTC_SUB_FAULT_DETECTION_COUNTER 0x14
+#define DTC_SUB_WWH_OBD_BY_MASK 0x42
+
+/*
+ * Columnar output layout (native byte order so Java can view it as IntBuffer):
+ *    0  u32 count
+ *    4  u8  sub_function
+ *    5  u8  status availability mask (02, 0A, 42)
+ *    6  u8  functional group identifier (42)
+ *    7  u8  DTC format identifier (42)
+ *    8  u32 dtc_offset     -> i32[count]
+ *   12  u32 status_offset  -> u8[count], 0 if absent (14)
+ *   16  u32 aux_offset     -> u8[count] severity (42) or fault detection counter (14), 0 if absent
+ *   20  u32 record_offset  -> u32[2 * count] (offset, length) of 04/06 record data within the
+ *                             response, 0 if absent
+ */
+#define DTC_COLUMNS_HEADER_SIZE 24
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Decodes a positive 0x59 response into the columnar layout; returns a J2534 status code
+long dtc_decode_response(const unsigned char* response, unsigned long length,
+                         unsigned char* out, unsigned long out_capacity, unsigned long* out_length);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeDecodeDtcResponse
+ * Signature: (Ljava/nio/ByteBuffer;ILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeDecodeDtcResponse
+  (JNIEnv *, jobject, jobject, jint, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UDS_DTC_DECODER_H
@@ -0,0 +1,537 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "uds_dtc_sweep.h"
+#include "j2534_jni.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define SWEEP_POLL_MS 5
+#define SWEEP_READ_BATCH 8
+#define SWEEP_DEFAULT_WINDOW_MS 100
+#define SWEEP_DEFAULT_BAUDRATE 500000
+
+// 0x19 sub-functions issued by the sweep
+#define DTC_REPORT_BY_STATUS_MASK 0x02
+#define DTC_REPORT_SNAPSHOT_BY_DTC 0x04
+#define DTC_REPORT_EXTENDED_BY_DTC 0x06
+#define DTC_ALL_RECORDS 0xFF
+
+typedef struct {
+    unsigned long rx_id;
+    unsigned long tx_id;
+    unsigned long filter_id;
+    int filter_active;
+    int responded;
+    int needs_list;
+    unsigned long* dtcs;
+    unsigned char* statuses;
+    unsigned int dtc_count;
+    unsigned int dtc_capacity;
+    unsigned int next_dtc;
+    unsigned int next_kind;
+    int in_flight;
+    unsigned char request[6];
+    unsigned long request_length;
+    unsigned long long deadline;
+} SWEEP_ECU;
+
+typedef struct {
+    unsigned char* data;
+    unsigned long capacity;
+    unsigned long length;
+    unsigned long record_count;
+    unsigned int flags;
+} SWEEP_OUTPUT;
+
+typedef struct {
+    unsigned long frames;
+    unsigned long responses;
+} SWEEP_LOAD;
+
+static void put_le16(unsigned char* dst, unsigned int value) {
+    dst[0] = static_cast<unsigned char>(value);
+    dst[1] = static_cast<unsigned char>(value >> 8);
+}
+
+static void put_le32(unsigned char* dst, unsigned long value) {
+    dst[0] = static_cast<unsigned char>(value);
+    dst[1] = static_cast<unsigned char>(value >> 8);
+    dst[2] = static_cast<unsigned char>(value >> 16);
+    dst[3] = static_cast<unsigned char>(value >> 24);
+}
+
+static unsigned long get_dtc(const unsigned char* p) {
+    return (static_cast<unsigned long>(p[0]) << 16) |
+           (static_cast<unsigned long>(p[1]) << 8) |
+           static_cast<unsigned long>(p[2]);
+}
+
+static void emit_record(SWEEP_OUTPUT* out, unsigned long ecu_id, unsigned long dtc,
+                        unsigned char status, unsigned char kind,
+                        const unsigned char* payload, unsigned long length) {
+    if (out->flags & DTC_SWEEP_TRUNCATED) {
+        return;
+    }
+    if (length > 0xFFFF) {
+        length = 0xFFFF;
+    }
+
+    unsigned long padded = (length + 3) & ~3UL;
+    if (out->length + DTC_SWEEP_RECORD_HEADER_SIZE + padded > out->capacity) {
+        out->flags |= DTC_SWEEP_TRUNCATED;
+        return;
+    }
+
+    unsigned char* rec = out->data + out->length;
+    put_le32(rec, ecu_id);
+    put_le32(rec + 4, dtc);
+    rec[8] = status;
+    rec[9] = kind;
+    put_le16(rec + 10, static_cast<unsigned int>(length));
+    if (length > 0) {
+        memcpy(rec + DTC_SWEEP_RECORD_HEADER_SIZE, payload, length);
+    }
+    memset(rec + DTC_SWEEP_RECORD_HEADER_SIZE + length, 0, padded - length);
+
+    out->length += DTC_SWEEP_RECORD_HEADER_SIZE + padded;
+    out->record_count++;
+}
+
+static int ecu_add_dtc(SWEEP_ECU* ecu, unsigned long dtc, unsigned char status) {
+    if (ecu->dtc_count == ecu->dtc_capacity) {
+        unsigned int capacity = ecu->dtc_capacity ? ecu->dtc_capacity * 2 : 32;
+        unsigned long* dtcs = static_cast<unsigned long*>(
+            realloc(ecu->dtcs, capacity * sizeof(unsigned long)));
+        if (dtcs == nullptr) {
+            return 0;
+        }
+        ecu->dtcs = dtcs;
+        unsigned char* statuses = static_cast<unsigned char*>(realloc(ecu->statuses, capacity));
+        if (statuses == nullptr) {
+            return 0;
+        }
+        ecu->statuses = statuses;
+        ecu->dtc_capacity = capacity;
+    }
+    ecu->dtcs[ecu->dtc_count] = dtc;
+    ecu->statuses[ecu->dtc_count] = status;
+    ecu->dtc_count++;
+    return 1;
+}
+
+// Consumes a positive 59 02 response into the ECU's follow-up list and the result buffer
+static long handle_dtc_list(SWEEP_ECU* ecu, SWEEP_OUTPUT* out,
+                            const unsigned char* payload, unsigned long length) {
+    for (unsigned long pos = 3; pos + 4 <= length; pos += 4) {
+        unsigned long dtc = get_dtc(payload + pos);
+        unsigned char status = payload[pos + 3];
+        if (!ecu_add_dtc(ecu, dtc, status)) {
+            return ERR_INSUFFICIENT_MEMORY;
+        }
+        emit_record(out, ecu->rx_id, dtc, status, DTC_RECORD_STATUS, nullptr, 0);
+    }
+    ecu->needs_list = 0;
+    ecu->responded = 1;
+    return STATUS_NOERROR;
+}
+
+// Consumes a positive 59 04 / 59 06 response (DTC, status, then raw records)
+static void handle_dtc_records(SWEEP_ECU* ecu, SWEEP_OUTPUT* out,
+                               const unsigned char* payload, unsigned long length) {
+    if (length <= 6) {
+        return; // no stored records for this DTC
+    }
+    unsigned char kind = (payload[1] == DTC_REPORT_SNAPSHOT_BY_DTC) ? DTC_RECORD_SNAPSHOT
+                                                                     : DTC_RECORD_EXTENDED;
+    emit_record(out, ecu->rx_id, get_dtc(payload + 2), payload[5], kind,
+                payload + 6, length - 6);
+}
+
+static int next_request(const DTC_SWEEP_CONFIG* config, SWEEP_ECU* ecu) {
+    unsigned char* req = ecu->request;
+    req[0] = UDS_SID_READ_DTC_INFORMATION;
+
+    if (ecu->needs_list) {
+        req[1] = DTC_REPORT_BY_STATUS_MASK;
+        req[2] = config->status_mask;
+        ecu->request_length = 3;
+        return 1;
+    }
+
+    while (ecu->next_dtc < ecu->dtc_count) {
+        unsigned long dtc = ecu->dtcs[ecu->next_dtc];
+        unsigned char sub_function;
+        int wanted;
+
+        if (ecu->next_kind == 0) {
+            ecu->next_kind = 1;
+            sub_function = DTC_REPORT_SNAPSHOT_BY_DTC;
+            wanted = (config->options & DTC_SWEEP_SNAPSHOTS) != 0;
+        } else {
+            ecu->next_kind = 0;
+            ecu->next_dtc++;
+            sub_function = DTC_REPORT_EXTENDED_BY_DTC;
+            wanted = (config->options & DTC_SWEEP_EXTENDED) != 0;
+        }
+
+        if (wanted) {
+            req[1] = sub_function;
+            req[2] = static_cast<unsigned char>(dtc >> 16);
+            req[3] = static_cast<unsigned char>(dtc >> 8);
+            req[4] = static_cast<unsigned char>(dtc);
+            req[5] = DTC_ALL_RECORDS;
+            ecu->request_length = 6;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ISO-TP frames on the bus for one response, including the flow control frame
+static unsigned long response_frames(unsigned long length) {
+    if (length <= 7) {
+        return 1;
+    }
+    return 2 + (length - 6 + 6) / 7;
+}
+
+/*
+ * Caps the number of ECUs serviced concurrently so that the responses expected
+ * inside one P2 window stay below half of what the bus can carry. Classic CAN
+ * frames take ~135 bits (11-bit) or ~160 bits (29-bit) with worst-case stuffing.
+ */
+static unsigned int max_in_flight(const DTC_SWEEP_CONFIG* config, const SWEEP_LOAD* load) {
+    unsigned long bits_per_frame = (config->tx_flags & CAN_29BIT_ID) ? 160 : 135;
+    unsigned long baudrate = config->baudrate ? config->baudrate : SWEEP_DEFAULT_BAUDRATE;
+    unsigned long budget = baudrate / bits_per_frame * UDS_DEFAULT_P2_MS / 1000 / 2;
+    unsigned long average = load->responses ? load->frames / load->responses : 4;
+    if (average == 0) {
+        average = 1;
+    }
+
+    unsigned long limit = budget / average;
+    if (limit < 1) {
+        limit = 1;
+    }
+    if (limit > DTC_SWEEP_MAX_ECUS) {
+        limit = DTC_SWEEP_MAX_ECUS;
+    }
+    return static_cast<unsigned int>(limit);
+}
+
+static SWEEP_ECU* find_ecu(SWEEP_ECU* ecus, unsigned int count, unsigned long rx_id) {
+    for (unsigned int i = 0; i < count; i++) {
+        if (ecus[i].rx_id == rx_id) {
+            return &ecus[i];
+        }
+    }
+    return nullptr;
+}
+
+static long collect_functional(J2534_LIBRARY* lib, unsigned long channel_id,
+                               const DTC_SWEEP_CONFIG* config, SWEEP_ECU* ecus,
+                               unsigned int ecu_count, SWEEP_OUTPUT* out) {
+    unsigned char req[3] = {UDS_SID_READ_DTC_INFORMATION, DTC_REPORT_BY_STATUS_MASK,
+                            config->status_mask};
+    long result = uds_send(lib, channel_id, config->functional_id, config->tx_flags,
+                           req, sizeof(req));
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+
+    unsigned long window = config->window_ms ? config->window_ms : SWEEP_DEFAULT_WINDOW_MS;
+    unsigned long long deadline = uds_now_ms() + window;
+    PASSTHRU_MSG* msgs = static_cast<PASSTHRU_MSG*>(malloc(SWEEP_READ_BATCH * sizeof(PASSTHRU_MSG)));
+    if (msgs == nullptr) {
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+
+    result = STATUS_NOERROR;
+    for (unsigned long long now = uds_now_ms(); now < deadline; now = uds_now_ms()) {
+        unsigned long num_msgs = SWEEP_READ_BATCH;
+        long status = lib->PassThruReadMsgs(channel_id, msgs, &num_msgs,
+                                            static_cast<unsigned long>(deadline - now));
+        if (status != STATUS_NOERROR && status != ERR_BUFFER_EMPTY && status != ERR_TIMEOUT) {
+            result = status;
+            break;
+        }
+
+        for (unsigned long i = 0; i < num_msgs; i++) {
+            if (!uds_is_rx_payload(&msgs[i])) {
+                continue;
+            }
+            SWEEP_ECU* ecu = find_ecu(ecus, ecu_count, uds_message_can_id(&msgs[i]));
+            if (ecu == nullptr) {
+                continue;
+            }
+
+            const unsigned char* payload = msgs[i].Data + UDS_CAN_ID_SIZE;
+            unsigned long length = msgs[i].DataSize - UDS_CAN_ID_SIZE;
+            ecu->responded = 1;
+
+            if (length >= 3 && payload[0] == UDS_SID_READ_DTC_INFORMATION + UDS_POSITIVE_RESPONSE_OFFSET &&
+                payload[1] == DTC_REPORT_BY_STATUS_MASK) {
+                // Also settles an earlier 0x78, which left the ECU in flight
+                ecu->in_flight = 0;
+                result = handle_dtc_list(ecu, out, payload, length);
+            } else if (length >= 3 && payload[0] == UDS_NEGATIVE_RESPONSE &&
+                       payload[2] == UDS_NRC_RESPONSE_PENDING) {
+                // The final answer arrives physically addressed; treat it as in flight
+                memcpy(ecu->request, req, sizeof(req));
+                ecu->request_length = sizeof(req);
+                ecu->needs_list = 0;
+                ecu->in_flight = 1;
+                ecu->deadline = uds_now_ms() + UDS_DEFAULT_P2_STAR_MS;
+            }
+            // Any other answer leaves needs_list set so the ECU is retried physically
+        }
+        if (result != STATUS_NOERROR) {
+            break;
+        }
+    }
+
+    free(msgs);
+    return result;
+}
+
+static long run_follow_ups(J2534_LIBRARY* lib, unsigned long channel_id,
+                           const DTC_SWEEP_CONFIG* config, SWEEP_ECU* ecus,
+                           unsigned int ecu_count, SWEEP_OUTPUT* out) {
+    SWEEP_LOAD load = {0, 0};
+    unsigned int in_flight = 0;
+    for (unsigned int i = 0; i < ecu_count; i++) {
+        in_flight += ecus[i].in_flight ? 1 : 0;
+    }
+
+    PASSTHRU_MSG* msgs = static_cast<PASSTHRU_MSG*>(malloc(SWEEP_READ_BATCH * sizeof(PASSTHRU_MSG)));
+    if (msgs == nullptr) {
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+
+    long result = STATUS_NOERROR;
+    for (;;) {
+        unsigned int limit = max_in_flight(config, &load);
+        for (unsigned int i = 0; i < ecu_count && in_flight < limit; i++) {
+            SWEEP_ECU* ecu = &ecus[i];
+            if (!ecu->responded || ecu->in_flight || !next_request(config, ecu)) {
+                continue;
+            }
+            result = uds_send(lib, channel_id, ecu->tx_id, config->tx_flags,
+                              ecu->request, ecu->request_length);
+            if (result != STATUS_NOERROR) {
+                break;
+            }
+            ecu->in_flight = 1;
+            ecu->deadline = uds_now_ms() + UDS_DEFAULT_P2_MS;
+            in_flight++;
+        }
+        if (result != STATUS_NOERROR || in_flight == 0) {
+            break;
+        }
+
+        unsigned long num_msgs = SWEEP_READ_BATCH;
+        long status = lib->PassThruReadMsgs(channel_id, msgs, &num_msgs, SWEEP_POLL_MS);
+        if (status != STATUS_NOERROR && status != ERR_BUFFER_EMPTY && status != ERR_TIMEOUT) {
+            result = status;
+            break;
+        }
+
+        for (unsigned long m = 0; m < num_msgs; m++) {
+            if (!uds_is_rx_payload(&msgs[m])) {
+                continue;
+            }
+            SWEEP_ECU* ecu = find_ecu(ecus, ecu_count, uds_message_can_id(&msgs[m]));
+            if (ecu == nullptr || !ecu->in_flight) {
+                continue;
+            }
+
+            const unsigned char* payload = msgs[m].Data + UDS_CAN_ID_SIZE;
+            unsigned long length = msgs[m].DataSize - UDS_CAN_ID_SIZE;
+            if (length < 2) {
+                continue;
+            }
+
+            if (payload[0] == UDS_NEGATIVE_RESPONSE) {
+                if (length >= 3 && payload[2] == UDS_NRC_RESPONSE_PENDING) {
+                    ecu->deadline = uds_now_ms() + UDS_DEFAULT_P2_STAR_MS;
+                    continue;
+                }
+                ecu->needs_list = 0;
+            } else if (payload[0] == UDS_SID_READ_DTC_INFORMATION + UDS_POSITIVE_RESPONSE_OFFSET &&
+                       payload[1] == ecu->request[1]) {
+                if (payload[1] == DTC_REPORT_BY_STATUS_MASK) {
+                    result = handle_dtc_list(ecu, out, payload, length);
+                } else {
+                    handle_dtc_records(ecu, out, payload, length);
+                }
+            } else {
+                continue;
+            }
+
+            load.frames += response_frames(length);
+            load.responses++;
+            ecu->in_flight = 0;
+            in_flight--;
+        }
+        if (result != STATUS_NOERROR) {
+            break;
+        }
+
+        unsigned long long now = uds_now_ms();
+        for (unsigned int i = 0; i < ecu_count; i++) {
+            if (ecus[i].in_flight && now >= ecus[i].deadline) {
+                LOGE("DTC sweep: ECU 0x%lX timed out on 0x19 %02X",
+                     ecus[i].rx_id, ecus[i].request[1]);
+                ecus[i].needs_list = 0;
+                ecus[i].in_flight = 0;
+                in_flight--;
+            }
+        }
+    }
+
+    free(msgs);
+    return result;
+}
+
+long dtc_sweep_run(J2534_LIBRARY* lib, unsigned long channel_id, const DTC_SWEEP_CONFIG* config,
+                   unsigned char* out, unsigned long out_capacity, unsigned long* out_length) {
+    static const unsigned long obd_responders[] = {
+        0x7E8, 0x7E9, 0x7EA, 0x7EB, 0x7EC, 0x7ED, 0x7EE, 0x7EF
+    };
+
+    if (config == nullptr || out == nullptr || out_length == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (lib == nullptr || lib->PassThruReadMsgs == nullptr || lib->PassThruWriteMsgs == nullptr ||
+        lib->PassThruStartMsgFilter == nullptr || lib->PassThruStopMsgFilter == nullptr) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+    if (out_capacity < DTC_SWEEP_HEADER_SIZE) {
+        return ERR_BUFFER_OVERFLOW;
+    }
+
+    const unsigned long* responders = config->responders;
+    unsigned int responder_count = config->responder_count;
+    if (responders == nullptr || responder_count == 0) {
+        if (config->tx_flags & CAN_29BIT_ID) {
+            return ERR_NULL_PARAMETER; // 29-bit responders cannot be enumerated
+        }
+        responders = obd_responders;
+        responder_count = sizeof(obd_responders) / sizeof(obd_responders[0]);
+    }
+    if (responder_count > DTC_SWEEP_MAX_ECUS) {
+        responder_count = DTC_SWEEP_MAX_ECUS;
+    }
+
+    SWEEP_ECU ecus[DTC_SWEEP_MAX_ECUS];
+    memset(ecus, 0, sizeof(ecus));
+
+    long result = STATUS_NOERROR;
+    for (unsigned int i = 0; i < responder_count; i++) {
+        ecus[i].rx_id = responders[i];
+        ecus[i].tx_id = uds_physical_tx_id(responders[i]);
+        ecus[i].needs_list = 1;
+        result = uds_start_flow_control(lib, channel_id, ecus[i].tx_id, ecus[i].rx_id,
+                                        config->tx_flags, &ecus[i].filter_id);
+        if (result != STATUS_NOERROR) {
+            LOGE("DTC sweep: flow control filter for 0x%lX failed: %ld", ecus[i].rx_id, result);
+            break;
+        }
+        ecus[i].filter_active = 1;
+    }
+
+    SWEEP_OUTPUT output;
+    output.data = out;
+    output.capacity = out_capacity;
+    output.length = DTC_SWEEP_HEADER_SIZE;
+    output.record_count = 0;
+    output.flags = 0;
+
+    if (result == STATUS_NOERROR) {
+        result = collect_functional(lib, channel_id, config, ecus, responder_count, &output);
+    }
+    if (result == STATUS_NOERROR) {
+        result = run_follow_ups(lib, channel_id, config, ecus, responder_count, &output);
+    }
+
+    unsigned int responded = 0;
+    for (unsigned int i = 0; i < responder_count; i++) {
+        if (ecus[i].filter_active) {
+            lib->PassThruStopMsgFilter(channel_id, ecus[i].filter_id);
+        }
+        responded += ecus[i].responded ? 1 : 0;
+        free(ecus[i].dtcs);
+        free(ecus[i].statuses);
+    }
+
+    put_le32(out, output.record_count);
+    put_le16(out + 4, responded);
+    put_le16(out + 6, output.flags);
+    *out_length = output.length;
+
+    LOGI("DTC sweep: %u responders, %lu records, %lu bytes%s", responded, output.record_count,
+         output.length, (output.flags & DTC_SWEEP_TRUNCATED) ? " (truncated)" : "");
+    return result;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeDtcSweep
+ * Signature: (IIIIII[ILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeDtcSweep
+  (JNIEnv *env, jobject obj, jint channel_id, jint flags, jint status_mask, jint options,
+   jint window_ms, jint baudrate, jintArray responders, jobject result_buffer) {
+
+    if (result_buffer == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    unsigned char* out = static_cast<unsigned char*>(env->GetDirectBufferAddress(result_buffer));
+    jlong capacity = env->GetDirectBufferCapacity(result_buffer);
+    if (out == nullptr || capacity <= 0) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    unsigned long ids[DTC_SWEEP_MAX_ECUS];
+    unsigned int id_count = 0;
+    if (responders != nullptr) {
+        jint values[DTC_SWEEP_MAX_ECUS];
+        jsize length = env->GetArrayLength(responders);
+        if (length > DTC_SWEEP_MAX_ECUS) {
+            length = DTC_SWEEP_MAX_ECUS;
+        }
+        env->GetIntArrayRegion(responders, 0, length, values);
+        for (jsize i = 0; i < length; i++) {
+            ids[id_count++] = static_cast<unsigned long>(static_cast<unsigned int>(values[i]));
+        }
+    }
+
+    DTC_SWEEP_CONFIG config;
+    config.functional_id = (flags & CAN_29BIT_ID) ? 0x18DB33F1UL : 0x7DFUL;
+    config.tx_flags = static_cast<unsigned long>(flags) | ISO15765_FRAME_PAD;
+    config.baudrate = static_cast<unsigned long>(baudrate);
+    config.window_ms = static_cast<unsigned long>(window_ms);
+    config.status_mask = static_cast<unsigned char>(status_mask);
+    config.options = static_cast<unsigned int>(options);
+    config.responders = id_count ? ids : nullptr;
+    config.responder_count = id_count;
+
+    unsigned long length = 0;
+    long result = dtc_sweep_run(g_j2534_lib, static_cast<unsigned long>(channel_id), &config,
+                                out, static_cast<unsigned long>(capacity), &length);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return static_cast<jint>(length);
+    } else {
+        return -1;
+    }
+}
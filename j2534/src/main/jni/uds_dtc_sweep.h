@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef UDS_DTC_SWEEP_H
+#define UDS_DTC_SWEEP_H
+
+#include <jni.h>
+#include "uds_client.h"
+
+#define DTC_SWEEP_MAX_ECUS 16
+
+// Sweep options
+#define DTC_SWEEP_SNAPSHOTS 0x01  // follow up every DTC with 0x19 04
+#define DTC_SWEEP_EXTENDED 0x02   // follow up every DTC with 0x19 06
+
+// Record kinds in the packed result buffer
+#define DTC_RECORD_STATUS 0
+#define DTC_RECORD_SNAPSHOT 1
+#define DTC_RECORD_EXTENDED 2
+
+// Result header flags
+#define DTC_SWEEP_TRUNCATED 0x0001
+
+/*
+ * Packed result layout (little endian, records 4-byte aligned):
+ *   header: u32 record_count, u16 responder_count, u16 flags
+ *   record: u32 ecu_id, u32 dtc, u8 status, u8 kind, u16 length, payload[length], pad
+ */
+#define DTC_SWEEP_HEADER_SIZE 8
+#define DTC_SWEEP_RECORD_HEADER_SIZE 12
+
+typedef struct {
+    unsigned long functional_id;
+    unsigned long tx_flags;
+    unsigned long baudrate;
+    unsigned long window_ms;
+    unsigned char status_mask;
+    unsigned int options;
+    const unsigned long* responders;  // candidate response IDs; null for OBD defaults
+    unsigned int responder_count;
+} DTC_SWEEP_CONFIG;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+long dtc_sweep_run(J2534_LIBRARY* lib, unsigned long channel_id, const DTC_SWEEP_CONFIG* config,
+                   unsigned char* out, unsigned long out_capacity, unsigned long* out_length);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeDtcSweep
+ * Signature: (IIIIII[ILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeDtcSweep
+  (JNIEnv *, jobject, jint, jint, jint, jint, jint, jint, jintArray, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UDS_DTC_SWEEP_H
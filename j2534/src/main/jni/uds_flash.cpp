@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "uds_flash.h"
+#include "checksum.h"
+#include "flash_compress.h"
+#include "j2534_jni.h"
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+void flash_set_phase(FLASH_SESSION* session, unsigned int phase) {
+    if (session->progress != nullptr) {
+        __atomic_store_n(&session->progress->phase, phase, __ATOMIC_RELEASE);
+    }
+}
+
+static int cancel_requested(const FLASH_SESSION* session) {
+    return session->progress != nullptr &&
+           __atomic_load_n(&session->progress->cancel, __ATOMIC_ACQUIRE) != 0;
+}
+
+static void put_be(unsigned char* dst, unsigned long value, unsigned int bytes) {
+    for (unsigned int i = 0; i < bytes; i++) {
+        dst[i] = static_cast<unsigned char>(value >> (8 * (bytes - 1 - i)));
+    }
+}
+
+long flash_check_response(FLASH_SESSION* session, unsigned char sid, const unsigned char* resp,
+                          unsigned long resp_len) {
+    if (resp_len >= 3 && resp[0] == UDS_NEGATIVE_RESPONSE) {
+        session->last_nrc = resp[2];
+        if (session->progress != nullptr) {
+            session->progress->nrc = resp[2];
+        }
+        LOGE("Service 0x%02X rejected by ECU 0x%lX, NRC 0x%02X", sid, session->link.rx_id, resp[2]);
+        return ERR_FAILED;
+    }
+    if (resp_len == 0 || resp[0] != sid + UDS_POSITIVE_RESPONSE_OFFSET) {
+        return ERR_INVALID_MSG;
+    }
+    return STATUS_NOERROR;
+}
+
+void flash_session_init(FLASH_SESSION* session, const UDS_LINK* link, unsigned char address_format,
+                        FLASH_PROGRESS* progress) {
+    memset(session, 0, sizeof(FLASH_SESSION));
+    session->link = *link;
+    session->address_format = address_format != 0 ? address_format : FLASH_DEFAULT_ADDRESS_FORMAT;
+    session->progress = progress;
+}
+
+long flash_image_map(FLASH_IMAGE* image, int fd, long long offset, unsigned long size) {
+    memset(image, 0, sizeof(FLASH_IMAGE));
+    if (fd < 0 || offset < 0 || size == 0) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    // mmap offsets must be page aligned
+    long long page_size = sysconf(_SC_PAGESIZE);
+    long long map_offset = offset & ~(page_size - 1);
+    unsigned long lead = static_cast<unsigned long>(offset - map_offset);
+    void* mapping = mmap(nullptr, lead + size, PROT_READ, MAP_PRIVATE, fd,
+                         static_cast<off_t>(map_offset));
+    if (mapping == MAP_FAILED) {
+        LOGE("Failed to map flash image: fd %d offset %lld", fd, offset);
+        return ERR_FAILED;
+    }
+    // The advice values are not flags; each needs its own call
+    madvise(mapping, lead + size, MADV_SEQUENTIAL);
+    madvise(mapping, lead + size, MADV_WILLNEED);
+
+    image->mapping = mapping;
+    image->map_length = lead + size;
+    image->data = static_cast<const unsigned char*>(mapping) + lead;
+    image->size = size;
+    return STATUS_NOERROR;
+}
+
+void flash_image_unmap(FLASH_IMAGE* image) {
+    if (image->mapping != nullptr) {
+        munmap(image->mapping, image->map_length);
+        image->mapping = nullptr;
+    }
+}
+
+unsigned long flash_encode_region(const FLASH_SESSION* session, unsigned char* dst,
+                                  unsigned long address, unsigned long size) {
+    unsigned int address_bytes = session->address_format & 0x0F;
+    unsigned int size_bytes = session->address_format >> 4;
+    if (address_bytes == 0 || address_bytes > 4 || size_bytes == 0 || size_bytes > 4) {
+        return 0;
+    }
+    dst[0] = session->address_format;
+    put_be(dst + 1, address, address_bytes);
+    put_be(dst + 1 + address_bytes, size, size_bytes);
+    return 1 + address_bytes + size_bytes;
+}
+
+long flash_routine_start(FLASH_SESSION* session, unsigned short routine_id,
+                         const unsigned char* params, unsigned long params_len,
+                         unsigned char* resp, unsigned long* resp_len) {
+    unsigned char req[64];
+    if (params_len > sizeof(req) - 4) {
+        return ERR_INVALID_MSG;
+    }
+    req[0] = UDS_SID_ROUTINE_CONTROL;
+    req[1] = ROUTINE_START;
+    req[2] = static_cast<unsigned char>(routine_id >> 8);
+    req[3] = static_cast<unsigned char>(routine_id & 0xFF);
+    if (params_len > 0) {
+        memcpy(req + 4, params, params_len);
+    }
+
+    long result = uds_transact(&session->link, req, 4 + params_len, resp, resp_len);
+    if (result == STATUS_NOERROR) {
+        result = flash_check_response(session, UDS_SID_ROUTINE_CONTROL, resp, *resp_len);
+    }
+    if (result == STATUS_NOERROR &&
+        (*resp_len < 4 || resp[2] != req[2] || resp[3] != req[3])) {
+        result = ERR_INVALID_MSG;
+    }
+    return result;
+}
+
+long flash_request_download(FLASH_SESSION* session, unsigned long address, unsigned long size,
+                            unsigned char data_format) {
+    unsigned char req[11];
+    unsigned long len = 0;
+    req[len++] = UDS_SID_REQUEST_DOWNLOAD;
+    req[len++] = data_format;
+    unsigned long region_len = flash_encode_region(session, req + len, address, size);
+    if (region_len == 0) {
+        return ERR_INVALID_MSG;
+    }
+    len += region_len;
+
+    flash_set_phase(session, FLASH_PHASE_REQUEST);
+
+    unsigned char resp[16];
+    unsigned long resp_len = sizeof(resp);
+    long result = uds_transact(&session->link, req, len, resp, &resp_len);
+    if (result == STATUS_NOERROR) {
+        result = flash_check_response(session, UDS_SID_REQUEST_DOWNLOAD, resp, resp_len);
+    }
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+
+    // 74 LFID maxNumberOfBlockLength[LFID >> 4]
+    unsigned int length_bytes = resp_len >= 2 ? resp[1] >> 4 : 0;
+    if (length_bytes == 0 || length_bytes > sizeof(unsigned long) || resp_len < 2 + length_bytes) {
+        return ERR_INVALID_MSG;
+    }
+    unsigned long block_length = 0;
+    for (unsigned int i = 0; i < length_bytes; i++) {
+        block_length = (block_length << 8) | resp[2 + i];
+    }
+    if (block_length > ISOTP_MAX_MESSAGE) {
+        block_length = ISOTP_MAX_MESSAGE;
+    }
+    if (block_length < 3) {
+        return ERR_INVALID_MSG;
+    }
+
+    session->max_block_length = block_length;
+    session->block_counter = 1;
+    if (session->progress != nullptr) {
+        session->progress->block_length = static_cast<unsigned int>(block_length);
+    }
+    return STATUS_NOERROR;
+}
+
+long flash_send_block(FLASH_SESSION* session, unsigned char* req, unsigned long length) {
+    if (cancel_requested(session)) {
+        return ERR_FAILED;
+    }
+
+    UDS_LINK link = session->link;
+    link.p2_ms = FLASH_TRANSFER_P2_MS;
+    req[0] = UDS_SID_TRANSFER_DATA;
+    req[1] = session->block_counter;
+
+    // A repeated block with the same counter is acknowledged without being rewritten.
+    // Some bootloaders answer the repeat with NRC 0x73 instead: the first copy was
+    // written and only its response was lost, so the block counts as accepted.
+    unsigned char resp[16];
+    long result = ERR_TIMEOUT;
+    for (int attempt = 0; attempt <= FLASH_BLOCK_RETRIES && result == ERR_TIMEOUT; attempt++) {
+        unsigned long resp_len = sizeof(resp);
+        result = uds_transact(&link, req, length + 2, resp, &resp_len);
+        if (result == STATUS_NOERROR && attempt > 0 && resp_len >= 3 &&
+            resp[0] == UDS_NEGATIVE_RESPONSE && resp[2] == UDS_NRC_WRONG_BLOCK_SEQUENCE_COUNTER) {
+            LOGI("TransferData block 0x%02X already accepted before the retry", session->block_counter);
+            break;
+        }
+        if (result == STATUS_NOERROR) {
+            result = flash_check_response(session, UDS_SID_TRANSFER_DATA, resp, resp_len);
+        }
+        if (result == STATUS_NOERROR && (resp_len < 2 || resp[1] != session->block_counter)) {
+            result = ERR_INVALID_MSG;
+        }
+    }
+    if (result != STATUS_NOERROR) {
+        LOGE("TransferData block 0x%02X failed: %ld", session->block_counter, result);
+        return result;
+    }
+
+    session->block_counter++;
+    return STATUS_NOERROR;
+}
+
+long flash_transfer_data(FLASH_SESSION* session, const unsigned char* data, unsigned long size) {
+    if (session->max_block_length == 0) {
+        return ERR_INVALID_DEVICE_STATE;
+    }
+
+    flash_set_phase(session, FLASH_PHASE_TRANSFER);
+
+    unsigned long chunk = session->max_block_length - 2;
+    unsigned char req[ISOTP_MAX_MESSAGE];
+    unsigned long offset = 0;
+
+    while (offset < size) {
+        unsigned long length = size - offset < chunk ? size - offset : chunk;
+        memcpy(req + 2, data + offset, length);
+
+        long result = flash_send_block(session, req, length);
+        if (result != STATUS_NOERROR) {
+            return result;
+        }
+
+        offset += length;
+        if (session->progress != nullptr) {
+            __atomic_add_fetch(&session->progress->bytes_done, length, __ATOMIC_RELEASE);
+        }
+    }
+    return STATUS_NOERROR;
+}
+
+long flash_transfer_exit(FLASH_SESSION* session) {
+    flash_set_phase(session, FLASH_PHASE_EXIT);
+
+    unsigned char req[1] = { UDS_SID_REQUEST_TRANSFER_EXIT };
+    unsigned char resp[64];
+    unsigned long resp_len = sizeof(resp);
+    long result = uds_transact(&session->link, req, sizeof(req), resp, &resp_len);
+    if (result == STATUS_NOERROR) {
+        result = flash_check_response(session, UDS_SID_REQUEST_TRANSFER_EXIT, resp, resp_len);
+    }
+    session->max_block_length = 0;
+    return result;
+}
+
+long flash_download_region(FLASH_SESSION* session, unsigned long address, const unsigned char* data,
+                           unsigned long size, unsigned char data_format) {
+    // An ECU compression profile overrides the caller's dataFormatIdentifier
+    int codec = FLASH_CODEC_NONE;
+    unsigned char profile_format = 0;
+    unsigned int frame_size = 0;
+    if (flash_profile_get(session->link.rx_id, &codec, &profile_format, &frame_size)) {
+        data_format = profile_format;
+    }
+
+    long result = flash_request_download(session, address, size, data_format);
+    if (result == STATUS_NOERROR) {
+        result = codec != FLASH_CODEC_NONE
+            ? flash_transfer_compressed(session, codec, frame_size, data, size)
+            : flash_transfer_data(session, data, size);
+    }
+    if (result == STATUS_NOERROR) {
+        result = flash_transfer_exit(session);
+    }
+    return result;
+}
+
+long flash_download(FLASH_SESSION* session, unsigned long address, const unsigned char* data,
+                    unsigned long size, unsigned char data_format) {
+    long result = flash_download_region(session, address, data, size, data_format);
+    flash_set_phase(session, result == STATUS_NOERROR ? FLASH_PHASE_DONE : FLASH_PHASE_FAILED);
+    return result;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFlashDownload
+ * Signature: (IIIIJJJIILjava/nio/ByteBuffer;)I
+ *
+ * Blocks until the region is programmed; call from a worker thread. fd stays
+ * owned by the caller (ParcelFileDescriptor), the image is mapped read-only.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFlashDownload
+  (JNIEnv *env, jobject obj, jint channel_id, jint flags, jint ecu_rx_id, jint fd,
+   jlong file_offset, jlong length, jlong memory_address, jint address_format,
+   jint data_format, jobject progress_buffer) {
+
+    if (g_j2534_lib == nullptr) {
+        g_last_error = ERR_DEVICE_NOT_CONNECTED;
+        return -1;
+    }
+
+    FLASH_PROGRESS* progress = nullptr;
+    if (progress_buffer != nullptr) {
+        progress = static_cast<FLASH_PROGRESS*>(env->GetDirectBufferAddress(progress_buffer));
+        if (progress == nullptr ||
+            env->GetDirectBufferCapacity(progress_buffer) < static_cast<jlong>(sizeof(FLASH_PROGRESS))) {
+            g_last_error = ERR_NULL_PARAMETER;
+            return -1;
+        }
+        progress->bytes_done = 0;
+        progress->bytes_total = static_cast<unsigned long long>(length);
+        progress->nrc = 0;
+        progress->cancel = 0;
+        progress->phase = FLASH_PHASE_IDLE;
+    }
+
+    FLASH_IMAGE image;
+    long result = flash_image_map(&image, fd, static_cast<long long>(file_offset),
+                                  static_cast<unsigned long>(length));
+    if (result != STATUS_NOERROR) {
+        g_last_error = result;
+        return -1;
+    }
+
+    UDS_LINK link;
+    unsigned long rx_id = static_cast<unsigned long>(ecu_rx_id);
+    unsigned long tx_flags = static_cast<unsigned long>(flags) | ISO15765_FRAME_PAD;
+    uds_link_init(&link, g_j2534_lib, static_cast<unsigned long>(channel_id),
+                  uds_physical_tx_id(rx_id), rx_id, tx_flags);
+
+    FLASH_SESSION session;
+    flash_session_init(&session, &link, static_cast<unsigned char>(address_format), progress);
+    if (progress != nullptr) {
+        progress->image_crc32 = crc32_update(0, image.data, image.size);
+    }
+
+    unsigned long filter_id = 0;
+    result = uds_start_flow_control(g_j2534_lib, link.channel_id, link.tx_id, rx_id,
+                                    tx_flags, &filter_id);
+    if (result == STATUS_NOERROR) {
+        result = flash_download(&session, static_cast<unsigned long>(memory_address),
+                                image.data, image.size, static_cast<unsigned char>(data_format));
+        g_j2534_lib->PassThruStopMsgFilter(link.channel_id, filter_id);
+    }
+    flash_image_unmap(&image);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        LOGI("Downloaded %lld bytes to 0x%llX", static_cast<long long>(length),
+             static_cast<unsigned long long>(memory_address));
+        return 0;
+    } else {
+        return -1;
+    }
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef UDS_FLASH_H
+#define UDS_FLASH_H
+
+#include <jni.h>
+#include "uds_client.h"
+
+#define UDS_SID_ROUTINE_CONTROL 0x31
+#define UDS_SID_REQUEST_DOWNLOAD 0x34
+#define UDS_SID_TRANSFER_DATA 0x36
+#define UDS_SID_REQUEST_TRANSFER_EXIT 0x37
+
+#define UDS_NRC_WRONG_BLOCK_SEQUENCE_COUNTER 0x73
+
+#define ROUTINE_START 0x01
+
+// addressAndLengthFormatIdentifier: 4-byte memorySize, 4-byte memoryAddress
+#define FLASH_DEFAULT_ADDRESS_FORMAT 0x44
+
+// A TransferData block is queued behind its own multi-frame transmission
+#define FLASH_TRANSFER_P2_MS 2000
+#define FLASH_BLOCK_RETRIES 2
+
+// Progress phases
+#define FLASH_PHASE_IDLE 0
+#define FLASH_PHASE_REQUEST 1
+#define FLASH_PHASE_TRANSFER 2
+#define FLASH_PHASE_EXIT 3
+#define FLASH_PHASE_DONE 4
+#define FLASH_PHASE_FAILED 5
+
+/*
+ * Progress counter shared with Java through a direct ByteBuffer (native byte order).
+ * Native code publishes bytes_done after every acknowledged block; Java may set
+ * cancel to a non-zero value to abort before the next block.
+ */
+typedef struct {
+    unsigned long long bytes_done;
+    unsigned long long bytes_total;
+    unsigned int phase;
+    unsigned int nrc;
+    unsigned int cancel;
+    unsigned int block_length;
+    unsigned int image_crc32;  // CRC32 of the mapped image, for post-flash verification
+    unsigned int reserved;
+} FLASH_PROGRESS;
+
+typedef struct {
+    UDS_LINK link;
+    unsigned char address_format;
+    unsigned long max_block_length;  // negotiated 0x36 message length, SID and counter included
+    unsigned char block_counter;
+    FLASH_PROGRESS* progress;        // may be null
+    unsigned char last_nrc;
+} FLASH_SESSION;
+
+// Read-only mapping of an image region passed in as a file descriptor
+typedef struct {
+    void* mapping;
+    unsigned long map_length;
+    const unsigned char* data;
+    unsigned long size;
+} FLASH_IMAGE;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void flash_session_init(FLASH_SESSION* session, const UDS_LINK* link, unsigned char address_format,
+                        FLASH_PROGRESS* progress);
+
+long flash_image_map(FLASH_IMAGE* image, int fd, long long offset, unsigned long size);
+void flash_image_unmap(FLASH_IMAGE* image);
+
+// STATUS_NOERROR for the positive response to sid, ERR_FAILED (NRC recorded) otherwise
+long flash_check_response(FLASH_SESSION* session, unsigned char sid, const unsigned char* resp,
+                          unsigned long resp_len);
+
+// 0x31 01: starts a routine; resp receives the positive response including routineInfo
+long flash_routine_start(FLASH_SESSION* session, unsigned short routine_id,
+                         const unsigned char* params, unsigned long params_len,
+                         unsigned char* resp, unsigned long* resp_len);
+
+// Encodes address and size per the session's addressAndLengthFormatIdentifier
+unsigned long flash_encode_region(const FLASH_SESSION* session, unsigned char* dst,
+                                  unsigned long address, unsigned long size);
+
+// 0x34: announces the region and negotiates maxNumberOfBlockLength
+long flash_request_download(FLASH_SESSION* session, unsigned long address, unsigned long size,
+                            unsigned char data_format);
+
+void flash_set_phase(FLASH_SESSION* session, unsigned int phase);
+
+// Sends req[2..2+length) as the next 0x36 block; req[0..1] are filled in here
+long flash_send_block(FLASH_SESSION* session, unsigned char* req, unsigned long length);
+
+// 0x36: streams data in blocks of the negotiated length
+long flash_transfer_data(FLASH_SESSION* session, const unsigned char* data, unsigned long size);
+
+// 0x37
+long flash_transfer_exit(FLASH_SESSION* session);
+
+// RequestDownload, TransferData and RequestTransferExit for one region of a larger job
+long flash_download_region(FLASH_SESSION* session, unsigned long address, const unsigned char* data,
+                           unsigned long size, unsigned char data_format);
+
+// flash_download_region for a single-region job; ends in FLASH_PHASE_DONE or FAILED
+long flash_download(FLASH_SESSION* session, unsigned long address, const unsigned char* data,
+                    unsigned long size, unsigned char data_format);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFlashDownload
+ * Signature: (IIIIJJJIILjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFlashDownload
+  (JNIEnv *, jobject, jint, jint, jint, jint, jlong, jlong, jlong, jint, jint, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UDS_FLASH_H
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "uds_flash_delta.h"
+#include "uds_memory_dump.h"
+#include "checksum.h"
+#include "j2534_jni.h"
+#include <stdlib.h>
+#include <string.h>
+
+static long compare_by_routine(FLASH_SESSION* session, const DELTA_CONFIG* config,
+                               unsigned long block, unsigned long address,
+                               const unsigned char* data, unsigned long length, int* differs) {
+    unsigned char params[9];
+    unsigned long params_len = flash_encode_region(session, params, address, length);
+    if (params_len == 0) {
+        return ERR_INVALID_MSG;
+    }
+
+    unsigned char resp[8 + DELTA_MAX_CHECKSUM_LENGTH];
+    unsigned long resp_len = sizeof(resp);
+    long result = flash_routine_start(session, config->checksum_routine_id, params, params_len,
+                                      resp, &resp_len);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+
+    // 71 01 RID checksum...
+    if (resp_len < 4 + config->checksum_length) {
+        return ERR_INVALID_MSG;
+    }
+    if (config->expected != nullptr) {
+        *differs = memcmp(resp + 4, config->expected + block * config->checksum_length,
+                          config->checksum_length) != 0;
+    } else {
+        unsigned int crc = crc32_update(0, data, length);
+        unsigned char expected[4] = { static_cast<unsigned char>(crc >> 24),
+                                      static_cast<unsigned char>(crc >> 16),
+                                      static_cast<unsigned char>(crc >> 8),
+                                      static_cast<unsigned char>(crc) };
+        *differs = memcmp(resp + 4, expected, sizeof(expected)) != 0;
+    }
+    return STATUS_NOERROR;
+}
+
+// *read_size carries the largest length the ECU accepted over to the next block
+static long compare_by_readback(FLASH_SESSION* session, unsigned long address,
+                                const unsigned char* data, unsigned long length,
+                                unsigned long* read_size, int* differs) {
+    unsigned char resp[ISOTP_MAX_MESSAGE];
+
+    *differs = 0;
+    for (unsigned long offset = 0; offset < length && !*differs;) {
+        unsigned long chunk = length - offset < *read_size ? length - offset : *read_size;
+        unsigned long requested = chunk;
+        unsigned long resp_len = 0;
+        long result = memory_read(session, address + offset, &chunk, resp, &resp_len);
+        if (result != STATUS_NOERROR) {
+            return result;
+        }
+        if (chunk < requested) {
+            *read_size = chunk;
+        }
+        *differs = memcmp(resp + 1, data + offset, chunk) != 0;
+        offset += chunk;
+    }
+    return STATUS_NOERROR;
+}
+
+long delta_find_changed(FLASH_SESSION* session, const DELTA_CONFIG* config, unsigned long address,
+                        const unsigned char* image, unsigned long size, unsigned char* changed,
+                        unsigned int* changed_count) {
+    if (config->block_size == 0 || changed == nullptr || changed_count == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (config->method == DELTA_COMPARE_ROUTINE &&
+        (config->checksum_length == 0 || config->checksum_length > DELTA_MAX_CHECKSUM_LENGTH ||
+         (config->expected == nullptr && config->checksum_length != 4))) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    unsigned long block_count = (size + config->block_size - 1) / config->block_size;
+    unsigned long read_size = config->read_size > 0 && config->read_size < DUMP_MAX_REQUEST
+        ? config->read_size : DUMP_MAX_REQUEST;
+    int comparable = 1;
+    *changed_count = 0;
+
+    for (unsigned long block = 0; block < block_count; block++) {
+        unsigned long offset = block * config->block_size;
+        unsigned long length = size - offset < config->block_size ? size - offset : config->block_size;
+        int differs = 1;
+
+        if (comparable) {
+            long result = config->method == DELTA_COMPARE_READBACK
+                ? compare_by_readback(session, address + offset, image + offset, length,
+                                      &read_size, &differs)
+                : compare_by_routine(session, config, block, address + offset, image + offset,
+                                     length, &differs);
+            if (result != STATUS_NOERROR) {
+                // One failed comparison means the ECU cannot be trusted to compare the rest
+                LOGE("Delta compare failed at block %lu (%ld), flashing remaining blocks", block, result);
+                comparable = 0;
+                differs = 1;
+            }
+        }
+
+        changed[block] = static_cast<unsigned char>(differs);
+        *changed_count += differs;
+    }
+    return STATUS_NOERROR;
+}
+
+long delta_flash(FLASH_SESSION* session, const DELTA_CONFIG* config, unsigned long address,
+                 const unsigned char* image, unsigned long size, unsigned char data_format,
+                 unsigned int* blocks_written) {
+    unsigned long block_count = (size + config->block_size - 1) / config->block_size;
+    unsigned char* changed = static_cast<unsigned char*>(malloc(block_count > 0 ? block_count : 1));
+    if (changed == nullptr) {
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+
+    unsigned int changed_count = 0;
+    long result = delta_find_changed(session, config, address, image, size, changed, &changed_count);
+    *blocks_written = 0;
+
+    if (result == STATUS_NOERROR && session->progress != nullptr) {
+        unsigned long long total = 0;
+        for (unsigned long block = 0; block < block_count; block++) {
+            if (changed[block]) {
+                unsigned long offset = block * config->block_size;
+                total += size - offset < config->block_size ? size - offset : config->block_size;
+            }
+        }
+        session->progress->bytes_done = 0;
+        session->progress->bytes_total = total;
+    }
+
+    // Runs of adjacent changed blocks become one erase and one download
+    unsigned long block = 0;
+    while (result == STATUS_NOERROR && block < block_count) {
+        if (!changed[block]) {
+            block++;
+            continue;
+        }
+        unsigned long first = block;
+        while (block < block_count && changed[block]) {
+            block++;
+        }
+        unsigned long offset = first * config->block_size;
+        unsigned long end = block * config->block_size < size ? block * config->block_size : size;
+
+        if (config->erase_routine_id != 0) {
+            unsigned char params[9];
+            unsigned long params_len = flash_encode_region(session, params, address + offset,
+                                                           end - offset);
+            unsigned char resp[16];
+            unsigned long resp_len = sizeof(resp);
+            result = flash_routine_start(session, config->erase_routine_id, params, params_len,
+                                         resp, &resp_len);
+        }
+        if (result == STATUS_NOERROR) {
+            result = flash_download_region(session, address + offset, image + offset,
+                                           end - offset, data_format);
+        }
+        if (result == STATUS_NOERROR) {
+            *blocks_written += static_cast<unsigned int>(block - first);
+        }
+    }
+
+    // Reported once for the whole job; each range only moves through REQUEST..EXIT
+    flash_set_phase(session, result == STATUS_NOERROR ? FLASH_PHASE_DONE : FLASH_PHASE_FAILED);
+    free(changed);
+    LOGI("Delta flash: %u of %lu blocks changed, %u written", changed_count, block_count,
+         *blocks_written);
+    return result;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFlashDeltaDownload
+ * Signature: (IIIIJJJIIIIIIILjava/nio/ByteBuffer;Ljava/nio/ByteBuffer;)I
+ *
+ * Returns the number of blocks written. expectedChecksums holds one checksum
+ * per block for DELTA_COMPARE_ROUTINE; when null the routine is assumed to report
+ * a big-endian CRC32, computed here per block.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFlashDeltaDownload
+  (JNIEnv *env, jobject obj, jint channel_id, jint flags, jint ecu_rx_id, jint fd,
+   jlong file_offset, jlong length, jlong memory_address, jint address_format, jint data_format,
+   jint block_size, jint method, jint checksum_routine_id, jint erase_routine_id, jint read_size,
+   jobject expected_checksums, jobject progress_buffer) {
+
+    if (g_j2534_lib == nullptr) {
+        g_last_error = ERR_DEVICE_NOT_CONNECTED;
+        return -1;
+    }
+    if (block_size <= 0 || length <= 0) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    DELTA_CONFIG config;
+    memset(&config, 0, sizeof(config));
+    config.block_size = static_cast<unsigned long>(block_size);
+    config.method = method;
+    config.checksum_routine_id = static_cast<unsigned short>(checksum_routine_id);
+    config.erase_routine_id = static_cast<unsigned short>(erase_routine_id);
+    config.read_size = read_size > 0 ? static_cast<unsigned long>(read_size) : 0;
+    if (expected_checksums != nullptr) {
+        unsigned long block_count = (static_cast<unsigned long>(length) + config.block_size - 1) /
+                                    config.block_size;
+        config.expected = static_cast<const unsigned char*>(env->GetDirectBufferAddress(expected_checksums));
+        config.checksum_length = static_cast<unsigned int>(
+            static_cast<unsigned long>(env->GetDirectBufferCapacity(expected_checksums)) / block_count);
+    } else if (method == DELTA_COMPARE_ROUTINE) {
+        config.checksum_length = 4;
+    }
+
+    FLASH_PROGRESS* progress = nullptr;
+    if (progress_buffer != nullptr) {
+        progress = static_cast<FLASH_PROGRESS*>(env->GetDirectBufferAddress(progress_buffer));
+        if (progress == nullptr ||
+            env->GetDirectBufferCapacity(progress_buffer) < static_cast<jlong>(sizeof(FLASH_PROGRESS))) {
+            g_last_error = ERR_NULL_PARAMETER;
+            return -1;
+        }
+        progress->nrc = 0;
+    }
+
+    FLASH_IMAGE image;
+    long result = flash_image_map(&image, fd, static_cast<long long>(file_offset),
+                                  static_cast<unsigned long>(length));
+    if (result != STATUS_NOERROR) {
+        g_last_error = result;
+        return -1;
+    }
+
+    UDS_LINK link;
+    unsigned long rx_id = static_cast<unsigned long>(ecu_rx_id);
+    unsigned long tx_flags = static_cast<unsigned long>(flags) | ISO15765_FRAME_PAD;
+    uds_link_init(&link, g_j2534_lib, static_cast<unsigned long>(channel_id),
+                  uds_physical_tx_id(rx_id), rx_id, tx_flags);
+
+    FLASH_SESSION session;
+    flash_session_init(&session, &link, static_cast<unsigned char>(address_format), progress);
+
+    unsigned int blocks_written = 0;
+    unsigned long filter_id = 0;
+    result = uds_start_flow_control(g_j2534_lib, link.channel_id, link.tx_id, rx_id,
+                                    tx_flags, &filter_id);
+    if (result == STATUS_NOERROR) {
+        result = delta_flash(&session, &config, static_cast<unsigned long>(memory_address),
+                             image.data, image.size, static_cast<unsigned char>(data_format),
+                             &blocks_written);
+        g_j2534_lib->PassThruStopMsgFilter(link.channel_id, filter_id);
+    }
+    flash_image_unmap(&image);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return static_cast<jint>(blocks_written);
+    } else {
+        return -1;
+    }
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef UDS_FLASH_DELTA_H
+#define UDS_FLASH_DELTA_H
+
+#include <jni.h>
+#include "uds_flash.h"
+
+#define UDS_SID_READ_MEMORY_BY_ADDRESS 0x23
+
+// How the ECU's current content is compared against the new image
+#define DELTA_COMPARE_ROUTINE 0   // 0x31 checksum routine per block vs. precomputed checksums
+#define DELTA_COMPARE_READBACK 1  // 0x23 ReadMemoryByAddress vs. the image bytes
+
+#define DELTA_MAX_CHECKSUM_LENGTH 32
+
+typedef struct {
+    unsigned long block_size;
+    int method;
+    unsigned short checksum_routine_id;
+    unsigned short erase_routine_id;  // 0 when RequestDownload erases implicitly
+    const unsigned char* expected;    // checksum_length bytes per block (ROUTINE only);
+                                      // null with checksum_length 4 compares big-endian CRC32
+    unsigned int checksum_length;
+    unsigned long read_size;          // largest 0x23 read (READBACK only); 0 for one full
+                                      // ISO-TP response, shrunk further when the ECU refuses
+} DELTA_CONFIG;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Marks each block_size block whose ECU content differs from image in changed[].
+ * Blocks that cannot be compared are marked changed.
+ */
+long delta_find_changed(FLASH_SESSION* session, const DELTA_CONFIG* config, unsigned long address,
+                        const unsigned char* image, unsigned long size, unsigned char* changed,
+                        unsigned int* changed_count);
+
+// Erases and downloads only the runs of changed blocks
+long delta_flash(FLASH_SESSION* session, const DELTA_CONFIG* config, unsigned long address,
+                 const unsigned char* image, unsigned long size, unsigned char data_format,
+                 unsigned int* blocks_written);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeFlashDeltaDownload
+ * Signature: (IIIIJJJIIIIIIILjava/nio/ByteBuffer;Ljava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeFlashDeltaDownload
+  (JNIEnv *, jobject, jint, jint, jint, jint, jlong, jlong, jlong, jint, jint, jint, jint, jint,
+   jint, jint, jobject, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UDS_FLASH_DELTA_H
@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "uds_memory_dump.h"
+#include "uds_did_batch.h"
+#include "uds_flash_delta.h"
+#include "j2534_jni.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    unsigned char* data;
+    unsigned long length;
+    unsigned long file_offset;
+    int full;
+} DUMP_BUFFER;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    DUMP_BUFFER buffers[DUMP_BUFFER_COUNT];
+    unsigned int write_index;
+    int fd;
+    int done;
+    long error;
+} DUMP_WRITER;
+
+static long write_fully(int fd, const unsigned char* data, unsigned long length, unsigned long offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            LOGE("Dump write failed at %lu: %s", offset, strerror(errno));
+            return ERR_FAILED;
+        }
+        data += written;
+        length -= static_cast<unsigned long>(written);
+        offset += static_cast<unsigned long>(written);
+    }
+    return STATUS_NOERROR;
+}
+
+// O_DIRECT only takes whole blocks, so a short last buffer is zero padded and the file trimmed back
+static long write_buffer(int fd, DUMP_BUFFER* buffer) {
+    int flags = fcntl(fd, F_GETFL);
+    unsigned long tail = buffer->length % DUMP_BUFFER_ALIGNMENT;
+    if (flags < 0 || !(flags & O_DIRECT) || tail == 0) {
+        return write_fully(fd, buffer->data, buffer->length, buffer->file_offset);
+    }
+
+    unsigned long padded = buffer->length + DUMP_BUFFER_ALIGNMENT - tail;
+    memset(buffer->data + buffer->length, 0, padded - buffer->length);
+    long result = write_fully(fd, buffer->data, padded, buffer->file_offset);
+    if (result == STATUS_NOERROR &&
+        ftruncate(fd, static_cast<off_t>(buffer->file_offset + buffer->length)) != 0) {
+        LOGE("Dump truncate failed: %s", strerror(errno));
+        result = ERR_FAILED;
+    }
+    return result;
+}
+
+// Writes full buffers in order while the bus thread fills the other one
+static void* dump_writer_thread(void* arg) {
+    DUMP_WRITER* writer = static_cast<DUMP_WRITER*>(arg);
+
+    pthread_mutex_lock(&writer->mutex);
+    for (;;) {
+        DUMP_BUFFER* buffer = &writer->buffers[writer->write_index];
+        while (!buffer->full && !writer->done) {
+            pthread_cond_wait(&writer->changed, &writer->mutex);
+        }
+        if (!buffer->full) {
+            break;
+        }
+        pthread_mutex_unlock(&writer->mutex);
+
+        long result = write_buffer(writer->fd, buffer);
+
+        pthread_mutex_lock(&writer->mutex);
+        if (result != STATUS_NOERROR) {
+            writer->error = result;
+        }
+        buffer->full = 0;
+        writer->write_index = (writer->write_index + 1) % DUMP_BUFFER_COUNT;
+        pthread_cond_broadcast(&writer->changed);
+    }
+    pthread_mutex_unlock(&writer->mutex);
+    return nullptr;
+}
+
+/*
+ * Queues buffer for writing and waits until the next one is free; returns the
+ * writer error. The writer releases every buffer even after a failed write, so
+ * the caller never touches one it still owns.
+ */
+static long submit_buffer(DUMP_WRITER* writer, unsigned int index, DUMP_BUFFER** next) {
+    pthread_mutex_lock(&writer->mutex);
+    writer->buffers[index].full = 1;
+    pthread_cond_broadcast(&writer->changed);
+
+    DUMP_BUFFER* buffer = &writer->buffers[(index + 1) % DUMP_BUFFER_COUNT];
+    while (buffer->full) {
+        pthread_cond_wait(&writer->changed, &writer->mutex);
+    }
+    long error = writer->error;
+    pthread_mutex_unlock(&writer->mutex);
+
+    *next = buffer;
+    return error;
+}
+
+long memory_read(FLASH_SESSION* session, unsigned long address, unsigned long* request_size,
+                 unsigned char* resp, unsigned long* resp_len) {
+    for (;;) {
+        unsigned char req[10];
+        req[0] = UDS_SID_READ_MEMORY_BY_ADDRESS;
+        unsigned long region_len = flash_encode_region(session, req + 1, address, *request_size);
+        if (region_len == 0) {
+            return ERR_INVALID_MSG;
+        }
+
+        unsigned long length = ISOTP_MAX_MESSAGE;
+        long result = uds_transact(&session->link, req, 1 + region_len, resp, &length);
+        if (result != STATUS_NOERROR) {
+            return result;
+        }
+        if (length >= 3 && resp[0] == UDS_NEGATIVE_RESPONSE && *request_size > 1 &&
+            (resp[2] == UDS_NRC_REQUEST_OUT_OF_RANGE || resp[2] == UDS_NRC_INCORRECT_LENGTH ||
+             resp[2] == UDS_NRC_RESPONSE_TOO_LONG)) {
+            *request_size /= 2;
+            continue;
+        }
+
+        result = flash_check_response(session, UDS_SID_READ_MEMORY_BY_ADDRESS, resp, length);
+        if (result != STATUS_NOERROR) {
+            return result;
+        }
+        if (length != 1 + *request_size) {
+            return ERR_INVALID_MSG;
+        }
+        *resp_len = length;
+        return STATUS_NOERROR;
+    }
+}
+
+long memory_dump(FLASH_SESSION* session, unsigned long address, unsigned long size, int fd,
+                 unsigned long resume_offset, unsigned int max_request) {
+    if (fd < 0 || size == 0) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    unsigned long offset = resume_offset - resume_offset % DUMP_BUFFER_ALIGNMENT;
+    if (offset > size) {
+        offset = size - size % DUMP_BUFFER_ALIGNMENT;
+    }
+    unsigned long max_size = max_request > 0 && max_request < DUMP_MAX_REQUEST
+        ? max_request : DUMP_MAX_REQUEST;
+    unsigned long request_size = max_size;
+    unsigned int good_reads = 0;
+
+    DUMP_WRITER* writer = static_cast<DUMP_WRITER*>(calloc(1, sizeof(DUMP_WRITER)));
+    unsigned char* resp = static_cast<unsigned char*>(malloc(ISOTP_MAX_MESSAGE));
+    long result = writer != nullptr && resp != nullptr ? STATUS_NOERROR : ERR_INSUFFICIENT_MEMORY;
+    for (int i = 0; result == STATUS_NOERROR && i < DUMP_BUFFER_COUNT; i++) {
+        void* data = nullptr;
+        if (posix_memalign(&data, DUMP_BUFFER_ALIGNMENT, DUMP_BUFFER_SIZE) != 0) {
+            result = ERR_INSUFFICIENT_MEMORY;
+        }
+        writer->buffers[i].data = static_cast<unsigned char*>(data);
+    }
+    if (result != STATUS_NOERROR) {
+        if (writer != nullptr) {
+            for (int i = 0; i < DUMP_BUFFER_COUNT; i++) {
+                free(writer->buffers[i].data);
+            }
+        }
+        free(writer);
+        free(resp);
+        return result;
+    }
+
+    pthread_mutex_init(&writer->mutex, nullptr);
+    pthread_cond_init(&writer->changed, nullptr);
+    writer->fd = fd;
+
+    pthread_t thread;
+    int thread_started = pthread_create(&thread, nullptr, dump_writer_thread, writer) == 0;
+    if (!thread_started) {
+        result = ERR_FAILED;
+    }
+
+    if (session->progress != nullptr) {
+        session->progress->bytes_total = size;
+        session->progress->bytes_done = offset;
+    }
+    flash_set_phase(session, FLASH_PHASE_TRANSFER);
+
+    unsigned int index = 0;
+    DUMP_BUFFER* buffer = &writer->buffers[0];
+    buffer->length = 0;
+    buffer->file_offset = offset;
+
+    // The bus thread only copies into the current buffer, so requests run back to back
+    while (result == STATUS_NOERROR && offset < size) {
+        if (session->progress != nullptr &&
+            __atomic_load_n(&session->progress->cancel, __ATOMIC_ACQUIRE) != 0) {
+            result = ERR_FAILED;
+            break;
+        }
+
+        unsigned long wanted = size - offset < request_size ? size - offset : request_size;
+        unsigned long resp_len = 0;
+        result = memory_read(session, address + offset, &wanted, resp, &resp_len);
+        if (result != STATUS_NOERROR) {
+            break;
+        }
+        // A rejected length may only apply to one area, so probe upwards again after a while
+        if (wanted < request_size && offset + wanted < size) {
+            request_size = wanted;
+            good_reads = 0;
+        } else if (request_size < max_size && ++good_reads >= DUMP_GROW_AFTER) {
+            request_size = request_size * 2 < max_size ? request_size * 2 : max_size;
+            good_reads = 0;
+        }
+
+        const unsigned char* data = resp + 1;
+        unsigned long remaining = wanted;
+        while (remaining > 0 && result == STATUS_NOERROR) {
+            unsigned long space = DUMP_BUFFER_SIZE - buffer->length;
+            unsigned long take = remaining < space ? remaining : space;
+            memcpy(buffer->data + buffer->length, data, take);
+            buffer->length += take;
+            data += take;
+            remaining -= take;
+
+            if (buffer->length == DUMP_BUFFER_SIZE) {
+                unsigned long next_offset = buffer->file_offset + buffer->length;
+                result = submit_buffer(writer, index, &buffer);
+                index = (index + 1) % DUMP_BUFFER_COUNT;
+                buffer->length = 0;
+                buffer->file_offset = next_offset;
+            }
+        }
+
+        offset += wanted;
+        if (session->progress != nullptr) {
+            __atomic_store_n(&session->progress->bytes_done, offset, __ATOMIC_RELEASE);
+        }
+    }
+
+    // Data read before a failure is still written so a resumed dump can start after it
+    if (thread_started && buffer->length > 0) {
+        DUMP_BUFFER* unused;
+        long write_result = submit_buffer(writer, index, &unused);
+        if (result == STATUS_NOERROR) {
+            result = write_result;
+        }
+    }
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->done = 1;
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->mutex);
+    if (thread_started) {
+        pthread_join(thread, nullptr);
+    }
+    if (result == STATUS_NOERROR) {
+        result = writer->error;
+    }
+    if (result == STATUS_NOERROR && fdatasync(fd) != 0 && errno != EINVAL) {
+        result = ERR_FAILED;
+    }
+
+    flash_set_phase(session, result == STATUS_NOERROR ? FLASH_PHASE_DONE : FLASH_PHASE_FAILED);
+    pthread_cond_destroy(&writer->changed);
+    pthread_mutex_destroy(&writer->mutex);
+    for (int i = 0; i < DUMP_BUFFER_COUNT; i++) {
+        free(writer->buffers[i].data);
+    }
+    free(writer);
+    free(resp);
+    return result;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeMemoryDump
+ * Signature: (IIIIJJIIZLjava/nio/ByteBuffer;)I
+ *
+ * With resume set, the dump continues from the current size of the file behind fd.
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeMemoryDump
+  (JNIEnv *env, jobject obj, jint channel_id, jint flags, jint ecu_rx_id, jint fd,
+   jlong memory_address, jlong length, jint address_format, jint max_request, jboolean resume,
+   jobject progress_buffer) {
+
+    if (fd < 0 || length <= 0) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+    if (g_j2534_lib == nullptr) {
+        g_last_error = ERR_DEVICE_NOT_CONNECTED;
+        return -1;
+    }
+
+    FLASH_PROGRESS* progress = nullptr;
+    if (progress_buffer != nullptr) {
+        progress = static_cast<FLASH_PROGRESS*>(env->GetDirectBufferAddress(progress_buffer));
+        if (progress == nullptr ||
+            env->GetDirectBufferCapacity(progress_buffer) < static_cast<jlong>(sizeof(FLASH_PROGRESS))) {
+            g_last_error = ERR_NULL_PARAMETER;
+            return -1;
+        }
+        progress->nrc = 0;
+    }
+
+    unsigned long resume_offset = 0;
+    struct stat st;
+    if (resume && fstat(fd, &st) == 0 && st.st_size > 0) {
+        resume_offset = static_cast<unsigned long>(st.st_size);
+    }
+
+    UDS_LINK link;
+    unsigned long rx_id = static_cast<unsigned long>(ecu_rx_id);
+    unsigned long tx_flags = static_cast<unsigned long>(flags) | ISO15765_FRAME_PAD;
+    uds_link_init(&link, g_j2534_lib, static_cast<unsigned long>(channel_id),
+                  uds_physical_tx_id(rx_id), rx_id, tx_flags);
+
+    FLASH_SESSION session;
+    flash_session_init(&session, &link, static_cast<unsigned char>(address_format), progress);
+
+    unsigned long filter_id = 0;
+    long result = uds_start_flow_control(g_j2534_lib, link.channel_id, link.tx_id, rx_id,
+                                         tx_flags, &filter_id);
+    if (result == STATUS_NOERROR) {
+        result = memory_dump(&session, static_cast<unsigned long>(memory_address),
+                             static_cast<unsigned long>(length), fd, resume_offset,
+                             max_request > 0 ? static_cast<unsigned int>(max_request) : 0);
+        g_j2534_lib->PassThruStopMsgFilter(link.channel_id, filter_id);
+    }
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return 0;
+    } else {
+        return -1;
+    }
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef UDS_MEMORY_DUMP_H
+#define UDS_MEMORY_DUMP_H
+
+#include <jni.h>
+#include "uds_flash.h"
+
+#define UDS_NRC_REQUEST_OUT_OF_RANGE 0x31
+
+// Largest memorySize whose 0x63 response fits one classic ISO-TP message
+#define DUMP_MAX_REQUEST (ISOTP_MAX_MESSAGE - 1)
+
+// Successful reads at a reduced request size before doubling it again
+#define DUMP_GROW_AFTER 16
+
+// Write buffers handed to the writer thread; aligned and sized for O_DIRECT
+#define DUMP_BUFFER_ALIGNMENT 4096
+#define DUMP_BUFFER_SIZE (256 * 1024)
+#define DUMP_BUFFER_COUNT 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * One 0x23 request for *request_size bytes into resp (ISOTP_MAX_MESSAGE bytes).
+ * Halves *request_size and retries while the ECU rejects the length.
+ */
+long memory_read(FLASH_SESSION* session, unsigned long address, unsigned long* request_size,
+                 unsigned char* resp, unsigned long* resp_len);
+
+/*
+ * Dumps [address, address + size) with 0x23 into fd at file offset 0..size. Starts
+ * at resume_offset (rounded down to DUMP_BUFFER_ALIGNMENT) so an interrupted dump
+ * continues where its file ends. Progress goes to session->progress.
+ */
+long memory_dump(FLASH_SESSION* session, unsigned long address, unsigned long size, int fd,
+                 unsigned long resume_offset, unsigned int max_request);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeMemoryDump
+ * Signature: (IIIIJJIIZLjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeMemoryDump
+  (JNIEnv *, jobject, jint, jint, jint, jint, jlong, jlong, jint, jint, jboolean, jobject);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UDS_MEMORY_DUMP_H
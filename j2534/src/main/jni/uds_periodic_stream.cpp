@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "uds_periodic_stream.h"
+#include "j2534_jni.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PERIODIC_RX_BATCH 16
+#define PERIODIC_RX_TIMEOUT_MS 50
+
+static unsigned char periodic_identifier(const PERIODIC_STREAM* stream) {
+    return static_cast<unsigned char>(stream->dynamic_did & 0xFF);
+}
+
+/*
+ * Sends a request and waits for its own response. Unlike uds_transact this skips
+ * periodic frames, which may share the response ID while transmission is active.
+ */
+static long periodic_transact(PERIODIC_STREAM* stream, const unsigned char* req,
+                              unsigned long req_len, unsigned char* resp, unsigned long* resp_len) {
+    UDS_LINK* link = &stream->link;
+    long result = uds_send(link->lib, link->channel_id, link->tx_id, link->tx_flags, req, req_len);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+
+    unsigned long long deadline = uds_now_ms() + link->p2_ms;
+    PASSTHRU_MSG msg;
+
+    for (;;) {
+        unsigned long long now = uds_now_ms();
+        if (now >= deadline) {
+            return ERR_TIMEOUT;
+        }
+
+        unsigned long num_msgs = 1;
+        result = link->lib->PassThruReadMsgs(link->channel_id, &msg, &num_msgs,
+                                             static_cast<unsigned long>(deadline - now));
+        if (result == ERR_BUFFER_EMPTY || result == ERR_TIMEOUT || num_msgs == 0) {
+            continue;
+        }
+        if (result != STATUS_NOERROR) {
+            return result;
+        }
+        if (!uds_is_rx_payload(&msg) || uds_message_can_id(&msg) != link->rx_id) {
+            continue;
+        }
+
+        const unsigned char* payload = msg.Data + UDS_CAN_ID_SIZE;
+        unsigned long length = msg.DataSize - UDS_CAN_ID_SIZE;
+
+        if (length >= 3 && payload[0] == UDS_NEGATIVE_RESPONSE && payload[1] == req[0]) {
+            if (payload[2] == UDS_NRC_RESPONSE_PENDING) {
+                deadline = uds_now_ms() + link->p2_star_ms;
+                continue;
+            }
+        } else if (length == 0 || payload[0] != req[0] + UDS_POSITIVE_RESPONSE_OFFSET) {
+            continue;
+        }
+
+        if (length > *resp_len) {
+            return ERR_BUFFER_OVERFLOW;
+        }
+        memcpy(resp, payload, length);
+        *resp_len = length;
+        return STATUS_NOERROR;
+    }
+}
+
+static long periodic_request(PERIODIC_STREAM* stream, const unsigned char* req, unsigned long req_len) {
+    unsigned char resp[64];
+    unsigned long resp_len = sizeof(resp);
+    long result = periodic_transact(stream, req, req_len, resp, &resp_len);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+    if (resp[0] == UDS_NEGATIVE_RESPONSE) {
+        LOGE("Service 0x%02X rejected by ECU 0x%lX, NRC 0x%02X", req[0], stream->link.rx_id,
+             resp_len >= 3 ? resp[2] : 0);
+        return ERR_FAILED;
+    }
+    return STATUS_NOERROR;
+}
+
+// 0x2A stopSending for the stream's periodic identifier
+static long stop_sending(PERIODIC_STREAM* stream) {
+    unsigned char stop[3] = { UDS_SID_READ_DATA_BY_PERIODIC_ID, PERIODIC_STOP_SENDING,
+                              periodic_identifier(stream) };
+    return periodic_request(stream, stop, sizeof(stop));
+}
+
+// 0x2C 03 clearDynamicallyDefinedDataIdentifier
+static long clear_dynamic_did(PERIODIC_STREAM* stream) {
+    unsigned char clear[4] = { UDS_SID_DYNAMICALLY_DEFINE_DID, 0x03,
+                               static_cast<unsigned char>(stream->dynamic_did >> 8),
+                               static_cast<unsigned char>(stream->dynamic_did & 0xFF) };
+    return periodic_request(stream, clear, sizeof(clear));
+}
+
+static long define_dynamic_did(PERIODIC_STREAM* stream) {
+    unsigned char req[4 + PERIODIC_MAX_SIGNALS * 4];
+    unsigned long len = 0;
+
+    // Clear any earlier definition first; defineByIdentifier appends otherwise
+    clear_dynamic_did(stream);
+
+    req[len++] = UDS_SID_DYNAMICALLY_DEFINE_DID;
+    req[len++] = 0x01;
+    req[len++] = static_cast<unsigned char>(stream->dynamic_did >> 8);
+    req[len++] = static_cast<unsigned char>(stream->dynamic_did & 0xFF);
+    for (unsigned int i = 0; i < stream->signal_count; i++) {
+        const PERIODIC_SIGNAL* signal = &stream->signals[i];
+        req[len++] = static_cast<unsigned char>(signal->source_did >> 8);
+        req[len++] = static_cast<unsigned char>(signal->source_did & 0xFF);
+        req[len++] = signal->position;
+        req[len++] = signal->size;
+    }
+    return periodic_request(stream, req, len);
+}
+
+static void write_sample(PERIODIC_STREAM* stream, const unsigned char* data, unsigned long long* seq) {
+    unsigned char* slot = stream->ring + PERIODIC_RING_HEADER_SIZE +
+                          (*seq % stream->slot_count) * stream->slot_size;
+    unsigned int timestamp = static_cast<unsigned int>(uds_now_ms() - stream->epoch_ms);
+    memcpy(slot, &timestamp, 4);
+
+    unsigned int offset = 0;
+    for (unsigned int i = 0; i < stream->signal_count; i++) {
+        const PERIODIC_SIGNAL* signal = &stream->signals[i];
+        unsigned int raw = 0;
+        for (unsigned int b = 0; b < signal->size; b++) {
+            raw = (raw << 8) | data[offset + b];
+        }
+        offset += signal->size;
+
+        float value = static_cast<float>(raw) * signal->scale + signal->offset;
+        memcpy(slot + 4 + i * 4, &value, 4);
+    }
+
+    (*seq)++;
+    __atomic_store_n(reinterpret_cast<unsigned long long*>(stream->ring), *seq, __ATOMIC_RELEASE);
+}
+
+static void* periodic_rx_thread(void* arg) {
+    PERIODIC_STREAM* stream = static_cast<PERIODIC_STREAM*>(arg);
+    J2534_LIBRARY* lib = stream->link.lib;
+    unsigned int* dropped = reinterpret_cast<unsigned int*>(stream->ring + 20);
+    unsigned long long seq = 0;
+    unsigned char pdid = periodic_identifier(stream);
+    PASSTHRU_MSG msgs[PERIODIC_RX_BATCH];
+
+    while (stream->running) {
+        unsigned long num_msgs = PERIODIC_RX_BATCH;
+        long result = lib->PassThruReadMsgs(stream->link.channel_id, msgs, &num_msgs,
+                                            PERIODIC_RX_TIMEOUT_MS);
+        if (result != STATUS_NOERROR && result != ERR_BUFFER_EMPTY && result != ERR_TIMEOUT) {
+            LOGE("Periodic stream read failed: %ld", result);
+            break;
+        }
+
+        for (unsigned long i = 0; i < num_msgs; i++) {
+            const PASSTHRU_MSG* msg = &msgs[i];
+            if (!uds_is_rx_payload(msg) || uds_message_can_id(msg) != stream->periodic_rx_id) {
+                continue;
+            }
+            const unsigned char* payload = msg->Data + UDS_CAN_ID_SIZE;
+            unsigned long length = msg->DataSize - UDS_CAN_ID_SIZE;
+            if (length == 0 || payload[0] != pdid) {
+                continue;
+            }
+            if (length - 1 < stream->data_length) {
+                __atomic_store_n(dropped, *dropped + 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            write_sample(stream, payload + 1, &seq);
+        }
+    }
+    return nullptr;
+}
+
+long periodic_stream_start(PERIODIC_STREAM* stream, unsigned char* ring, unsigned long ring_capacity) {
+    if (stream == nullptr || ring == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (stream->link.lib == nullptr || stream->link.lib->PassThruReadMsgs == nullptr) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+    if ((reinterpret_cast<unsigned long>(ring) & 7) != 0 ||
+        (stream->dynamic_did & 0xFF00) != PERIODIC_DID_BASE) {
+        return ERR_INVALID_MSG;
+    }
+    if (stream->signal_count == 0 || stream->signal_count > PERIODIC_MAX_SIGNALS) {
+        return ERR_INVALID_MSG;
+    }
+
+    stream->data_length = 0;
+    for (unsigned int i = 0; i < stream->signal_count; i++) {
+        if (stream->signals[i].size == 0 || stream->signals[i].size > 4 ||
+            stream->signals[i].position == 0) {
+            return ERR_INVALID_MSG;
+        }
+        stream->data_length += stream->signals[i].size;
+    }
+    if (stream->data_length > PERIODIC_MAX_DATA) {
+        return ERR_INVALID_MSG;
+    }
+
+    stream->slot_size = 4 + 4 * stream->signal_count;
+    if (ring_capacity < PERIODIC_RING_HEADER_SIZE + stream->slot_size) {
+        return ERR_BUFFER_OVERFLOW;
+    }
+    stream->ring = ring;
+    stream->slot_count = static_cast<unsigned int>(
+        (ring_capacity - PERIODIC_RING_HEADER_SIZE) / stream->slot_size);
+
+    memset(ring, 0, PERIODIC_RING_HEADER_SIZE);
+    memcpy(ring + 8, &stream->slot_count, 4);
+    memcpy(ring + 12, &stream->slot_size, 4);
+    memcpy(ring + 16, &stream->signal_count, 4);
+
+    UDS_LINK* link = &stream->link;
+    long result = uds_start_flow_control(link->lib, link->channel_id, link->tx_id, link->rx_id,
+                                         link->tx_flags, &stream->filter_id);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+    stream->has_periodic_filter = 0;
+    if (stream->periodic_rx_id != link->rx_id) {
+        result = uds_start_flow_control(link->lib, link->channel_id, link->tx_id,
+                                        stream->periodic_rx_id, link->tx_flags,
+                                        &stream->periodic_filter_id);
+        if (result != STATUS_NOERROR) {
+            link->lib->PassThruStopMsgFilter(link->channel_id, stream->filter_id);
+            return result;
+        }
+        stream->has_periodic_filter = 1;
+    }
+
+    result = define_dynamic_did(stream);
+    int defined = result == STATUS_NOERROR;
+    int sending = 0;
+    if (result == STATUS_NOERROR) {
+        unsigned char req[3] = { UDS_SID_READ_DATA_BY_PERIODIC_ID, stream->rate,
+                                 periodic_identifier(stream) };
+        result = periodic_request(stream, req, sizeof(req));
+        sending = result == STATUS_NOERROR;
+    }
+
+    if (result == STATUS_NOERROR) {
+        stream->epoch_ms = uds_now_ms();
+        stream->running = 1;
+        if (pthread_create(&stream->thread, nullptr, periodic_rx_thread, stream) != 0) {
+            stream->running = 0;
+            result = ERR_FAILED;
+        }
+    }
+
+    if (result != STATUS_NOERROR) {
+        // Leave the ECU as periodic_stream_stop would: not sending, DID cleared
+        if (sending) {
+            stop_sending(stream);
+        }
+        if (defined) {
+            clear_dynamic_did(stream);
+        }
+        if (stream->has_periodic_filter) {
+            link->lib->PassThruStopMsgFilter(link->channel_id, stream->periodic_filter_id);
+        }
+        link->lib->PassThruStopMsgFilter(link->channel_id, stream->filter_id);
+        return result;
+    }
+
+    LOGI("Periodic DID 0x%04X streaming %u signals from ECU 0x%lX", stream->dynamic_did,
+         stream->signal_count, link->rx_id);
+    return STATUS_NOERROR;
+}
+
+long periodic_stream_stop(PERIODIC_STREAM* stream) {
+    if (stream == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    stream->running = 0;
+    pthread_join(stream->thread, nullptr);
+
+    long result = stop_sending(stream);
+    clear_dynamic_did(stream);
+
+    UDS_LINK* link = &stream->link;
+    if (stream->has_periodic_filter) {
+        link->lib->PassThruStopMsgFilter(link->channel_id, stream->periodic_filter_id);
+    }
+    link->lib->PassThruStopMsgFilter(link->channel_id, stream->filter_id);
+    return result;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativePeriodicStart
+ * Signature: (IIIIII[I[FLjava/nio/ByteBuffer;)J
+ *
+ * signals holds (sourceDid << 16 | position << 8 | size) per element and
+ * scaling holds the matching (scale, offset) pairs.
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativePeriodicStart
+  (JNIEnv *env, jobject obj, jint channel_id, jint flags, jint ecu_rx_id, jint periodic_rx_id,
+   jint dynamic_did, jint rate, jintArray signals, jfloatArray scaling, jobject ring_buffer) {
+
+    unsigned char* ring = ring_buffer != nullptr
+        ? static_cast<unsigned char*>(env->GetDirectBufferAddress(ring_buffer)) : nullptr;
+    if (signals == nullptr || scaling == nullptr || ring == nullptr ||
+        env->GetArrayLength(scaling) != 2 * env->GetArrayLength(signals)) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return 0;
+    }
+    if (g_j2534_lib == nullptr) {
+        g_last_error = ERR_DEVICE_NOT_CONNECTED;
+        return 0;
+    }
+    jsize count = env->GetArrayLength(signals);
+    if (count == 0 || count > PERIODIC_MAX_SIGNALS) {
+        g_last_error = ERR_INVALID_MSG;
+        return 0;
+    }
+
+    PERIODIC_STREAM* stream = static_cast<PERIODIC_STREAM*>(calloc(1, sizeof(PERIODIC_STREAM)));
+    if (stream == nullptr) {
+        g_last_error = ERR_INSUFFICIENT_MEMORY;
+        return 0;
+    }
+
+    unsigned long rx_id = static_cast<unsigned long>(ecu_rx_id);
+    uds_link_init(&stream->link, g_j2534_lib, static_cast<unsigned long>(channel_id),
+                  uds_physical_tx_id(rx_id), rx_id,
+                  static_cast<unsigned long>(flags) | ISO15765_FRAME_PAD);
+    stream->periodic_rx_id = periodic_rx_id != 0 ? static_cast<unsigned long>(periodic_rx_id) : rx_id;
+    stream->dynamic_did = static_cast<unsigned short>(dynamic_did);
+    stream->rate = static_cast<unsigned char>(rate);
+    stream->signal_count = static_cast<unsigned int>(count);
+
+    jint* specs = env->GetIntArrayElements(signals, nullptr);
+    jfloat* factors = env->GetFloatArrayElements(scaling, nullptr);
+    for (jsize i = 0; i < count; i++) {
+        stream->signals[i].source_did = static_cast<unsigned short>((specs[i] >> 16) & 0xFFFF);
+        stream->signals[i].position = static_cast<unsigned char>((specs[i] >> 8) & 0xFF);
+        stream->signals[i].size = static_cast<unsigned char>(specs[i] & 0xFF);
+        stream->signals[i].scale = factors[2 * i];
+        stream->signals[i].offset = factors[2 * i + 1];
+    }
+    env->ReleaseFloatArrayElements(scaling, factors, JNI_ABORT);
+    env->ReleaseIntArrayElements(signals, specs, JNI_ABORT);
+
+    long result = periodic_stream_start(stream, ring,
+        static_cast<unsigned long>(env->GetDirectBufferCapacity(ring_buffer)));
+    g_last_error = result;
+    if (result != STATUS_NOERROR) {
+        free(stream);
+        return 0;
+    }
+
+    // The RX thread writes into the buffer until stop, so keep it reachable
+    stream->ring_ref = env->NewGlobalRef(ring_buffer);
+    return reinterpret_cast<jlong>(stream);
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativePeriodicStop
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativePeriodicStop
+  (JNIEnv *env, jobject obj, jlong handle) {
+
+    PERIODIC_STREAM* stream = reinterpret_cast<PERIODIC_STREAM*>(handle);
+    if (stream == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    long result = periodic_stream_stop(stream);
+    env->DeleteGlobalRef(stream->ring_ref);
+    free(stream);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return 0;
+    } else {
+        return -1;
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef UDS_PERIODIC_STREAM_H
+#define UDS_PERIODIC_STREAM_H
+
+#include <jni.h>
+#include <pthread.h>
+#include "uds_client.h"
+
+#define UDS_SID_READ_DATA_BY_PERIODIC_ID 0x2A
+#define UDS_SID_DYNAMICALLY_DEFINE_DID 0x2C
+
+// 0x2A transmission modes
+#define PERIODIC_RATE_SLOW 0x01
+#define PERIODIC_RATE_MEDIUM 0x02
+#define PERIODIC_RATE_FAST 0x03
+#define PERIODIC_STOP_SENDING 0x04
+
+// Periodic DIDs live in 0xF200..0xF2FF; 0x2A addresses them by the low byte
+#define PERIODIC_DID_BASE 0xF200
+
+#define PERIODIC_MAX_SIGNALS 16
+// Periodic responses are ISO-TP single frames: PCI, periodic identifier and up to 6 data bytes
+#define PERIODIC_MAX_DATA 6
+
+/*
+ * Shared sample ring (native byte order), filled by the stream's RX thread:
+ *    0  u64 write_seq     records written so far, stored with release semantics
+ *    8  u32 slot_count
+ *   12  u32 slot_size     4 + 4 * signal_count
+ *   16  u32 signal_count
+ *   20  u32 dropped       frames that did not match the definition
+ *   24  slots[slot_count]: u32 timestamp_ms, f32 values[signal_count]
+ * A reader copies slot (seq % slot_count) and re-reads write_seq to detect overrun.
+ */
+#define PERIODIC_RING_HEADER_SIZE 24
+
+// One element of the dynamic DID: size bytes at 1-based position within source_did
+typedef struct {
+    unsigned short source_did;
+    unsigned char position;
+    unsigned char size;
+    float scale;
+    float offset;
+} PERIODIC_SIGNAL;
+
+typedef struct {
+    UDS_LINK link;
+    unsigned long filter_id;
+    unsigned long periodic_rx_id;
+    unsigned long periodic_filter_id;
+    int has_periodic_filter;
+    unsigned short dynamic_did;
+    unsigned char rate;
+    PERIODIC_SIGNAL signals[PERIODIC_MAX_SIGNALS];
+    unsigned int signal_count;
+    unsigned int data_length;
+    unsigned char* ring;
+    unsigned int slot_count;
+    unsigned int slot_size;
+    pthread_t thread;
+    volatile int running;
+    unsigned long long epoch_ms;
+    jobject ring_ref;
+} PERIODIC_STREAM;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Defines the dynamic DID, starts 0x2A transmission and the RX thread. The caller
+ * must already have opened the diagnostic session the ECU requires for 0x2C/0x2A.
+ */
+long periodic_stream_start(PERIODIC_STREAM* stream, unsigned char* ring, unsigned long ring_capacity);
+
+// Stops the RX thread, 0x2A transmission and clears the dynamic DID
+long periodic_stream_stop(PERIODIC_STREAM* stream);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativePeriodicStart
+ * Signature: (IIIIII[I[FLjava/nio/ByteBuffer;)J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativePeriodicStart
+  (JNIEnv *, jobject, jint, jint, jint, jint, jint, jint, jintArray, jfloatArray, jobject);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativePeriodicStop
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativePeriodicStop
+  (JNIEnv *, jobject, jlong);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UDS_PERIODIC_STREAM_H
@@ -0,0 +1,818 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#include "xcp_master.h"
+#include "j2534_jni.h"
+#include "uds_client.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000000000ULL +
+           static_cast<unsigned long long>(ts.tv_nsec);
+}
+
+// Multi-byte fields follow the byte order the slave reported in CONNECT
+static unsigned int get_value(const XCP_MASTER* master, const unsigned char* src, unsigned int size) {
+    unsigned int value = 0;
+    for (unsigned int i = 0; i < size; i++) {
+        if (master->big_endian) {
+            value = (value << 8) | src[i];
+        } else {
+            value |= static_cast<unsigned int>(src[i]) << (8 * i);
+        }
+    }
+    return value;
+}
+
+static void put_value(const XCP_MASTER* master, unsigned char* dst, unsigned int value,
+                      unsigned int size) {
+    for (unsigned int i = 0; i < size; i++) {
+        unsigned int shift = master->big_endian ? 8 * (size - 1 - i) : 8 * i;
+        dst[i] = static_cast<unsigned char>(value >> shift);
+    }
+}
+
+static unsigned long can_protocol(const XCP_MASTER* master) {
+    return (master->tx_flags & CAN_FD_FORMAT) ? FD_CAN_PS : CAN;
+}
+
+// XCP on CAN pads every CTO to the full DLC; CAN FD rounds up to the next valid length
+static unsigned int padded_length(const XCP_MASTER* master, unsigned int length) {
+    static const unsigned int fd_lengths[] = { 8, 12, 16, 20, 24, 32, 48, 64 };
+    if (!(master->tx_flags & CAN_FD_FORMAT)) {
+        return XCP_CAN_DLC;
+    }
+    for (unsigned int i = 0; i < sizeof(fd_lengths) / sizeof(fd_lengths[0]); i++) {
+        if (length <= fd_lengths[i]) {
+            return fd_lengths[i];
+        }
+    }
+    return 64;
+}
+
+static long send_cto(XCP_MASTER* master, const unsigned char* data, unsigned int length) {
+    PASSTHRU_MSG msg;
+    memset(&msg, 0, offsetof(PASSTHRU_MSG, Data));
+    msg.ProtocolID = can_protocol(master);
+    msg.TxFlags = master->tx_flags;
+
+    unsigned int dlc = padded_length(master, length);
+    msg.DataSize = UDS_CAN_ID_SIZE + dlc;
+    msg.Data[0] = static_cast<unsigned char>(master->cro_id >> 24);
+    msg.Data[1] = static_cast<unsigned char>(master->cro_id >> 16);
+    msg.Data[2] = static_cast<unsigned char>(master->cro_id >> 8);
+    msg.Data[3] = static_cast<unsigned char>(master->cro_id);
+    memcpy(msg.Data + UDS_CAN_ID_SIZE, data, length);
+    memset(msg.Data + UDS_CAN_ID_SIZE + length, 0, dlc - length);
+
+    unsigned long num_msgs = 1;
+    return master->lib->PassThruWriteMsgs(master->channel_id, &msg, &num_msgs, XCP_T1_MS);
+}
+
+static void wait_until(XCP_MASTER* master, unsigned long long deadline_ms) {
+    unsigned long long now = uds_now_ms();
+    if (deadline_ms <= now) {
+        return;
+    }
+    unsigned long long wait_ms = deadline_ms - now;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += static_cast<time_t>(wait_ms / 1000);
+    deadline.tv_nsec += static_cast<long>(wait_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&master->response_ready, &master->mutex, &deadline);
+}
+
+// Sends one CTO and waits up to T1 for the RES or ERR packet the RX thread hands over
+static long exchange(XCP_MASTER* master, const unsigned char* req, unsigned int req_len) {
+    pthread_mutex_lock(&master->mutex);
+    master->awaiting = 1;
+    master->responded = 0;
+    pthread_mutex_unlock(&master->mutex);
+
+    long result = send_cto(master, req, req_len);
+
+    pthread_mutex_lock(&master->mutex);
+    if (result == STATUS_NOERROR) {
+        unsigned long long deadline = uds_now_ms() + XCP_T1_MS;
+        while (!master->responded && uds_now_ms() < deadline) {
+            wait_until(master, deadline);
+        }
+        if (!master->responded) {
+            result = ERR_TIMEOUT;
+        }
+    }
+    master->awaiting = 0;
+    pthread_mutex_unlock(&master->mutex);
+    return result;
+}
+
+/*
+ * Runs a command with the standard error handling: a timeout is followed by
+ * SYNCH and a repetition, ERR_CMD_BUSY is repeated. On success response holds
+ * the positive response packet.
+ */
+static long xcp_command(XCP_MASTER* master, const unsigned char* req, unsigned int req_len,
+                        unsigned int min_response) {
+    long result = ERR_TIMEOUT;
+
+    for (unsigned int attempt = 0; attempt < XCP_COMMAND_ATTEMPTS; attempt++) {
+        result = exchange(master, req, req_len);
+        if (result == ERR_TIMEOUT) {
+            LOGE("XCP command 0x%02X timed out, resynchronising", req[0]);
+            unsigned char synch = XCP_CMD_SYNCH;
+            exchange(master, &synch, 1);
+            continue;
+        }
+        if (result != STATUS_NOERROR) {
+            return result;
+        }
+
+        if (master->response[0] == XCP_PID_ERR) {
+            master->last_error_code = master->response_length >= 2 ? master->response[1] : 0;
+            if (master->last_error_code == XCP_ERR_CMD_BUSY) {
+                result = ERR_FAILED;
+                continue;
+            }
+            LOGE("XCP command 0x%02X rejected by slave 0x%lX, error 0x%02X", req[0],
+                 master->dto_id, master->last_error_code);
+            return ERR_FAILED;
+        }
+        if (master->response_length < min_response) {
+            LOGE("XCP response to 0x%02X too short (%u bytes)", req[0], master->response_length);
+            return ERR_INVALID_MSG;
+        }
+        return STATUS_NOERROR;
+    }
+    return result;
+}
+
+static long xcp_connect(XCP_MASTER* master) {
+    unsigned char req[2] = { XCP_CMD_CONNECT, 0x00 };
+    long result = xcp_command(master, req, sizeof(req), 8);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+
+    const unsigned char* resp = master->response;
+    unsigned char comm_mode = resp[2];
+    master->big_endian = comm_mode & 0x01;
+    master->max_cto = resp[3];
+    master->max_dto = get_value(master, resp + 4, 2);
+
+    // DAQ resource and byte address granularity; word-granular DTOs carry fill bytes
+    if (!(resp[1] & 0x04) || ((comm_mode >> 1) & 0x03) != 0) {
+        LOGE("XCP slave 0x%lX has no byte-granular DAQ (resource 0x%02X, mode 0x%02X)",
+             master->dto_id, resp[1], comm_mode);
+        return ERR_NOT_SUPPORTED;
+    }
+    unsigned int frame_size = (master->tx_flags & CAN_FD_FORMAT) ? 64 : XCP_CAN_DLC;
+    if (master->max_dto > frame_size || master->max_dto < 2 || master->max_cto < 8) {
+        return ERR_INVALID_MSG;
+    }
+    return STATUS_NOERROR;
+}
+
+static long read_daq_info(XCP_MASTER* master) {
+    unsigned char req = XCP_CMD_GET_DAQ_PROCESSOR_INFO;
+    long result = xcp_command(master, &req, 1, 8);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+
+    unsigned char properties = master->response[1];
+    unsigned int max_daq = get_value(master, master->response + 2, 2);
+    master->min_daq = master->response[6];
+    master->daq_key = master->response[7];
+    if (!(properties & XCP_DAQ_CONFIG_DYNAMIC) || master->min_daq + master->list_count > max_daq) {
+        LOGE("XCP slave 0x%lX cannot allocate %u dynamic DAQ lists", master->dto_id,
+             master->list_count);
+        return ERR_NOT_SUPPORTED;
+    }
+
+    static const unsigned int id_sizes[] = { 1, 2, 3, 4 };
+    master->id_field_size = id_sizes[master->daq_key >> XCP_DAQ_IDENTIFICATION_SHIFT];
+    master->overload_msb = (properties & XCP_DAQ_OVERLOAD_MSB) != 0;
+
+    req = XCP_CMD_GET_DAQ_RESOLUTION_INFO;
+    result = xcp_command(master, &req, 1, 8);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+
+    unsigned int granularity = master->response[1];
+    master->max_entry_size = master->response[2];
+    unsigned char timestamp_mode = master->response[5];
+    unsigned int ticks = get_value(master, master->response + 6, 2);
+
+    for (unsigned int i = 0; i < master->signal_count; i++) {
+        unsigned int size = master->signals[i].size;
+        if (granularity == 0 || size % granularity != 0 || size > master->max_entry_size) {
+            LOGE("XCP signal %u of %u bytes does not fit ODT entries of %u..%u", i, size,
+                 granularity, master->max_entry_size);
+            return ERR_INVALID_MSG;
+        }
+    }
+
+    master->timestamp_size = 0;
+    master->tick_ns = 0;
+    if ((properties & XCP_DAQ_TIMESTAMP_SUPPORTED) || (timestamp_mode & XCP_TIMESTAMP_FIXED)) {
+        master->timestamp_size = timestamp_mode & 0x07;
+        if (master->timestamp_size != 1 && master->timestamp_size != 2 &&
+            master->timestamp_size != 4) {
+            master->timestamp_size = 0;
+        }
+        // Units 0..9 are 1 ns..1 s in decades; sub-nanosecond units fall back to host time
+        unsigned int unit = timestamp_mode >> 4;
+        if (master->timestamp_size != 0 && unit <= 9) {
+            master->tick_ns = ticks;
+            for (unsigned int i = 0; i < unit; i++) {
+                master->tick_ns *= 10;
+            }
+        }
+    }
+    return STATUS_NOERROR;
+}
+
+/*
+ * Packs each list's signals into ODTs in order. An ODT holds MAX_DTO bytes
+ * minus the identification field and, for the first ODT of a cycle, the
+ * timestamp.
+ */
+static long build_layout(XCP_MASTER* master) {
+    master->odt_count = 0;
+
+    for (unsigned int l = 0; l < master->list_count; l++) {
+        XCP_DAQ_LIST* list = &master->lists[l];
+        list->number = static_cast<unsigned short>(master->min_daq + l);
+        list->first_odt = master->odt_count;
+        list->odt_count = 0;
+
+        XCP_ODT* odt = nullptr;
+        for (unsigned int s = list->first_signal; s < list->first_signal + list->signal_count; s++) {
+            const XCP_SIGNAL* signal = &master->signals[s];
+            if ((master->daq_key & XCP_DAQ_ADDR_EXTENSION_DAQ) &&
+                signal->extension != master->signals[list->first_signal].extension) {
+                return ERR_INVALID_MSG;
+            }
+
+            int new_odt = odt == nullptr || odt->entry_count == XCP_MAX_ODT_ENTRIES ||
+                          odt->length + signal->size > master->max_dto;
+            if (!new_odt && (master->daq_key & XCP_DAQ_ADDR_EXTENSION_ODT)) {
+                new_odt = signal->extension != master->signals[odt->entries[0].signal].extension;
+            }
+            if (new_odt) {
+                odt = &master->odts[master->odt_count++];
+                odt->entry_count = 0;
+                odt->length = master->id_field_size;
+                if (list->odt_count == 0) {
+                    odt->length += master->timestamp_size;
+                }
+                list->odt_count++;
+                if (odt->length + signal->size > master->max_dto) {
+                    return ERR_INVALID_MSG;
+                }
+            }
+
+            XCP_ODT_ENTRY* entry = &odt->entries[odt->entry_count++];
+            entry->signal = static_cast<unsigned char>(s);
+            entry->offset = static_cast<unsigned char>(odt->length);
+            entry->size = signal->size;
+            odt->length += signal->size;
+        }
+    }
+
+    if ((master->daq_key >> XCP_DAQ_IDENTIFICATION_SHIFT & 0x03) == 0 &&
+        master->odt_count > XCP_PID_SERV) {
+        return ERR_INVALID_MSG;
+    }
+    return STATUS_NOERROR;
+}
+
+static void put_daq_number(const XCP_MASTER* master, unsigned char* dst, unsigned int daq) {
+    put_value(master, dst, daq, 2);
+}
+
+static long configure_daq(XCP_MASTER* master) {
+    unsigned char req[8];
+
+    req[0] = XCP_CMD_FREE_DAQ;
+    long result = xcp_command(master, req, 1, 1);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+
+    req[0] = XCP_CMD_ALLOC_DAQ;
+    req[1] = 0;
+    put_value(master, req + 2, master->list_count, 2);
+    result = xcp_command(master, req, 4, 1);
+
+    for (unsigned int l = 0; l < master->list_count && result == STATUS_NOERROR; l++) {
+        req[0] = XCP_CMD_ALLOC_ODT;
+        req[1] = 0;
+        put_daq_number(master, req + 2, master->lists[l].number);
+        req[4] = static_cast<unsigned char>(master->lists[l].odt_count);
+        result = xcp_command(master, req, 5, 1);
+    }
+
+    for (unsigned int l = 0; l < master->list_count && result == STATUS_NOERROR; l++) {
+        const XCP_DAQ_LIST* list = &master->lists[l];
+        for (unsigned int o = 0; o < list->odt_count && result == STATUS_NOERROR; o++) {
+            req[0] = XCP_CMD_ALLOC_ODT_ENTRY;
+            req[1] = 0;
+            put_daq_number(master, req + 2, list->number);
+            req[4] = static_cast<unsigned char>(o);
+            req[5] = static_cast<unsigned char>(master->odts[list->first_odt + o].entry_count);
+            result = xcp_command(master, req, 6, 1);
+        }
+    }
+
+    // WRITE_DAQ advances the DAQ pointer, so one SET_DAQ_PTR per ODT suffices
+    for (unsigned int l = 0; l < master->list_count && result == STATUS_NOERROR; l++) {
+        const XCP_DAQ_LIST* list = &master->lists[l];
+        for (unsigned int o = 0; o < list->odt_count && result == STATUS_NOERROR; o++) {
+            req[0] = XCP_CMD_SET_DAQ_PTR;
+            req[1] = 0;
+            put_daq_number(master, req + 2, list->number);
+            req[4] = static_cast<unsigned char>(o);
+            req[5] = 0;
+            result = xcp_command(master, req, 6, 1);
+
+            const XCP_ODT* odt = &master->odts[list->first_odt + o];
+            for (unsigned int e = 0; e < odt->entry_count && result == STATUS_NOERROR; e++) {
+                const XCP_SIGNAL* signal = &master->signals[odt->entries[e].signal];
+                req[0] = XCP_CMD_WRITE_DAQ;
+                req[1] = 0xFF;                       // no bit offset
+                req[2] = signal->size;
+                req[3] = signal->extension;
+                put_value(master, req + 4, signal->address, 4);
+                result = xcp_command(master, req, 8, 1);
+            }
+        }
+    }
+
+    for (unsigned int l = 0; l < master->list_count && result == STATUS_NOERROR; l++) {
+        XCP_DAQ_LIST* list = &master->lists[l];
+        req[0] = XCP_CMD_SET_DAQ_LIST_MODE;
+        req[1] = master->timestamp_size != 0 ? XCP_DAQ_MODE_TIMESTAMP : 0;
+        put_daq_number(master, req + 2, list->number);
+        put_value(master, req + 4, list->event, 2);
+        req[6] = 1;                                  // prescaler
+        req[7] = 0;                                  // priority
+        result = xcp_command(master, req, 8, 1);
+        if (result != STATUS_NOERROR) {
+            break;
+        }
+
+        req[0] = XCP_CMD_START_STOP_DAQ_LIST;
+        req[1] = 0x02;                               // select for START_STOP_SYNCH
+        put_daq_number(master, req + 2, list->number);
+        result = xcp_command(master, req, 4, 2);
+        if (result == STATUS_NOERROR) {
+            list->first_pid = master->response[1];
+        }
+    }
+    return result;
+}
+
+static void build_pid_map(XCP_MASTER* master) {
+    memset(master->pid_list, 0, sizeof(master->pid_list));
+    if ((master->daq_key >> XCP_DAQ_IDENTIFICATION_SHIFT & 0x03) != 0) {
+        return;
+    }
+    for (unsigned int l = 0; l < master->list_count; l++) {
+        const XCP_DAQ_LIST* list = &master->lists[l];
+        for (unsigned int o = 0; o < list->odt_count && list->first_pid + o < XCP_PID_SERV; o++) {
+            master->pid_list[list->first_pid + o] = static_cast<unsigned char>(l + 1);
+        }
+    }
+}
+
+static void count_dropped(XCP_MASTER* master) {
+    unsigned int* dropped = reinterpret_cast<unsigned int*>(master->ring + 20);
+    __atomic_store_n(dropped, *dropped + 1, __ATOMIC_RELAXED);
+}
+
+static void write_record(XCP_MASTER* master, unsigned int index, const XCP_DAQ_LIST* list) {
+    unsigned char* slot = master->ring + XCP_RING_HEADER_SIZE +
+                          (master->seq % master->slot_count) * master->slot_size;
+    unsigned short daq_list = static_cast<unsigned short>(index);
+    unsigned short first_signal = static_cast<unsigned short>(list->first_signal);
+    unsigned short count = static_cast<unsigned short>(list->signal_count);
+    unsigned short flags = list->clock_started && master->tick_ns != 0
+        ? XCP_RECORD_SLAVE_TIMESTAMP : 0;
+
+    memcpy(slot, &list->timestamp_ns, 8);
+    memcpy(slot + 8, &daq_list, 2);
+    memcpy(slot + 10, &first_signal, 2);
+    memcpy(slot + 12, &count, 2);
+    memcpy(slot + 14, &flags, 2);
+    memcpy(slot + XCP_RECORD_HEADER_SIZE, list->values, 4 * list->signal_count);
+
+    master->seq++;
+    __atomic_store_n(reinterpret_cast<unsigned long long*>(master->ring), master->seq,
+                     __ATOMIC_RELEASE);
+}
+
+static void cycle_timestamp(XCP_MASTER* master, XCP_DAQ_LIST* list, const unsigned char* dto) {
+    if (master->tick_ns == 0) {
+        list->timestamp_ns = now_ns() - master->epoch_ns;
+        return;
+    }
+
+    unsigned int raw = get_value(master, dto + master->id_field_size, master->timestamp_size);
+    if (!list->clock_started) {
+        list->ticks = raw;
+        list->clock_started = 1;
+    } else {
+        unsigned long long mask = (1ULL << (8 * master->timestamp_size)) - 1;
+        list->ticks += (static_cast<unsigned long long>(raw) - list->last_ticks) & mask;
+    }
+    list->last_ticks = raw;
+    list->timestamp_ns = list->ticks * master->tick_ns;
+}
+
+// Assembles the ODTs of one DAQ cycle; a gap in the ODT sequence drops the cycle
+static void handle_dto(XCP_MASTER* master, const unsigned char* dto, unsigned int length) {
+    unsigned int odt_number;
+    unsigned int index;
+
+    if (length < master->id_field_size) {
+        return;
+    }
+    switch (master->daq_key >> XCP_DAQ_IDENTIFICATION_SHIFT & 0x03) {
+    case 0: {
+        unsigned int pid = dto[0];
+        if (master->overload_msb && (pid & 0x80)) {
+            count_dropped(master);
+            pid &= 0x7F;
+        }
+        if (master->pid_list[pid] == 0) {
+            return;
+        }
+        index = master->pid_list[pid] - 1u;
+        odt_number = pid - master->lists[index].first_pid;
+        break;
+    }
+    case 1:
+        odt_number = dto[0];
+        index = dto[1] - master->min_daq;
+        break;
+    case 2:
+        odt_number = dto[0];
+        index = get_value(master, dto + 1, 2) - master->min_daq;
+        break;
+    default:
+        odt_number = dto[0];
+        index = get_value(master, dto + 2, 2) - master->min_daq;
+        break;
+    }
+    if (index >= master->list_count) {
+        return;
+    }
+
+    XCP_DAQ_LIST* list = &master->lists[index];
+    if (odt_number >= list->odt_count) {
+        return;
+    }
+    if (odt_number == 0) {
+        if (list->next_odt != 0) {
+            count_dropped(master);
+        }
+        list->next_odt = 0;
+    } else if (odt_number != list->next_odt) {
+        if (list->next_odt != 0) {
+            count_dropped(master);
+            list->next_odt = 0;
+        }
+        return;
+    }
+
+    const XCP_ODT* odt = &master->odts[list->first_odt + odt_number];
+    if (length < odt->length) {
+        count_dropped(master);
+        list->next_odt = 0;
+        return;
+    }
+    if (odt_number == 0) {
+        cycle_timestamp(master, list, dto);
+    }
+
+    for (unsigned int e = 0; e < odt->entry_count; e++) {
+        const XCP_ODT_ENTRY* entry = &odt->entries[e];
+        list->values[entry->signal - list->first_signal] =
+            get_value(master, dto + entry->offset, entry->size);
+    }
+
+    list->next_odt = odt_number + 1;
+    if (list->next_odt == list->odt_count) {
+        write_record(master, index, list);
+        list->next_odt = 0;
+    }
+}
+
+static void* xcp_rx_thread(void* arg) {
+    XCP_MASTER* master = static_cast<XCP_MASTER*>(arg);
+    PASSTHRU_MSG msgs[XCP_RX_BATCH];
+
+    while (master->running) {
+        unsigned long num_msgs = XCP_RX_BATCH;
+        long result = master->lib->PassThruReadMsgs(master->channel_id, msgs, &num_msgs,
+                                                    XCP_RX_TIMEOUT_MS);
+        if (result != STATUS_NOERROR && result != ERR_BUFFER_EMPTY && result != ERR_TIMEOUT) {
+            LOGE("XCP read failed: %ld", result);
+            break;
+        }
+
+        for (unsigned long i = 0; i < num_msgs; i++) {
+            const PASSTHRU_MSG* msg = &msgs[i];
+            if (!uds_is_rx_payload(msg) || uds_message_can_id(msg) != master->dto_id) {
+                continue;
+            }
+            const unsigned char* packet = msg->Data + UDS_CAN_ID_SIZE;
+            unsigned int length = static_cast<unsigned int>(msg->DataSize - UDS_CAN_ID_SIZE);
+
+            if (packet[0] == XCP_PID_RES || packet[0] == XCP_PID_ERR) {
+                pthread_mutex_lock(&master->mutex);
+                if (master->awaiting && !master->responded) {
+                    master->response_length = length < sizeof(master->response)
+                        ? length : static_cast<unsigned int>(sizeof(master->response));
+                    memcpy(master->response, packet, master->response_length);
+                    master->responded = 1;
+                    pthread_cond_signal(&master->response_ready);
+                }
+                pthread_mutex_unlock(&master->mutex);
+            } else if (packet[0] == XCP_PID_EV) {
+                LOGI("XCP event 0x%02X from slave 0x%lX", length > 1 ? packet[1] : 0,
+                     master->dto_id);
+            } else if (packet[0] != XCP_PID_SERV && master->acquiring) {
+                handle_dto(master, packet, length);
+            }
+        }
+    }
+    return nullptr;
+}
+
+static long validate_signals(XCP_MASTER* master) {
+    if (master->signal_count == 0 || master->signal_count > XCP_MAX_SIGNALS) {
+        return ERR_INVALID_MSG;
+    }
+
+    // One DAQ list per event channel; signals of an event must be contiguous
+    master->list_count = 0;
+    for (unsigned int i = 0; i < master->signal_count; i++) {
+        const XCP_SIGNAL* signal = &master->signals[i];
+        if (signal->size != 1 && signal->size != 2 && signal->size != 4) {
+            return ERR_INVALID_MSG;
+        }
+        if (i > 0 && signal->event == master->signals[i - 1].event) {
+            master->lists[master->list_count - 1].signal_count++;
+            continue;
+        }
+        for (unsigned int l = 0; l < master->list_count; l++) {
+            if (master->lists[l].event == signal->event) {
+                return ERR_INVALID_MSG;
+            }
+        }
+        if (master->list_count == XCP_MAX_DAQ_LISTS) {
+            return ERR_INVALID_MSG;
+        }
+        XCP_DAQ_LIST* list = &master->lists[master->list_count++];
+        memset(list, 0, sizeof(*list));
+        list->event = signal->event;
+        list->first_signal = i;
+        list->signal_count = 1;
+    }
+    return STATUS_NOERROR;
+}
+
+long xcp_master_start(XCP_MASTER* master, unsigned char* ring, unsigned long ring_capacity) {
+    if (master == nullptr || ring == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+    if (master->lib == nullptr || master->lib->PassThruReadMsgs == nullptr) {
+        return ERR_DEVICE_NOT_CONNECTED;
+    }
+    if ((reinterpret_cast<unsigned long>(ring) & 7) != 0) {
+        return ERR_INVALID_MSG;
+    }
+    long result = validate_signals(master);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+
+    unsigned int widest = 0;
+    for (unsigned int l = 0; l < master->list_count; l++) {
+        if (master->lists[l].signal_count > widest) {
+            widest = master->lists[l].signal_count;
+        }
+    }
+    master->slot_size = XCP_RECORD_HEADER_SIZE + 4 * widest;
+    if (ring_capacity < XCP_RING_HEADER_SIZE + master->slot_size) {
+        return ERR_BUFFER_OVERFLOW;
+    }
+    master->ring = ring;
+    master->slot_count = static_cast<unsigned int>(
+        (ring_capacity - XCP_RING_HEADER_SIZE) / master->slot_size);
+    master->seq = 0;
+
+    memset(ring, 0, XCP_RING_HEADER_SIZE);
+    memcpy(ring + 8, &master->slot_count, 4);
+    memcpy(ring + 12, &master->slot_size, 4);
+    memcpy(ring + 16, &master->signal_count, 4);
+
+    PASSTHRU_MSG mask;
+    PASSTHRU_MSG pattern;
+    memset(&mask, 0, sizeof(mask));
+    memset(&pattern, 0, sizeof(pattern));
+    mask.ProtocolID = pattern.ProtocolID = can_protocol(master);
+    mask.TxFlags = pattern.TxFlags = master->tx_flags;
+    mask.DataSize = pattern.DataSize = UDS_CAN_ID_SIZE;
+    memset(mask.Data, 0xFF, UDS_CAN_ID_SIZE);
+    pattern.Data[0] = static_cast<unsigned char>(master->dto_id >> 24);
+    pattern.Data[1] = static_cast<unsigned char>(master->dto_id >> 16);
+    pattern.Data[2] = static_cast<unsigned char>(master->dto_id >> 8);
+    pattern.Data[3] = static_cast<unsigned char>(master->dto_id);
+    result = master->lib->PassThruStartMsgFilter(master->channel_id, PASS_FILTER, &mask, &pattern,
+                                                 nullptr, &master->filter_id);
+    if (result != STATUS_NOERROR) {
+        return result;
+    }
+
+    pthread_mutex_init(&master->mutex, nullptr);
+    pthread_cond_init(&master->response_ready, nullptr);
+    master->acquiring = 0;
+    master->running = 1;
+    if (pthread_create(&master->thread, nullptr, xcp_rx_thread, master) != 0) {
+        master->running = 0;
+        pthread_cond_destroy(&master->response_ready);
+        pthread_mutex_destroy(&master->mutex);
+        master->lib->PassThruStopMsgFilter(master->channel_id, master->filter_id);
+        return ERR_FAILED;
+    }
+
+    int connected = 0;
+    result = xcp_connect(master);
+    if (result == STATUS_NOERROR) {
+        connected = 1;
+        result = read_daq_info(master);
+    }
+    if (result == STATUS_NOERROR) {
+        result = build_layout(master);
+    }
+    if (result == STATUS_NOERROR) {
+        result = configure_daq(master);
+    }
+    if (result == STATUS_NOERROR) {
+        build_pid_map(master);
+        master->epoch_ns = now_ns();
+        master->acquiring = 1;
+        unsigned char req[2] = { XCP_CMD_START_STOP_SYNCH, 0x01 };   // start selected
+        result = xcp_command(master, req, sizeof(req), 1);
+    }
+
+    if (result != STATUS_NOERROR) {
+        master->acquiring = 0;
+        if (connected) {
+            unsigned char req = XCP_CMD_DISCONNECT;
+            xcp_command(master, &req, 1, 1);
+        }
+        master->running = 0;
+        pthread_join(master->thread, nullptr);
+        pthread_cond_destroy(&master->response_ready);
+        pthread_mutex_destroy(&master->mutex);
+        master->lib->PassThruStopMsgFilter(master->channel_id, master->filter_id);
+        return result;
+    }
+
+    LOGI("XCP DAQ running: %u signals in %u lists, %u ODTs, slave 0x%lX", master->signal_count,
+         master->list_count, master->odt_count, master->dto_id);
+    return STATUS_NOERROR;
+}
+
+long xcp_master_stop(XCP_MASTER* master) {
+    if (master == nullptr) {
+        return ERR_NULL_PARAMETER;
+    }
+
+    unsigned char stop[2] = { XCP_CMD_START_STOP_SYNCH, 0x00 };        // stop all
+    long result = xcp_command(master, stop, sizeof(stop), 1);
+    master->acquiring = 0;
+
+    unsigned char req = XCP_CMD_FREE_DAQ;
+    xcp_command(master, &req, 1, 1);
+    req = XCP_CMD_DISCONNECT;
+    xcp_command(master, &req, 1, 1);
+
+    master->running = 0;
+    pthread_join(master->thread, nullptr);
+    pthread_cond_destroy(&master->response_ready);
+    pthread_mutex_destroy(&master->mutex);
+    master->lib->PassThruStopMsgFilter(master->channel_id, master->filter_id);
+    return result;
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeXcpStart
+ * Signature: (IIII[I[ILjava/nio/ByteBuffer;)J
+ *
+ * channel_id is a connected CAN (or FD_CAN_PS with CAN_FD_FORMAT in flags)
+ * channel. addresses and signals are parallel; signals holds
+ * (extension << 24 | event << 8 | size) per element.
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeXcpStart
+  (JNIEnv *env, jobject obj, jint channel_id, jint flags, jint cro_id, jint dto_id,
+   jintArray addresses, jintArray signals, jobject ring_buffer) {
+
+    unsigned char* ring = ring_buffer != nullptr
+        ? static_cast<unsigned char*>(env->GetDirectBufferAddress(ring_buffer)) : nullptr;
+    if (addresses == nullptr || signals == nullptr || ring == nullptr ||
+        env->GetArrayLength(addresses) != env->GetArrayLength(signals)) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return 0;
+    }
+    if (g_j2534_lib == nullptr) {
+        g_last_error = ERR_DEVICE_NOT_CONNECTED;
+        return 0;
+    }
+    jsize count = env->GetArrayLength(signals);
+    if (count == 0 || count > XCP_MAX_SIGNALS) {
+        g_last_error = ERR_INVALID_MSG;
+        return 0;
+    }
+
+    XCP_MASTER* master = static_cast<XCP_MASTER*>(calloc(1, sizeof(XCP_MASTER)));
+    if (master == nullptr) {
+        g_last_error = ERR_INSUFFICIENT_MEMORY;
+        return 0;
+    }
+
+    master->lib = g_j2534_lib;
+    master->channel_id = static_cast<unsigned long>(channel_id);
+    master->cro_id = static_cast<unsigned long>(cro_id);
+    master->dto_id = static_cast<unsigned long>(dto_id);
+    master->tx_flags = static_cast<unsigned long>(flags);
+    master->signal_count = static_cast<unsigned int>(count);
+
+    jint* address_values = env->GetIntArrayElements(addresses, nullptr);
+    jint* specs = env->GetIntArrayElements(signals, nullptr);
+    for (jsize i = 0; i < count; i++) {
+        master->signals[i].address = static_cast<unsigned int>(address_values[i]);
+        master->signals[i].extension = static_cast<unsigned char>((specs[i] >> 24) & 0xFF);
+        master->signals[i].event = static_cast<unsigned short>((specs[i] >> 8) & 0xFFFF);
+        master->signals[i].size = static_cast<unsigned char>(specs[i] & 0xFF);
+    }
+    env->ReleaseIntArrayElements(signals, specs, JNI_ABORT);
+    env->ReleaseIntArrayElements(addresses, address_values, JNI_ABORT);
+
+    long result = xcp_master_start(master, ring,
+        static_cast<unsigned long>(env->GetDirectBufferCapacity(ring_buffer)));
+    g_last_error = result;
+    if (result != STATUS_NOERROR) {
+        free(master);
+        return 0;
+    }
+
+    // The RX thread writes into the buffer until stop, so keep it reachable
+    master->ring_ref = env->NewGlobalRef(ring_buffer);
+    return reinterpret_cast<jlong>(master);
+}
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeXcpStop
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeXcpStop
+  (JNIEnv *env, jobject obj, jlong handle) {
+
+    XCP_MASTER* master = reinterpret_cast<XCP_MASTER*>(handle);
+    if (master == nullptr) {
+        g_last_error = ERR_NULL_PARAMETER;
+        return -1;
+    }
+
+    long result = xcp_master_stop(master);
+    env->DeleteGlobalRef(master->ring_ref);
+    free(master);
+    g_last_error = result;
+
+    if (result == STATUS_NOERROR) {
+        return 0;
+    } else {
+        return -1;
+    }
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2024 SpaceTec Automotive Diagnostics
+ * All rights reserved.
+ *
+ * This file is part of the SpaceTec professional automotive diagnostic system.
+ */
+
+#ifndef XCP_MASTER_H
+#define XCP_MASTER_H
+
+#include <jni.h>
+#include <pthread.h>
+#include "j2534_native.h"
+
+// XCP command codes (ASAM MCD-1 XCP 1.x)
+#define XCP_CMD_CONNECT 0xFF
+#define XCP_CMD_DISCONNECT 0xFE
+#define XCP_CMD_SYNCH 0xFC
+#define XCP_CMD_SET_DAQ_PTR 0xE2
+#define XCP_CMD_WRITE_DAQ 0xE1
+#define XCP_CMD_SET_DAQ_LIST_MODE 0xE0
+#define XCP_CMD_START_STOP_DAQ_LIST 0xDE
+#define XCP_CMD_START_STOP_SYNCH 0xDD
+#define XCP_CMD_GET_DAQ_PROCESSOR_INFO 0xDA
+#define XCP_CMD_GET_DAQ_RESOLUTION_INFO 0xD9
+#define XCP_CMD_FREE_DAQ 0xD6
+#define XCP_CMD_ALLOC_DAQ 0xD5
+#define XCP_CMD_ALLOC_ODT 0xD4
+#define XCP_CMD_ALLOC_ODT_ENTRY 0xD3
+
+// Packet identifiers of slave to master packets; DAQ DTOs use 0x00..0xFB
+#define XCP_PID_RES 0xFF
+#define XCP_PID_ERR 0xFE
+#define XCP_PID_EV 0xFD
+#define XCP_PID_SERV 0xFC
+
+#define XCP_ERR_CMD_SYNCH 0x00
+#define XCP_ERR_CMD_BUSY 0x10
+
+// DAQ_PROPERTIES and DAQ_KEY_BYTE bits of GET_DAQ_PROCESSOR_INFO
+#define XCP_DAQ_CONFIG_DYNAMIC 0x01
+#define XCP_DAQ_TIMESTAMP_SUPPORTED 0x10
+#define XCP_DAQ_OVERLOAD_MSB 0x40
+#define XCP_DAQ_ADDR_EXTENSION_ODT 0x10
+#define XCP_DAQ_ADDR_EXTENSION_DAQ 0x20
+#define XCP_DAQ_IDENTIFICATION_SHIFT 6
+#define XCP_TIMESTAMP_FIXED 0x08
+
+// SET_DAQ_LIST_MODE
+#define XCP_DAQ_MODE_TIMESTAMP 0x10
+
+#define XCP_MAX_SIGNALS 64
+#define XCP_MAX_DAQ_LISTS 8                  // one per event channel in use
+#define XCP_MAX_ODT_ENTRIES 16
+#define XCP_CAN_DLC 8
+#define XCP_T1_MS 100                        // standard command timeout
+#define XCP_COMMAND_ATTEMPTS 3               // retries after SYNCH or ERR_CMD_BUSY
+#define XCP_RX_BATCH 32
+#define XCP_RX_TIMEOUT_MS 10
+
+/*
+ * Shared sample ring (native byte order), one record per completed DAQ cycle:
+ *    0  u64 write_seq     records written so far, stored with release semantics
+ *    8  u32 slot_count
+ *   12  u32 slot_size     16 + 4 * (signals of the largest DAQ list)
+ *   16  u32 signal_count
+ *   20  u32 dropped       cycles lost to missing or out of order ODTs
+ *   24  slots[slot_count]:
+ *         u64 timestamp_ns  slave DAQ clock (unwrapped) or host clock since start
+ *         u16 daq_list      index among the lists of this session
+ *         u16 first_signal  index of the first signal in the record
+ *         u16 count         signals in the record
+ *         u16 flags         bit 0: timestamp is the slave's
+ *         u32 values[count] raw signal values, zero-extended
+ * A reader copies slot (seq % slot_count) and re-reads write_seq to detect overrun.
+ */
+#define XCP_RING_HEADER_SIZE 24
+#define XCP_RECORD_HEADER_SIZE 16
+#define XCP_RECORD_SLAVE_TIMESTAMP 0x0001
+
+// One measured variable: size bytes at address, sampled on an event channel
+typedef struct {
+    unsigned int address;
+    unsigned char extension;
+    unsigned char size;
+    unsigned short event;
+} XCP_SIGNAL;
+
+typedef struct {
+    unsigned char signal;
+    unsigned char offset;             // byte position in the DTO
+    unsigned char size;
+} XCP_ODT_ENTRY;
+
+typedef struct {
+    XCP_ODT_ENTRY entries[XCP_MAX_ODT_ENTRIES];
+    unsigned int entry_count;
+    unsigned int length;              // DTO bytes including identification field and timestamp
+} XCP_ODT;
+
+typedef struct {
+    unsigned short number;            // DAQ list number on the slave
+    unsigned short event;
+    unsigned int first_odt;           // into XCP_MASTER.odts
+    unsigned int odt_count;
+    unsigned int first_signal;
+    unsigned int signal_count;
+    unsigned char first_pid;          // absolute ODT numbering
+    unsigned int next_odt;            // ODT expected next in the cycle being assembled
+    unsigned long long timestamp_ns;
+    int clock_started;
+    unsigned int last_ticks;
+    unsigned long long ticks;         // slave DAQ clock unwrapped to 64 bits
+    unsigned int values[XCP_MAX_SIGNALS];
+} XCP_DAQ_LIST;
+
+typedef struct {
+    J2534_LIBRARY* lib;
+    unsigned long channel_id;
+    unsigned long cro_id;
+    unsigned long dto_id;
+    unsigned long tx_flags;
+    unsigned long filter_id;
+    XCP_SIGNAL signals[XCP_MAX_SIGNALS];
+    unsigned int signal_count;
+    // From CONNECT and the DAQ info commands
+    int big_endian;
+    unsigned int max_cto;
+    unsigned int max_dto;
+    unsigned int min_daq;
+    unsigned int id_field_size;       // 1 absolute PID, 2..4 relative ODT with DAQ number
+    unsigned int max_entry_size;
+    unsigned int daq_key;
+    int overload_msb;                 // slave flags overruns in the PID's top bit
+    unsigned int timestamp_size;      // 0 when the slave does not timestamp
+    unsigned long long tick_ns;       // duration of one DAQ clock tick, 0 if not representable
+    // DAQ layout
+    XCP_DAQ_LIST lists[XCP_MAX_DAQ_LISTS];
+    unsigned int list_count;
+    XCP_ODT odts[XCP_MAX_SIGNALS];
+    unsigned int odt_count;
+    unsigned char pid_list[256];      // absolute PID -> list index + 1
+    // Command mailbox, filled by the RX thread
+    pthread_mutex_t mutex;
+    pthread_cond_t response_ready;
+    int awaiting;
+    int responded;
+    unsigned char response[64];
+    unsigned int response_length;
+    unsigned char last_error_code;
+    // Sample ring
+    unsigned char* ring;
+    unsigned int slot_count;
+    unsigned int slot_size;
+    unsigned long long seq;
+    unsigned long long epoch_ns;
+    volatile int acquiring;
+    pthread_t thread;
+    volatile int running;
+    jobject ring_ref;
+} XCP_MASTER;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Connects to the slave, reads its DAQ processor and resolution info,
+ * allocates one dynamic DAQ list per event channel (signals must be grouped by
+ * event), writes the ODT entries and starts synchronous acquisition. The CAN
+ * channel must already be connected; DTOs are decoded on the master's RX thread.
+ */
+long xcp_master_start(XCP_MASTER* master, unsigned char* ring, unsigned long ring_capacity);
+
+// Stops acquisition, disconnects and stops the RX thread
+long xcp_master_stop(XCP_MASTER* master);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeXcpStart
+ * Signature: (IIII[I[ILjava/nio/ByteBuffer;)J
+ */
+JNIEXPORT jlong JNICALL Java_com_spacetec_j2534_J2534Interface_nativeXcpStart
+  (JNIEnv *, jobject, jint, jint, jint, jint, jintArray, jintArray, jobject);
+
+/*
+ * Class:     com_spacetec_j2534_J2534Interface
+ * Method:    nativeXcpStop
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_spacetec_j2534_J2534Interface_nativeXcpStop
+  (JNIEnv *, jobject, jlong);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // XCP_MASTER_H